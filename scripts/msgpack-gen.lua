@@ -41,6 +41,27 @@ api = {
   -- Helpers for object-oriented languages
   classes = {'Buffer', 'Window', 'Tabpage'}
 }
+-- functions that run Vim script or autocommands, which may wait for input or
+-- re-enter the event loop
+may_block = {
+  vim_command = true,
+  vim_eval = true,
+  vim_change_directory = true,
+  vim_set_option = true,
+  vim_set_current_buffer = true,
+  vim_set_current_window = true,
+  vim_set_current_tabpage = true,
+  buffer_set_option = true,
+  buffer_set_name = true,
+  window_set_option = true
+}
+-- return types that are only known to the C code, the metadata gives the
+-- type that clients receive
+public_types = {
+  BufferLines = 'StringArray'
+}
+-- C return type of the functions that return one of those
+c_return_types = {}
 -- names of all headers relative to the source root(for inclusion in the
 -- generated file)
 headers = {}
@@ -77,6 +98,10 @@ for i = 1, #arg - 1 do
     end
     -- assign a unique integer id for each api function
     fn.id = fn_id
+    if public_types[fn.return_type] then
+      c_return_types[fn_id] = fn.return_type
+      fn.return_type = public_types[fn.return_type]
+    end
   end
   input:close()
 end
@@ -137,6 +162,7 @@ for i = 1, #api.functions do
   local fn = api.functions[i]
   local args = {}
   local cleanup_label = 'cleanup_'..i
+  local return_type = c_return_types[fn.id] or fn.return_type
   output:write('\n    case '..fn.id..': {')
 
   output:write('\n      if (req->via.array.ptr[3].via.array.size != '..#fn.parameters..') {')
@@ -169,9 +195,9 @@ for i = 1, #api.functions do
   -- function call
   local call_args = table.concat(args, ', ')
   output:write('\n      ')
-  if fn.return_type ~= 'void' then
+  if return_type ~= 'void' then
     -- has a return value, prefix the call with a declaration
-    output:write(fn.return_type..' rv = ')
+    output:write(return_type..' rv = ')
   end
 
   -- write the function name and the opening parenthesis
@@ -203,8 +229,8 @@ for i = 1, #api.functions do
     output:write(');\n')
   end
 
-  if fn.return_type ~= 'void' then
-    output:write('\n      ret = '..string.upper(fn.return_type)..'_OBJ(rv);')
+  if return_type ~= 'void' then
+    output:write('\n      ret = '..string.upper(return_type)..'_OBJ(rv);')
   end
   -- Now generate the cleanup label for freeing memory allocated for the
   -- arguments
@@ -228,5 +254,24 @@ output:write([[
   }
   return ret;
 }
+
+bool msgpack_rpc_method_may_block(uint64_t method_id)
+{
+  switch (method_id) {
+]])
+
+for i = 1, #api.functions do
+  local fn = api.functions[i]
+  if may_block[fn.name] then
+    output:write('    case '..fn.id..':\n')
+  end
+end
+
+output:write([[
+      return true;
+    default:
+      return false;
+  }
+}
 ]])
 output:close()
@@ -142,6 +142,50 @@ end:
   return rv;
 }
 
+/// Retrieves a line range from the buffer. The result is the same as
+/// `buffer_get_slice`, but the lines are serialized directly from the buffer
+/// memory instead of being copied into intermediate strings, which makes it
+/// much cheaper for large ranges.
+///
+/// @param buffer The buffer handle
+/// @param start The first line index
+/// @param end The last line index
+/// @param include_start True if the slice includes the `start` parameter
+/// @param include_end True if the slice includes the `end` parameter
+/// @param[out] err Details of an error that may have occurred
+/// @return An array of lines
+BufferLines buffer_get_lines(Buffer buffer,
+                             Integer start,
+                             Integer end,
+                             Boolean include_start,
+                             Boolean include_end,
+                             Error *err)
+{
+  BufferLines rv = {.buffer = buffer, .start = 0, .end = 0};
+  buf_T *buf = find_buffer_by_handle(buffer, err);
+
+  if (!buf) {
+    return rv;
+  }
+
+  start = normalize_index(buf, start) + (include_start ? 0 : 1);
+  end = normalize_index(buf, end) + (include_end ? 1 : 0);
+
+  if (start >= end) {
+    // Serialized as a 0-length array
+    return rv;
+  }
+
+  if (end - 1 > LONG_MAX) {
+    set_api_error("Line index is too high", err);
+    return rv;
+  }
+
+  rv.start = start;
+  rv.end = end;
+  return rv;
+}
+
 /// Replaces a line range on the buffer
 ///
 /// @param buffer The buffer handle
@@ -474,6 +518,39 @@ Position buffer_get_mark(Buffer buffer, String name, Error *err)
   return rv;
 }
 
+/// Gets the counters of the block cache that keeps the lines of a buffer in
+/// memory
+///
+/// @param buffer The buffer handle
+/// @param[out] err Details of an error that may have occurred
+/// @return A dictionary with the number of `hits` and `misses` when getting
+///         a block, the number of blocks released from memory(`evictions`),
+///         and the number of pages that are in memory(`pages`) and allowed
+///         to be in memory(`max_pages`)
+Dictionary buffer_get_cache_stats(Buffer buffer, Error *err)
+{
+  Dictionary rv = ARRAY_DICT_INIT;
+  buf_T *buf = find_buffer_by_handle(buffer, err);
+
+  if (!buf) {
+    return rv;
+  }
+
+  memfile_T *mfp = buf->b_ml.ml_mfp;
+
+  if (mfp == NULL) {
+    set_api_error("Buffer is not loaded", err);
+    return rv;
+  }
+
+  PUT(rv, "hits", INTEGER_OBJ((Integer)mfp->mf_hits));
+  PUT(rv, "misses", INTEGER_OBJ((Integer)mfp->mf_misses));
+  PUT(rv, "evictions", INTEGER_OBJ((Integer)mfp->mf_evictions));
+  PUT(rv, "pages", INTEGER_OBJ(mfp->mf_used_count));
+  PUT(rv, "max_pages", INTEGER_OBJ(mfp->mf_used_count_max));
+  return rv;
+}
+
 // Find a window that contains "buf" and switch to it.
 // If there is no such window, use the current window and change "curbuf".
 // Caller must initialize save_curbuf to NULL.
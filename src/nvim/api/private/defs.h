@@ -47,6 +47,14 @@ typedef struct {
   Integer row, col;
 } Position;
 
+// A range of buffer lines. The lines are not copied when the object is
+// created, they are read from the buffer while the object is serialized.
+// Clients receive a StringArray, the API metadata gives that type.
+typedef struct {
+  Buffer buffer;
+  Integer start, end;
+} BufferLines;
+
 typedef struct {
   Object *items;
   size_t size, capacity;
@@ -75,6 +83,7 @@ typedef enum {
   kObjectTypeBufferArray,
   kObjectTypeWindowArray,
   kObjectTypeTabpageArray,
+  kObjectTypeBufferLines,
 } ObjectType;
 
 struct object {
@@ -94,6 +103,7 @@ struct object {
     BufferArray bufferarray;
     WindowArray windowarray;
     TabpageArray tabpagearray;
+    BufferLines bufferlines;
   } data;
 };
 
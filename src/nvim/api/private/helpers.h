@@ -71,6 +71,11 @@
   .data.tabpagearray = a                                                      \
   })
 
+#define BUFFERLINES_OBJ(l) ((Object) {                                        \
+  .type = kObjectTypeBufferLines,                                             \
+  .data.bufferlines = l                                                       \
+  })
+
 #define DICTIONARY_OBJ(d) ((Object) {                                         \
   .type = kObjectTypeDictionary,                                              \
   .data.dictionary = d                                                        \
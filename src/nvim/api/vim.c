@@ -8,6 +8,7 @@
 #include "nvim/api/private/defs.h"
 #include "nvim/api/buffer.h"
 #include "nvim/os/channel.h"
+#include "nvim/os/event.h"
 #include "nvim/vim.h"
 #include "nvim/buffer.h"
 #include "nvim/window.h"
@@ -15,6 +16,7 @@
 #include "nvim/ascii.h"
 #include "nvim/ex_docmd.h"
 #include "nvim/screen.h"
+#include "nvim/syntax.h"
 #include "nvim/memory.h"
 #include "nvim/message.h"
 #include "nvim/eval.h"
@@ -446,6 +448,35 @@ void vim_unsubscribe(uint64_t channel_id, String event)
   channel_unsubscribe(channel_id, e);
 }
 
+/// Gets event loop and RPC timing statistics, to find what keeps the editor
+/// busy. Durations are in microseconds.
+///
+/// @param reset Reset the statistics after reading them
+/// @return A Dictionary with the statistics of each event type in "events",
+///         of each event loop iteration in "process", the queue sizes and
+///         the request statistics of each channel in "channels"
+Dictionary vim_get_loop_stats(Boolean reset)
+{
+  Dictionary rv = event_get_stats(reset);
+  PUT(rv, "channels", ARRAY_OBJ(channel_get_stats(reset)));
+  return rv;
+}
+
+/// Gets the highlighting profile, to find the syntax patterns and lines that
+/// make redrawing slow. It is always collected: every line drawn is timed,
+/// syntax patterns are timed for a sample of the calls and their total time
+/// is estimated from that. Durations are in microseconds.
+///
+/// @param reset Reset the profile after reading it
+/// @return A Dictionary with the statistics of all drawn lines in "lines",
+///         the slowest lines in "slowest_lines", the time of each syntax
+///         group in "groups", the slowest patterns in "patterns" and the
+///         lines and syntax time of each buffer in "buffers"
+Dictionary vim_get_syntax_stats(Boolean reset)
+{
+  return syntax_get_stats(reset);
+}
+
 /// Writes a message to vim output or error buffer. The string is split
 /// and flushed after each newline. Incomplete lines are kept for writing
 /// later.
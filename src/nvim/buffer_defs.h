@@ -91,6 +91,9 @@ typedef struct memfile memfile_T;
 // for FileID
 #include "nvim/os/fs_defs.h"
 
+// for LatencyStats
+#include "nvim/os/event_defs.h"
+
 /*
  * The taggy struct is used to store the information about a :tag command.
  */
@@ -371,12 +374,16 @@ typedef struct qf_info_S qf_info_T;
 
 /*
  * Used for :syntime: timing of executing a syntax pattern.
+ * "samples" and "prof_time" are always updated, for the highlighting profile
+ * that syntax_get_stats() returns.
  */
 typedef struct {
   proftime_T total;             /* total time used */
   proftime_T slowest;           /* time of slowest call */
   long count;                   /* nr of times used */
   long match;                   /* nr of times matched */
+  uint64_t samples;             /* nr of calls that were timed */
+  uint64_t prof_time;           /* estimated total time in nanoseconds */
 } syn_time_T;
 
 /*
@@ -421,6 +428,15 @@ typedef struct {
    * b_sst_freecount	number of free entries in b_sst_array[]
    * b_sst_check_lnum	entries after this lnum need to be checked for
    *			validity (MAXLNUM means no check needed)
+   * b_sst_idle_lnum	syntax_idle() stored states for the lines before this
+   *			one, it continues here
+   * b_sst_idle_end	how far syntax_idle() got before a change made it
+   *			go back to b_sst_idle_lnum, the states stored after
+   *			the change are still valid if parsing the change
+   *			results in the same state
+   * b_syn_tick	incremented when the stored states change in a way
+   *			that may change the highlighting of lines without
+   *			changing the text, lines drawn before are not valid
    */
   synstate_T  *b_sst_array;
   int b_sst_len;
@@ -429,6 +445,19 @@ typedef struct {
   int b_sst_freecount;
   linenr_T b_sst_check_lnum;
   uint16_t b_sst_lasttick;      /* last display tick */
+  linenr_T b_sst_idle_lnum;
+  linenr_T b_sst_idle_end;
+  int b_syn_tick;
+
+  /*
+   * b_syn_lines[] caches the syntax attributes of displayed lines, so that
+   * windows showing the same lines don't parse them again.  Indexed by line
+   * number modulo SYN_LINE_CACHE_SIZE, allocated when first used.
+   * b_syn_nocache is TRUE when a pattern depends on the cursor position or
+   * the Visual area, then the cache is not used.
+   */
+  synline_T   *b_syn_lines;
+  int b_syn_nocache;
 
   /* for spell checking */
   garray_T b_langp;             /* list of pointers to slang_T, see spell.c */
@@ -714,6 +743,9 @@ struct file_buffer {
   linenr_T b_no_eol_lnum;       /* non-zero lnum when last line of next binary
                                  * write should not have an end-of-line */
 
+  struct bgread *b_bgread;      /* state of reading the file in the
+                                 * background or NULL, see readfile_bg() */
+
   int b_start_eol;              /* last line had eol when it was read */
   int b_start_ffc;              /* first char of 'ff' when edit started */
   char_u      *b_start_fenc;    /* 'fileencoding' when edit started or NULL */
@@ -746,6 +778,12 @@ struct file_buffer {
                                  * normally points to this, but some windows
                                  * may use a different synblock_T. */
 
+  /* Highlighting profile, see syntax_get_stats(): lines drawn by
+   * win_line() and the estimated time matching syntax patterns, in
+   * nanoseconds. */
+  LatencyStats b_draw_stats;
+  uint64_t b_syn_prof_time;
+
   signlist_T *b_signlist;       /* list of signs to draw */
 };
 
@@ -1018,6 +1056,7 @@ struct window_S {
                                        recomputed */
   int w_nrwidth;                    /* width of 'number' and 'relativenumber'
                                        column being used */
+  struct renderline *w_render_cache; /* lines drawn before, see screen.c */
 
   /*
    * === end of cached values ===
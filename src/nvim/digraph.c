@@ -1659,7 +1659,7 @@ void listdigraphs(void)
     dp++;
   }
   // clear screen, because some digraphs may be wrong, in which case we messed
-  // up ScreenLines
+  // up ScreenCells
   must_redraw = CLEAR;
 }
 
@@ -204,6 +204,7 @@ static int echo_attr = 0;   /* attributes used for ":echo" */
  * Structure to hold info for a user function.
  */
 typedef struct ufunc ufunc_T;
+typedef struct funccode_S funccode_T;
 
 struct ufunc {
   int uf_varargs;               /* variable nr of arguments */
@@ -229,6 +230,7 @@ struct ufunc {
   scid_T uf_script_ID;          /* ID of script where function was defined,
                                    used for s: variables */
   int uf_refcount;              /* for numbered function: reference count */
+  funccode_T  *uf_code;         /* compiled lines or NULL, see func_compile() */
   char_u uf_name[1];            /* name of function (actually longer); can
                                    start with <SNR>123_ (<SNR> is K_SPECIAL
                                    KS_EXTRA KE_SNR) */
@@ -261,6 +263,8 @@ static ufunc_T dumuf;
 #define FUNCLINE(fp, j) ((char_u **)(fp->uf_lines.ga_data))[j]
 
 #define MAX_FUNC_ARGS   20      /* maximum number of function arguments */
+#define FUNC_STACK_LEN  64      /* maximum number of values on the stack of a
+                                   compiled function */
 #define VAR_SHORT_LEN   20      /* short variable name length */
 #define FIXVAR_CNT      12      /* number of fixed variables */
 
@@ -300,6 +304,91 @@ typedef struct {
   list_T      *fi_list;         /* list being used */
 } forinfo_T;
 
+/*
+ * Instructions of a compiled user function, see func_compile().  Each
+ * command starts with an FI_LINE, the expressions work on a stack of values.
+ */
+typedef enum {
+  FI_LINE,                      /* start of command in line "fi_arg",
+                                   continue at "fi_jump" on error */
+  FI_END,                       /* end of the function */
+  FI_NUMBER,                    /* push Number "fi_nr" */
+  FI_STRING,                    /* push a copy of String "fi_str" */
+  FI_LOCAL,                     /* push l: variable "fi_name" */
+  FI_ARG,                       /* push named argument "fi_arg" */
+  FI_VAR,                       /* push any other variable "fi_str" */
+  FI_EVAL,                      /* push the value of expression "fi_str" */
+  FI_EVAL7,                     /* push the value of eval7() of "fi_str" */
+  FI_LEADER,                    /* apply '!' and '-' in "fi_str" */
+  FI_STRCHK,                    /* check first operand of '+', '-', '.' */
+  FI_NUMCHK,                    /* check first operand of '*', '/', '%' */
+  FI_ADDSUB,                    /* '+', '-' or '.' in "fi_arg" */
+  FI_MULDIV,                    /* '*', '/' or '%' in "fi_arg" */
+  FI_COMPARE,                   /* compare with exptype_T "fi_arg" */
+  FI_JUMP,                      /* continue at "fi_jump" */
+  FI_JUMP_TRUE,                 /* "||": pop, push 1 and jump when TRUE */
+  FI_JUMP_FALSE,                /* "&&": pop, push 0 and jump when FALSE */
+  FI_TEST,                      /* "?": pop, jump when FALSE */
+  FI_COND,                      /* ":if", ":while": pop, jump when FALSE */
+  FI_FUNC,                      /* find function "fi_str" for FI_CALL */
+  FI_CALL,                      /* call it with "fi_arg" arguments */
+  FI_STORE,                     /* ":let" for l: variable "fi_name" */
+  FI_LET,                       /* any other ":let fi_str" */
+  FI_CALLCMD,                   /* ":call fi_str" */
+  FI_RETURN,                    /* ":return" */
+  FI_FOR,                       /* start ":for fi_str" at level "fi_arg" */
+  FI_NEXT,                      /* next item, jump to "fi_jump" when done */
+  FI_ENDFOR,                    /* end ":for" at level "fi_arg" */
+  FI_LOOP                       /* ":endwhile", ":endfor", ":continue" */
+} funcop_T;
+
+/* Values for "fi_flags". */
+#define FIF_COPY        1       /* "fi_str" may be changed, use a copy */
+#define FIF_STRING      2       /* FI_EVAL7 after the "." operator */
+#define FIF_IS          4       /* FI_COMPARE for "is" and "isnot" */
+#define FIF_SEMICOLON   8       /* FI_LET of "[var; var]" */
+#define FIF_VALUE       16      /* FI_RETURN with a value */
+
+typedef struct {
+  funcop_T fi_op;
+  int fi_arg;                   /* line number, operator, count, etc. */
+  int fi_jump;                  /* index of the instruction to continue at */
+  int fi_flags;                 /* FIF_ flags */
+  varnumber_T fi_nr;            /* Number value */
+  hash_T fi_hash;               /* hash of "fi_name" */
+  char_u      *fi_str;          /* allocated name, text or String value */
+  char_u      *fi_name;         /* allocated name of an l: variable */
+  char_u      *fi_text;         /* text in uf_lines for error messages */
+} funcinstr_T;
+
+struct funccode_S {
+  int fcd_ok;                   /* FALSE when the lines can't be compiled */
+  int fcd_len;                  /* number of instructions */
+  funcinstr_T *fcd_instr;       /* the instructions */
+};
+
+/*
+ * State used while compiling a function.
+ */
+typedef struct {
+  ufunc_T     *fcp_func;        /* function being compiled */
+  garray_T fcp_instr;           /* funcinstr_T items */
+  int fcp_depth;                /* number of values on the stack */
+  int fcp_calls;                /* number of pending FI_FUNC */
+  int fcp_overflow;             /* TRUE when exceeding FUNC_STACK_LEN */
+} funccomp_T;
+
+#define FCP_INSTR(cp, idx) (((funcinstr_T *)(cp)->fcp_instr.ga_data)[idx])
+
+/*
+ * A function call for which the arguments are being evaluated.
+ */
+typedef struct {
+  char_u      *fpc_name;        /* allocated function name */
+  char_u      *fpc_errname;     /* name for the error message */
+  linenr_T fpc_lnum;            /* cursor line for the range */
+} funcpending_T;
+
 /*
  * Struct used by trans_function_name()
  */
@@ -318,6 +407,21 @@ typedef enum {
   VAR_FLAVOUR_VIMINFO           /* all uppercase */
 } var_flavour_T;
 
+/*
+ * types for expressions.
+ */
+typedef enum {
+  TYPE_UNKNOWN = 0
+  , TYPE_EQUAL          /* == */
+  , TYPE_NEQUAL         /* != */
+  , TYPE_GREATER        /* >  */
+  , TYPE_GEQUAL         /* >= */
+  , TYPE_SMALLER        /* <  */
+  , TYPE_SEQUAL         /* <= */
+  , TYPE_MATCH          /* =~ */
+  , TYPE_NOMATCH        /* !~ */
+} exptype_T;
+
 /*
  * Array to hold the value of v: variables.
  * The value is in a dictitem, so that it can also be used in the v: scope.
@@ -3072,21 +3176,6 @@ char_u *get_user_var_name(expand_T *xp, int idx)
 }
 
 
-/*
- * types for expressions.
- */
-typedef enum {
-  TYPE_UNKNOWN = 0
-  , TYPE_EQUAL          /* == */
-  , TYPE_NEQUAL         /* != */
-  , TYPE_GREATER        /* >  */
-  , TYPE_GEQUAL         /* >= */
-  , TYPE_SMALLER        /* <  */
-  , TYPE_SEQUAL         /* <= */
-  , TYPE_MATCH          /* =~ */
-  , TYPE_NOMATCH        /* !~ */
-} exptype_T;
-
 /*
  * The "evaluate" argument: When FALSE, the argument is only parsed but not
  * executed.  The function may return OK, but the rettv will be of type
@@ -3340,16 +3429,10 @@ static int eval4(char_u **arg, typval_T *rettv, int evaluate)
 {
   typval_T var2;
   char_u      *p;
-  int i;
-  exptype_T type = TYPE_UNKNOWN;
-  int type_is = FALSE;              /* TRUE for "is" and "isnot" */
-  int len = 2;
-  long n1, n2;
-  char_u      *s1, *s2;
-  char_u buf1[NUMBUFLEN], buf2[NUMBUFLEN];
-  regmatch_T regmatch;
+  exptype_T type;
+  int type_is;                      /* TRUE for "is" and "isnot" */
+  int len;
   int ic;
-  char_u      *save_cpo;
 
   /*
    * Get the first variable.
@@ -3358,6 +3441,53 @@ static int eval4(char_u **arg, typval_T *rettv, int evaluate)
     return FAIL;
 
   p = *arg;
+  type = get_compare_type(p, &len, &type_is);
+
+  /*
+   * If there is a comparative operator, use it.
+   */
+  if (type != TYPE_UNKNOWN) {
+    /* extra question mark appended: ignore case */
+    if (p[len] == '?') {
+      ic = TRUE;
+      ++len;
+    }
+    /* extra '#' appended: match case */
+    else if (p[len] == '#') {
+      ic = FALSE;
+      ++len;
+    }
+    /* nothing appended: use 'ignorecase' */
+    else
+      ic = p_ic;
+
+    /*
+     * Get the second variable.
+     */
+    *arg = skipwhite(p + len);
+    if (eval5(arg, &var2, evaluate) == FAIL) {
+      clear_tv(rettv);
+      return FAIL;
+    }
+
+    if (evaluate)
+      return typval_compare(rettv, &var2, type, type_is, ic);
+  }
+
+  return OK;
+}
+
+/*
+ * Find the comparison operator at "p".  Sets "*lenp" to its length, without
+ * a trailing '#' or '?', and "*type_is" to TRUE for "is" and "isnot".
+ * Returns TYPE_UNKNOWN when there is no comparison operator.
+ */
+static exptype_T get_compare_type(char_u *p, int *lenp, int *type_is)
+{
+  exptype_T type = TYPE_UNKNOWN;
+  int len = 2;
+
+  *type_is = FALSE;
   switch (p[0]) {
   case '=':   if (p[1] == '=')
       type = TYPE_EQUAL;
@@ -3386,202 +3516,190 @@ static int eval4(char_u **arg, typval_T *rettv, int evaluate)
         len = 5;
       if (!vim_isIDc(p[len])) {
         type = len == 2 ? TYPE_EQUAL : TYPE_NEQUAL;
-        type_is = TRUE;
+        *type_is = TRUE;
       }
   }
     break;
   }
 
+  *lenp = len;
+  return type;
+}
+
+/*
+ * Compare "typ1" with "typ2" using "type".  "ic" is TRUE to ignore case.
+ * The Number result is put in "typ1", "typ2" is cleared.
+ * Return OK or FAIL, both values are cleared on failure.
+ */
+static int typval_compare(typval_T *typ1, typval_T *typ2, exptype_T type,
+                          int type_is, int ic)
+{
+  long n1, n2;
+  char_u      *s1, *s2;
+  char_u buf1[NUMBUFLEN], buf2[NUMBUFLEN];
+  regmatch_T regmatch;
+  char_u      *save_cpo;
+  int i;
+
+  if (type_is && typ1->v_type != typ2->v_type) {
+    /* For "is" a different type always means FALSE, for "notis"
+     * it means TRUE. */
+    n1 = (type == TYPE_NEQUAL);
+  } else if (typ1->v_type == VAR_LIST || typ2->v_type == VAR_LIST) {
+    if (type_is) {
+      n1 = (typ1->v_type == typ2->v_type
+            && typ1->vval.v_list == typ2->vval.v_list);
+      if (type == TYPE_NEQUAL)
+        n1 = !n1;
+    } else if (typ1->v_type != typ2->v_type
+               || (type != TYPE_EQUAL && type != TYPE_NEQUAL)) {
+      if (typ1->v_type != typ2->v_type) {
+        EMSG(_("E691: Can only compare List with List"));
+      } else {
+        EMSG(_("E692: Invalid operation for List"));
+      }
+      clear_tv(typ1);
+      clear_tv(typ2);
+      return FAIL;
+    } else {
+      /* Compare two Lists for being equal or unequal. */
+      n1 = list_equal(typ1->vval.v_list, typ2->vval.v_list,
+          ic, FALSE);
+      if (type == TYPE_NEQUAL)
+        n1 = !n1;
+    }
+  } else if (typ1->v_type == VAR_DICT || typ2->v_type == VAR_DICT) {
+    if (type_is) {
+      n1 = (typ1->v_type == typ2->v_type
+            && typ1->vval.v_dict == typ2->vval.v_dict);
+      if (type == TYPE_NEQUAL)
+        n1 = !n1;
+    } else if (typ1->v_type != typ2->v_type
+               || (type != TYPE_EQUAL && type != TYPE_NEQUAL)) {
+      if (typ1->v_type != typ2->v_type)
+        EMSG(_("E735: Can only compare Dictionary with Dictionary"));
+      else
+        EMSG(_("E736: Invalid operation for Dictionary"));
+      clear_tv(typ1);
+      clear_tv(typ2);
+      return FAIL;
+    } else {
+      /* Compare two Dictionaries for being equal or unequal. */
+      n1 = dict_equal(typ1->vval.v_dict, typ2->vval.v_dict,
+          ic, FALSE);
+      if (type == TYPE_NEQUAL)
+        n1 = !n1;
+    }
+  } else if (typ1->v_type == VAR_FUNC || typ2->v_type == VAR_FUNC) {
+    if (typ1->v_type != typ2->v_type
+        || (type != TYPE_EQUAL && type != TYPE_NEQUAL)) {
+      if (typ1->v_type != typ2->v_type)
+        EMSG(_("E693: Can only compare Funcref with Funcref"));
+      else
+        EMSG(_("E694: Invalid operation for Funcrefs"));
+      clear_tv(typ1);
+      clear_tv(typ2);
+      return FAIL;
+    } else {
+      /* Compare two Funcrefs for being equal or unequal. */
+      if (typ1->vval.v_string == NULL
+          || typ2->vval.v_string == NULL)
+        n1 = FALSE;
+      else
+        n1 = STRCMP(typ1->vval.v_string,
+            typ2->vval.v_string) == 0;
+      if (type == TYPE_NEQUAL)
+        n1 = !n1;
+    }
+  }
   /*
-   * If there is a comparative operator, use it.
+   * If one of the two variables is a float, compare as a float.
+   * When using "=~" or "!~", always compare as string.
    */
-  if (type != TYPE_UNKNOWN) {
-    /* extra question mark appended: ignore case */
-    if (p[len] == '?') {
-      ic = TRUE;
-      ++len;
+  else if ((typ1->v_type == VAR_FLOAT || typ2->v_type == VAR_FLOAT)
+           && type != TYPE_MATCH && type != TYPE_NOMATCH) {
+    float_T f1, f2;
+
+    if (typ1->v_type == VAR_FLOAT)
+      f1 = typ1->vval.v_float;
+    else
+      f1 = get_tv_number(typ1);
+    if (typ2->v_type == VAR_FLOAT)
+      f2 = typ2->vval.v_float;
+    else
+      f2 = get_tv_number(typ2);
+    n1 = FALSE;
+    switch (type) {
+    case TYPE_EQUAL:    n1 = (f1 == f2); break;
+    case TYPE_NEQUAL:   n1 = (f1 != f2); break;
+    case TYPE_GREATER:  n1 = (f1 > f2); break;
+    case TYPE_GEQUAL:   n1 = (f1 >= f2); break;
+    case TYPE_SMALLER:  n1 = (f1 < f2); break;
+    case TYPE_SEQUAL:   n1 = (f1 <= f2); break;
+    case TYPE_UNKNOWN:
+    case TYPE_MATCH:
+    case TYPE_NOMATCH:  break;              /* avoid gcc warning */
     }
-    /* extra '#' appended: match case */
-    else if (p[len] == '#') {
-      ic = FALSE;
-      ++len;
+  }
+  /*
+   * If one of the two variables is a number, compare as a number.
+   * When using "=~" or "!~", always compare as string.
+   */
+  else if ((typ1->v_type == VAR_NUMBER || typ2->v_type == VAR_NUMBER)
+           && type != TYPE_MATCH && type != TYPE_NOMATCH) {
+    n1 = get_tv_number(typ1);
+    n2 = get_tv_number(typ2);
+    switch (type) {
+    case TYPE_EQUAL:    n1 = (n1 == n2); break;
+    case TYPE_NEQUAL:   n1 = (n1 != n2); break;
+    case TYPE_GREATER:  n1 = (n1 > n2); break;
+    case TYPE_GEQUAL:   n1 = (n1 >= n2); break;
+    case TYPE_SMALLER:  n1 = (n1 < n2); break;
+    case TYPE_SEQUAL:   n1 = (n1 <= n2); break;
+    case TYPE_UNKNOWN:
+    case TYPE_MATCH:
+    case TYPE_NOMATCH:  break;              /* avoid gcc warning */
     }
-    /* nothing appended: use 'ignorecase' */
+  } else {
+    s1 = get_tv_string_buf(typ1, buf1);
+    s2 = get_tv_string_buf(typ2, buf2);
+    if (type != TYPE_MATCH && type != TYPE_NOMATCH)
+      i = ic ? MB_STRICMP(s1, s2) : STRCMP(s1, s2);
     else
-      ic = p_ic;
-
-    /*
-     * Get the second variable.
-     */
-    *arg = skipwhite(p + len);
-    if (eval5(arg, &var2, evaluate) == FAIL) {
-      clear_tv(rettv);
-      return FAIL;
-    }
-
-    if (evaluate) {
-      if (type_is && rettv->v_type != var2.v_type) {
-        /* For "is" a different type always means FALSE, for "notis"
-         * it means TRUE. */
-        n1 = (type == TYPE_NEQUAL);
-      } else if (rettv->v_type == VAR_LIST || var2.v_type == VAR_LIST) {
-        if (type_is) {
-          n1 = (rettv->v_type == var2.v_type
-                && rettv->vval.v_list == var2.vval.v_list);
-          if (type == TYPE_NEQUAL)
-            n1 = !n1;
-        } else if (rettv->v_type != var2.v_type
-                   || (type != TYPE_EQUAL && type != TYPE_NEQUAL)) {
-          if (rettv->v_type != var2.v_type) {
-            EMSG(_("E691: Can only compare List with List"));
-          } else {
-            EMSG(_("E692: Invalid operation for List"));
-          }
-          clear_tv(rettv);
-          clear_tv(&var2);
-          return FAIL;
-        } else {
-          /* Compare two Lists for being equal or unequal. */
-          n1 = list_equal(rettv->vval.v_list, var2.vval.v_list,
-              ic, FALSE);
-          if (type == TYPE_NEQUAL)
-            n1 = !n1;
-        }
-      } else if (rettv->v_type == VAR_DICT || var2.v_type == VAR_DICT) {
-        if (type_is) {
-          n1 = (rettv->v_type == var2.v_type
-                && rettv->vval.v_dict == var2.vval.v_dict);
-          if (type == TYPE_NEQUAL)
-            n1 = !n1;
-        } else if (rettv->v_type != var2.v_type
-                   || (type != TYPE_EQUAL && type != TYPE_NEQUAL)) {
-          if (rettv->v_type != var2.v_type)
-            EMSG(_("E735: Can only compare Dictionary with Dictionary"));
-          else
-            EMSG(_("E736: Invalid operation for Dictionary"));
-          clear_tv(rettv);
-          clear_tv(&var2);
-          return FAIL;
-        } else {
-          /* Compare two Dictionaries for being equal or unequal. */
-          n1 = dict_equal(rettv->vval.v_dict, var2.vval.v_dict,
-              ic, FALSE);
-          if (type == TYPE_NEQUAL)
-            n1 = !n1;
-        }
-      } else if (rettv->v_type == VAR_FUNC || var2.v_type == VAR_FUNC) {
-        if (rettv->v_type != var2.v_type
-            || (type != TYPE_EQUAL && type != TYPE_NEQUAL)) {
-          if (rettv->v_type != var2.v_type)
-            EMSG(_("E693: Can only compare Funcref with Funcref"));
-          else
-            EMSG(_("E694: Invalid operation for Funcrefs"));
-          clear_tv(rettv);
-          clear_tv(&var2);
-          return FAIL;
-        } else {
-          /* Compare two Funcrefs for being equal or unequal. */
-          if (rettv->vval.v_string == NULL
-              || var2.vval.v_string == NULL)
-            n1 = FALSE;
-          else
-            n1 = STRCMP(rettv->vval.v_string,
-                var2.vval.v_string) == 0;
-          if (type == TYPE_NEQUAL)
-            n1 = !n1;
-        }
-      }
-      /*
-       * If one of the two variables is a float, compare as a float.
-       * When using "=~" or "!~", always compare as string.
-       */
-      else if ((rettv->v_type == VAR_FLOAT || var2.v_type == VAR_FLOAT)
-               && type != TYPE_MATCH && type != TYPE_NOMATCH) {
-        float_T f1, f2;
-
-        if (rettv->v_type == VAR_FLOAT)
-          f1 = rettv->vval.v_float;
-        else
-          f1 = get_tv_number(rettv);
-        if (var2.v_type == VAR_FLOAT)
-          f2 = var2.vval.v_float;
-        else
-          f2 = get_tv_number(&var2);
-        n1 = FALSE;
-        switch (type) {
-        case TYPE_EQUAL:    n1 = (f1 == f2); break;
-        case TYPE_NEQUAL:   n1 = (f1 != f2); break;
-        case TYPE_GREATER:  n1 = (f1 > f2); break;
-        case TYPE_GEQUAL:   n1 = (f1 >= f2); break;
-        case TYPE_SMALLER:  n1 = (f1 < f2); break;
-        case TYPE_SEQUAL:   n1 = (f1 <= f2); break;
-        case TYPE_UNKNOWN:
-        case TYPE_MATCH:
-        case TYPE_NOMATCH:  break;              /* avoid gcc warning */
-        }
+      i = 0;
+    n1 = FALSE;
+    switch (type) {
+    case TYPE_EQUAL:    n1 = (i == 0); break;
+    case TYPE_NEQUAL:   n1 = (i != 0); break;
+    case TYPE_GREATER:  n1 = (i > 0); break;
+    case TYPE_GEQUAL:   n1 = (i >= 0); break;
+    case TYPE_SMALLER:  n1 = (i < 0); break;
+    case TYPE_SEQUAL:   n1 = (i <= 0); break;
+
+    case TYPE_MATCH:
+    case TYPE_NOMATCH:
+      /* avoid 'l' flag in 'cpoptions' */
+      save_cpo = p_cpo;
+      p_cpo = (char_u *)"";
+      regmatch.regprog = vim_regcomp(s2,
+          RE_MAGIC + RE_STRING);
+      regmatch.rm_ic = ic;
+      if (regmatch.regprog != NULL) {
+        n1 = vim_regexec_nl(&regmatch, s1, (colnr_T)0);
+        vim_regfree(regmatch.regprog);
+        if (type == TYPE_NOMATCH)
+          n1 = !n1;
       }
-      /*
-       * If one of the two variables is a number, compare as a number.
-       * When using "=~" or "!~", always compare as string.
-       */
-      else if ((rettv->v_type == VAR_NUMBER || var2.v_type == VAR_NUMBER)
-               && type != TYPE_MATCH && type != TYPE_NOMATCH) {
-        n1 = get_tv_number(rettv);
-        n2 = get_tv_number(&var2);
-        switch (type) {
-        case TYPE_EQUAL:    n1 = (n1 == n2); break;
-        case TYPE_NEQUAL:   n1 = (n1 != n2); break;
-        case TYPE_GREATER:  n1 = (n1 > n2); break;
-        case TYPE_GEQUAL:   n1 = (n1 >= n2); break;
-        case TYPE_SMALLER:  n1 = (n1 < n2); break;
-        case TYPE_SEQUAL:   n1 = (n1 <= n2); break;
-        case TYPE_UNKNOWN:
-        case TYPE_MATCH:
-        case TYPE_NOMATCH:  break;              /* avoid gcc warning */
-        }
-      } else {
-        s1 = get_tv_string_buf(rettv, buf1);
-        s2 = get_tv_string_buf(&var2, buf2);
-        if (type != TYPE_MATCH && type != TYPE_NOMATCH)
-          i = ic ? MB_STRICMP(s1, s2) : STRCMP(s1, s2);
-        else
-          i = 0;
-        n1 = FALSE;
-        switch (type) {
-        case TYPE_EQUAL:    n1 = (i == 0); break;
-        case TYPE_NEQUAL:   n1 = (i != 0); break;
-        case TYPE_GREATER:  n1 = (i > 0); break;
-        case TYPE_GEQUAL:   n1 = (i >= 0); break;
-        case TYPE_SMALLER:  n1 = (i < 0); break;
-        case TYPE_SEQUAL:   n1 = (i <= 0); break;
-
-        case TYPE_MATCH:
-        case TYPE_NOMATCH:
-          /* avoid 'l' flag in 'cpoptions' */
-          save_cpo = p_cpo;
-          p_cpo = (char_u *)"";
-          regmatch.regprog = vim_regcomp(s2,
-              RE_MAGIC + RE_STRING);
-          regmatch.rm_ic = ic;
-          if (regmatch.regprog != NULL) {
-            n1 = vim_regexec_nl(&regmatch, s1, (colnr_T)0);
-            vim_regfree(regmatch.regprog);
-            if (type == TYPE_NOMATCH)
-              n1 = !n1;
-          }
-          p_cpo = save_cpo;
-          break;
+      p_cpo = save_cpo;
+      break;
 
-        case TYPE_UNKNOWN:  break;              /* avoid gcc warning */
-        }
-      }
-      clear_tv(rettv);
-      clear_tv(&var2);
-      rettv->v_type = VAR_NUMBER;
-      rettv->vval.v_number = n1;
+    case TYPE_UNKNOWN:  break;              /* avoid gcc warning */
     }
   }
-
+  clear_tv(typ1);
+  clear_tv(typ2);
+  typ1->v_type = VAR_NUMBER;
+  typ1->vval.v_number = n1;
   return OK;
 }
 
@@ -3599,13 +3717,7 @@ static int eval4(char_u **arg, typval_T *rettv, int evaluate)
 static int eval5(char_u **arg, typval_T *rettv, int evaluate)
 {
   typval_T var2;
-  typval_T var3;
   int op;
-  long n1, n2;
-  float_T f1 = 0, f2 = 0;
-  char_u      *s1, *s2;
-  char_u buf1[NUMBUFLEN], buf2[NUMBUFLEN];
-  char_u      *p;
 
   /*
    * Get the first variable.
@@ -3621,21 +3733,8 @@ static int eval5(char_u **arg, typval_T *rettv, int evaluate)
     if (op != '+' && op != '-' && op != '.')
       break;
 
-    if ((op != '+' || rettv->v_type != VAR_LIST)
-        && (op == '.' || rettv->v_type != VAR_FLOAT)
-        ) {
-      /* For "list + ...", an illegal use of the first operand as
-       * a number cannot be determined before evaluating the 2nd
-       * operand: if this is also a list, all is ok.
-       * For "something . ...", "something - ..." or "non-list + ...",
-       * we know that the first operand needs to be a string or number
-       * without evaluating the 2nd operand.  So check before to avoid
-       * side effects after an error. */
-      if (evaluate && get_tv_string_chk(rettv) == NULL) {
-        clear_tv(rettv);
-        return FAIL;
-      }
-    }
+    if (evaluate && eval_addsub_check(rettv, op) == FAIL)
+      return FAIL;
 
     /*
      * Get the second variable.
@@ -3646,99 +3745,135 @@ static int eval5(char_u **arg, typval_T *rettv, int evaluate)
       return FAIL;
     }
 
-    if (evaluate) {
-      /*
-       * Compute the result.
-       */
-      if (op == '.') {
-        s1 = get_tv_string_buf(rettv, buf1);            /* already checked */
-        s2 = get_tv_string_buf_chk(&var2, buf2);
-        if (s2 == NULL) {               /* type error ? */
-          clear_tv(rettv);
-          clear_tv(&var2);
-          return FAIL;
-        }
-        p = concat_str(s1, s2);
-        clear_tv(rettv);
-        rettv->v_type = VAR_STRING;
-        rettv->vval.v_string = p;
-      } else if (op == '+' && rettv->v_type == VAR_LIST
-                 && var2.v_type == VAR_LIST) {
-        /* concatenate Lists */
-        if (list_concat(rettv->vval.v_list, var2.vval.v_list,
-                &var3) == FAIL) {
-          clear_tv(rettv);
-          clear_tv(&var2);
-          return FAIL;
-        }
-        clear_tv(rettv);
-        *rettv = var3;
-      } else {
-        int error = FALSE;
-
-        if (rettv->v_type == VAR_FLOAT) {
-          f1 = rettv->vval.v_float;
-          n1 = 0;
-        } else {
-          n1 = get_tv_number_chk(rettv, &error);
-          if (error) {
-            /* This can only happen for "list + non-list".  For
-             * "non-list + ..." or "something - ...", we returned
-             * before evaluating the 2nd operand. */
-            clear_tv(rettv);
-            return FAIL;
-          }
-          if (var2.v_type == VAR_FLOAT)
-            f1 = n1;
-        }
-        if (var2.v_type == VAR_FLOAT) {
-          f2 = var2.vval.v_float;
-          n2 = 0;
-        } else {
-          n2 = get_tv_number_chk(&var2, &error);
-          if (error) {
-            clear_tv(rettv);
-            clear_tv(&var2);
-            return FAIL;
-          }
-          if (rettv->v_type == VAR_FLOAT)
-            f2 = n2;
-        }
-        clear_tv(rettv);
-
-        /* If there is a float on either side the result is a float. */
-        if (rettv->v_type == VAR_FLOAT || var2.v_type == VAR_FLOAT) {
-          if (op == '+')
-            f1 = f1 + f2;
-          else
-            f1 = f1 - f2;
-          rettv->v_type = VAR_FLOAT;
-          rettv->vval.v_float = f1;
-        } else {
-          if (op == '+')
-            n1 = n1 + n2;
-          else
-            n1 = n1 - n2;
-          rettv->v_type = VAR_NUMBER;
-          rettv->vval.v_number = n1;
-        }
-      }
-      clear_tv(&var2);
-    }
+    if (evaluate && eval_addsub(rettv, &var2, op) == FAIL)
+      return FAIL;
   }
   return OK;
 }
 
 /*
- * Handle fifth level expression:
- *	*	number multiplication
- *	/	number division
- *	%	number modulo
- *
- * "arg" must point to the first non-white of the expression.
- * "arg" is advanced to the next non-white after the recognized expression.
- *
- * Return OK or FAIL.
+ * Check the first operand "tv1" of "op" ('+', '-' or '.') before the second
+ * one is evaluated.
+ * For "list + ...", an illegal use of the first operand as a number cannot
+ * be determined before evaluating the 2nd operand: if this is also a list,
+ * all is ok.
+ * For "something . ...", "something - ..." or "non-list + ...", we know that
+ * the first operand needs to be a string or number without evaluating the
+ * 2nd operand.  So check before to avoid side effects after an error.
+ * Return OK or FAIL, "tv1" is cleared on failure.
+ */
+static int eval_addsub_check(typval_T *tv1, int op)
+{
+  if ((op != '+' || tv1->v_type != VAR_LIST)
+      && (op == '.' || tv1->v_type != VAR_FLOAT)
+      && get_tv_string_chk(tv1) == NULL) {
+    clear_tv(tv1);
+    return FAIL;
+  }
+  return OK;
+}
+
+/*
+ * Compute "tv1 op tv2" for '+', '-' and '.', after eval_addsub_check().
+ * The result is put in "tv1", "tv2" is cleared.
+ * Return OK or FAIL, both values are cleared on failure.
+ */
+static int eval_addsub(typval_T *tv1, typval_T *tv2, int op)
+{
+  typval_T var3;
+  long n1, n2;
+  float_T f1 = 0, f2 = 0;
+  char_u      *s1, *s2;
+  char_u buf1[NUMBUFLEN], buf2[NUMBUFLEN];
+  char_u      *p;
+
+  if (op == '.') {
+    s1 = get_tv_string_buf(tv1, buf1);            /* already checked */
+    s2 = get_tv_string_buf_chk(tv2, buf2);
+    if (s2 == NULL) {               /* type error ? */
+      clear_tv(tv1);
+      clear_tv(tv2);
+      return FAIL;
+    }
+    p = concat_str(s1, s2);
+    clear_tv(tv1);
+    tv1->v_type = VAR_STRING;
+    tv1->vval.v_string = p;
+  } else if (op == '+' && tv1->v_type == VAR_LIST
+             && tv2->v_type == VAR_LIST) {
+    /* concatenate Lists */
+    if (list_concat(tv1->vval.v_list, tv2->vval.v_list,
+            &var3) == FAIL) {
+      clear_tv(tv1);
+      clear_tv(tv2);
+      return FAIL;
+    }
+    clear_tv(tv1);
+    *tv1 = var3;
+  } else {
+    int error = FALSE;
+
+    if (tv1->v_type == VAR_FLOAT) {
+      f1 = tv1->vval.v_float;
+      n1 = 0;
+    } else {
+      n1 = get_tv_number_chk(tv1, &error);
+      if (error) {
+        /* This can only happen for "list + non-list".  For
+         * "non-list + ..." or "something - ...", we returned
+         * before evaluating the 2nd operand. */
+        clear_tv(tv1);
+        return FAIL;
+      }
+      if (tv2->v_type == VAR_FLOAT)
+        f1 = n1;
+    }
+    if (tv2->v_type == VAR_FLOAT) {
+      f2 = tv2->vval.v_float;
+      n2 = 0;
+    } else {
+      n2 = get_tv_number_chk(tv2, &error);
+      if (error) {
+        clear_tv(tv1);
+        clear_tv(tv2);
+        return FAIL;
+      }
+      if (tv1->v_type == VAR_FLOAT)
+        f2 = n2;
+    }
+    clear_tv(tv1);
+
+    /* If there is a float on either side the result is a float. */
+    if (tv1->v_type == VAR_FLOAT || tv2->v_type == VAR_FLOAT) {
+      if (op == '+')
+        f1 = f1 + f2;
+      else
+        f1 = f1 - f2;
+      tv1->v_type = VAR_FLOAT;
+      tv1->vval.v_float = f1;
+    } else {
+      if (op == '+')
+        n1 = n1 + n2;
+      else
+        n1 = n1 - n2;
+      tv1->v_type = VAR_NUMBER;
+      tv1->vval.v_number = n1;
+    }
+  }
+  clear_tv(tv2);
+  return OK;
+}
+
+/*
+ * Handle fifth level expression:
+ *	*	number multiplication
+ *	/	number division
+ *	%	number modulo
+ *
+ * "arg" must point to the first non-white of the expression.
+ * "arg" is advanced to the next non-white after the recognized expression.
+ *
+ * Return OK or FAIL.
  */
 static int 
 eval6 (
@@ -3750,10 +3885,6 @@ eval6 (
 {
   typval_T var2;
   int op;
-  long n1, n2;
-  int use_float = FALSE;
-  float_T f1 = 0, f2;
-  int error = FALSE;
 
   /*
    * Get the first variable.
@@ -3769,85 +3900,126 @@ eval6 (
     if (op != '*' && op != '/' && op != '%')
       break;
 
-    if (evaluate) {
-      if (rettv->v_type == VAR_FLOAT) {
-        f1 = rettv->vval.v_float;
-        use_float = TRUE;
-        n1 = 0;
-      } else
-        n1 = get_tv_number_chk(rettv, &error);
-      clear_tv(rettv);
-      if (error)
-        return FAIL;
-    } else
-      n1 = 0;
+    if (evaluate && eval_muldiv_check(rettv) == FAIL)
+      return FAIL;
 
     /*
      * Get the second variable.
      */
     *arg = skipwhite(*arg + 1);
-    if (eval7(arg, &var2, evaluate, FALSE) == FAIL)
+    if (eval7(arg, &var2, evaluate, FALSE) == FAIL) {
+      if (evaluate)
+        clear_tv(rettv);
       return FAIL;
+    }
 
-    if (evaluate) {
-      if (var2.v_type == VAR_FLOAT) {
-        if (!use_float) {
-          f1 = n1;
-          use_float = TRUE;
-        }
-        f2 = var2.vval.v_float;
-        n2 = 0;
-      } else {
-        n2 = get_tv_number_chk(&var2, &error);
-        clear_tv(&var2);
-        if (error)
-          return FAIL;
-        if (use_float)
-          f2 = n2;
-      }
+    if (evaluate && eval_muldiv(rettv, &var2, op) == FAIL)
+      return FAIL;
+  }
 
-      /*
-       * Compute the result.
-       * When either side is a float the result is a float.
-       */
-      if (use_float) {
-        if (op == '*')
-          f1 = f1 * f2;
-        else if (op == '/') {
-          /* We rely on the floating point library to handle divide
-           * by zero to result in "inf" and not a crash. */
-          f1 = f2 != 0 ? f1 / f2 : INFINITY;
-        } else {
-          EMSG(_("E804: Cannot use '%' with Float"));
-          return FAIL;
-        }
-        rettv->v_type = VAR_FLOAT;
-        rettv->vval.v_float = f1;
-      } else {
-        if (op == '*')
-          n1 = n1 * n2;
-        else if (op == '/') {
-          if (n2 == 0) {                /* give an error message? */
-            if (n1 == 0)
-              n1 = -0x7fffffffL - 1L;                   /* similar to NaN */
-            else if (n1 < 0)
-              n1 = -0x7fffffffL;
-            else
-              n1 = 0x7fffffffL;
-          } else
-            n1 = n1 / n2;
-        } else {
-          if (n2 == 0)                  /* give an error message? */
-            n1 = 0;
-          else
-            n1 = n1 % n2;
-        }
-        rettv->v_type = VAR_NUMBER;
-        rettv->vval.v_number = n1;
-      }
+  return OK;
+}
+
+/*
+ * Check that the first operand "tv1" of '*', '/' or '%' can be used as a
+ * number, before the second one is evaluated.
+ * Return OK or FAIL, "tv1" is cleared on failure.
+ */
+static int eval_muldiv_check(typval_T *tv1)
+{
+  int error = FALSE;
+
+  if (tv1->v_type != VAR_FLOAT) {
+    (void)get_tv_number_chk(tv1, &error);
+    if (error) {
+      clear_tv(tv1);
+      return FAIL;
+    }
+  }
+  return OK;
+}
+
+/*
+ * Compute "tv1 op tv2" for '*', '/' and '%', after eval_muldiv_check().
+ * The result is put in "tv1", "tv2" is cleared.
+ * Return OK or FAIL, both values are cleared on failure.
+ */
+static int eval_muldiv(typval_T *tv1, typval_T *tv2, int op)
+{
+  long n1, n2;
+  int use_float = FALSE;
+  float_T f1 = 0, f2;
+  int error = FALSE;
+
+  if (tv1->v_type == VAR_FLOAT) {
+    f1 = tv1->vval.v_float;
+    use_float = TRUE;
+    n1 = 0;
+  } else
+    n1 = get_tv_number_chk(tv1, &error);
+  clear_tv(tv1);
+  if (error) {
+    clear_tv(tv2);
+    return FAIL;
+  }
+
+  if (tv2->v_type == VAR_FLOAT) {
+    if (!use_float) {
+      f1 = n1;
+      use_float = TRUE;
+    }
+    f2 = tv2->vval.v_float;
+    n2 = 0;
+  } else {
+    n2 = get_tv_number_chk(tv2, &error);
+    if (error) {
+      clear_tv(tv2);
+      return FAIL;
     }
+    if (use_float)
+      f2 = n2;
   }
+  clear_tv(tv2);
 
+  /*
+   * Compute the result.
+   * When either side is a float the result is a float.
+   */
+  if (use_float) {
+    if (op == '*')
+      f1 = f1 * f2;
+    else if (op == '/') {
+      /* We rely on the floating point library to handle divide
+       * by zero to result in "inf" and not a crash. */
+      f1 = f2 != 0 ? f1 / f2 : INFINITY;
+    } else {
+      EMSG(_("E804: Cannot use '%' with Float"));
+      return FAIL;
+    }
+    tv1->v_type = VAR_FLOAT;
+    tv1->vval.v_float = f1;
+  } else {
+    if (op == '*')
+      n1 = n1 * n2;
+    else if (op == '/') {
+      if (n2 == 0) {                /* give an error message? */
+        if (n1 == 0)
+          n1 = -0x7fffffffL - 1L;                   /* similar to NaN */
+        else if (n1 < 0)
+          n1 = -0x7fffffffL;
+        else
+          n1 = 0x7fffffffL;
+      } else
+        n1 = n1 / n2;
+    } else {
+      if (n2 == 0)                  /* give an error message? */
+        n1 = 0;
+      else
+        n1 = n1 % n2;
+    }
+    tv1->v_type = VAR_NUMBER;
+    tv1->vval.v_number = n1;
+  }
   return OK;
 }
 
@@ -4086,45 +4258,56 @@ eval7 (
   /*
    * Apply logical NOT and unary '-', from right to left, ignore '+'.
    */
-  if (ret == OK && evaluate && end_leader > start_leader) {
-    int error = FALSE;
-    int val = 0;
-    float_T f = 0.0;
+  if (ret == OK && evaluate && end_leader > start_leader)
+    ret = eval7_leader(rettv, start_leader, end_leader);
 
-    if (rettv->v_type == VAR_FLOAT)
-      f = rettv->vval.v_float;
-    else
-      val = get_tv_number_chk(rettv, &error);
-    if (error) {
+  return ret;
+}
+
+/*
+ * Apply the logical NOT and unary '-' characters between "start_leader" and
+ * "end_leader" to "rettv", from right to left, ignore '+'.
+ * Return OK or FAIL, "rettv" is cleared on failure.
+ */
+static int eval7_leader(typval_T *rettv, char_u *start_leader,
+                        char_u *end_leader)
+{
+  int error = FALSE;
+  int val = 0;
+  float_T f = 0.0;
+
+  if (rettv->v_type == VAR_FLOAT)
+    f = rettv->vval.v_float;
+  else
+    val = get_tv_number_chk(rettv, &error);
+  if (error) {
+    clear_tv(rettv);
+    return FAIL;
+  } else {
+    while (end_leader > start_leader) {
+      --end_leader;
+      if (*end_leader == '!') {
+        if (rettv->v_type == VAR_FLOAT)
+          f = !f;
+        else
+          val = !val;
+      } else if (*end_leader == '-') {
+        if (rettv->v_type == VAR_FLOAT)
+          f = -f;
+        else
+          val = -val;
+      }
+    }
+    if (rettv->v_type == VAR_FLOAT) {
       clear_tv(rettv);
-      ret = FAIL;
+      rettv->vval.v_float = f;
     } else {
-      while (end_leader > start_leader) {
-        --end_leader;
-        if (*end_leader == '!') {
-          if (rettv->v_type == VAR_FLOAT)
-            f = !f;
-          else
-            val = !val;
-        } else if (*end_leader == '-') {
-          if (rettv->v_type == VAR_FLOAT)
-            f = -f;
-          else
-            val = -val;
-        }
-      }
-      if (rettv->v_type == VAR_FLOAT) {
-        clear_tv(rettv);
-        rettv->vval.v_float = f;
-      } else {
-        clear_tv(rettv);
-        rettv->v_type = VAR_NUMBER;
-        rettv->vval.v_number = val;
-      }
+      clear_tv(rettv);
+      rettv->v_type = VAR_NUMBER;
+      rettv->vval.v_number = val;
     }
   }
-
-  return ret;
+  return OK;
 }
 
 /*
@@ -8864,6 +9047,10 @@ static void get_buffer_lines(buf_T *buf, linenr_T start, linenr_T end, int retli
   if (buf == NULL || buf->b_ml.ml_mfp == NULL || start < 0)
     return;
 
+  /* Lines that are still being read in the background are needed. */
+  if ((retlist ? end : start) > buf->b_ml.ml_line_count)
+    readfile_bg_wait(buf);
+
   if (!retlist) {
     if (start >= 1 && start <= buf->b_ml.ml_line_count)
       p = ml_get_buf(buf, start, FALSE);
@@ -12206,7 +12393,7 @@ static void f_screenattr(typval_T *argvars, typval_T *rettv)
       || col < 0 || col >= screen_Columns)
     c = -1;
   else
-    c = ScreenAttrs[LineOffset[row] + col];
+    c = ScreenCells[LineOffset[row] + col].sc_attr;
   rettv->vval.v_number = c;
 }
 
@@ -12227,10 +12414,10 @@ static void f_screenchar(typval_T *argvars, typval_T *rettv)
     c = -1;
   else {
     off = LineOffset[row] + col;
-    if (enc_utf8 && ScreenLinesUC[off] != 0)
-      c = ScreenLinesUC[off];
+    if (enc_utf8 && ScreenCells[off].sc_uc != 0)
+      c = ScreenCells[off].sc_uc;
     else
-      c = ScreenLines[off];
+      c = ScreenCells[off].sc_char;
   }
   rettv->vval.v_number = c;
 }
@@ -14868,6 +15055,7 @@ var2fpos (
     }
   } else if (name[0] == '$') {        /* last column or line */
     if (dollar_lnum) {
+      readfile_bg_wait(curbuf);
       pos.lnum = curbuf->b_ml.ml_line_count;
       pos.col = 0;
     } else {
@@ -15657,8 +15845,10 @@ static linenr_T get_tv_lnum_buf(typval_T *argvars, buf_T *buf)
   if (argvars[0].v_type == VAR_STRING
       && argvars[0].vval.v_string != NULL
       && argvars[0].vval.v_string[0] == '$'
-      && buf != NULL)
+      && buf != NULL) {
+    readfile_bg_wait(buf);
     return buf->b_ml.ml_line_count;
+  }
   return get_tv_number_chk(&argvars[0], NULL);
 }
 
@@ -16991,6 +17181,7 @@ void ex_function(exarg_T *eap)
       /* redefine existing function */
       ga_clear_strings(&(fp->uf_args));
       ga_clear_strings(&(fp->uf_lines));
+      func_code_free(fp->uf_code);
       free(name);
       name = NULL;
     }
@@ -17072,6 +17263,7 @@ void ex_function(exarg_T *eap)
   }
   fp->uf_args = newargs;
   fp->uf_lines = newlines;
+  fp->uf_code = NULL;
   fp->uf_tml_count = NULL;
   fp->uf_tml_total = NULL;
   fp->uf_tml_self = NULL;
@@ -17782,6 +17974,7 @@ static void func_free(ufunc_T *fp)
   /* clear this function */
   ga_clear_strings(&(fp->uf_args));
   ga_clear_strings(&(fp->uf_lines));
+  func_code_free(fp->uf_code);
   free(fp->uf_tml_count);
   free(fp->uf_tml_total);
   free(fp->uf_tml_self);
@@ -18040,9 +18233,19 @@ call_user_func (
   save_did_emsg = did_emsg;
   did_emsg = FALSE;
 
-  /* call do_cmdline() to execute the lines */
-  do_cmdline(NULL, get_func_line, (void *)fc,
-      DOCMD_NOWAIT|DOCMD_VERBOSE|DOCMD_REPEAT);
+  /* Execute the compiled lines when nothing needs the line interpreter:
+   * no try conditional that errors may be converted to an exception for,
+   * no debugging, profiling or listing of the executed lines. */
+  if (fp->uf_code == NULL)
+    fp->uf_code = func_compile(fp);
+  if (fp->uf_code->fcd_ok && trylevel == 0 && !force_abort && !did_throw
+      && do_profiling != PROF_YES && fc->breakpoint == 0
+      && debug_break_level < 0 && p_verbose < 15)
+    func_execute(fc, fp->uf_code, argvars);
+  else
+    /* call do_cmdline() to execute the lines */
+    do_cmdline(NULL, get_func_line, (void *)fc,
+        DOCMD_NOWAIT|DOCMD_VERBOSE|DOCMD_REPEAT);
 
   --RedrawingDisabled;
 
@@ -18157,6 +18360,1265 @@ call_user_func (
   }
 }
 
+/*
+ * Compile the lines of user function "fp" into instructions for
+ * func_execute(), to avoid parsing every command and expression again each
+ * time the function is called.
+ * Only ":let", ":if", ":while", ":for", ":call" and ":return" are compiled.
+ * For any other command, a '|', a range or a modifier the returned code has
+ * "fcd_ok" FALSE and the lines are executed with do_cmdline() instead.
+ * Expressions that are not handled here are left to eval0() and eval7().
+ */
+static funccode_T *func_compile(ufunc_T *fp)
+{
+  /* Commands that can be compiled, with the shortest abbreviation. */
+  static struct cmdkind {
+    char        *fk_name;
+    int fk_len;
+  } cmds[] = {
+    {"let", 3}, {"if", 2}, {"elseif", 5}, {"else", 2}, {"endif", 2},
+    {"while", 2}, {"endwhile", 4}, {"for", 3}, {"endfor", 5},
+    {"break", 4}, {"continue", 3}, {"return", 4}, {"call", 3}
+  };
+  enum {
+    FK_LET, FK_IF, FK_ELSEIF, FK_ELSE, FK_ENDIF, FK_WHILE, FK_ENDWHILE,
+    FK_FOR, FK_ENDFOR, FK_BREAK, FK_CONTINUE, FK_RETURN, FK_CALL
+  };
+  /* Conditionals being compiled.  Jumps that still need to go to the end
+   * are linked through their "fi_jump". */
+  struct {
+    int cs_kind;                /* FK_IF, FK_WHILE or FK_FOR */
+    int cs_head;                /* instruction to loop back to */
+    int cs_next;                /* FI_COND to jump to the next branch */
+    int cs_exits;               /* jumps to the end */
+    int cs_else;                /* TRUE after ":else" */
+  } cstack[CSTACK_LEN];
+  int cs_idx = -1;
+  funccomp_T comp;
+  funccomp_T  *cp = &comp;
+  funccode_T  *code = xcalloc(1, sizeof(funccode_T));
+  char_u      *cmd, *arg, *p;
+  int kind, idx, i, k, len;
+  int first;
+  typval_T tv;
+  char_u      *nextcmd;
+  int error;
+
+  cp->fcp_func = fp;
+  cp->fcp_depth = 0;
+  cp->fcp_calls = 0;
+  cp->fcp_overflow = FALSE;
+  ga_init(&cp->fcp_instr, (int)sizeof(funcinstr_T), 32);
+
+  for (int lnum = 1; lnum <= fp->uf_lines.ga_len; ++lnum) {
+    cmd = FUNCLINE(fp, lnum - 1);
+    if (cmd == NULL || (cmd[0] == '#' && cmd[1] == '!'))
+      continue;               /* continuation line or comment */
+    while (*cmd == ' ' || *cmd == '\t' || *cmd == ':')
+      ++cmd;
+    if (*cmd == NUL || *cmd == '"')
+      continue;
+
+    for (p = cmd; ASCII_ISALPHA(*p); ++p)
+      ;
+    len = (int)(p - cmd);
+    for (kind = 0; kind < (int)(sizeof(cmds) / sizeof(struct cmdkind)); ++kind)
+      if (len >= cmds[kind].fk_len && len <= (int)STRLEN(cmds[kind].fk_name)
+          && STRNCMP(cmds[kind].fk_name, cmd, len) == 0)
+        break;
+    if (kind == (int)(sizeof(cmds) / sizeof(struct cmdkind)) || *p == '!')
+      goto fail;
+    arg = skipwhite(p);
+    first = cp->fcp_instr.ga_len;
+    cp->fcp_depth = 0;
+
+    /* Commands without an argument may only be followed by a comment. */
+    if ((kind == FK_ELSE || kind == FK_ENDIF || kind == FK_ENDWHILE
+         || kind == FK_ENDFOR || kind == FK_BREAK || kind == FK_CONTINUE)
+        && *arg != NUL && *arg != '"')
+      goto fail;
+
+    switch (kind) {
+    case FK_LET:
+    {
+      int var_count = 0;
+      int semicolon = 0;
+      int op;
+      char_u  *expr;
+      char_u  *key;
+      funcinstr_T *ip;
+
+      ++emsg_skip;
+      p = skip_var_list(arg, &var_count, &semicolon);
+      --emsg_skip;
+      if (p == NULL)
+        goto fail;
+      if (p > arg && p[-1] == '.')          /* for var.='str' */
+        --p;
+      expr = skipwhite(p);
+      if (*expr == '=') {
+        op = '=';
+        expr = skipwhite(expr + 1);
+      } else if (*expr != NUL && vim_strchr((char_u *)"+-.", *expr) != NULL
+                 && expr[1] == '=') {
+        op = *expr;
+        expr = skipwhite(expr + 2);
+      } else
+        goto fail;                          /* listing variables */
+
+      idx = func_emit(cp, FI_LINE, lnum);
+      FCP_INSTR(cp, idx).fi_text = expr;
+      if (func_compile_expr(cp, expr) == FAIL)
+        goto fail;
+      if ((key = func_local_name(arg, (int)(p - arg))) != NULL) {
+        i = func_emit(cp, FI_STORE, op);
+        ip = &FCP_INSTR(cp, i);
+        ip->fi_name = key;
+        ip->fi_hash = hash_hash(ip->fi_name);
+      } else {
+        i = func_emit(cp, FI_LET, op);
+        ip = &FCP_INSTR(cp, i);
+        ip->fi_nr = var_count;
+        if (semicolon)
+          ip->fi_flags |= FIF_SEMICOLON;
+      }
+      func_set_text(ip, arg);
+      FCP_INSTR(cp, idx).fi_jump = cp->fcp_instr.ga_len;
+      break;
+    }
+
+    case FK_IF:
+    case FK_WHILE:
+      if (cs_idx >= CSTACK_LEN - 2)
+        goto fail;
+      ++cs_idx;
+      cstack[cs_idx].cs_kind = kind;
+      cstack[cs_idx].cs_exits = -1;
+      cstack[cs_idx].cs_else = FALSE;
+    /* FALLTHROUGH */
+    case FK_ELSEIF:
+      if (kind == FK_ELSEIF) {
+        if (cs_idx < 0 || cstack[cs_idx].cs_kind != FK_IF
+            || cstack[cs_idx].cs_else)
+          goto fail;
+        func_emit_exit(cp, FI_JUMP, &cstack[cs_idx].cs_exits);
+        func_patch(cp, cstack[cs_idx].cs_next);
+      }
+      idx = func_emit_exit(cp, FI_LINE, &cstack[cs_idx].cs_exits);
+      FCP_INSTR(cp, idx).fi_arg = lnum;
+      FCP_INSTR(cp, idx).fi_text = arg;
+      cstack[cs_idx].cs_head = idx;
+      if (func_compile_expr(cp, arg) == FAIL)
+        goto fail;
+      if (kind == FK_WHILE)
+        func_emit_exit(cp, FI_COND, &cstack[cs_idx].cs_exits);
+      else
+        cstack[cs_idx].cs_next = func_emit(cp, FI_COND, 0);
+      break;
+
+    case FK_ELSE:
+      if (cs_idx < 0 || cstack[cs_idx].cs_kind != FK_IF
+          || cstack[cs_idx].cs_else)
+        goto fail;
+      func_emit_exit(cp, FI_JUMP, &cstack[cs_idx].cs_exits);
+      func_patch(cp, cstack[cs_idx].cs_next);
+      cstack[cs_idx].cs_else = TRUE;
+      func_emit_line(cp, lnum);
+      break;
+
+    case FK_ENDIF:
+      if (cs_idx < 0 || cstack[cs_idx].cs_kind != FK_IF)
+        goto fail;
+      if (!cstack[cs_idx].cs_else)
+        func_patch(cp, cstack[cs_idx].cs_next);
+      func_patch_exits(cp, cstack[cs_idx].cs_exits);
+      func_emit_line(cp, lnum);
+      --cs_idx;
+      break;
+
+    case FK_FOR:
+      /* Check the syntax the way the line interpreter skips it. */
+      nextcmd = NULL;
+      ++emsg_skip;
+      free_for_info(eval_for_line(arg, &error, &nextcmd, TRUE));
+      --emsg_skip;
+      if (error || nextcmd != NULL || cs_idx >= CSTACK_LEN - 2)
+        goto fail;
+      ++cs_idx;
+      cstack[cs_idx].cs_kind = kind;
+      cstack[cs_idx].cs_exits = -1;
+
+      /* The first time the list is evaluated, after that ":endfor" jumps
+       * back to get the next item. */
+      func_emit_line(cp, lnum);
+      idx = func_emit(cp, FI_FOR, cs_idx);
+      func_set_text(&FCP_INSTR(cp, idx), arg);
+      idx = func_emit(cp, FI_JUMP, 0);
+      cstack[cs_idx].cs_head = func_emit_line(cp, lnum);
+      func_patch(cp, idx);
+      idx = func_emit_exit(cp, FI_NEXT, &cstack[cs_idx].cs_exits);
+      FCP_INSTR(cp, idx).fi_arg = cs_idx;
+      func_set_text(&FCP_INSTR(cp, idx), arg);
+      break;
+
+    case FK_ENDWHILE:
+    case FK_ENDFOR:
+      if (cs_idx < 0 || cstack[cs_idx].cs_kind
+          != (kind == FK_ENDWHILE ? FK_WHILE : FK_FOR))
+        goto fail;
+      func_emit_line(cp, lnum);
+      idx = func_emit(cp, FI_LOOP, 0);
+      FCP_INSTR(cp, idx).fi_jump = cstack[cs_idx].cs_head;
+      func_patch_exits(cp, cstack[cs_idx].cs_exits);
+      if (kind == FK_ENDFOR)
+        func_emit(cp, FI_ENDFOR, cs_idx);
+      --cs_idx;
+      break;
+
+    case FK_BREAK:
+    case FK_CONTINUE:
+      for (k = cs_idx; k >= 0 && cstack[k].cs_kind == FK_IF; --k)
+        ;
+      if (k < 0)
+        goto fail;
+      func_emit_line(cp, lnum);
+      if (kind == FK_BREAK)
+        func_emit_exit(cp, FI_JUMP, &cstack[k].cs_exits);
+      else {
+        idx = func_emit(cp, FI_LOOP, 0);
+        FCP_INSTR(cp, idx).fi_jump = cstack[k].cs_head;
+      }
+      break;
+
+    case FK_RETURN:
+      if (*arg == '|')
+        goto fail;
+      if (*arg == NUL) {
+        func_emit_line(cp, lnum);
+        func_emit(cp, FI_RETURN, 0);
+        break;
+      }
+      idx = func_emit(cp, FI_LINE, lnum);
+      FCP_INSTR(cp, idx).fi_text = arg;
+      if (func_compile_expr(cp, arg) == FAIL)
+        goto fail;
+      i = func_emit(cp, FI_RETURN, 0);
+      FCP_INSTR(cp, i).fi_flags |= FIF_VALUE;
+      /* On error return without a value. */
+      i = func_emit(cp, FI_RETURN, 0);
+      FCP_INSTR(cp, idx).fi_jump = i;
+      break;
+
+    case FK_CALL:
+      nextcmd = NULL;
+      ++emsg_skip;
+      i = eval0(arg, &tv, &nextcmd, FALSE);
+      --emsg_skip;
+      if (i == FAIL || nextcmd != NULL)
+        goto fail;
+      func_emit_line(cp, lnum);
+      idx = func_emit(cp, FI_CALLCMD, 0);
+      func_set_text(&FCP_INSTR(cp, idx), arg);
+      break;
+    }
+
+    /* Remember the command name for an exception thrown for an error. */
+    while (FCP_INSTR(cp, first).fi_op != FI_LINE)
+      ++first;
+    FCP_INSTR(cp, first).fi_name = vim_strsave((char_u *)cmds[kind].fk_name);
+  }
+  if (cs_idx >= 0)
+    goto fail;                /* missing ":endif", etc. */
+  func_emit(cp, FI_END, 0);
+
+  code->fcd_ok = TRUE;
+  code->fcd_len = cp->fcp_instr.ga_len;
+  code->fcd_instr = cp->fcp_instr.ga_data;
+  return code;
+
+fail:
+  func_truncate(cp, 0);
+  ga_clear(&cp->fcp_instr);
+  return code;
+}
+
+/*
+ * Append instruction "op" with argument "arg" and keep track of the number
+ * of values on the stack.
+ * Returns the index of the new instruction.
+ */
+static int func_emit(funccomp_T *cp, funcop_T op, int arg)
+{
+  funcinstr_T *ip;
+
+  ga_grow(&cp->fcp_instr, 1);
+  ip = &FCP_INSTR(cp, cp->fcp_instr.ga_len);
+  memset(ip, 0, sizeof(funcinstr_T));
+  ip->fi_op = op;
+  ip->fi_arg = arg;
+  ip->fi_jump = cp->fcp_instr.ga_len + 1;
+
+  switch (op) {
+  case FI_NUMBER:
+  case FI_STRING:
+  case FI_LOCAL:
+  case FI_ARG:
+  case FI_VAR:
+  case FI_EVAL:
+  case FI_EVAL7:
+    ++cp->fcp_depth;
+    break;
+  case FI_ADDSUB:
+  case FI_MULDIV:
+  case FI_COMPARE:
+  case FI_JUMP_TRUE:
+  case FI_JUMP_FALSE:
+  case FI_TEST:
+  case FI_COND:
+  case FI_STORE:
+  case FI_LET:
+    --cp->fcp_depth;
+    break;
+  case FI_FUNC:
+    ++cp->fcp_calls;
+    break;
+  case FI_CALL:
+    cp->fcp_depth -= arg - 1;
+    --cp->fcp_calls;
+    break;
+  default:
+    break;
+  }
+  /* Leave room for the extra argument of call_func(). */
+  if (cp->fcp_depth >= FUNC_STACK_LEN - 1 || cp->fcp_calls >= FUNC_STACK_LEN)
+    cp->fcp_overflow = TRUE;
+
+  return cp->fcp_instr.ga_len++;
+}
+
+/*
+ * Append an FI_LINE for line "lnum" that continues with the next
+ * instruction on error.
+ */
+static int func_emit_line(funccomp_T *cp, int lnum)
+{
+  return func_emit(cp, FI_LINE, lnum);
+}
+
+/*
+ * Append instruction "op" that jumps to the end of a conditional, linked
+ * into the list at "exits" until func_patch_exits() is used.
+ */
+static int func_emit_exit(funccomp_T *cp, funcop_T op, int *exits)
+{
+  int idx = func_emit(cp, op, 0);
+
+  FCP_INSTR(cp, idx).fi_jump = *exits;
+  *exits = idx;
+  return idx;
+}
+
+/*
+ * Make instruction "idx" jump to the next instruction to be appended.
+ */
+static void func_patch(funccomp_T *cp, int idx)
+{
+  FCP_INSTR(cp, idx).fi_jump = cp->fcp_instr.ga_len;
+}
+
+/*
+ * Make all the instructions in the list "exits" jump to the next
+ * instruction to be appended.
+ */
+static void func_patch_exits(funccomp_T *cp, int exits)
+{
+  while (exits >= 0) {
+    int next = FCP_INSTR(cp, exits).fi_jump;
+
+    func_patch(cp, exits);
+    exits = next;
+  }
+}
+
+/*
+ * Remove the instructions from index "len" onwards.
+ */
+static void func_truncate(funccomp_T *cp, int len)
+{
+  while (cp->fcp_instr.ga_len > len) {
+    funcinstr_T *ip = &FCP_INSTR(cp, --cp->fcp_instr.ga_len);
+
+    free(ip->fi_str);
+    free(ip->fi_name);
+  }
+}
+
+/*
+ * Set the text of a command for instruction "ip".  When it contains a curly
+ * braces name evaluating it may change the text, then a copy must be used.
+ */
+static void func_set_text(funcinstr_T *ip, char_u *text)
+{
+  ip->fi_str = vim_strsave(text);
+  if (vim_strchr(text, '{') != NULL)
+    ip->fi_flags |= FIF_COPY;
+}
+
+/*
+ * Get the text of instruction "ip", "*tofree" is set to a copy that must be
+ * freed.
+ */
+static char_u *func_get_text(funcinstr_T *ip, char_u **tofree)
+{
+  if (ip->fi_flags & FIF_COPY)
+    return *tofree = vim_strsave(ip->fi_str);
+  *tofree = NULL;
+  return ip->fi_str;
+}
+
+/*
+ * Check if "name[len]" is a variable local to the function being compiled,
+ * one without "l:" that isn't a v: variable or one with "l:".
+ * Returns the allocated name without "l:", NULL if it isn't.
+ */
+static char_u *func_local_name(char_u *name, int len)
+{
+  char_u      *p;
+  char_u      *key;
+  hashitem_T  *hi;
+  int scoped = FALSE;
+
+  if (len > 2 && name[0] == 'l' && name[1] == ':') {
+    name += 2;
+    len -= 2;
+    scoped = TRUE;
+  }
+  if (len <= 0 || !eval_isnamec1(*name))
+    return NULL;
+  for (p = name; p < name + len; ++p)
+    if (!eval_isnamec(*p) || *p == ':' || *p == AUTOLOAD_CHAR)
+      return NULL;
+
+  key = vim_strnsave(name, len);
+  if (!scoped) {
+    /* "version" is "v:version" in all scopes */
+    hi = hash_find(&compat_hashtab, key);
+    if (!HASHITEM_EMPTY(hi)) {
+      free(key);
+      return NULL;
+    }
+  }
+  return key;
+}
+
+/*
+ * Compile the expression of a command at "arg".
+ * Returns FAIL when it isn't a valid expression that ends the command, the
+ * function is not compiled then.
+ */
+static int func_compile_expr(funccomp_T *cp, char_u *arg)
+{
+  typval_T tv;
+  char_u      *nextcmd = NULL;
+  char_u      *p;
+  int start = cp->fcp_instr.ga_len;
+  int depth = cp->fcp_depth;
+  int ret;
+
+  /* Check the syntax the way the line interpreter skips it.  Nothing is
+   * allocated when not evaluating. */
+  ++emsg_skip;
+  ret = eval0(arg, &tv, &nextcmd, FALSE);
+  --emsg_skip;
+  if (ret == FAIL || nextcmd != NULL)
+    return FAIL;
+
+  p = skipwhite(arg);
+  if (c_expr1(cp, &p) == FAIL || !ends_excmd(*p) || cp->fcp_overflow) {
+    /* Let eval0() handle the whole expression. */
+    func_truncate(cp, start);
+    cp->fcp_depth = depth;
+    cp->fcp_calls = 0;
+    cp->fcp_overflow = FALSE;
+    start = func_emit(cp, FI_EVAL, 0);
+    func_set_text(&FCP_INSTR(cp, start), arg);
+  }
+  return OK;
+}
+
+/*
+ * Compile "expr2 ? expr1 : expr1", like eval1().
+ */
+static int c_expr1(funccomp_T *cp, char_u **arg)
+{
+  int test, jump;
+
+  if (c_expr2(cp, arg) == FAIL)
+    return FAIL;
+
+  if ((*arg)[0] == '?') {
+    test = func_emit(cp, FI_TEST, 0);
+    *arg = skipwhite(*arg + 1);
+    if (c_expr1(cp, arg) == FAIL || (*arg)[0] != ':')
+      return FAIL;
+    jump = func_emit(cp, FI_JUMP, 0);
+    func_patch(cp, test);
+    /* Only one of the values is pushed. */
+    --cp->fcp_depth;
+    *arg = skipwhite(*arg + 1);
+    if (c_expr1(cp, arg) == FAIL)
+      return FAIL;
+    func_patch(cp, jump);
+  }
+  return OK;
+}
+
+/*
+ * Compile "expr3 || expr3 || expr3", like eval2().
+ */
+static int c_expr2(funccomp_T *cp, char_u **arg)
+{
+  int exits = -1;
+  int idx;
+
+  if (c_expr3(cp, arg) == FAIL)
+    return FAIL;
+
+  if ((*arg)[0] != '|' || (*arg)[1] != '|')
+    return OK;
+  while ((*arg)[0] == '|' && (*arg)[1] == '|') {
+    func_emit_exit(cp, FI_JUMP_TRUE, &exits);
+    *arg = skipwhite(*arg + 2);
+    if (c_expr3(cp, arg) == FAIL)
+      return FAIL;
+  }
+  func_emit_exit(cp, FI_JUMP_TRUE, &exits);
+  idx = func_emit(cp, FI_NUMBER, 0);
+  FCP_INSTR(cp, idx).fi_nr = FALSE;
+  func_patch_exits(cp, exits);
+  return OK;
+}
+
+/*
+ * Compile "expr4 && expr4 && expr4", like eval3().
+ */
+static int c_expr3(funccomp_T *cp, char_u **arg)
+{
+  int exits = -1;
+  int idx;
+
+  if (c_expr4(cp, arg) == FAIL)
+    return FAIL;
+
+  if ((*arg)[0] != '&' || (*arg)[1] != '&')
+    return OK;
+  while ((*arg)[0] == '&' && (*arg)[1] == '&') {
+    func_emit_exit(cp, FI_JUMP_FALSE, &exits);
+    *arg = skipwhite(*arg + 2);
+    if (c_expr4(cp, arg) == FAIL)
+      return FAIL;
+  }
+  func_emit_exit(cp, FI_JUMP_FALSE, &exits);
+  idx = func_emit(cp, FI_NUMBER, 0);
+  FCP_INSTR(cp, idx).fi_nr = TRUE;
+  func_patch_exits(cp, exits);
+  return OK;
+}
+
+/*
+ * Compile a comparison, like eval4().
+ */
+static int c_expr4(funccomp_T *cp, char_u **arg)
+{
+  char_u      *p;
+  exptype_T type;
+  int type_is;
+  int len;
+  int ic;
+  int idx;
+
+  if (c_expr5(cp, arg) == FAIL)
+    return FAIL;
+
+  p = *arg;
+  type = get_compare_type(p, &len, &type_is);
+  if (type != TYPE_UNKNOWN) {
+    if (p[len] == '?') {
+      ic = TRUE;
+      ++len;
+    } else if (p[len] == '#') {
+      ic = FALSE;
+      ++len;
+    } else
+      ic = -1;                /* use 'ignorecase' */
+
+    *arg = skipwhite(p + len);
+    if (c_expr5(cp, arg) == FAIL)
+      return FAIL;
+    idx = func_emit(cp, FI_COMPARE, type);
+    FCP_INSTR(cp, idx).fi_nr = ic;
+    if (type_is)
+      FCP_INSTR(cp, idx).fi_flags |= FIF_IS;
+  }
+  return OK;
+}
+
+/*
+ * Compile '+', '-' and '.', like eval5().
+ */
+static int c_expr5(funccomp_T *cp, char_u **arg)
+{
+  int op;
+
+  if (c_expr6(cp, arg, FALSE) == FAIL)
+    return FAIL;
+
+  for (;; ) {
+    op = **arg;
+    if (op != '+' && op != '-' && op != '.')
+      break;
+    func_emit(cp, FI_STRCHK, op);
+    *arg = skipwhite(*arg + 1);
+    if (c_expr6(cp, arg, op == '.') == FAIL)
+      return FAIL;
+    func_emit(cp, FI_ADDSUB, op);
+  }
+  return OK;
+}
+
+/*
+ * Compile '*', '/' and '%', like eval6().
+ */
+static int c_expr6(funccomp_T *cp, char_u **arg, int want_string)
+{
+  int op;
+
+  if (c_expr7(cp, arg, want_string) == FAIL)
+    return FAIL;
+
+  for (;; ) {
+    op = **arg;
+    if (op != '*' && op != '/' && op != '%')
+      break;
+    func_emit(cp, FI_NUMCHK, op);
+    *arg = skipwhite(*arg + 1);
+    if (c_expr7(cp, arg, FALSE) == FAIL)
+      return FAIL;
+    func_emit(cp, FI_MULDIV, op);
+  }
+  return OK;
+}
+
+/*
+ * Compile a value with its leading '!', '-' and '+', like eval7().
+ * What isn't handled by c_operand() is left to eval7() when the function is
+ * executed.
+ */
+static int c_expr7(funccomp_T *cp, char_u **arg, int want_string)
+{
+  char_u      *start = *arg;
+  char_u      *end_leader;
+  int first = cp->fcp_instr.ga_len;
+  int depth = cp->fcp_depth;
+  int calls = cp->fcp_calls;
+  int idx;
+  typval_T tv;
+  char_u      *p;
+
+  while (**arg == '!' || **arg == '-' || **arg == '+')
+    *arg = skipwhite(*arg + 1);
+  end_leader = *arg;
+
+  if (c_operand(cp, arg, want_string) == OK) {
+    if (end_leader == start)
+      return OK;
+    if (cp->fcp_instr.ga_len == first + 1
+        && FCP_INSTR(cp, first).fi_op == FI_NUMBER) {
+      /* Apply the leader to a Number constant now. */
+      tv.v_type = VAR_NUMBER;
+      tv.vval.v_number = FCP_INSTR(cp, first).fi_nr;
+      (void)eval7_leader(&tv, start, end_leader);
+      FCP_INSTR(cp, first).fi_nr = tv.vval.v_number;
+    } else {
+      idx = func_emit(cp, FI_LEADER, (int)(end_leader - start));
+      FCP_INSTR(cp, idx).fi_str = vim_strnsave(start,
+          (int)(end_leader - start));
+    }
+    return OK;
+  }
+
+  func_truncate(cp, first);
+  cp->fcp_depth = depth;
+  cp->fcp_calls = calls;
+
+  /* Find the end the way the line interpreter skips it. */
+  p = start;
+  ++emsg_skip;
+  idx = eval7(&p, &tv, FALSE, want_string);
+  --emsg_skip;
+  if (idx == FAIL)
+    return FAIL;
+  *arg = p;
+  while (p > start && vim_iswhite(p[-1]))
+    --p;
+  /* What follows may depend on the type of the value, e.g. ".key" for a
+   * Dictionary. */
+  if (p == *arg && (*p == '.' || *p == '[' || *p == '('))
+    return FAIL;
+
+  idx = func_emit(cp, FI_EVAL7, 0);
+  FCP_INSTR(cp, idx).fi_str = vim_strnsave(start, (int)(p - start));
+  if (vim_strchr(FCP_INSTR(cp, idx).fi_str, '{') != NULL)
+    FCP_INSTR(cp, idx).fi_flags |= FIF_COPY;
+  if (want_string)
+    FCP_INSTR(cp, idx).fi_flags |= FIF_STRING;
+  return OK;
+}
+
+/*
+ * Compile a Number or String constant, a variable, a function call or a
+ * nested expression.
+ * Returns FAIL for anything else or when followed by an index, which is left
+ * to eval7().
+ */
+static int c_operand(funccomp_T *cp, char_u **arg, int want_string)
+{
+  char_u      *p = *arg;
+  char_u      *name;
+  int len;
+  int idx;
+  long n;
+  typval_T tv;
+
+  switch (*p) {
+  case '0': case '1': case '2': case '3': case '4':
+  case '5': case '6': case '7': case '8': case '9':
+    /* Leave a Float to eval7(). */
+    name = skipdigits(p + 1);
+    if (!want_string && name[0] == '.' && vim_isdigit(name[1]))
+      return FAIL;
+    vim_str2nr(p, NULL, &len, TRUE, TRUE, &n, NULL);
+    p += len;
+    idx = func_emit(cp, FI_NUMBER, 0);
+    FCP_INSTR(cp, idx).fi_nr = n;
+    break;
+
+  case '"':
+  case '\'':
+    if ((*p == '"' ? get_string_tv(&p, &tv, TRUE)
+         : get_lit_string_tv(&p, &tv, TRUE)) == FAIL)
+      return FAIL;
+    idx = func_emit(cp, FI_STRING, 0);
+    FCP_INSTR(cp, idx).fi_str = tv.vval.v_string;
+    break;
+
+  case '(':
+    p = skipwhite(p + 1);
+    if (c_expr1(cp, &p) == FAIL || *p != ')')
+      return FAIL;
+    ++p;
+    if (*p == '.')
+      return FAIL;
+    break;
+
+  default:
+    if (!eval_isnamec1(*p))
+      return FAIL;
+    name = p;
+    while (eval_isnamec(*p))
+      ++p;
+    if (*p == '{')
+      return FAIL;
+    len = (int)(p - name);
+    if (*skipwhite(p) == '(') {
+      if (c_call(cp, name, len, &p) == FAIL)
+        return FAIL;
+    } else
+      c_variable(cp, name, len);
+    /* Can be a Dictionary entry. */
+    if (*p == '.')
+      return FAIL;
+    break;
+  }
+
+  /* Leave an index or a call of a Funcref to eval7(). */
+  if (*p == '[' || *p == '(')
+    return FAIL;
+  *arg = skipwhite(p);
+  return OK;
+}
+
+/*
+ * Compile getting the value of variable "name[len]".
+ */
+static void c_variable(funccomp_T *cp, char_u *name, int len)
+{
+  ufunc_T     *fp = cp->fcp_func;
+  funcinstr_T *ip;
+  char_u      *key;
+  int idx;
+
+  /* Named argument "a:name". */
+  if (len > 2 && name[0] == 'a' && name[1] == ':')
+    for (int i = 0; i < fp->uf_args.ga_len; ++i)
+      if (STRNCMP(FUNCARG(fp, i), name + 2, len - 2) == 0
+          && FUNCARG(fp, i)[len - 2] == NUL) {
+        func_emit(cp, FI_ARG, i);
+        return;
+      }
+
+  key = func_local_name(name, len);
+  idx = func_emit(cp, key != NULL ? FI_LOCAL : FI_VAR, len);
+  ip = &FCP_INSTR(cp, idx);
+  ip->fi_str = vim_strnsave(name, len);
+  if (key != NULL) {
+    ip->fi_name = key;
+    ip->fi_hash = hash_hash(key);
+  }
+}
+
+/*
+ * Compile calling function "name[len]", "*arg" points to after the name.
+ * The arguments are handled like get_func_tv() does.
+ * Returns FAIL when an argument can't be compiled.
+ */
+static int c_call(funccomp_T *cp, char_u *name, int len, char_u **arg)
+{
+  char_u      *argp = skipwhite(*arg);
+  int argcount = 0;
+  int idx;
+
+  idx = func_emit(cp, FI_FUNC, len);
+  FCP_INSTR(cp, idx).fi_str = vim_strnsave(name, len);
+  FCP_INSTR(cp, idx).fi_text = name;
+
+  while (argcount < MAX_FUNC_ARGS) {
+    argp = skipwhite(argp + 1);             /* skip the '(' or ',' */
+    if (*argp == ')' || *argp == ',' || *argp == NUL)
+      break;
+    if (c_expr1(cp, &argp) == FAIL)
+      return FAIL;
+    ++argcount;
+    if (*argp != ',')
+      break;
+  }
+  if (*argp != ')')
+    return FAIL;
+  func_emit(cp, FI_CALL, argcount);
+  *arg = argp + 1;
+  return OK;
+}
+
+/*
+ * Execute the instructions of compiled function "code", called with
+ * funccall "fc" and arguments "argvars".
+ * Does what do_cmdline() does for the lines of the function, in the same
+ * order, and what the commands and eval1() to eval7() do for the
+ * instructions.
+ */
+static void func_execute(funccall_T *fc, funccode_T *code, typval_T *argvars)
+{
+  ufunc_T     *fp = fc->func;
+  funcinstr_T *instr = code->fcd_instr;
+  funcinstr_T *ip;
+  funcinstr_T *stmt = NULL;     /* FI_LINE of the current command */
+  typval_T stack[FUNC_STACK_LEN];
+  int sp = 0;
+  funcpending_T calls[FUNC_STACK_LEN];
+  int ncalls = 0;
+  void        *fis[CSTACK_LEN];   /* info for ":for" */
+  int pc = 0;
+  int report = TRUE;
+  int error;
+  varnumber_T n;
+  typval_T tv;
+  dictitem_T  *di;
+  hashitem_T  *hi;
+  char_u      *text;
+  char_u      *tofree;
+  char_u op[2];
+  cmdmod_T save_cmdmod;
+  struct msglist      **saved_msg_list = msg_list;
+  struct msglist      *private_msg_list = NULL;
+
+  memset(fis, 0, sizeof(fis));
+  memset(&save_cmdmod, 0, sizeof(save_cmdmod));
+  msg_list = &private_msg_list;
+
+  /* Inside a function use a higher nesting level. */
+  if (ex_nesting_level == fc->level)
+    ++ex_nesting_level;
+  did_throw = FALSE;
+  did_emsg = FALSE;
+  KeyTyped = FALSE;
+
+  for (;; ) {
+    ip = &instr[pc++];
+    switch (ip->fi_op) {
+    case FI_LINE:
+    case FI_END:
+      if (stmt != NULL) {
+        /* End of the previous command, like do_one_cmd() and
+         * do_cmdline(). */
+        if (curwin->w_cursor.lnum == 0)
+          curwin->w_cursor.lnum = 1;
+        do_errthrow(NULL, stmt->fi_name);
+        cmdmod = save_cmdmod;
+        --ex_nesting_level;
+        /* reset did_emsg for a function that is not aborted by an error */
+        if (did_emsg && !force_abort && !(fp->uf_flags & FC_ABORT))
+          did_emsg = FALSE;
+        if (trylevel == 0 && !did_emsg && !got_int && !did_throw)
+          force_abort = FALSE;
+        stmt = NULL;
+      }
+      if (ip->fi_op == FI_END || fc->returned || got_int || did_throw
+          || (did_emsg && (force_abort || (fp->uf_flags & FC_ABORT))))
+        goto done;
+
+      stmt = ip;
+      report = TRUE;
+      sourcing_lnum = ip->fi_arg;
+      fc->linenr = ip->fi_arg;
+      ++ex_nesting_level;
+      save_cmdmod = cmdmod;
+      memset(&cmdmod, 0, sizeof(cmdmod));
+      break;
+
+    case FI_NUMBER:
+      stack[sp].v_type = VAR_NUMBER;
+      stack[sp].v_lock = 0;
+      stack[sp++].vval.v_number = ip->fi_nr;
+      break;
+
+    case FI_STRING:
+      stack[sp].v_type = VAR_STRING;
+      stack[sp].v_lock = 0;
+      stack[sp++].vval.v_string = vim_strsave(ip->fi_str);
+      break;
+
+    case FI_LOCAL:
+      hi = hash_lookup(&fc->l_vars.dv_hashtab, ip->fi_name, ip->fi_hash);
+      if (!HASHITEM_EMPTY(hi))
+        copy_tv(&HI2DI(hi)->di_tv, &stack[sp++]);
+      else if (get_var_tv(ip->fi_str, ip->fi_arg, &stack[sp], TRUE,
+                   FALSE) == FAIL)
+        goto fail;
+      else
+        ++sp;
+      break;
+
+    case FI_ARG:
+      copy_tv(&argvars[ip->fi_arg], &stack[sp++]);
+      break;
+
+    case FI_VAR:
+      if (get_var_tv(ip->fi_str, ip->fi_arg, &stack[sp], TRUE,
+              FALSE) == FAIL)
+        goto fail;
+      ++sp;
+      break;
+
+    case FI_EVAL:
+      text = func_get_text(ip, &tofree);
+      error = eval0(text, &stack[sp], NULL, TRUE);
+      free(tofree);
+      if (error == FAIL) {
+        report = FALSE;             /* eval0() did that */
+        goto fail;
+      }
+      ++sp;
+      break;
+
+    case FI_EVAL7:
+      text = func_get_text(ip, &tofree);
+      error = eval7(&text, &stack[sp], TRUE, ip->fi_flags & FIF_STRING);
+      if (error == OK && *text != NUL) {
+        clear_tv(&stack[sp]);
+        error = FAIL;
+      }
+      free(tofree);
+      if (error == FAIL)
+        goto fail;
+      ++sp;
+      break;
+
+    case FI_LEADER:
+      if (eval7_leader(&stack[sp - 1], ip->fi_str,
+              ip->fi_str + ip->fi_arg) == FAIL) {
+        --sp;
+        goto fail;
+      }
+      break;
+
+    case FI_STRCHK:
+      if (eval_addsub_check(&stack[sp - 1], ip->fi_arg) == FAIL) {
+        --sp;
+        goto fail;
+      }
+      break;
+
+    case FI_NUMCHK:
+      if (eval_muldiv_check(&stack[sp - 1]) == FAIL) {
+        --sp;
+        goto fail;
+      }
+      break;
+
+    case FI_ADDSUB:
+    case FI_MULDIV:
+      --sp;
+      if ((ip->fi_op == FI_ADDSUB
+           ? eval_addsub(&stack[sp - 1], &stack[sp], ip->fi_arg)
+           : eval_muldiv(&stack[sp - 1], &stack[sp], ip->fi_arg)) == FAIL) {
+        --sp;
+        goto fail;
+      }
+      break;
+
+    case FI_COMPARE:
+      --sp;
+      if (typval_compare(&stack[sp - 1], &stack[sp], (exptype_T)ip->fi_arg,
+              (ip->fi_flags & FIF_IS) != 0,
+              ip->fi_nr < 0 ? p_ic : (int)ip->fi_nr) == FAIL) {
+        --sp;
+        goto fail;
+      }
+      break;
+
+    case FI_JUMP:
+      pc = ip->fi_jump;
+      break;
+
+    case FI_JUMP_TRUE:
+    case FI_JUMP_FALSE:
+    case FI_TEST:
+    case FI_COND:
+      error = FALSE;
+      n = get_tv_number_chk(&stack[--sp], &error);
+      clear_tv(&stack[sp]);
+      if (error) {
+        /* eval_to_bool() doesn't report an invalid expression */
+        if (ip->fi_op == FI_COND)
+          report = FALSE;
+        goto fail;
+      }
+      if (ip->fi_op == FI_JUMP_TRUE || ip->fi_op == FI_JUMP_FALSE) {
+        if ((n != 0) == (ip->fi_op == FI_JUMP_TRUE)) {
+          stack[sp].v_type = VAR_NUMBER;
+          stack[sp].v_lock = 0;
+          stack[sp++].vval.v_number = n != 0;
+          pc = ip->fi_jump;
+        }
+      } else if (n == 0)
+        pc = ip->fi_jump;
+      break;
+
+    case FI_FUNC:
+    {
+      int len = ip->fi_arg;
+
+      /* If it is the name of a variable of type VAR_FUNC use its
+       * contents. */
+      text = deref_func_name(ip->fi_str, &len, FALSE);
+      calls[ncalls].fpc_name = vim_strnsave(text, len);
+      /* The name of a function is followed by the arguments in the
+       * message, like get_func_tv() does. */
+      calls[ncalls].fpc_errname = text == ip->fi_str
+                                  ? ip->fi_text : calls[ncalls].fpc_name;
+      calls[ncalls++].fpc_lnum = curwin->w_cursor.lnum;
+      break;
+    }
+
+    case FI_CALL:
+    {
+      funcpending_T *call = &calls[--ncalls];
+      int doesrange;
+
+      tv.v_type = VAR_UNKNOWN;
+      error = call_func(call->fpc_name, (int)STRLEN(call->fpc_name), &tv,
+          ip->fi_arg, &stack[sp - ip->fi_arg],
+          call->fpc_lnum, call->fpc_lnum, &doesrange, TRUE, NULL);
+      for (int i = 0; i < ip->fi_arg; ++i)
+        clear_tv(&stack[--sp]);
+      free(call->fpc_name);
+      /* Make aborting() reliable for an error in the called function, like
+       * get_func_tv() does.  The error path of ":return" depends on it. */
+      update_force_abort();
+
+      /* Stop the expression evaluation when immediately aborting on
+       * error, or when an interrupt occurred or an exception was thrown
+       * but not caught. */
+      if (aborting()) {
+        if (error == OK)
+          clear_tv(&tv);
+        goto fail;
+      }
+      if (error == FAIL)
+        goto fail;
+      stack[sp++] = tv;
+      break;
+    }
+
+    case FI_STORE:
+      tv = stack[--sp];
+      hi = hash_lookup(&fc->l_vars.dv_hashtab, ip->fi_name, ip->fi_hash);
+      di = HASHITEM_EMPTY(hi) ? NULL : HI2DI(hi);
+      /* Assign to an existing variable of the same type directly, what
+       * set_var() would do. */
+      if (di != NULL && di->di_flags == 0 && di->di_tv.v_lock == 0
+          && di->di_tv.v_type == tv.v_type && tv.v_type != VAR_FUNC) {
+        if (ip->fi_arg == '=') {
+          clear_tv(&di->di_tv);
+          di->di_tv = tv;
+          di->di_tv.v_lock = 0;
+          break;
+        }
+        if (tv.v_type == VAR_NUMBER && ip->fi_arg != '.') {
+          if (ip->fi_arg == '+')
+            di->di_tv.vval.v_number += tv.vval.v_number;
+          else
+            di->di_tv.vval.v_number -= tv.vval.v_number;
+          break;
+        }
+      }
+    /* FALLTHROUGH */
+    case FI_LET:
+      if (ip->fi_op == FI_LET)
+        tv = stack[--sp];
+      op[0] = (char_u)ip->fi_arg;
+      op[1] = NUL;
+      text = func_get_text(ip, &tofree);
+      (void)ex_let_vars(text, &tv, FALSE,
+          (ip->fi_flags & FIF_SEMICOLON) != 0,
+          ip->fi_op == FI_LET ? (int)ip->fi_nr : 1, op);
+      clear_tv(&tv);
+      free(tofree);
+      break;
+
+    case FI_CALLCMD:
+    {
+      exarg_T ea;
+
+      memset(&ea, 0, sizeof(ea));
+      ea.cmdidx = CMD_call;
+      ea.arg = func_get_text(ip, &tofree);
+      ea.line1 = curwin->w_cursor.lnum;
+      ea.line2 = curwin->w_cursor.lnum;
+      ex_call(&ea);
+      free(tofree);
+      break;
+    }
+
+    case FI_RETURN:
+      if (ip->fi_flags & FIF_VALUE) {
+        fc->returned = TRUE;
+        clear_tv(fc->rettv);
+        *fc->rettv = stack[--sp];
+      }
+      /* It's safer to return also on error, unless the expression
+       * evaluation has been cancelled. */
+      else {
+        update_force_abort();
+        if (!aborting())
+          fc->returned = TRUE;
+      }
+      pc = code->fcd_len - 1;           /* FI_END */
+      break;
+
+    case FI_FOR:
+      text = func_get_text(ip, &tofree);
+      fis[ip->fi_arg] = eval_for_line(text, &error, NULL, FALSE);
+      free(tofree);
+      if (error) {
+        free_for_info(fis[ip->fi_arg]);
+        fis[ip->fi_arg] = NULL;
+      }
+      break;
+
+    case FI_NEXT:
+      if (fis[ip->fi_arg] != NULL) {
+        text = func_get_text(ip, &tofree);
+        error = !next_for_item(fis[ip->fi_arg], text);
+        free(tofree);
+      } else
+        error = TRUE;
+      if (error) {
+        free_for_info(fis[ip->fi_arg]);
+        fis[ip->fi_arg] = NULL;
+        pc = ip->fi_jump;
+      }
+      break;
+
+    case FI_ENDFOR:
+      free_for_info(fis[ip->fi_arg]);
+      fis[ip->fi_arg] = NULL;
+      break;
+
+    case FI_LOOP:
+      line_breakcheck();                /* check if CTRL-C typed */
+      pc = ip->fi_jump;
+      break;
+    }
+    continue;
+
+fail:
+    /* The expression of the command failed: drop the values and report
+     * like get_func_tv() and eval0() do, continue with the next command. */
+    while (sp > 0)
+      clear_tv(&stack[--sp]);
+    while (ncalls > 0) {
+      --ncalls;
+      if (!aborting())
+        emsg_funcname(N_("E116: Invalid arguments for function %s"),
+            calls[ncalls].fpc_errname);
+      free(calls[ncalls].fpc_name);
+    }
+    if (report && stmt->fi_text != NULL && !aborting())
+      EMSG2(_(e_invexpr2), stmt->fi_text);
+    pc = stmt->fi_jump;
+  }
+
+done:
+  for (int i = 0; i < CSTACK_LEN; ++i)
+    free_for_info(fis[i]);
+
+  do_errthrow(NULL, (char_u *)"endfunction");
+  /* On an interrupt or an aborting error disable the conversion of errors
+   * to exceptions. */
+  if (trylevel == 0 && (got_int || (did_emsg && force_abort)))
+    suppress_errthrow = TRUE;
+  if (did_throw)
+    need_rethrow = TRUE;
+  if (ex_nesting_level > fc->level + 1) {
+    if (!did_throw)
+      check_cstack = TRUE;
+  } else {
+    /* When leaving a function, reduce nesting level. */
+    --ex_nesting_level;
+    /* Go to debug mode when returning from a function in which we are
+     * single-stepping. */
+    if (ex_nesting_level + 1 <= debug_break_level)
+      do_debug((char_u *)_("End of function"));
+  }
+  msg_list = saved_msg_list;
+}
+
+/*
+ * Free the compiled code of a function.
+ */
+static void func_code_free(funccode_T *code)
+{
+  if (code == NULL)
+    return;
+  for (int i = 0; i < code->fcd_len; ++i) {
+    free(code->fcd_instr[i].fi_str);
+    free(code->fcd_instr[i].fi_name);
+  }
+  free(code->fcd_instr);
+  free(code);
+}
+
 /*
  * Return TRUE if items in "fc" do not have "copyID".  That means they are not
  * referenced from anywhere that is in use.
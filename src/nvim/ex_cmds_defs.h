@@ -749,6 +749,8 @@ enum CMD_index
       BANG|TRLBAR|CMDWIN),
   EX(CMD_registers,       "registers",    ex_display,
       EXTRA|NOTRLCOM|TRLBAR|CMDWIN),
+  EX(CMD_regtime,         "regtime",      ex_regtime,
+      NEEDARG|WORD1|TRLBAR|CMDWIN),
   EX(CMD_resize,          "resize",       ex_resize,
       RANGE|NOTADR|TRLBAR|WORD1),
   EX(CMD_retab,           "retab",        ex_retab,
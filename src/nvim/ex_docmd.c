@@ -1385,6 +1385,8 @@ static char_u * do_one_cmd(char_u **cmdlinep,
     if (lnum == MAXLNUM) {
       if (*ea.cmd == '%') {                 /* '%' - all lines */
         ++ea.cmd;
+        if (!ea.skip)
+          readfile_bg_wait(curbuf);
         ea.line1 = 1;
         ea.line2 = curbuf->b_ml.ml_line_count;
         ++ea.addr_count;
@@ -1719,6 +1721,8 @@ static char_u * do_one_cmd(char_u **cmdlinep,
   }
 
   if ((ea.argt & DFLALL) && ea.addr_count == 0) {
+    if (!ea.skip)
+      readfile_bg_wait(curbuf);
     ea.line1 = 1;
     ea.line2 = curbuf->b_ml.ml_line_count;
   }
@@ -3067,6 +3071,10 @@ set_one_cmd_context (
     xp->xp_context = EXPAND_SYNTIME;
     xp->xp_pattern = arg;
     break;
+  case CMD_regtime:
+    xp->xp_context = EXPAND_REGTIME;
+    xp->xp_pattern = arg;
+    break;
 
 
   default:
@@ -3149,6 +3157,8 @@ get_address (
 
     case '$':                               /* '$' - last line */
       ++cmd;
+      if (!skip)
+        readfile_bg_wait(curbuf);
       lnum = curbuf->b_ml.ml_line_count;
       break;
 
@@ -4241,6 +4251,7 @@ static struct {
   {EXPAND_MENUS, "menu"},
   {EXPAND_OWNSYNTAX, "syntax"},
   {EXPAND_SYNTIME, "syntime"},
+  {EXPAND_REGTIME, "regtime"},
   {EXPAND_SETTINGS, "option"},
   {EXPAND_SHELLCMD, "shellcmd"},
   {EXPAND_SIGN, "sign"},
@@ -3716,6 +3716,7 @@ ExpandFromContext (
       {EXPAND_MENUNAMES, get_menu_names, FALSE, TRUE},
       {EXPAND_SYNTAX, get_syntax_name, TRUE, TRUE},
       {EXPAND_SYNTIME, get_syntime_arg, TRUE, TRUE},
+      {EXPAND_REGTIME, get_regtime_arg, TRUE, TRUE},
       {EXPAND_HIGHLIGHT, get_highlight_name, TRUE, TRUE},
       {EXPAND_EVENTS, get_event_name, TRUE, TRUE},
       {EXPAND_AUGROUP, get_augroup_name, TRUE, TRUE},
@@ -21,6 +21,7 @@
 #include "nvim/edit.h"
 #include "nvim/eval.h"
 #include "nvim/ex_cmds.h"
+#include "nvim/ex_cmds2.h"
 #include "nvim/ex_docmd.h"
 #include "nvim/ex_eval.h"
 #include "nvim/fold.h"
@@ -50,6 +51,7 @@
 #include "nvim/undo.h"
 #include "nvim/window.h"
 #include "nvim/os/os.h"
+#include "nvim/os/rstream.h"
 
 #if defined(HAVE_UTIME) && defined(HAVE_UTIME_H)
 # include <utime.h>             /* for struct utimbuf */
@@ -173,6 +175,29 @@ struct bw_info {
 # endif
 };
 
+/* Number of bytes read at once by readfile_bg(). */
+#define BGREAD_SIZE     0x100000
+
+/*
+ * State of a file that is read into a buffer in the background, see
+ * readfile_bg().
+ */
+struct bgread {
+  buf_T       *buf;             /* buffer receiving the text */
+  RStream     *rstream;         /* reads the rest of the file or NULL */
+  int fd;                       /* duplicate of the file descriptor or -1 */
+  int set_options;              /* reset 'eol' for an incomplete last line */
+  int check_utf8;               /* lines must be valid UTF-8 */
+  int illegal;                  /* TRUE when an illegal byte was found */
+  off_t size;                   /* size of the file when reading started */
+  off_t offset;                 /* nr of bytes added to the buffer */
+  linenr_T lnum;                /* last line added to the buffer */
+  char_u      *chunk;           /* BGREAD_SIZE bytes for reading */
+  char_u      *line;            /* incomplete line at the end of a chunk */
+  size_t line_len;              /* length of "line" */
+  size_t line_size;             /* allocated size of "line" */
+};
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "fileio.c.generated.h"
 #endif
@@ -293,6 +318,8 @@ readfile (
   int msg_save = msg_scroll;
   linenr_T read_no_eol_lnum = 0;        /* non-zero lnum when last line of
                                         * last read was missing the eol */
+  int bg_read = FALSE;                  /* rest of the file is read in the
+                                           background */
   int try_mac = (vim_strchr(p_ffs, 'm') != NULL);
   int try_dos = (vim_strchr(p_ffs, 'd') != NULL);
   int try_unix = (vim_strchr(p_ffs, 'x') != NULL);
@@ -996,6 +1023,68 @@ retry:
       sha256_start(&sha_ctx);
   }
 
+  /*
+   * A big file may be used through a read-only mapping instead of copying
+   * it into the buffer, when 'mmapsize' is set, or it may be read in the
+   * background when 'bgreadsize' is set.  Only when the whole file is read
+   * into an empty buffer and its text can be used as-is: no conversion, no
+   * BOM, Unix line endings and for UTF-8 no illegal bytes.  The checks are
+   * the same as when reading the file below, also after "ucs-bom" found no
+   * BOM and the bytes that were read are to be used again.
+   */
+  if ((p_mms > 0 || p_brs > 0)
+      && newfile
+      && wasempty
+      && from == 0
+      && (!skip_read || filesize == 0)
+      && !filtering
+      && !read_stdin
+      && !read_buffer
+      && !read_undo_file
+      && !(flags & (READ_DUMMY | READ_NOFAST))
+      && lines_to_skip == 0
+      && lines_to_read == MAXLNUM
+      && !converted
+      && (fileformat == EOL_UNKNOWN || fileformat == EOL_UNIX)) {
+    int check_utf8 = (enc_utf8 && !curbuf->b_p_bin);
+    int read_as_is = FALSE;
+    long min_kbyte = (p_mms > 0 && (p_brs <= 0 || p_mms < p_brs))
+                     ? p_mms : p_brs;
+    off_t plain_size;
+
+    if (readfile_check_plain(fd, min_kbyte, fileformat, try_dos, try_mac,
+            try_unix, &plain_size) == FAIL) {
+      /* read it below */
+    } else if (p_mms > 0
+               && readfile_mmap(fd, plain_size, check_utf8) == OK) {
+      filesize = plain_size;
+      /* The lines after the first region are counted later, like when
+       * reading in the background. */
+      if (ml_mmap_no_eol(curbuf) && set_options)
+        curbuf->b_p_eol = FALSE;
+      read_no_eol_lnum = curbuf->b_no_eol_lnum;
+      bg_read = ml_mmap_counting(curbuf);
+      read_as_is = TRUE;
+    } else if (p_brs > 0
+               && readfile_bg(fd, plain_size, check_utf8, set_options,
+                   &filesize) == OK) {
+      /* 'eol' was reset already when the whole file was read. */
+      read_no_eol_lnum = curbuf->b_no_eol_lnum;
+      bg_read = (curbuf->b_bgread != NULL);
+      read_as_is = TRUE;
+    }
+
+    if (read_as_is) {
+      fileformat = EOL_UNIX;
+      if (set_options)
+        set_fileformat(EOL_UNIX, OPT_LOCAL);
+      /* No empty line to delete, all lines were added. */
+      wasempty = FALSE;
+      linecnt = 0;
+      goto failed;
+    }
+  }
+
   while (!error && !got_int) {
     /*
      * We allocate as much space for the file as we can get, plus
@@ -1560,46 +1649,7 @@ rewind_retry:
        * when reading the first part of a file: guess EOL type
        */
       if (fileformat == EOL_UNKNOWN) {
-        /* First try finding a NL, for Dos and Unix */
-        if (try_dos || try_unix) {
-          for (p = ptr; p < ptr + size; ++p) {
-            if (*p == NL) {
-              if (!try_unix
-                  || (try_dos && p > ptr && p[-1] == CAR))
-                fileformat = EOL_DOS;
-              else
-                fileformat = EOL_UNIX;
-              break;
-            }
-          }
-
-          /* Don't give in to EOL_UNIX if EOL_MAC is more likely */
-          if (fileformat == EOL_UNIX && try_mac) {
-            /* Need to reset the counters when retrying fenc. */
-            try_mac = 1;
-            try_unix = 1;
-            for (; p >= ptr && *p != CAR; p--)
-              ;
-            if (p >= ptr) {
-              for (p = ptr; p < ptr + size; ++p) {
-                if (*p == NL)
-                  try_unix++;
-                else if (*p == CAR)
-                  try_mac++;
-              }
-              if (try_mac > try_unix)
-                fileformat = EOL_MAC;
-            }
-          }
-        }
-
-        /* No NL found: may use Mac format */
-        if (fileformat == EOL_UNKNOWN && try_mac)
-          fileformat = EOL_MAC;
-
-        /* Still nothing found?  Use first format in 'ffs' */
-        if (fileformat == EOL_UNKNOWN)
-          fileformat = default_fileformat();
+        fileformat = readfile_guess_ff(ptr, size, try_dos, try_mac, try_unix);
 
         // May set 'p_ff' if editing a new file.
         if (set_options) {
@@ -1886,6 +1936,10 @@ failed:
         STRCAT(IObuff, _("[READ ERRORS]"));
         c = TRUE;
       }
+      if (bg_read) {
+        STRCAT(IObuff, _("[loading]"));
+        c = TRUE;
+      }
       if (msg_add_fileformat(fileformat))
         c = TRUE;
         msg_add_lines(c, (long)linecnt, filesize);
@@ -1980,6 +2034,9 @@ failed:
      * output was done.
      */
     msg_scroll = TRUE;
+    /* The autocommands must see all lines of the file. */
+    if (bg_read && has_autocmd(EVENT_BUFREADPOST, sfname, curbuf))
+      readfile_bg_wait(curbuf);
     if (filtering)
       apply_autocmds_exarg(EVENT_FILTERREADPOST, NULL, sfname,
           FALSE, curbuf, eap);
@@ -2307,6 +2364,12 @@ buf_write (
 
   if (fname == NULL || *fname == NUL)   /* safety check */
     return FAIL;
+  /* Writing up to the last line includes the lines that are still being
+   * read in the background. */
+  if (readfile_bg_reading(buf) && end == buf->b_ml.ml_line_count) {
+    readfile_bg_wait(buf);
+    end = old_line_count = buf->b_ml.ml_line_count;
+  }
   if (buf->b_ml.ml_mfp == NULL) {
     /* This can happen during startup when there is a stray "w" in the
      * vimrc file. */
@@ -3189,7 +3252,11 @@ nobackup:
    * a new one. If this still fails we may have lost the original file!
    * (this may happen when the user reached his quotum for number of files).
    * Appending will fail if the file does not exist and forceit is FALSE.
+   * A buffer that uses a mapping of the file needs its lines before the
+   * file is truncated.
    */
+  if (!append)
+    ml_mmap_unmap_file(wfname);
   while ((fd = mch_open((char *)wfname, O_WRONLY | (append
                                                               ? (forceit ? (
                                                                    O_APPEND |
@@ -4274,6 +4341,487 @@ static int get_fio_flags(char_u *ptr)
 
 
 
+/*
+ * Guess the format of a file from the first "size" bytes of its text at
+ * "ptr".  "try_dos", "try_mac" and "try_unix" tell which formats may be
+ * used, see 'fileformats'.
+ */
+static int readfile_guess_ff(char_u *ptr, long size, int try_dos,
+                             int try_mac, int try_unix)
+{
+  int fileformat = EOL_UNKNOWN;
+  char_u      *p;
+
+  /* First try finding a NL, for Dos and Unix */
+  if (try_dos || try_unix) {
+    for (p = ptr; p < ptr + size; ++p) {
+      if (*p == NL) {
+        if (!try_unix
+            || (try_dos && p > ptr && p[-1] == CAR))
+          fileformat = EOL_DOS;
+        else
+          fileformat = EOL_UNIX;
+        break;
+      }
+    }
+
+    /* Don't give in to EOL_UNIX if EOL_MAC is more likely */
+    if (fileformat == EOL_UNIX && try_mac) {
+      /* Count the line breaks of each kind. */
+      try_mac = 1;
+      try_unix = 1;
+      for (; p >= ptr && *p != CAR; p--)
+        ;
+      if (p >= ptr) {
+        for (p = ptr; p < ptr + size; ++p) {
+          if (*p == NL)
+            try_unix++;
+          else if (*p == CAR)
+            try_mac++;
+        }
+        if (try_mac > try_unix)
+          fileformat = EOL_MAC;
+      }
+    }
+  }
+
+  /* No NL found: may use Mac format */
+  if (fileformat == EOL_UNKNOWN && try_mac)
+    fileformat = EOL_MAC;
+
+  /* Still nothing found?  Use first format in 'ffs' */
+  if (fileformat == EOL_UNKNOWN)
+    fileformat = default_fileformat();
+
+  return fileformat;
+}
+
+#define PLAIN_CHECK_SIZE 0x10000        /* what readfile() reads first */
+
+/*
+ * Check if the text of "fd" can be used as-is: a regular file of at least
+ * "min_kbyte" Kbyte without a BOM, in Unix format.  When "fileformat" is
+ * EOL_UNKNOWN the format is guessed from the start of the file, as
+ * readfile() does.  The file position is not changed.
+ * Sets "*sizep" to the size of the file.
+ */
+static int readfile_check_plain(int fd, long min_kbyte, int fileformat,
+                                int try_dos, int try_mac, int try_unix,
+                                off_t *sizep)
+{
+  FileInfo file_info;
+  char_u      *first;
+  off_t pos;
+  long len;
+  int blen;
+  int retval = FAIL;
+
+  if (!os_get_file_info_fd(fd, &file_info)
+      || !S_ISREG(file_info.stat.st_mode)
+      || file_info.stat.st_size < (uint64_t)min_kbyte * 1024)
+    return FAIL;
+
+  pos = lseek(fd, (off_t)0L, SEEK_CUR);
+  if (pos < 0 || lseek(fd, (off_t)0L, SEEK_SET) != 0)
+    return FAIL;
+  first = xmalloc(PLAIN_CHECK_SIZE);
+  len = read_eintr(fd, first, PLAIN_CHECK_SIZE);
+  if (len > 0
+      && (len < 2 || check_for_bom(first, len, &blen, FIO_ALL) == NULL)
+      && (fileformat == EOL_UNIX
+          || readfile_guess_ff(first, len, try_dos, try_mac, try_unix)
+          == EOL_UNIX)) {
+    *sizep = (off_t)file_info.stat.st_size;
+    retval = OK;
+  }
+  free(first);
+  if (lseek(fd, pos, SEEK_SET) != pos)
+    retval = FAIL;
+  return retval;
+}
+
+/*
+ * Try to use a read-only mapping of "fd", which has "size" bytes, as the
+ * text of the current buffer instead of reading it, see ml_open_mmap().
+ * Only for files of at least 'mmapsize' Kbyte.  When "check_utf8" is TRUE
+ * the text must be valid UTF-8.
+ * Returns FAIL when the file was not mapped.
+ */
+static int readfile_mmap(int fd, off_t size, int check_utf8)
+{
+  if (size < (off_t)p_mms * 1024
+      || (off_t)(size_t)size != size
+      || ml_open_mmap(curbuf, fd, (size_t)size, check_utf8) == FAIL)
+    return FAIL;
+  return OK;
+}
+
+/*
+ * Read the text of "fd" into the current buffer, which must be empty, as
+ * readfile() does for a file in Unix format without conversion.  For a file
+ * of at least 'bgreadsize' Kbyte only the first screenful of lines is read
+ * right away, the rest is appended while waiting for the user to type (see
+ * bgread_cb()).  Commands that need all lines call readfile_bg_wait().
+ * "size" is the size of the file.  When "check_utf8" is TRUE the text must
+ * be valid UTF-8, this is checked for each line that is added.  When an
+ * illegal byte is found later the file is read again, see
+ * readfile_reread().
+ * Sets "*sizep" to the number of bytes that were read.
+ * Returns FAIL when the file must be read the usual way.
+ */
+static int readfile_bg(int fd, off_t size, int check_utf8, int set_options,
+                       off_t *sizep)
+{
+  struct bgread *r;
+  off_t pos;
+  long n = 0;
+
+  if (size < (off_t)p_brs * 1024
+      || (pos = lseek(fd, (off_t)0L, SEEK_CUR)) < 0
+      || lseek(fd, (off_t)0L, SEEK_SET) != 0)
+    return FAIL;
+
+  r = xcalloc(1, sizeof(struct bgread));
+  r->buf = curbuf;
+  r->fd = -1;
+  r->set_options = set_options;
+  r->check_utf8 = check_utf8;
+  r->size = size;
+  r->chunk = xmalloc(BGREAD_SIZE);
+  curbuf->b_no_eol_lnum = 0;
+
+  /* The lines for the first screen are needed right away.  They are added
+   * above the empty line of the buffer. */
+  while (r->lnum < Rows && !r->illegal
+         && (n = read_eintr(fd, r->chunk, BGREAD_SIZE)) > 0)
+    bgread_add(r, r->chunk, (size_t)n);
+
+  if (n > 0 && !r->illegal) {
+    /* Reading continues at the current position, using another file
+     * descriptor because "fd" is closed by readfile(). */
+    r->fd = dup(fd);
+    if (r->fd < 0)
+      bgread_rest(r, fd);
+  }
+  if (r->fd < 0)
+    bgread_last(r);
+
+  /* Read the file the usual way for an illegal byte, to try another
+   * encoding or report it.  Delete the lines that were added. */
+  if (r->illegal) {
+    while (r->lnum > 0)
+      ml_delete(r->lnum--, FALSE);
+    curbuf->b_ml.ml_flags |= ML_EMPTY;
+    bgread_free(r);
+    (void)lseek(fd, pos, SEEK_SET);
+    return FAIL;
+  }
+
+  *sizep = r->offset;
+  if (r->fd < 0) {
+    (void)bgread_finish(r);
+    r = NULL;
+  }
+
+  /* Delete the empty line, which comes after the lines that were added. */
+  if (!(curbuf->b_ml.ml_flags & ML_EMPTY))
+    ml_delete(curbuf->b_ml.ml_line_count, FALSE);
+
+  if (r != NULL) {
+    r->rstream = rstream_new(bgread_cb, BGREAD_SIZE, r, true);
+    rstream_set_file(r->rstream, r->fd);
+    rstream_set_file_offset(r->rstream, (size_t)r->offset);
+    rstream_start(r->rstream);
+    curbuf->b_bgread = r;
+  }
+  return OK;
+}
+
+/*
+ * Return TRUE when not all lines of "buf" were added yet, because the file
+ * is read in the background or the lines of a mapped file are counted.
+ */
+int readfile_bg_reading(buf_T *buf)
+{
+  return buf->b_bgread != NULL || ml_mmap_counting(buf);
+}
+
+/*
+ * Add all lines that are still to be read when the text of "buf" is read in
+ * the background, for a command that needs all of them.  Also counts all
+ * lines of a mapped file.
+ */
+void readfile_bg_wait(buf_T *buf)
+{
+  struct bgread *r = buf->b_bgread;
+  linenr_T old_count = buf->b_ml.ml_line_count;
+  size_t n;
+
+  if (ml_mmap_counting(buf) && ml_mmap_count(buf, 0) == FAIL)
+    readfile_reread(buf);
+  if (r == NULL)
+    return;
+  buf->b_bgread = NULL;
+
+  /* First the text that was read already, then the rest of the file. */
+  rstream_stop(r->rstream);
+  while ((n = rstream_read(r->rstream, (char *)r->chunk, BGREAD_SIZE)) > 0)
+    bgread_add(r, r->chunk, n);
+  if (lseek(r->fd, r->offset, SEEK_SET) == r->offset)
+    bgread_rest(r, r->fd);
+  if (bgread_finish(r) == FAIL)
+    readfile_reread(buf);
+  else
+    readfile_bg_added(buf, old_count);
+}
+
+/*
+ * Count the lines of mapped files that were not counted yet, for about "ms"
+ * msec while waiting for the user to type.
+ * Returns TRUE when there is more to do.
+ */
+int readfile_bg_idle(long ms)
+{
+  proftime_T tm;
+  buf_T       *buf;
+
+  /* Not halfway a command, a buffer may be read again. */
+  if (updating_screen || starting || State == HITRETURN || State == ASKMORE
+      || State == CONFIRM || State == EXTERNCMD)
+    return FALSE;
+
+  profile_setlimit(ms, &tm);
+  for (buf = firstbuf; buf != NULL; buf = buf->b_next) {
+    while (ml_mmap_counting(buf)) {
+      if (profile_passed_limit(&tm))
+        return TRUE;
+      if (ml_mmap_count(buf, BGREAD_SIZE) == FAIL)
+        readfile_reread(buf);
+    }
+  }
+  return FALSE;
+}
+
+/*
+ * Read the file of "buf" again the usual way, after an illegal byte was
+ * found in the text that was used as-is.  Only its lines are replaced, this
+ * is not a change and no autocommands are triggered.
+ */
+static void readfile_reread(buf_T *buf)
+{
+  aco_save_T aco;
+  win_T       *wp;
+
+  aucmd_prepbuf(&aco, buf);
+  ml_close(curbuf, TRUE);
+  if (ml_open(curbuf) == OK) {
+    block_autocmds();
+    ++msg_silent;
+    keep_filetype = TRUE;
+    (void)readfile(curbuf->b_ffname, curbuf->b_fname, (linenr_T)0,
+        (linenr_T)0, (linenr_T)MAXLNUM, NULL, READ_NEW | READ_NOFAST);
+    keep_filetype = FALSE;
+    --msg_silent;
+    unblock_autocmds();
+  }
+  FOR_ALL_WINDOWS(wp)
+  {
+    if (wp->w_buffer == curbuf) {
+      if (wp->w_cursor.lnum > curbuf->b_ml.ml_line_count)
+        wp->w_cursor.lnum = curbuf->b_ml.ml_line_count;
+      if (wp->w_topline > curbuf->b_ml.ml_line_count)
+        wp->w_topline = curbuf->b_ml.ml_line_count;
+    }
+  }
+  ++curbuf->b_changedtick;
+  redraw_buf_later(curbuf, NOT_VALID);
+  aucmd_restbuf(&aco);
+}
+
+/*
+ * Stop reading the text of "buf" in the background, when its lines are
+ * freed.
+ */
+void readfile_bg_stop(buf_T *buf)
+{
+  if (buf->b_bgread != NULL) {
+    bgread_free(buf->b_bgread);
+    buf->b_bgread = NULL;
+  }
+}
+
+/*
+ * Called when more of the file that is read in the background is available.
+ */
+static void bgread_cb(RStream *rstream, void *data, bool eof)
+{
+  struct bgread *r = data;
+  buf_T *buf = r->buf;
+  linenr_T old_count = buf->b_ml.ml_line_count;
+  size_t n;
+
+  /* Adding the lines is not a change, don't wait for the rest. */
+  buf->b_bgread = NULL;
+  while ((n = rstream_read(rstream, (char *)r->chunk, BGREAD_SIZE)) > 0)
+    bgread_add(r, r->chunk, n);
+  if (r->illegal) {
+    bgread_free(r);
+    readfile_reread(buf);
+    return;
+  }
+  if (!eof)
+    buf->b_bgread = r;
+  else if (bgread_finish(r) == FAIL) {
+    readfile_reread(buf);
+    return;
+  }
+  readfile_bg_added(buf, old_count);
+}
+
+/*
+ * Add the lines in "ptr[len]" to the buffer.  An incomplete line at the end
+ * is kept until the next call.  "ptr" is modified.  Nothing is added after
+ * an illegal byte was found.
+ */
+static void bgread_add(struct bgread *r, char_u *ptr, size_t len)
+{
+  char_u *end = ptr + len;
+  char_u *nl;
+
+  if (r->illegal)
+    return;
+  r->offset += (off_t)len;
+  while ((nl = memchr(ptr, NL, (size_t)(end - ptr))) != NULL) {
+    if (r->line_len > 0) {
+      bgread_keep(r, ptr, (size_t)(nl - ptr));
+      bgread_line(r, r->line, r->line_len);
+      r->line_len = 0;
+    } else {
+      bgread_line(r, ptr, (size_t)(nl - ptr));
+    }
+    ptr = nl + 1;
+  }
+  bgread_keep(r, ptr, (size_t)(end - ptr));
+}
+
+/*
+ * Append "ptr[len]" to the incomplete line.
+ */
+static void bgread_keep(struct bgread *r, char_u *ptr, size_t len)
+{
+  if (len == 0)
+    return;
+  if (r->line_len + len + 1 > r->line_size) {
+    r->line_size = (r->line_len + len + 1) * 2;
+    r->line = xrealloc(r->line, r->line_size);
+  }
+  memmove(r->line + r->line_len, ptr, len);
+  r->line_len += len;
+}
+
+/*
+ * Add the line "ptr[len]" after the last line that was added.  There must
+ * be room for a NUL after it.  When it must be valid UTF-8 and isn't, sets
+ * "r->illegal" instead.  A character is never split by a line break, an
+ * incomplete one at the end is illegal.
+ */
+static void bgread_line(struct bgread *r, char_u *ptr, size_t len)
+{
+  char_u *p = ptr;
+
+  if (r->illegal || (r->check_utf8 && utf_check_bytes(ptr, len) != 0)) {
+    r->illegal = TRUE;
+    return;
+  }
+
+  /* NULs are replaced by newlines, like readfile() does. */
+  while ((p = memchr(p, NUL, (size_t)(ptr + len - p))) != NULL)
+    *p++ = NL;
+  ptr[len] = NUL;
+  if (ml_append_buf(r->buf, r->lnum, ptr, (colnr_T)(len + 1), TRUE) == OK)
+    ++r->lnum;
+}
+
+/*
+ * Read the rest of the file from "fd" without waiting.
+ */
+static void bgread_rest(struct bgread *r, int fd)
+{
+  long n;
+
+  while (!r->illegal && (n = read_eintr(fd, r->chunk, BGREAD_SIZE)) > 0)
+    bgread_add(r, r->chunk, (size_t)n);
+}
+
+/*
+ * Add the incomplete last line, if any, when all of the file was read.
+ */
+static void bgread_last(struct bgread *r)
+{
+  buf_T *buf = r->buf;
+
+  if (r->line_len > 0) {
+    bgread_line(r, r->line, r->line_len);
+    r->line_len = 0;
+    if (r->illegal)
+      return;
+    buf->b_no_eol_lnum = r->lnum;
+    if (r->set_options)
+      buf->b_p_eol = buf->b_start_eol = FALSE;
+  }
+}
+
+/*
+ * Add the incomplete last line, if any, when all of the file was read and
+ * free "r".
+ * Returns FAIL when an illegal byte was found, the file must then be read
+ * again.
+ */
+static int bgread_finish(struct bgread *r)
+{
+  buf_T *buf = r->buf;
+  int illegal;
+
+  bgread_last(r);
+  illegal = r->illegal;
+  if (!illegal && r->offset < r->size)
+    EMSG2(_("E210: Error reading \"%s\""), buf->b_fname);
+  bgread_free(r);
+  return illegal ? FAIL : OK;
+}
+
+/*
+ * Free "r" and stop reading.
+ */
+static void bgread_free(struct bgread *r)
+{
+  if (r->rstream != NULL)
+    rstream_free(r->rstream);
+  if (r->fd >= 0)
+    close(r->fd);
+  free(r->chunk);
+  free(r->line);
+  free(r);
+}
+
+/*
+ * Called after lines were added to "buf", it had "old_count" lines before.
+ * Adding lines is not a change, but "b:changedtick" tells that the text is
+ * different.  Redraw the windows that show the end of "buf".
+ */
+void readfile_bg_added(buf_T *buf, linenr_T old_count)
+{
+  win_T *wp;
+
+  if (buf->b_ml.ml_line_count == old_count)
+    return;
+  ++buf->b_changedtick;
+  FOR_ALL_WINDOWS(wp) {
+    if (wp->w_buffer == buf && wp->w_botline > old_count)
+      redraw_win_later(wp, NOT_VALID);
+  }
+}
+
 /*
  * Check for a Unicode BOM (Byte Order Mark) at the start of p[size].
  * "size" must be at least 2.
@@ -7134,6 +7682,10 @@ int has_autocmd(event_T event, char_u *sfname, buf_T *buf)
   char_u      *tail = path_tail(sfname);
   int retval = FALSE;
 
+  /* Avoid expanding the file name when there is nothing to match with. */
+  if (first_autopat[(int)event] == NULL)
+    return FALSE;
+
   fname = FullName_save(sfname, FALSE);
   if (fname == NULL)
     return FALSE;
@@ -21,7 +21,7 @@
 /*
  * Number of Rows and Columns in the screen.
  * Must be long to be able to use them as options in option.c.
- * Note: Use screen_Rows and screen_Columns to access items in ScreenLines[].
+ * Note: Use screen_Rows and screen_Columns to access items in ScreenCells[].
  * They may have different values when the screen wasn't (re)allocated yet
  * after setting Rows or Columns (e.g., when starting up).
  */
@@ -33,37 +33,30 @@ EXTERN long Rows                        /* nr of rows in the screen */
 EXTERN long Columns INIT(= 80);         /* nr of columns in the screen */
 
 /*
- * The characters that are currently on the screen are kept in ScreenLines[].
- * It is a single block of characters, the size of the screen plus one line.
- * The attributes for those characters are kept in ScreenAttrs[].
+ * The characters that are currently on the screen are kept in ScreenCells[].
+ * It is a single block of cells, the size of the screen plus one line.  Each
+ * cell holds the character and its attributes.
  *
- * "LineOffset[n]" is the offset from ScreenLines[] for the start of line 'n'.
- * The same value is used for ScreenLinesUC[] and ScreenAttrs[].
+ * "LineOffset[n]" is the offset in ScreenCells[] for the start of line 'n'.
+ *
+ * sc_char is the character, for DBCS the first byte.  When the character
+ * occupies two display cells sc_char of the next cell is 0.
+ * When using Unicode characters (in UTF-8 encoding) sc_uc contains the
+ * Unicode for the character at this position, or NUL when the character in
+ * sc_char is to be used (ASCII char).
+ * The composing characters in sc_cc[] are to be drawn on top of the original
+ * character, they are only to be used when sc_uc != 0.
+ * sc_char2 is only used for euc-jp: Second byte of a character that starts
+ * with 0x8e.  These are single-width.
  *
  * Note: before the screen is initialized and when out of memory these can be
  * NULL.
  */
-EXTERN schar_T  *ScreenLines INIT(= NULL);
-EXTERN sattr_T  *ScreenAttrs INIT(= NULL);
+EXTERN screencell_T *ScreenCells INIT(= NULL);
 EXTERN unsigned *LineOffset INIT(= NULL);
 EXTERN char_u   *LineWraps INIT(= NULL);        /* line wraps to next line */
-
-/*
- * When using Unicode characters (in UTF-8 encoding) the character in
- * ScreenLinesUC[] contains the Unicode for the character at this position, or
- * NUL when the character in ScreenLines[] is to be used (ASCII char).
- * The composing characters are to be drawn on top of the original character.
- * ScreenLinesC[0][off] is only to be used when ScreenLinesUC[off] != 0.
- * Note: These three are only allocated when enc_utf8 is set!
- */
-EXTERN u8char_T *ScreenLinesUC INIT(= NULL);    /* decoded UTF-8 characters */
-EXTERN u8char_T *ScreenLinesC[MAX_MCO];         /* composing characters */
 EXTERN int Screen_mco INIT(= 0);                /* value of p_mco used when
-                                                   allocating ScreenLinesC[] */
-
-/* Only used for euc-jp: Second byte of a character that starts with 0x8e.
- * These are single-width. */
-EXTERN schar_T  *ScreenLines2 INIT(= NULL);
+                                                   allocating ScreenCells[] */
 
 /*
  * Indexes for tab page line:
@@ -74,8 +67,8 @@ EXTERN schar_T  *ScreenLines2 INIT(= NULL);
  */
 EXTERN short    *TabPageIdxs INIT(= NULL);
 
-EXTERN int screen_Rows INIT(= 0);           /* actual size of ScreenLines[] */
-EXTERN int screen_Columns INIT(= 0);        /* actual size of ScreenLines[] */
+EXTERN int screen_Rows INIT(= 0);           /* actual size of ScreenCells[] */
+EXTERN int screen_Columns INIT(= 0);        /* actual size of ScreenCells[] */
 
 /*
  * When vgetc() is called, it sets mod_mask to the set of modifiers that are
@@ -138,7 +131,7 @@ EXTERN int compl_cont_status INIT(= 0);
 
 /*
  * Functions for putting characters in the command line,
- * while keeping ScreenLines[] updated.
+ * while keeping ScreenCells[] updated.
  */
 EXTERN int cmdmsg_rl INIT(= FALSE);         /* cmdline is drawn right to left */
 EXTERN int msg_col;
@@ -0,0 +1,339 @@
+/// @file grid.c
+///
+/// Structured screen updates for remote UIs.
+///
+/// Channels that subscribe to "grid_line" receive the screen contents as RPC
+/// events instead of having to parse the terminal output. A copy of what was
+/// last sent is kept, each flush compares it with ScreenCells[] and sends the
+/// cells that changed:
+///
+///   grid_resize       [width, height]
+///   grid_attr_define  [[attr_id, {bold: .., foreground: .., ..}], ...]
+///   grid_line         [[row, col, cells], ...]
+///
+/// All three are sent to the channels that subscribed to "grid_line".
+/// "cells" is an array of [text], [text, attr_id] or [text, attr_id, repeat].
+/// The attribute id is left out when it is the same as for the previous cell
+/// of the line, "repeat" is used for runs of identical cells. The right half
+/// of a double-wide character has an empty text.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nvim/vim.h"
+#include "nvim/grid.h"
+#include "nvim/mbyte.h"
+#include "nvim/memory.h"
+#include "nvim/syntax.h"
+#include "nvim/api/private/defs.h"
+#include "nvim/api/private/helpers.h"
+#include "nvim/os/channel.h"
+#include "nvim/os/msgpack_rpc_helpers.h"
+
+/// State of the highlighting of an attribute id
+typedef enum {
+  kAttrUndefined = 0,
+  kAttrPending,   ///< Added to the attributes of the current flush
+  kAttrDefined,   ///< Sent to the subscribed channels
+} AttrState;
+
+/// Copy of the screen as it was last sent
+typedef struct {
+  int rows, columns;
+  screencell_T *cells;
+  bool valid;
+  // False when the subscribed channels need a grid_resize event
+  bool size_sent;
+  // Value of channel_subscription_tick() at the last flush, when the
+  // subscriptions change everything is sent again
+  uint64_t subscription_tick;
+  // AttrState of each attribute id
+  kvec_t(uint8_t) defined;
+} Grid;
+
+static Grid grid = {.cells = NULL};
+
+#ifdef INCLUDE_GENERATED_DECLARATIONS
+# include "grid.c.generated.h"
+#endif
+
+/// Sends the screen cells that changed since the last call to the subscribed
+/// channels. Called when a terminal output frame is complete.
+void grid_flush(void)
+{
+  static bool busy = false;
+
+  if (ScreenCells == NULL || busy
+      || !channel_subscriber_count(GRID_LINE_EVENT)) {
+    return;
+  }
+
+  busy = true;
+
+  if (grid.rows != screen_Rows
+      || grid.columns != screen_Columns
+      || grid.cells == NULL) {
+    grid_alloc();
+  } else if (grid.subscription_tick != channel_subscription_tick()) {
+    // A channel may have subscribed, it needs everything
+    grid_invalidate();
+    grid.size_sent = false;
+  }
+
+  grid.subscription_tick = channel_subscription_tick();
+
+  if (!grid.size_sent) {
+    Array size = ARRAY_DICT_INIT;
+    ADD(size, INTEGER_OBJ(grid.columns));
+    ADD(size, INTEGER_OBJ(grid.rows));
+    grid.size_sent = grid_send(GRID_RESIZE_EVENT, size);
+  }
+
+  Array attrs = ARRAY_DICT_INIT;
+  Array lines = ARRAY_DICT_INIT;
+
+  for (int row = 0; row < grid.rows; row++) {
+    grid_line(row, &lines, &attrs);
+  }
+
+  grid.valid = true;
+
+  bool sent = grid.size_sent;
+
+  if (attrs.size) {
+    // Lines that use the attributes are only sent after their definition
+    if (sent && grid_send(GRID_ATTR_EVENT, attrs)) {
+      grid_attrs_defined();
+    } else {
+      msgpack_rpc_free_array(attrs);
+      sent = false;
+    }
+  }
+
+  if (lines.size) {
+    if (sent) {
+      sent = grid_send(GRID_LINE_EVENT, lines);
+    } else {
+      msgpack_rpc_free_array(lines);
+    }
+  }
+
+  if (!sent) {
+    // Send everything again with the next flush
+    grid_invalidate();
+    grid.size_sent = false;
+  }
+
+  busy = false;
+}
+
+/// Forgets what was sent, the next flush sends all cells and attributes
+/// again. Called when the screen is cleared, highlighting may have changed.
+void grid_invalidate(void)
+{
+  grid.valid = false;
+  kv_size(grid.defined) = 0;
+}
+
+/// Sends a grid event to the channels that subscribed to "grid_line"
+///
+/// @return false if a channel didn't get the event
+static bool grid_send(char *name, Array arg)
+{
+  return channel_send_grouped_event(GRID_LINE_EVENT, name, ARRAY_OBJ(arg));
+}
+
+/// Marks the attributes added by the current flush as sent
+static void grid_attrs_defined(void)
+{
+  for (size_t i = 0; i < kv_size(grid.defined); i++) {
+    if (kv_A(grid.defined, i) == kAttrPending) {
+      kv_A(grid.defined, i) = kAttrDefined;
+    }
+  }
+}
+
+/// Adds the changed part of screen line `row` to `lines`, and the
+/// definitions of attributes it uses for the first time to `attrs`
+static void grid_line(int row, Array *lines, Array *attrs)
+{
+  unsigned off = LineOffset[row];
+  size_t goff = (size_t)row * (size_t)grid.columns;
+  int start = 0, end = grid.columns - 1;
+
+  if (grid.valid) {
+    while (start < grid.columns && grid_cell_equal(off + start, goff + start)) {
+      start++;
+    }
+
+    if (start == grid.columns) {
+      // Unchanged
+      return;
+    }
+
+    while (end > start && grid_cell_equal(off + end, goff + end)) {
+      end--;
+    }
+  }
+
+  // Don't split a double-wide character
+  if (start > 0 && ScreenCells[off + start].sc_char == 0) {
+    start--;
+  }
+
+  if (end < grid.columns - 1 && ScreenCells[off + end + 1].sc_char == 0) {
+    end++;
+  }
+
+  Array cells = ARRAY_DICT_INIT;
+  char_u prev_text[MB_MAXBYTES * (MAX_MCO + 1) + 1];
+  int prev_attr = -1, last_sent_attr = -1;
+  Array *prev = NULL;
+
+  for (int col = start; col <= end; col++) {
+    char_u text[MB_MAXBYTES * (MAX_MCO + 1) + 1];
+    // Invalid attributes are used to force a redraw, it follows later
+    int attr = ScreenCells[off + col].sc_attr == (sattr_T)-1
+               ? 0
+               : ScreenCells[off + col].sc_attr;
+
+    grid_cell_text(off + col, text);
+
+    if (prev != NULL && attr == prev_attr && !STRCMP(text, prev_text)) {
+      // Same as the previous cell, count it
+      if (prev->size < 3) {
+        ADD(*prev, INTEGER_OBJ(attr));
+        ADD(*prev, INTEGER_OBJ(2));
+      } else {
+        prev->items[2].data.integer++;
+      }
+    } else {
+      Array cell = ARRAY_DICT_INIT;
+      ADD(cell, STRING_OBJ(cstr_to_string((char *)text)));
+
+      if (attr != last_sent_attr) {
+        ADD(cell, INTEGER_OBJ(attr));
+        last_sent_attr = attr;
+        grid_define_attr(attr, attrs);
+      }
+
+      ADD(cells, ARRAY_OBJ(cell));
+      prev = &cells.items[cells.size - 1].data.array;
+      prev_attr = attr;
+      STRCPY(prev_text, text);
+    }
+
+    grid_cell_copy(off + col, goff + col);
+  }
+
+  Array line = ARRAY_DICT_INIT;
+  ADD(line, INTEGER_OBJ(row));
+  ADD(line, INTEGER_OBJ(start));
+  ADD(line, ARRAY_OBJ(cells));
+  ADD(*lines, ARRAY_OBJ(line));
+}
+
+/// Puts the text of the screen cell at `off` in `buf`
+static void grid_cell_text(unsigned off, char_u *buf)
+{
+  if (enc_utf8 && ScreenCells[off].sc_uc != 0) {
+    buf[utfc_char2bytes(off, buf)] = NUL;
+  } else if (ScreenCells[off].sc_char == 0) {
+    // right half of a double-wide character
+    *buf = NUL;
+  } else {
+    buf[0] = ScreenCells[off].sc_char;
+    buf[1] = NUL;
+    if (enc_dbcs == DBCS_JPNU && ScreenCells[off].sc_char == 0x8e) {
+      buf[1] = ScreenCells[off].sc_char2;
+      buf[2] = NUL;
+    }
+  }
+}
+
+/// Checks if screen cell `off` is the same as the cell `goff` that was sent
+static bool grid_cell_equal(unsigned off, size_t goff)
+{
+  const screencell_T *cell = &ScreenCells[off];
+  const screencell_T *sent = &grid.cells[goff];
+
+  if (memcmp(cell, sent, offsetof(screencell_T, sc_cc))) {
+    return false;
+  }
+
+  return cell->sc_uc == 0
+         || !memcmp(cell->sc_cc, sent->sc_cc,
+                    sizeof(u8char_T) * (size_t)Screen_mco);
+}
+
+static void grid_cell_copy(unsigned off, size_t goff)
+{
+  grid.cells[goff] = ScreenCells[off];
+}
+
+/// Adds the highlighting of `attr` to `attrs` if it wasn't sent yet
+static void grid_define_attr(int attr, Array *attrs)
+{
+  while (kv_size(grid.defined) <= (size_t)attr) {
+    kv_push(uint8_t, grid.defined, kAttrUndefined);
+  }
+
+  if (kv_A(grid.defined, attr) != kAttrUndefined) {
+    return;
+  }
+
+  // Defined when the attributes of the flush were sent
+  kv_A(grid.defined, attr) = kAttrPending;
+
+  int flags = attr;
+  Integer fg = -1, bg = -1;
+
+  if (attr > HL_ALL) {
+    attrentry_T *aep = t_colors > 1
+                       ? syn_cterm_attr2entry(attr)
+                       : syn_term_attr2entry(attr);
+    flags = aep != NULL ? aep->ae_attr : 0;
+    if (aep != NULL && t_colors > 1) {
+      // Color numbers are stored plus one, zero means not set
+      fg = (Integer)aep->ae_u.cterm.fg_color - 1;
+      bg = (Integer)aep->ae_u.cterm.bg_color - 1;
+    }
+  }
+
+  Dictionary hl = ARRAY_DICT_INIT;
+  PUT(hl, "bold", BOOLEAN_OBJ(flags & HL_BOLD));
+  PUT(hl, "italic", BOOLEAN_OBJ(flags & HL_ITALIC));
+  PUT(hl, "underline", BOOLEAN_OBJ(flags & HL_UNDERLINE));
+  PUT(hl, "undercurl", BOOLEAN_OBJ(flags & HL_UNDERCURL));
+  PUT(hl, "reverse", BOOLEAN_OBJ(flags & HL_INVERSE));
+  PUT(hl, "standout", BOOLEAN_OBJ(flags & HL_STANDOUT));
+  PUT(hl, "foreground", INTEGER_OBJ(fg));
+  PUT(hl, "background", INTEGER_OBJ(bg));
+
+  Array def = ARRAY_DICT_INIT;
+  ADD(def, INTEGER_OBJ(attr));
+  ADD(def, DICTIONARY_OBJ(hl));
+  ADD(*attrs, ARRAY_OBJ(def));
+}
+
+/// (Re)allocates the copy of the screen for the current screen size
+static void grid_alloc(void)
+{
+  size_t cells = (size_t)screen_Rows * (size_t)screen_Columns;
+
+  grid_free();
+  grid.rows = screen_Rows;
+  grid.columns = screen_Columns;
+  grid.cells = xcalloc(cells, sizeof(screencell_T));
+
+  grid_invalidate();
+  grid.size_sent = false;
+}
+
+static void grid_free(void)
+{
+  free(grid.cells);
+  grid.cells = NULL;
+}
@@ -0,0 +1,14 @@
+#ifndef NVIM_GRID_H
+#define NVIM_GRID_H
+
+/// Event broadcast with the screen lines that changed
+#define GRID_LINE_EVENT "grid_line"
+/// Event broadcast when the size of the screen changed
+#define GRID_RESIZE_EVENT "grid_resize"
+/// Event broadcast with the highlighting of new attribute ids
+#define GRID_ATTR_EVENT "grid_attr_define"
+
+#ifdef INCLUDE_GENERATED_DECLARATIONS
+# include "grid.h.generated.h"
+#endif
+#endif  // NVIM_GRID_H
@@ -579,7 +579,7 @@ char_u * mb_init()
   /* The cell width depends on the type of multi-byte characters. */
   (void)init_chartab();
 
-  /* When enc_utf8 is set or reset, (de)allocate ScreenLinesUC[] */
+  /* When enc_utf8 is set or reset, reallocate ScreenCells[] */
   screenalloc(FALSE);
 
   /* When using Unicode, set default for 'fileencodings'. */
@@ -1324,7 +1324,7 @@ size_t mb_string2cells(const char_u *str)
 
 /*
  * mb_off2cells() function pointer.
- * Return number of display cells for char at ScreenLines[off].
+ * Return number of display cells for char at ScreenCells[off].
  * We make sure that the offset used is less than "max_off".
  */
 int latin_off2cells(unsigned off, unsigned max_off)
@@ -1340,14 +1340,14 @@ int dbcs_off2cells(unsigned off, unsigned max_off)
 
   /* Number of cells is equal to number of bytes, except for euc-jp when
    * the first byte is 0x8e. */
-  if (enc_dbcs == DBCS_JPNU && ScreenLines[off] == 0x8e)
+  if (enc_dbcs == DBCS_JPNU && ScreenCells[off].sc_char == 0x8e)
     return 1;
-  return MB_BYTE2LEN(ScreenLines[off]);
+  return MB_BYTE2LEN(ScreenCells[off].sc_char);
 }
 
 int utf_off2cells(unsigned off, unsigned max_off)
 {
-  return (off + 1 < max_off && ScreenLines[off + 1] == 0) ? 2 : 1;
+  return (off + 1 < max_off && ScreenCells[off + 1].sc_char == 0) ? 2 : 1;
 }
 
 /*
@@ -1588,7 +1588,7 @@ int utfc_ptr2char_len(const char_u *p, int *pcc, int maxlen)
  * Convert the character at screen position "off" to a sequence of bytes.
  * Includes the composing characters.
  * "buf" must at least have the length MB_MAXBYTES + 1.
- * Only to be used when ScreenLinesUC[off] != 0.
+ * Only to be used when ScreenCells[off].sc_uc != 0.
  * Returns the produced number of bytes.
  */
 int utfc_char2bytes(int off, char_u *buf)
@@ -1596,11 +1596,11 @@ int utfc_char2bytes(int off, char_u *buf)
   int len;
   int i;
 
-  len = utf_char2bytes(ScreenLinesUC[off], buf);
+  len = utf_char2bytes(ScreenCells[off].sc_uc, buf);
   for (i = 0; i < Screen_mco; ++i) {
-    if (ScreenLinesC[i][off] == 0)
+    if (ScreenCells[off].sc_cc[i] == 0)
       break;
-    len += utf_char2bytes(ScreenLinesC[i][off], buf + len);
+    len += utf_char2bytes(ScreenCells[off].sc_cc[i], buf + len);
   }
   return len;
 }
@@ -1662,6 +1662,33 @@ int utf_ptr2len_len(const char_u *p, int size)
   return len;
 }
 
+/*
+ * Check if "p[len]" is valid UTF-8, the way readfile() does.
+ * Returns -1 when there is an illegal byte, otherwise the number of bytes at
+ * the end of an incomplete character, zero when there is none.
+ */
+int utf_check_bytes(const char_u *p, size_t len)
+{
+  const char_u *end = p + len;
+  int todo;
+  int l;
+
+  while (p < end) {
+    if (*p < 0x80) {
+      ++p;
+      continue;
+    }
+    todo = end - p > 6 ? 6 : (int)(end - p);
+    l = utf_ptr2len_len(p, todo);
+    if (l > todo)
+      return todo;
+    if (l == 1)
+      return -1;
+    p += l;
+  }
+  return 0;
+}
+
 /*
  * Return the number of bytes the UTF-8 encoding of the character at "p" takes.
  * This includes following composing characters.
@@ -2910,36 +2937,38 @@ int dbcs_head_off(const char_u *base, const char_u *p)
 }
 
 /*
- * Special version of dbcs_head_off() that works for ScreenLines[], where
- * single-width DBCS_JPNU characters are stored separately.
+ * Special version of dbcs_head_off() that works for the cells in
+ * ScreenCells[] from "base" to "off", where single-width DBCS_JPNU characters
+ * keep their second byte in the same cell.
  */
-int dbcs_screen_head_off(const char_u *base, const char_u *p)
+int dbcs_screen_head_off(unsigned base, unsigned off)
 {
   /* It can't be a trailing byte when not using DBCS, at the start of the
-   * string or the previous byte can't start a double-byte.
+   * line or the previous byte can't start a double-byte.
    * For euc-jp an 0x8e byte in the previous cell always means we have a
    * lead byte in the current cell. */
-  if (p <= base
-      || (enc_dbcs == DBCS_JPNU && p[-1] == 0x8e)
-      || MB_BYTE2LEN(p[-1]) == 1
-      || *p == NUL)
+  if (off <= base
+      || (enc_dbcs == DBCS_JPNU && ScreenCells[off - 1].sc_char == 0x8e)
+      || MB_BYTE2LEN(ScreenCells[off - 1].sc_char) == 1
+      || ScreenCells[off].sc_char == NUL)
     return 0;
 
   /* This is slow: need to start at the base and go forward until the
-   * byte we are looking for.  Return 1 when we went past it, 0 otherwise.
-   * For DBCS_JPNU look out for 0x8e, which means the second byte is not
-   * stored as the next byte. */
-  const char_u *q = base;
-  while (q < p) {
-    if (enc_dbcs == DBCS_JPNU && *q == 0x8e) {
+   * cell we are looking for.  Return 1 when we went past it, 0 otherwise.
+   * For DBCS_JPNU look out for 0x8e, which means the second byte is in the
+   * same cell. */
+  unsigned q = base;
+  while (q < off) {
+    if ((enc_dbcs == DBCS_JPNU && ScreenCells[q].sc_char == 0x8e)
+        || MB_BYTE2LEN(ScreenCells[q].sc_char) == 1
+        || ScreenCells[q + 1].sc_char == NUL) {
       ++q;
-    }
-    else {
-      q += dbcs_ptr2len(q);
+    } else {
+      q += 2;
     }
   }
 
-  return (q == p) ? 0 : 1;
+  return (q == off) ? 0 : 1;
 }
 
 int utf_head_off(const char_u *base, const char_u *p)
@@ -3282,12 +3311,11 @@ int mb_fix_col(int col, int row)
 {
   col = check_col(col);
   row = check_row(row);
-  if (has_mbyte && ScreenLines != NULL && col > 0
+  if (has_mbyte && ScreenCells != NULL && col > 0
       && ((enc_dbcs
-          && ScreenLines[LineOffset[row] + col] != NUL
-          && dbcs_screen_head_off(ScreenLines + LineOffset[row],
-            ScreenLines + LineOffset[row] + col))
-        || (enc_utf8 && ScreenLines[LineOffset[row] + col] == 0)))
+          && ScreenCells[LineOffset[row] + col].sc_char != NUL
+          && dbcs_screen_head_off(LineOffset[row], LineOffset[row] + col))
+        || (enc_utf8 && ScreenCells[LineOffset[row] + col].sc_char == 0)))
     return col - 1;
   return col;
 }
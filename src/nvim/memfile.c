@@ -31,8 +31,11 @@
  * file is opened.
  */
 
+#include <stdint.h>
 #include <string.h>
 
+#include <uv.h>
+
 #include "nvim/vim.h"
 #include "nvim/memfile.h"
 #include "nvim/fileio.h"
@@ -43,13 +46,50 @@
 #include "nvim/memory.h"
 #include "nvim/os_unix.h"
 #include "nvim/path.h"
+#include "nvim/strings.h"
 #include "nvim/ui.h"
+#include "nvim/lib/kvec.h"
+#include "nvim/os/event.h"
 #include "nvim/os/os.h"
 
 #define MEMFILE_PAGE_SIZE 4096          /* default page size */
 
 static long_u total_mem_used = 0;       /* total memory used for memfiles */
 
+/*
+ * Copy of a block that is written to the swap file in the background.
+ */
+typedef struct {
+  blocknr_T nr;                 /* block number, for marking it dirty again */
+  off_t offset;                 /* position in the file */
+  char_u      *data;            /* copy of the block data */
+  unsigned size;                /* number of bytes in "data" */
+  int dummy;                    /* TRUE when filling the space of a freed
+                                   block */
+} mfwrite_block_T;
+
+/*
+ * Writes collected by mf_sync() with MFS_ASYNC.  They are done in order by a
+ * libuv work request, so that only one thread writes to the swap file.
+ * The blocks stay in memory with BH_WRITING set until the writes are done.
+ * The thread pushes a kEventSwapWrite event when done, the result is used by
+ * mf_write_event() unless the main thread waited for it before.
+ */
+struct mf_write {
+  uv_work_t req;
+  memfile_T   *mfp;             /* NULL when finished */
+  int fd;
+  kvec_t(mfwrite_block_T) blocks;
+  blocknr_T infile_count;       /* mf_infile_count when the writes are done */
+  char_u      *sws;             /* copy of 'swapsync' for MFS_FLUSH or NULL */
+  int failed;                   /* TRUE when a write failed */
+  uv_mutex_t mutex;             /* protects "done" */
+  uv_cond_t cond;               /* signalled when "done" is set */
+  int done;                     /* TRUE when mf_write_work() is done */
+  int event_done;               /* TRUE when mf_write_event() was called */
+  int req_done;                 /* TRUE when mf_write_done() was called */
+};
+
 
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "memfile.c.generated.h"
@@ -61,10 +101,12 @@ static long_u total_mem_used = 0;       /* total memory used for memfiles */
  * mf_open_file()   open a swap file for an existing memfile
  * mf_close()	    close (and delete) a memfile
  * mf_new()	    create a new block in a memfile and lock it
+ * mf_new_fill()   reserve numbers for blocks that are filled when needed
  * mf_get()	    get an existing block and lock it
  * mf_put()	    unlock a block, may be marked for writing
  * mf_free()	    remove a block
- * mf_sync()	    sync changed parts of memfile to disk
+ * mf_sync()	    sync changed parts of memfile to disk, possibly in the
+ *		    background
  * mf_release_all() release as much memory as possible
  * mf_trans_del()   may translate negative to positive block number
  * mf_fullname()    make file name full path (use before first :cd)
@@ -105,8 +147,16 @@ memfile_T *mf_open(char_u *fname, int flags)
   mfp->mf_free_first = NULL;            /* free list is empty */
   mfp->mf_used_first = NULL;            /* used list is empty */
   mfp->mf_used_last = NULL;
+  mfp->mf_clock_hand = NULL;
   mfp->mf_dirty = FALSE;
+  mfp->mf_batch = NULL;
+  mfp->mf_writing = NULL;
+  mfp->mf_fill = NULL;
+  mfp->mf_fill_clean = NULL;
   mfp->mf_used_count = 0;
+  mfp->mf_hits = 0;
+  mfp->mf_misses = 0;
+  mfp->mf_evictions = 0;
   mf_hash_init(&mfp->mf_hash);
   mf_hash_init(&mfp->mf_trans);
   mfp->mf_page_size = MEMFILE_PAGE_SIZE;
@@ -187,6 +237,7 @@ void mf_close(memfile_T *mfp, int del_file)
 
   if (mfp == NULL)                  /* safety check */
     return;
+  mf_wait_write(mfp);
   if (mfp->mf_fd >= 0) {
     if (close(mfp->mf_fd) < 0)
       EMSG(_(e_swapclose));
@@ -203,6 +254,7 @@ void mf_close(memfile_T *mfp, int del_file)
     free(mf_rem_free(mfp));
   mf_hash_free(&mfp->mf_hash);
   mf_hash_free_all(&mfp->mf_trans);         /* free hashtable and its items */
+  free(mfp->mf_fill_clean);
   free(mfp->mf_fname);
   free(mfp->mf_ffname);
   free(mfp);
@@ -224,6 +276,7 @@ mf_close_file (
   if (mfp == NULL || mfp->mf_fd < 0)            /* nothing to close */
     return;
 
+  mf_wait_write(mfp);
   if (getlines) {
     /* get all blocks in memory by accessing all lines (clumsy!) */
     mf_dont_release = TRUE;
@@ -321,7 +374,8 @@ bhdr_T *mf_new(memfile_T *mfp, int negative, int page_count)
       mfp->mf_blocknr_max += page_count;
     }
   }
-  hp->bh_flags = BH_LOCKED | BH_DIRTY;          /* new block is always dirty */
+  /* new block is always dirty */
+  hp->bh_flags = BH_LOCKED | BH_DIRTY | BH_REFERENCED;
   mfp->mf_dirty = TRUE;
   hp->bh_page_count = page_count;
   mf_ins_used(mfp, hp);
@@ -337,6 +391,53 @@ bhdr_T *mf_new(memfile_T *mfp, int negative, int page_count)
   return hp;
 }
 
+/*
+ * Reserve "count" negative block numbers for blocks that are not in memory
+ * yet.  When one of them is needed mf_get() calls "fill" with "arg" to fill
+ * it, with index 0 for the returned number, 1 for the next lower one, etc.
+ * Until such a block is changed it may be released from memory also when
+ * there is no swap file, it is filled again when needed.
+ * Only one range of numbers can be reserved.
+ *
+ * Returns the number of the first block.
+ */
+blocknr_T mf_new_fill(memfile_T *mfp, long count, mf_fill_T fill, void *arg)
+{
+  blocknr_T first = mfp->mf_blocknr_min;
+
+  mfp->mf_fill = fill;
+  mfp->mf_fill_arg = arg;
+  mfp->mf_fill_first = first;
+  mfp->mf_fill_count = count;
+  mfp->mf_fill_clean = xmalloc((size_t)count);
+  memset(mfp->mf_fill_clean, TRUE, (size_t)count);
+
+  mfp->mf_blocknr_min -= count;
+  mfp->mf_neg_count += count;
+  return first;
+}
+
+/*
+ * Return TRUE if block "nr" was reserved by mf_new_fill() and can be filled,
+ * it wasn't changed or freed.
+ */
+static int mf_can_fill(memfile_T *mfp, blocknr_T nr)
+{
+  return mfp->mf_fill != NULL
+         && nr <= mfp->mf_fill_first
+         && nr > mfp->mf_fill_first - mfp->mf_fill_count
+         && mfp->mf_fill_clean[mfp->mf_fill_first - nr];
+}
+
+/*
+ * Block "nr" was changed or freed, it must not be filled again.
+ */
+static void mf_fill_done(memfile_T *mfp, blocknr_T nr)
+{
+  if (mf_can_fill(mfp, nr))
+    mfp->mf_fill_clean[mfp->mf_fill_first - nr] = FALSE;
+}
+
 /*
  * Get existing block "nr" with "page_count" pages.
  *
@@ -345,6 +446,7 @@ bhdr_T *mf_new(memfile_T *mfp, int negative, int page_count)
 bhdr_T *mf_get(memfile_T *mfp, blocknr_T nr, int page_count)
 {
   bhdr_T    *hp;
+  int fill;
   /* doesn't exist */
   if (nr >= mfp->mf_blocknr_max || nr <= mfp->mf_blocknr_min)
     return NULL;
@@ -353,8 +455,10 @@ bhdr_T *mf_get(memfile_T *mfp, blocknr_T nr, int page_count)
    * see if it is in the cache
    */
   hp = mf_find_hash(mfp, nr);
-  if (hp == NULL) {     /* not in the hash list */
-    if (nr < 0 || nr >= mfp->mf_infile_count)       /* can't be in the file */
+  if (hp == NULL) {     /* not in the hash table */
+    fill = mf_can_fill(mfp, nr);
+    /* can't be in the file */
+    if (!fill && (nr < 0 || nr >= mfp->mf_infile_count))
       return NULL;
 
     /* could check here if the block is in the free list */
@@ -372,18 +476,23 @@ bhdr_T *mf_get(memfile_T *mfp, blocknr_T nr, int page_count)
     hp->bh_bnum = nr;
     hp->bh_flags = 0;
     hp->bh_page_count = page_count;
-    if (mf_read(mfp, hp) == FAIL) {         /* cannot read the block! */
+    if (fill)
+      mfp->mf_fill(mfp->mf_fill_arg, (long)(mfp->mf_fill_first - nr),
+          hp->bh_data, mfp->mf_page_size * page_count);
+    else if (mf_read(mfp, hp) == FAIL) {    /* cannot read the block! */
       mf_free_bhdr(hp);
       return NULL;
     }
+    mfp->mf_misses++;
+    mf_ins_used(mfp, hp);       /* put in front of used list */
+    mf_ins_hash(mfp, hp);
   } else {
-    mf_rem_used(mfp, hp);       /* remove from list, insert in front below */
-    mf_rem_hash(mfp, hp);
+    /* The block stays where it is in the used list, only remember that it
+     * was used for mf_release(). */
+    mfp->mf_hits++;
   }
 
-  hp->bh_flags |= BH_LOCKED;
-  mf_ins_used(mfp, hp);         /* put in front of used list */
-  mf_ins_hash(mfp, hp);         /* put in front of hash list */
+  hp->bh_flags |= BH_LOCKED | BH_REFERENCED;
 
   return hp;
 }
@@ -408,6 +517,7 @@ void mf_put(memfile_T *mfp, bhdr_T *hp, int dirty, int infile)
   if (dirty) {
     flags |= BH_DIRTY;
     mfp->mf_dirty = TRUE;
+    mf_fill_done(mfp, hp->bh_bnum);
   }
   hp->bh_flags = flags;
   if (infile)
@@ -420,9 +530,10 @@ void mf_put(memfile_T *mfp, bhdr_T *hp, int dirty, int infile)
 void mf_free(memfile_T *mfp, bhdr_T *hp)
 {
   free(hp->bh_data);        /* free the memory */
-  mf_rem_hash(mfp, hp);         /* get *hp out of the hash list */
+  mf_rem_hash(mfp, hp);         /* get *hp out of the hash table */
   mf_rem_used(mfp, hp);         /* get *hp out of the used list */
   if (hp->bh_bnum < 0) {
+    mf_fill_done(mfp, hp->bh_bnum);
     free(hp);               /* don't want negative numbers in free list */
     mfp->mf_neg_count--;
   } else
@@ -439,6 +550,9 @@ void mf_free(memfile_T *mfp, bhdr_T *hp)
  *  MFS_FLUSH	Make sure buffers are flushed to disk, so they will survive a
  *		system crash.
  *  MFS_ZERO	Only write block 0.
+ *  MFS_ASYNC	Copy the blocks and write them in the background.  A write
+ *		error is reported later, by mf_write_event().  Nothing is
+ *		written while the previous background writes are not done yet.
  *
  * Return FAIL for failure, OK otherwise
  */
@@ -456,6 +570,20 @@ int mf_sync(memfile_T *mfp, int flags)
     return FAIL;
   }
 
+  if (flags & MFS_ASYNC) {
+    /* Try again later, the blocks stay dirty. */
+    if (mfp->mf_writing != NULL && !mf_write_finished(mfp))
+      return OK;
+    mfp->mf_batch = xcalloc(1, sizeof(struct mf_write));
+    mfp->mf_batch->mfp = mfp;
+    mfp->mf_batch->fd = mfp->mf_fd;
+    mfp->mf_batch->infile_count = mfp->mf_infile_count;
+    kv_init(mfp->mf_batch->blocks);
+  } else {
+    /* The file must not be written by two threads at the same time. */
+    mf_wait_write(mfp);
+  }
+
   /* Only a CTRL-C while writing will break us here, not one typed
    * previously. */
   got_int = FALSE;
@@ -496,7 +624,23 @@ int mf_sync(memfile_T *mfp, int flags)
   if (hp == NULL || status == FAIL)
     mfp->mf_dirty = FALSE;
 
-  if ((flags & MFS_FLUSH) && *p_sws != NUL) {
+  if (mfp->mf_batch != NULL) {
+    struct mf_write *batch = mfp->mf_batch;
+
+    mfp->mf_batch = NULL;
+    if ((flags & MFS_FLUSH) && *p_sws != NUL)
+      batch->sws = vim_strsave(p_sws);
+    if (kv_size(batch->blocks) == 0 && batch->sws == NULL) {
+      mf_free_write(batch);
+    } else {
+      uv_mutex_init(&batch->mutex);
+      uv_cond_init(&batch->cond);
+      batch->req.data = batch;
+      mfp->mf_writing = batch;
+      uv_queue_work(uv_default_loop(), &batch->req, mf_write_work,
+                    mf_write_done);
+    }
+  } else if ((flags & MFS_FLUSH) && *p_sws != NUL) {
 #if defined(UNIX)
 # ifdef HAVE_FSYNC
     if (STRCMP(p_sws, "fsync") == 0) {
@@ -543,7 +687,7 @@ void mf_set_dirty(memfile_T *mfp)
 }
 
 /*
- * insert block *hp in front of hashlist of memfile *mfp
+ * insert block *hp in the hash table of memfile *mfp
  */
 static void mf_ins_hash(memfile_T *mfp, bhdr_T *hp)
 {
@@ -551,7 +695,7 @@ static void mf_ins_hash(memfile_T *mfp, bhdr_T *hp)
 }
 
 /*
- * remove block *hp from hashlist of memfile list *mfp
+ * remove block *hp from the hash table of memfile *mfp
  */
 static void mf_rem_hash(memfile_T *mfp, bhdr_T *hp)
 {
@@ -559,7 +703,7 @@ static void mf_rem_hash(memfile_T *mfp, bhdr_T *hp)
 }
 
 /*
- * look in hash lists of memfile *mfp for block header with number 'nr'
+ * look in the hash table of memfile *mfp for block header with number 'nr'
  */
 static bhdr_T *mf_find_hash(memfile_T *mfp, blocknr_T nr)
 {
@@ -587,6 +731,8 @@ static void mf_ins_used(memfile_T *mfp, bhdr_T *hp)
  */
 static void mf_rem_used(memfile_T *mfp, bhdr_T *hp)
 {
+  if (mfp->mf_clock_hand == hp)     /* move the hand to the next block */
+    mfp->mf_clock_hand = hp->bh_prev;
   if (hp->bh_next == NULL)          /* last block in used list */
     mfp->mf_used_last = hp->bh_prev;
   else
@@ -600,7 +746,7 @@ static void mf_rem_used(memfile_T *mfp, bhdr_T *hp)
 }
 
 /*
- * Release the least recently used block from the used list if the number
+ * Release a block that was not used recently from the used list if the number
  * of used memory blocks gets to big.
  *
  * Return the block header to the caller, including the memory block, so
@@ -611,6 +757,7 @@ static bhdr_T *mf_release(memfile_T *mfp, int page_count)
   bhdr_T      *hp;
   int need_release;
   buf_T       *buf;
+  unsigned count;
 
   /* don't release while in mf_close_file() */
   if (mf_dont_release)
@@ -638,18 +785,40 @@ static bhdr_T *mf_release(memfile_T *mfp, int page_count)
 
   /*
    * don't release a block if
-   *	there is no file for this memfile
+   *	there is no file for this memfile and no block can be filled
    * or
    *	the number of blocks for this memfile is lower than the maximum
    *	  and
    *	total memory used is not up to 'maxmemtot'
    */
-  if (mfp->mf_fd < 0 || !need_release)
+  if ((mfp->mf_fd < 0 && mfp->mf_fill == NULL) || !need_release)
     return NULL;
 
-  for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
-    if (!(hp->bh_flags & BH_LOCKED))
+  /*
+   * CLOCK algorithm: the hand goes around the used list, from the last block
+   * to the first one.  A block that was used since the hand passed it gets
+   * another chance, the first unlocked block that wasn't is released.
+   * Going around twice is enough to find one, if there is any.
+   */
+  hp = NULL;
+  for (count = 2 * mfp->mf_used_count; count > 0; --count) {
+    bhdr_T *cand = mfp->mf_clock_hand;
+
+    if (cand == NULL && (cand = mfp->mf_used_last) == NULL)
       break;
+    mfp->mf_clock_hand = cand->bh_prev;
+    if (cand->bh_flags & (BH_LOCKED | BH_WRITING))
+      continue;
+    /* Without a file only a block that can be filled again can go. */
+    if (mfp->mf_fd < 0 && !mf_can_fill(mfp, cand->bh_bnum))
+      continue;
+    if (cand->bh_flags & BH_REFERENCED) {
+      cand->bh_flags &= ~BH_REFERENCED;
+      continue;
+    }
+    hp = cand;
+    break;
+  }
   if (hp == NULL)       /* not a single one that can be released */
     return NULL;
 
@@ -662,6 +831,7 @@ static bhdr_T *mf_release(memfile_T *mfp, int page_count)
 
   mf_rem_used(mfp, hp);
   mf_rem_hash(mfp, hp);
+  mfp->mf_evictions++;
 
   /*
    * If a bhdr_T is returned, make sure that the page_count of bh_data is
@@ -698,12 +868,13 @@ int mf_release_all(void)
       /* only if there is a swapfile */
       if (mfp->mf_fd >= 0) {
         for (hp = mfp->mf_used_last; hp != NULL; ) {
-          if (!(hp->bh_flags & BH_LOCKED)
+          if (!(hp->bh_flags & (BH_LOCKED | BH_WRITING))
               && (!(hp->bh_flags & BH_DIRTY)
                   || mf_write(mfp, hp) != FAIL)) {
             mf_rem_used(mfp, hp);
             mf_rem_hash(mfp, hp);
             mf_free_bhdr(hp);
+            mfp->mf_evictions++;
             hp = mfp->mf_used_last;             /* re-start, list was changed */
             retval = TRUE;
           } else
@@ -775,6 +946,10 @@ static int mf_read(memfile_T *mfp, bhdr_T *hp)
   page_size = mfp->mf_page_size;
   offset = (off_t)page_size * hp->bh_bnum;
   size = page_size * hp->bh_page_count;
+  /* The pages may still be written in the background, e.g. as filler for a
+   * freed block. */
+  if (mf_write_pending(mfp, offset, size))
+    mf_wait_write(mfp);
   if (lseek(mfp->mf_fd, offset, SEEK_SET) != offset) {
     PERROR(_("E294: Seek error in swap file read"));
     return FAIL;
@@ -800,10 +975,19 @@ static int mf_write(memfile_T *mfp, bhdr_T *hp)
   unsigned page_size;       /* number of bytes in a page */
   unsigned page_count;      /* number of pages written */
   unsigned size;            /* number of bytes written */
+  blocknr_T   *infile;      /* number of pages in the file */
 
   if (mfp->mf_fd < 0)       /* there is no file, can't write */
     return FAIL;
 
+  /* An older copy of the block may still be written in the background.
+   * Blocks written in the background are only in the file when done. */
+  if (mfp->mf_batch == NULL) {
+    mf_wait_write(mfp);
+    infile = &mfp->mf_infile_count;
+  } else
+    infile = &mfp->mf_batch->infile_count;
+
   if (hp->bh_bnum < 0)          /* must assign file block number */
     if (mf_trans_add(mfp, hp) == FAIL)
       return FAIL;
@@ -818,14 +1002,15 @@ static int mf_write(memfile_T *mfp, bhdr_T *hp)
    */
   for (;; ) {
     nr = hp->bh_bnum;
-    if (nr > mfp->mf_infile_count) {            /* beyond end of file */
-      nr = mfp->mf_infile_count;
+    if (nr > *infile) {                         /* beyond end of file */
+      nr = *infile;
       hp2 = mf_find_hash(mfp, nr);              /* NULL caught below */
     } else
       hp2 = hp;
 
     offset = (off_t)page_size * nr;
-    if (lseek(mfp->mf_fd, offset, SEEK_SET) != offset) {
+    if (mfp->mf_batch == NULL
+        && lseek(mfp->mf_fd, offset, SEEK_SET) != offset) {
       PERROR(_("E296: Seek error in swap file write"));
       return FAIL;
     }
@@ -846,12 +1031,17 @@ static int mf_write(memfile_T *mfp, bhdr_T *hp)
       did_swapwrite_msg = TRUE;
       return FAIL;
     }
-    did_swapwrite_msg = FALSE;
-    if (hp2 != NULL)                        /* written a non-dummy block */
+    if (mfp->mf_batch == NULL)
+      did_swapwrite_msg = FALSE;
+    if (hp2 != NULL) {                      /* written a non-dummy block */
       hp2->bh_flags &= ~BH_DIRTY;
+      /* Keep it in memory until it is in the file. */
+      if (mfp->mf_batch != NULL)
+        hp2->bh_flags |= BH_WRITING;
+    }
     /* appended to the file */
-    if (nr + (blocknr_T)page_count > mfp->mf_infile_count)
-      mfp->mf_infile_count = nr + page_count;
+    if (nr + (blocknr_T)page_count > *infile)
+      *infile = nr + page_count;
     if (nr == hp->bh_bnum)                  /* written the desired block */
       break;
   }
@@ -867,12 +1057,206 @@ static int mf_write_block(memfile_T *mfp, bhdr_T *hp, off_t offset, unsigned siz
   char_u      *data = hp->bh_data;
   int result = OK;
 
+  /* In mf_sync() with MFS_ASYNC: only copy the block, it is written by
+   * mf_write_work(). */
+  if (mfp->mf_batch != NULL) {
+    kv_push(mfwrite_block_T, mfp->mf_batch->blocks, ((mfwrite_block_T) {
+      .nr = hp->bh_bnum,
+      .offset = offset,
+      .data = xmemdupz(data, size),
+      .size = size,
+      .dummy = (offset != (off_t)mfp->mf_page_size * hp->bh_bnum)
+    }));
+    return OK;
+  }
+
   if ((unsigned)write_eintr(mfp->mf_fd, data, size) != size)
     result = FAIL;
 
   return result;
 }
 
+/*
+ * Wait for the background writes of memfile "mfp" to finish.  Only waits for
+ * the write request itself, the event loop is not run.
+ */
+static void mf_wait_write(memfile_T *mfp)
+{
+  struct mf_write *w = mfp->mf_writing;
+
+  if (w == NULL)
+    return;
+  uv_mutex_lock(&w->mutex);
+  while (!w->done)
+    uv_cond_wait(&w->cond, &w->mutex);
+  uv_mutex_unlock(&w->mutex);
+  mf_write_finish(w);
+}
+
+/*
+ * Return TRUE when the background writes of memfile "mfp" include bytes of
+ * the "size" bytes at "offset" in the swap file.
+ */
+static int mf_write_pending(memfile_T *mfp, off_t offset, unsigned size)
+{
+  struct mf_write *w = mfp->mf_writing;
+
+  if (w == NULL)
+    return FALSE;
+  for (size_t i = 0; i < kv_size(w->blocks); i++) {
+    mfwrite_block_T *b = &kv_A(w->blocks, i);
+
+    if (b->offset < offset + (off_t)size
+        && offset < b->offset + (off_t)b->size)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/*
+ * Check if the background writes of memfile "mfp" are done, without
+ * waiting.  When they are, the result is used and TRUE is returned.
+ */
+static int mf_write_finished(memfile_T *mfp)
+{
+  struct mf_write *w = mfp->mf_writing;
+  int done;
+
+  uv_mutex_lock(&w->mutex);
+  done = w->done;
+  uv_mutex_unlock(&w->mutex);
+  if (done)
+    mf_write_finish(w);
+  return done;
+}
+
+/*
+ * Write the blocks collected by mf_sync().  Runs in a libuv thread, must
+ * only use the copied data.
+ */
+static void mf_write_work(uv_work_t *req)
+{
+  struct mf_write *w = req->data;
+
+  for (size_t i = 0; i < kv_size(w->blocks) && !w->failed; i++) {
+    mfwrite_block_T *b = &kv_A(w->blocks, i);
+    size_t done = 0;
+
+    while (done < b->size) {
+      ssize_t n = pwrite(w->fd, b->data + done, b->size - done,
+                         b->offset + (off_t)done);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        w->failed = TRUE;
+        break;
+      }
+      done += (size_t)n;
+    }
+  }
+
+  if (!w->failed && w->sws != NULL) {
+#ifdef HAVE_FSYNC
+    if (STRCMP(w->sws, "fsync") == 0) {
+      if (fsync(w->fd))
+        w->failed = TRUE;
+    } else
+#endif
+    sync();
+  }
+
+  uv_mutex_lock(&w->mutex);
+  w->done = TRUE;
+  uv_cond_signal(&w->cond);
+  uv_mutex_unlock(&w->mutex);
+
+  Event event;
+  event.type = kEventSwapWrite;
+  event.data.swap_write = w;
+  event_push_async(event, true);
+}
+
+/*
+ * Called in the main thread when libuv is done with the write request.  It
+ * is freed by this or by mf_write_event(), whichever is called last.
+ */
+static void mf_write_done(uv_work_t *req, int status)
+{
+  struct mf_write *w = req->data;
+
+  w->req_done = TRUE;
+  if (w->event_done)
+    mf_free_write(w);
+}
+
+/*
+ * Use the result of the background writes "w" for its memfile.  The blocks
+ * can be released from memory again.  After a write error they are marked
+ * dirty again, so that they are written by the next sync, the error is
+ * reported by mf_write_event().  Only when all writes succeeded the blocks
+ * appended to the file are counted.
+ */
+static void mf_write_finish(struct mf_write *w)
+{
+  memfile_T *mfp = w->mfp;
+
+  if (mfp == NULL)              /* already done */
+    return;
+  w->mfp = NULL;
+  mfp->mf_writing = NULL;
+
+  for (size_t i = 0; i < kv_size(w->blocks); i++) {
+    mfwrite_block_T *b = &kv_A(w->blocks, i);
+    bhdr_T *hp;
+
+    if (!b->dummy && (hp = mf_find_hash(mfp, b->nr)) != NULL) {
+      hp->bh_flags &= ~BH_WRITING;
+      if (w->failed)
+        hp->bh_flags |= BH_DIRTY;
+    }
+  }
+
+  if (w->failed) {
+    mfp->mf_dirty = TRUE;
+  } else {
+    did_swapwrite_msg = FALSE;
+    if (w->infile_count > mfp->mf_infile_count)
+      mfp->mf_infile_count = w->infile_count;
+  }
+}
+
+static void mf_free_write(struct mf_write *w)
+{
+  for (size_t i = 0; i < kv_size(w->blocks); i++)
+    free(kv_A(w->blocks, i).data);
+  kv_destroy(w->blocks);
+  if (w->req.data != NULL) {
+    uv_mutex_destroy(&w->mutex);
+    uv_cond_destroy(&w->cond);
+  }
+  free(w->sws);
+  free(w);
+}
+
+/*
+ * Called in the main thread for the kEventSwapWrite event pushed when writing
+ * a swap file in the background is done.  Uses the result when the memfile
+ * didn't wait for it and reports a failure like mf_write() does.
+ */
+void mf_write_event(Event event)
+{
+  struct mf_write *w = event.data.swap_write;
+
+  mf_write_finish(w);
+  if (w->failed && !did_swapwrite_msg) {
+    EMSG(_("E297: Write error in swap file"));
+    did_swapwrite_msg = TRUE;
+  }
+  w->event_done = TRUE;
+  if (w->req_done)
+    mf_free_write(w);
+}
+
 /*
  * Make block number for *hp positive and add it to the translation list
  *
@@ -887,6 +1271,13 @@ static int mf_trans_add(memfile_T *mfp, bhdr_T *hp)
   if (hp->bh_bnum >= 0)                     /* it's already positive */
     return OK;
 
+  /* A block that can be filled is not in the file yet. */
+  if (mf_can_fill(mfp, hp->bh_bnum)) {
+    mf_fill_done(mfp, hp->bh_bnum);
+    hp->bh_flags |= BH_DIRTY;
+    mfp->mf_dirty = TRUE;
+  }
+
   NR_TRANS *np = xmalloc(sizeof(NR_TRANS));
 
   /*
@@ -917,9 +1308,9 @@ static int mf_trans_add(memfile_T *mfp, bhdr_T *hp)
   np->nt_old_bnum = hp->bh_bnum;            /* adjust number */
   np->nt_new_bnum = new_bnum;
 
-  mf_rem_hash(mfp, hp);                     /* remove from old hash list */
+  mf_rem_hash(mfp, hp);                     /* remove with the old key */
   hp->bh_bnum = new_bnum;
-  mf_ins_hash(mfp, hp);                     /* insert in new hash list */
+  mf_ins_hash(mfp, hp);                     /* insert with the new key */
 
   /* Insert "np" into "mf_trans" hashtable with key "np->nt_old_bnum" */
   mf_hash_add_item(&mfp->mf_trans, (mf_hashitem_T *)np);
@@ -1048,13 +1439,22 @@ mf_do_open (
  */
 
 /*
- * The number of buckets in the hashtable is increased by a factor of
- * MHT_GROWTH_FACTOR when the average number of items per bucket
- * exceeds 2 ^ MHT_LOG_LOAD_FACTOR.
+ * The number of slots in the hashtable is doubled when more than half of
+ * them would be used, which keeps the probe sequences short.
  */
-#define MHT_LOG_LOAD_FACTOR 6
 #define MHT_GROWTH_FACTOR   2   /* must be a power of two */
 
+/*
+ * Return the slot where the search for "key" starts.  Block numbers are
+ * mostly consecutive, they are spread over the table with a multiplicative
+ * hash to avoid long runs of used slots.
+ */
+static long_u mf_hash_slot(mf_hashtab_T *mht, blocknr_T key)
+{
+  return (long_u)(((uint64_t)key * 0x9E3779B97F4A7C15ULL) >> 32)
+         & mht->mht_mask;
+}
+
 /*
  * Initialize an empty hash table.
  */
@@ -1081,14 +1481,9 @@ static void mf_hash_free(mf_hashtab_T *mht)
 static void mf_hash_free_all(mf_hashtab_T *mht)
 {
   long_u idx;
-  mf_hashitem_T   *mhi;
-  mf_hashitem_T   *next;
 
   for (idx = 0; idx <= mht->mht_mask; idx++)
-    for (mhi = mht->mht_buckets[idx]; mhi != NULL; mhi = next) {
-      next = mhi->mhi_next;
-      free(mhi);
-    }
+    free(mht->mht_buckets[idx]);
 
   mf_hash_free(mht);
 }
@@ -1099,40 +1494,33 @@ static void mf_hash_free_all(mf_hashtab_T *mht)
  */
 static mf_hashitem_T *mf_hash_find(mf_hashtab_T *mht, blocknr_T key)
 {
+  long_u idx = mf_hash_slot(mht, key);
   mf_hashitem_T   *mhi;
 
-  mhi = mht->mht_buckets[key & mht->mht_mask];
-  while (mhi != NULL && mhi->mhi_key != key)
-    mhi = mhi->mhi_next;
+  while ((mhi = mht->mht_buckets[idx]) != NULL && mhi->mhi_key != key)
+    idx = (idx + 1) & mht->mht_mask;
 
   return mhi;
 }
 
 /*
  * Add item "mhi" to hashtable "mht".
- * "mhi" must not be NULL.
+ * "mhi" must not be NULL and its key must not be in "mht" yet.
  */
 static void mf_hash_add_item(mf_hashtab_T *mht, mf_hashitem_T *mhi)
 {
   long_u idx;
 
-  idx = mhi->mhi_key & mht->mht_mask;
-  mhi->mhi_next = mht->mht_buckets[idx];
-  mhi->mhi_prev = NULL;
-  if (mhi->mhi_next != NULL)
-    mhi->mhi_next->mhi_prev = mhi;
+  /* Grow the hashtable when more than half of the slots would be used. */
+  if ((mht->mht_count + 1) * 2 > mht->mht_mask + 1)
+    mf_hash_grow(mht);
+
+  idx = mf_hash_slot(mht, mhi->mhi_key);
+  while (mht->mht_buckets[idx] != NULL)
+    idx = (idx + 1) & mht->mht_mask;
   mht->mht_buckets[idx] = mhi;
 
   mht->mht_count++;
-
-  /*
-   * Grow hashtable when we have more thank 2^MHT_LOG_LOAD_FACTOR
-   * items per bucket on average
-   */
-  if (mht->mht_fixed == 0
-      && (mht->mht_count >> MHT_LOG_LOAD_FACTOR) > mht->mht_mask) {
-    mf_hash_grow(mht);
-  }
 }
 
 /*
@@ -1141,13 +1529,31 @@ static void mf_hash_add_item(mf_hashtab_T *mht, mf_hashitem_T *mhi)
  */
 static void mf_hash_rem_item(mf_hashtab_T *mht, mf_hashitem_T *mhi)
 {
-  if (mhi->mhi_prev == NULL)
-    mht->mht_buckets[mhi->mhi_key & mht->mht_mask] = mhi->mhi_next;
-  else
-    mhi->mhi_prev->mhi_next = mhi->mhi_next;
+  long_u idx = mf_hash_slot(mht, mhi->mhi_key);
+  long_u next;
+  long_u home;
 
-  if (mhi->mhi_next != NULL)
-    mhi->mhi_next->mhi_prev = mhi->mhi_prev;
+  while (mht->mht_buckets[idx] != mhi)
+    idx = (idx + 1) & mht->mht_mask;
+  mht->mht_buckets[idx] = NULL;
+
+  /*
+   * Items after the free slot that can't be found anymore, because their
+   * probe sequence starts at or before it, are moved back into it.  This
+   * avoids the need for "deleted" markers.
+   */
+  for (next = (idx + 1) & mht->mht_mask;
+       mht->mht_buckets[next] != NULL;
+       next = (next + 1) & mht->mht_mask) {
+    home = mf_hash_slot(mht, mht->mht_buckets[next]->mhi_key);
+    /* Distance from the home slot to "next" and to the free slot, wrapping
+     * around at the end of the array. */
+    if (((next - home) & mht->mht_mask) >= ((next - idx) & mht->mht_mask)) {
+      mht->mht_buckets[idx] = mht->mht_buckets[next];
+      mht->mht_buckets[next] = NULL;
+      idx = next;
+    }
+  }
 
   mht->mht_count--;
 
@@ -1156,60 +1562,27 @@ static void mf_hash_rem_item(mf_hashtab_T *mht, mf_hashitem_T *mhi)
 }
 
 /*
- * Increase number of buckets in the hashtable by MHT_GROWTH_FACTOR and
+ * Increase number of slots in the hashtable by MHT_GROWTH_FACTOR and
  * rehash items.
  */
 static void mf_hash_grow(mf_hashtab_T *mht)
 {
-  long_u i, j;
-  int shift;
-  mf_hashitem_T   *mhi;
-  mf_hashitem_T   *tails[MHT_GROWTH_FACTOR];
-  mf_hashitem_T   **buckets;
-  size_t size;
-
-  size = (mht->mht_mask + 1) * MHT_GROWTH_FACTOR * sizeof(void *);
-  buckets = xcalloc(1, size);
-
-  shift = 0;
-  while ((mht->mht_mask >> shift) != 0)
-    shift++;
-
-  for (i = 0; i <= mht->mht_mask; i++) {
-    /*
-     * Traverse the items in the i-th original bucket and move them into
-     * MHT_GROWTH_FACTOR new buckets, preserving their relative order
-     * within each new bucket.  Preserving the order is important because
-     * mf_get() tries to keep most recently used items at the front of
-     * each bucket.
-     *
-     * Here we strongly rely on the fact the hashes are computed modulo
-     * a power of two.
-     */
-
-    memset(tails, 0, sizeof(tails));
-
-    for (mhi = mht->mht_buckets[i]; mhi != NULL; mhi = mhi->mhi_next) {
-      j = (mhi->mhi_key >> shift) & (MHT_GROWTH_FACTOR - 1);
-      if (tails[j] == NULL) {
-        buckets[i + (j << shift)] = mhi;
-        tails[j] = mhi;
-        mhi->mhi_prev = NULL;
-      } else {
-        tails[j]->mhi_next = mhi;
-        mhi->mhi_prev = tails[j];
-        tails[j] = mhi;
-      }
-    }
-
-    for (j = 0; j < MHT_GROWTH_FACTOR; j++)
-      if (tails[j] != NULL)
-        tails[j]->mhi_next = NULL;
+  mf_hashitem_T   **old_buckets = mht->mht_buckets;
+  long_u old_size = mht->mht_mask + 1;
+  long_u i, idx;
+
+  mht->mht_buckets = xcalloc(old_size * MHT_GROWTH_FACTOR, sizeof(void *));
+  mht->mht_mask = old_size * MHT_GROWTH_FACTOR - 1;
+
+  for (i = 0; i < old_size; i++) {
+    if (old_buckets[i] == NULL)
+      continue;
+    idx = mf_hash_slot(mht, old_buckets[i]->mhi_key);
+    while (mht->mht_buckets[idx] != NULL)
+      idx = (idx + 1) & mht->mht_mask;
+    mht->mht_buckets[idx] = old_buckets[i];
   }
 
-  if (mht->mht_buckets != mht->mht_small_buckets)
-    free(mht->mht_buckets);
-
-  mht->mht_buckets = buckets;
-  mht->mht_mask = (mht->mht_mask + 1) * MHT_GROWTH_FACTOR - 1;
+  if (old_buckets != mht->mht_small_buckets)
+    free(old_buckets);
 }
@@ -3,6 +3,7 @@
 
 #include "nvim/buffer_defs.h"
 #include "nvim/memfile_defs.h"
+#include "nvim/os/event_defs.h"
 
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "memfile.h.generated.h"
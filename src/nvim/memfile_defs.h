@@ -5,42 +5,42 @@ typedef struct block_hdr bhdr_T;
 typedef long blocknr_T;
 
 /*
- * mf_hashtab_T is a chained hashtable with blocknr_T key and arbitrary
- * structures as items.  This is an intrusive data structure: we require
- * that items begin with mf_hashitem_T which contains the key and linked
- * list pointers.  List of items in each bucket is doubly-linked.
+ * mf_hashtab_T is an open addressing hashtable with blocknr_T key and
+ * arbitrary structures as items.  This is an intrusive data structure: we
+ * require that items begin with mf_hashitem_T which contains the key.
+ * Collisions are resolved by linear probing, a slot is NULL when it is not
+ * used.
  */
 
 typedef struct mf_hashitem_S mf_hashitem_T;
 
 struct mf_hashitem_S {
-  mf_hashitem_T   *mhi_next;
-  mf_hashitem_T   *mhi_prev;
   blocknr_T mhi_key;
 };
 
 #define MHT_INIT_SIZE   64
 
 typedef struct mf_hashtab_S {
-  long_u mht_mask;                  /* mask used for hash value (nr of items
+  long_u mht_mask;                  /* mask used for hash value (nr of slots
                                      * in array is "mht_mask" + 1) */
   long_u mht_count;                 /* nr of items inserted into hashtable */
   mf_hashitem_T   **mht_buckets;    /* points to mht_small_buckets or
                                      *dynamically allocated array */
-  mf_hashitem_T   *mht_small_buckets[MHT_INIT_SIZE];     /* initial buckets */
-  char mht_fixed;                   /* non-zero value forbids growth */
+  mf_hashitem_T   *mht_small_buckets[MHT_INIT_SIZE];     /* initial slots */
 } mf_hashtab_T;
 
 /*
  * for each (previously) used block in the memfile there is one block header.
  *
  * The block may be linked in the used list OR in the free list.
- * The used blocks are also kept in hash lists.
+ * The used blocks are also kept in a hash table.
  *
- * The used list is a doubly linked list, most recently used block first.
+ * The used list is a doubly linked list, newest block first.
  *	The blocks in the used list have a block of memory allocated.
  *	mf_used_count is the number of pages in the used list.
- * The hash lists are used to quickly find a block in the used list.
+ *	Blocks are not moved when they are used, the CLOCK algorithm in
+ *	mf_release() uses the BH_REFERENCED flag to find the block to release.
+ * The hash table is used to quickly find a block in the used list.
  * The free list is a single linked list, not sorted.
  *	The blocks in the free list have no block of memory allocated and
  *	the contents of the block in the file (if any) is irrelevant.
@@ -55,16 +55,20 @@ struct block_hdr {
   char_u      *bh_data;             /* pointer to memory (for used block) */
   int bh_page_count;                /* number of pages in this block */
 
-#define BH_DIRTY    1
-#define BH_LOCKED   2
-  char bh_flags;                    /* BH_DIRTY or BH_LOCKED */
+#define BH_DIRTY      1
+#define BH_LOCKED     2
+#define BH_REFERENCED 4             /* used since the CLOCK hand passed */
+#define BH_WRITING    8             /* being written in the background, must
+                                       stay in memory */
+  char bh_flags;                    /* BH_DIRTY, BH_LOCKED, BH_REFERENCED,
+                                       BH_WRITING */
 };
 
 /*
  * when a block with a negative number is flushed to the file, it gets
  * a positive number. Because the reference to the block is still the negative
  * number, we remember the translation to the new positive number in the
- * double linked trans lists. The structure is the same as the hash lists.
+ * trans hash table. The structure is the same as for the used blocks.
  */
 typedef struct nr_trans NR_TRANS;
 
@@ -75,23 +79,44 @@ struct nr_trans {
   blocknr_T nt_new_bnum;                /* new, positive, number */
 };
 
+/*
+ * Fills block "idx" of the blocks reserved by mf_new_fill(), "data" has
+ * "size" bytes.
+ */
+typedef void (*mf_fill_T)(void *arg, long idx, char_u *data, unsigned size);
+
 struct memfile {
   char_u      *mf_fname;                /* name of the file */
   char_u      *mf_ffname;               /* idem, full path */
   int mf_fd;                            /* file descriptor */
   bhdr_T      *mf_free_first;           /* first block_hdr in free list */
-  bhdr_T      *mf_used_first;           /* mru block_hdr in used list */
-  bhdr_T      *mf_used_last;            /* lru block_hdr in used list */
+  bhdr_T      *mf_used_first;           /* newest block_hdr in used list */
+  bhdr_T      *mf_used_last;            /* oldest block_hdr in used list */
+  bhdr_T      *mf_clock_hand;           /* next block_hdr mf_release() looks
+                                           at, NULL for mf_used_last */
   unsigned mf_used_count;               /* number of pages in used list */
   unsigned mf_used_count_max;           /* maximum number of pages in memory */
-  mf_hashtab_T mf_hash;                 /* hash lists */
-  mf_hashtab_T mf_trans;                /* trans lists */
+  long_u mf_hits;                       /* mf_get() found block in memory */
+  long_u mf_misses;                     /* mf_get() read block from file */
+  long_u mf_evictions;                  /* blocks released from memory */
+  mf_hashtab_T mf_hash;                 /* hash table of used blocks */
+  mf_hashtab_T mf_trans;                /* trans hash table */
   blocknr_T mf_blocknr_max;             /* highest positive block number + 1*/
   blocknr_T mf_blocknr_min;             /* lowest negative block number - 1 */
   blocknr_T mf_neg_count;               /* number of negative blocks numbers */
   blocknr_T mf_infile_count;            /* number of pages in the file */
   unsigned mf_page_size;                /* number of bytes in a page */
   int mf_dirty;                         /* TRUE if there are dirty blocks */
+  struct mf_write *mf_batch;            /* writes being collected by
+                                           mf_sync() with MFS_ASYNC */
+  struct mf_write *mf_writing;          /* writes done in the background */
+  mf_fill_T mf_fill;                    /* fills reserved blocks, NULL when
+                                           there are none */
+  void        *mf_fill_arg;             /* argument for mf_fill */
+  blocknr_T mf_fill_first;              /* number of the first reserved block */
+  long mf_fill_count;                   /* number of reserved blocks */
+  char_u      *mf_fill_clean;           /* TRUE for a reserved block that can
+                                           be filled (again) */
 };
 
 #endif // NVIM_MEMFILE_DEFS_H
@@ -41,7 +41,10 @@
  *  mf_get().
  */
 
+#include <signal.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "nvim/vim.h"
 #include "nvim/memline.h"
@@ -213,6 +216,24 @@ struct block0 {
 
 #define STACK_INCR      5       /* nr of entries added to ml_stack at a time */
 
+#define MM_INDEX_STEP   64      /* nr of lines per ml_mmap index entry */
+#define MM_COUNT_SIZE   0x40000 /* nr of bytes of a mapped file counted when
+                                   it is opened */
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+ * The mappings in use, for ml_mmap_sigbus().  When the SIGBUS handler is
+ * installed "mm_sigbus_prev" is the one it replaced.
+ */
+static mlmmap_T *mm_first = NULL;
+static int mm_sigbus_installed = FALSE;
+static struct sigaction mm_sigbus_prev;
+static size_t mm_page_size;
+static volatile sig_atomic_t mm_got_sigbus = FALSE;
+
 /*
  * The line number where the first mark may be is remembered.
  * If it is 0 there are no marks at all.
@@ -259,9 +280,13 @@ int ml_open(buf_T *buf)
   buf->b_ml.ml_stack_size = 0;   /* no stack yet */
   buf->b_ml.ml_stack = NULL;    /* no stack yet */
   buf->b_ml.ml_stack_top = 0;   /* nothing in the stack */
+  buf->b_ml.ml_leaf_count = 0;  /* no remembered data blocks */
+  buf->b_ml.ml_leaf_next = 0;
   buf->b_ml.ml_locked = NULL;   /* no cached block */
   buf->b_ml.ml_line_lnum = 0;   /* no cached line */
   buf->b_ml.ml_chunksize = NULL;
+  buf->b_ml.ml_mmap = NULL;     /* no mapped file */
+  buf->b_ml.ml_mmap_fill = NULL;
 
   if (cmdmod.noswapfile) {
     buf->b_p_swf = FALSE;
@@ -373,6 +398,167 @@ error:
   return FAIL;
 }
 
+/*
+ * Use a read-only mapping of file "fd", which is "size" bytes long, as the
+ * text of "buf".  The memline must be empty, as ml_open() made it.  The file
+ * must be in Unix format and in 'encoding', the bytes are used as-is.  When
+ * "check_utf8" is TRUE the text must be valid UTF-8.
+ *
+ * The lines are not copied into the memfile.  Only the lines of the first
+ * region are counted here, the rest is counted and checked when needed or
+ * while waiting for the user to type (see ml_mmap_count()), the line count
+ * grows meanwhile.  Lines are read from the mapping until the buffer is
+ * changed, then the data blocks are filled from it when needed (see
+ * ml_mmap_materialize()).
+ * When the file is truncated while it is mapped the lines that are gone are
+ * empty, see ml_mmap_sigbus().
+ *
+ * Return FAIL when the file can't be used this way, the caller must then
+ * read it the usual way.
+ */
+int ml_open_mmap(buf_T *buf, int fd, size_t size, int check_utf8)
+{
+  memfile_T   *mfp = buf->b_ml.ml_mfp;
+  mlmmap_T    *mm;
+  void        *base;
+  bhdr_T      *hp;
+  PTR_BL      *pp;
+  int ok;
+  FileInfo file_info;
+
+  if (mfp == NULL || !(buf->b_ml.ml_flags & ML_EMPTY) || size == 0)
+    return FAIL;
+
+  /* Get rid of the cached line and locked block of the empty memline. */
+  ml_flush_line(buf);
+  (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+  buf->b_ml.ml_line_lnum = 0;
+
+  /* The root must only have data block 2, see ml_mmap_materialize(). */
+  if ((hp = mf_get(mfp, (blocknr_T)1, 1)) == NULL)
+    return FAIL;
+  pp = (PTR_BL *)(hp->bh_data);
+  ok = (pp->pb_id == PTR_ID && pp->pb_count == 1
+        && pp->pb_pointer[0].pe_bnum == 2);
+  mf_put(mfp, hp, FALSE, FALSE);
+  if (!ok)
+    return FAIL;
+
+  base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, (off_t)0);
+  if (base == MAP_FAILED)
+    return FAIL;
+
+  mm = xcalloc(1, sizeof(mlmmap_T));
+  mm->mm_base = base;
+  mm->mm_size = size;
+  mm->mm_valid = size;
+  if (ml_mmap_guard(mm) == FAIL) {
+    munmap(base, size);
+    free(mm);
+    return FAIL;
+  }
+  mm->mm_fname = vim_strsave(buf->b_fname == NULL ? (char_u *)""
+                                                   : buf->b_fname);
+  if (os_get_file_info_fd(fd, &file_info))
+    os_file_info_get_id(&file_info, &mm->mm_file_id);
+  mm->mm_index_size = 1024;
+  mm->mm_index = xmalloc(mm->mm_index_size * sizeof(size_t));
+  mm->mm_counting = TRUE;
+  mm->mm_check_utf8 = check_utf8;
+  mm->mm_no_eol = (mm->mm_base[size - 1] != NL);
+
+  buf->b_ml.ml_mmap = mm;
+  buf->b_ml.ml_line_count = 0;
+  buf->b_ml.ml_flags &= ~ML_EMPTY;
+
+  /* Read the file the usual way for an illegal byte in the first region, to
+   * try another encoding or report it, or when it was truncated already. */
+  if (ml_mmap_count(buf, MM_COUNT_SIZE) == FAIL || mm->mm_truncated) {
+    buf->b_ml.ml_mmap = NULL;
+    buf->b_ml.ml_line_count = 1;
+    buf->b_ml.ml_flags |= ML_EMPTY;
+    ml_mmap_free(mm);
+    return FAIL;
+  }
+
+  return OK;
+}
+
+/*
+ * Count the lines of the mapped file of "buf" after the ones counted so far,
+ * for about "size" bytes, or all of them when "size" is zero.  Also checks
+ * them for illegal UTF-8 when needed and adds them to the line index.
+ * b_ml.ml_line_count is the number of lines counted, it grows like when a
+ * file is read in the background.
+ * Returns FAIL when an illegal byte was found, the file must then be read
+ * the usual way.
+ */
+int ml_mmap_count(buf_T *buf, size_t size)
+{
+  mlmmap_T    *mm = buf->b_ml.ml_mmap;
+  linenr_T old_count = buf->b_ml.ml_line_count;
+  char_u      *p;
+  char_u      *nl;
+  char_u      *stop;
+  size_t len;
+
+  if (mm == NULL || !mm->mm_counting)
+    return OK;
+  if (mm->mm_illegal)
+    return FAIL;
+
+  p = mm->mm_base + mm->mm_counted;
+  stop = size == 0 || size > mm->mm_valid - mm->mm_counted
+         ? mm->mm_base + mm->mm_valid : p + size;
+  while (p < stop) {
+    nl = memchr(p, NL, (size_t)(mm->mm_base + mm->mm_valid - p));
+    len = (size_t)((nl == NULL ? mm->mm_base + mm->mm_valid : nl) - p);
+    if (mm->mm_check_utf8 && utf_check_bytes(p, len) != 0) {
+      mm->mm_illegal = TRUE;
+      break;
+    }
+    if (mm->mm_line_count % MM_INDEX_STEP == 0) {
+      if (mm->mm_indexed == mm->mm_index_size) {
+        mm->mm_index_size *= 2;
+        mm->mm_index = xrealloc(mm->mm_index,
+            mm->mm_index_size * sizeof(size_t));
+      }
+      mm->mm_index[mm->mm_indexed++] = (size_t)(p - mm->mm_base);
+    }
+    mm->mm_line_count++;
+    p = nl == NULL ? p + len : nl + 1;
+  }
+  mm->mm_counted = (size_t)(p - mm->mm_base);
+
+  /* A NL at the very end doesn't start another line. */
+  if (!mm->mm_illegal && mm->mm_counted >= mm->mm_valid) {
+    mm->mm_counting = FALSE;
+    if (mm->mm_no_eol)
+      buf->b_no_eol_lnum = mm->mm_line_count;
+  }
+
+  buf->b_ml.ml_line_count = mm->mm_line_count;
+  if (old_count != 0)
+    readfile_bg_added(buf, old_count);
+  return mm->mm_illegal ? FAIL : OK;
+}
+
+/*
+ * Return TRUE when not all lines of the mapped file of "buf" were counted.
+ */
+int ml_mmap_counting(buf_T *buf)
+{
+  return buf->b_ml.ml_mmap != NULL && buf->b_ml.ml_mmap->mm_counting;
+}
+
+/*
+ * Return TRUE when "buf" uses a mapped file without a NL at the end.
+ */
+int ml_mmap_no_eol(buf_T *buf)
+{
+  return buf->b_ml.ml_mmap != NULL && buf->b_ml.ml_mmap->mm_no_eol;
+}
+
 /*
  * ml_setname() is called when the file name of "buf" has been changed.
  * It may rename the swap file.
@@ -558,12 +744,17 @@ void ml_close(buf_T *buf, int del_file)
 {
   if (buf->b_ml.ml_mfp == NULL)                 /* not open */
     return;
+  readfile_bg_stop(buf);
   mf_close(buf->b_ml.ml_mfp, del_file);         /* close the .swp file */
   if (buf->b_ml.ml_line_lnum != 0 && (buf->b_ml.ml_flags & ML_LINE_DIRTY))
     free(buf->b_ml.ml_line_ptr);
   free(buf->b_ml.ml_stack);
   free(buf->b_ml.ml_chunksize);
   buf->b_ml.ml_chunksize = NULL;
+  ml_mmap_free(buf->b_ml.ml_mmap);
+  buf->b_ml.ml_mmap = NULL;
+  ml_mmap_free(buf->b_ml.ml_mmap_fill);
+  buf->b_ml.ml_mmap_fill = NULL;
   buf->b_ml.ml_mfp = NULL;
 
   /* Reset the "recovered" flag, give the ATTENTION prompt the next time
@@ -1639,7 +1830,9 @@ void ml_sync_all(int check_file, int check_char)
       }
     }
     if (buf->b_ml.ml_mfp->mf_dirty) {
-      (void)mf_sync(buf->b_ml.ml_mfp, (check_char ? MFS_STOP : 0)
+      /* When typing, write in the background, a slow disk must not delay
+       * the next character. */
+      (void)mf_sync(buf->b_ml.ml_mfp, (check_char ? MFS_STOP | MFS_ASYNC : 0)
           | (bufIsChanged(buf) ? MFS_FLUSH : 0));
       if (check_char && ui_char_avail())        /* character available now */
         break;
@@ -1671,16 +1864,24 @@ void ml_preserve(buf_T *buf, int message)
     return;
   }
 
+  /* All lines must be in the swap file, also the ones in data blocks that
+   * are filled from a mapped file. */
+  if (buf->b_ml.ml_mmap != NULL)
+    ml_mmap_materialize(buf);
+
   /* We only want to stop when interrupted here, not when interrupted
    * before. */
   got_int = FALSE;
 
   ml_flush_line(buf);                               /* flush buffered line */
+  if (buf->b_ml.ml_mmap_fill != NULL)
+    ml_mmap_fill_all(buf);
   (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);   /* flush locked block */
   status = mf_sync(mfp, MFS_ALL | MFS_FLUSH);
 
   /* stack is invalid after mf_sync(.., MFS_ALL) */
   buf->b_ml.ml_stack_top = 0;
+  buf->b_ml.ml_leaf_count = 0;
 
   /*
    * Some of the data blocks may have been changed from negative to
@@ -1710,6 +1911,7 @@ void ml_preserve(buf_T *buf, int message)
     if (mf_sync(mfp, MFS_ALL | MFS_FLUSH) == FAIL)
       status = FAIL;
     buf->b_ml.ml_stack_top = 0;             /* stack is invalid now */
+    buf->b_ml.ml_leaf_count = 0;
   }
 theend:
   got_int |= got_int_save;
@@ -1784,6 +1986,15 @@ errorret:
   if (buf->b_ml.ml_mfp == NULL)         /* there are no lines */
     return (char_u *)"";
 
+  if (mm_got_sigbus)
+    ml_mmap_report();
+
+  if (buf->b_ml.ml_mmap != NULL) {
+    if (!will_change)
+      return ml_mmap_get(buf->b_ml.ml_mmap, lnum);
+    ml_mmap_materialize(buf);
+  }
+
   /*
    * See if it is the same line as requested last time.
    * Otherwise may need to flush last used line.
@@ -1906,6 +2117,11 @@ ml_append_int (
   PTR_BL      *pp;
   infoptr_T   *ip;
 
+  /* A change needs all lines. */
+  readfile_bg_wait(buf);
+  if (buf->b_ml.ml_mmap != NULL)
+    ml_mmap_materialize(buf);
+
   /* lnum out of range */
   if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL)
     return FAIL;
@@ -2351,6 +2567,10 @@ int ml_replace(linenr_T lnum, char_u *line, int copy)
   if (curbuf->b_ml.ml_mfp == NULL && open_buffer(FALSE, NULL, 0) == FAIL)
     return FAIL;
 
+  readfile_bg_wait(curbuf);
+  if (curbuf->b_ml.ml_mmap != NULL)
+    ml_mmap_materialize(curbuf);
+
   if (copy) {
     line = vim_strsave(line);
   }
@@ -2397,6 +2617,10 @@ static int ml_delete_int(buf_T *buf, linenr_T lnum, int message)
   if (lnum < 1 || lnum > buf->b_ml.ml_line_count)
     return FAIL;
 
+  readfile_bg_wait(buf);
+  if (buf->b_ml.ml_mmap != NULL)
+    ml_mmap_materialize(buf);
+
   if (lowest_marked && lowest_marked > lnum)
     lowest_marked--;
 
@@ -2529,6 +2753,10 @@ void ml_setmarked(linenr_T lnum)
       || curbuf->b_ml.ml_mfp == NULL)
     return;                         /* give error message? */
 
+  /* The mark is stored in the data block. */
+  if (curbuf->b_ml.ml_mmap != NULL)
+    ml_mmap_materialize(curbuf);
+
   if (lowest_marked == 0 || lowest_marked > lnum)
     lowest_marked = lnum;
 
@@ -2555,7 +2783,8 @@ linenr_T ml_firstmarked(void)
   linenr_T lnum;
   int i;
 
-  if (curbuf->b_ml.ml_mfp == NULL)
+  /* A mapped file has no marks, ml_setmarked() gets rid of the mapping. */
+  if (curbuf->b_ml.ml_mfp == NULL || curbuf->b_ml.ml_mmap != NULL)
     return (linenr_T) 0;
 
   /*
@@ -2599,6 +2828,11 @@ void ml_clearmarked(void)
   if (curbuf->b_ml.ml_mfp == NULL)          /* nothing to do */
     return;
 
+  if (curbuf->b_ml.ml_mmap != NULL) {       /* no marks in a mapped file */
+    lowest_marked = 0;
+    return;
+  }
+
   /*
    * The search starts with line lowest_marked.
    */
@@ -2781,6 +3015,11 @@ static bhdr_T *ml_find_line(buf_T *buf, linenr_T lnum, int action)
 
   mfp = buf->b_ml.ml_mfp;
 
+  /* Inserting or deleting a line changes the line numbers of the remembered
+   * data blocks and may split or free them. */
+  if (action == ML_INSERT || action == ML_DELETE)
+    buf->b_ml.ml_leaf_count = 0;
+
   /*
    * If there is a locked block check if the wanted line is in it.
    * If not, flush and release the locked block.
@@ -2819,6 +3058,9 @@ static bhdr_T *ml_find_line(buf_T *buf, linenr_T lnum, int action)
   if (action == ML_FLUSH)           /* nothing else to do */
     return NULL;
 
+  if (action == ML_FIND && (hp = ml_find_leaf(buf, lnum)) != NULL)
+    return hp;
+
   bnum = 1;                         /* start at the root of the tree */
   page_count = 1;
   low = 1;
@@ -2862,6 +3104,8 @@ static bhdr_T *ml_find_line(buf_T *buf, linenr_T lnum, int action)
       buf->b_ml.ml_locked_high = high;
       buf->b_ml.ml_locked_lineadd = 0;
       buf->b_ml.ml_flags &= ~(ML_LOCKED_DIRTY | ML_LOCKED_POS);
+      if (action == ML_FIND)
+        ml_add_leaf(buf, bnum, page_count, low, high);
       return hp;
     }
 
@@ -2939,6 +3183,87 @@ error_noblock:
   return NULL;
 }
 
+/*
+ * Find line "lnum" in one of the data blocks remembered by ml_add_leaf().
+ * When found the block is locked and put in ml_locked, and the stack is
+ * restored to lead to it, like ml_find_line() does.
+ * Returns NULL when the line is not in one of them.
+ */
+static bhdr_T *ml_find_leaf(buf_T *buf, linenr_T lnum)
+{
+  memfile_T   *mfp = buf->b_ml.ml_mfp;
+  mlleaf_T    *lf = NULL;
+  bhdr_T      *hp;
+  DATA_BL     *dp;
+  int i;
+
+  for (i = 0; i < buf->b_ml.ml_leaf_count; ++i) {
+    lf = &buf->b_ml.ml_leaves[i];
+    if (lf->lf_low <= lnum && lf->lf_high >= lnum)
+      break;
+  }
+  if (i == buf->b_ml.ml_leaf_count)
+    return NULL;
+
+  /*
+   * When a negative block number was translated the block can't be found
+   * with it.  Going down the tree updates the pointer block then.  Also
+   * check that the block still has the remembered lines.
+   */
+  hp = mf_get(mfp, lf->lf_bnum, lf->lf_page_count);
+  if (hp != NULL) {
+    dp = (DATA_BL *)(hp->bh_data);
+    if (dp->db_id != DATA_ID
+        || dp->db_line_count != lf->lf_high - lf->lf_low + 1) {
+      mf_put(mfp, hp, FALSE, FALSE);
+      hp = NULL;
+    }
+  }
+  if (hp == NULL) {
+    *lf = buf->b_ml.ml_leaves[--buf->b_ml.ml_leaf_count];
+    return NULL;
+  }
+
+  buf->b_ml.ml_stack_top = 0;
+  for (i = 0; i < lf->lf_depth; ++i)
+    buf->b_ml.ml_stack[ml_add_stack(buf)] = lf->lf_stack[i];
+
+  buf->b_ml.ml_locked = hp;
+  buf->b_ml.ml_locked_low = lf->lf_low;
+  buf->b_ml.ml_locked_high = lf->lf_high;
+  buf->b_ml.ml_locked_lineadd = 0;
+  buf->b_ml.ml_flags &= ~(ML_LOCKED_DIRTY | ML_LOCKED_POS);
+  return hp;
+}
+
+/*
+ * Remember data block "bnum" with "page_count" pages, which contains lines
+ * "low" to "high" and was found by going down the tree with the current
+ * stack.  Replaces the oldest entry when there is no room.
+ */
+static void ml_add_leaf(buf_T *buf, blocknr_T bnum, int page_count,
+                        linenr_T low, linenr_T high)
+{
+  mlleaf_T    *lf;
+  int depth = buf->b_ml.ml_stack_top;
+
+  if (depth > ML_LEAF_DEPTH)
+    return;
+
+  if (buf->b_ml.ml_leaf_count < ML_LEAF_COUNT) {
+    lf = &buf->b_ml.ml_leaves[buf->b_ml.ml_leaf_count++];
+  } else {
+    lf = &buf->b_ml.ml_leaves[buf->b_ml.ml_leaf_next];
+    buf->b_ml.ml_leaf_next = (buf->b_ml.ml_leaf_next + 1) % ML_LEAF_COUNT;
+  }
+  lf->lf_bnum = bnum;
+  lf->lf_page_count = page_count;
+  lf->lf_low = low;
+  lf->lf_high = high;
+  lf->lf_depth = depth;
+  memmove(lf->lf_stack, buf->b_ml.ml_stack, (size_t)depth * sizeof(infoptr_T));
+}
+
 /*
  * add an entry to the info pointer stack
  *
@@ -3876,6 +4201,9 @@ long ml_find_line_or_offset(buf_T *buf, linenr_T lnum, long *offp)
   /* take care of cached line first */
   ml_flush_line(curbuf);
 
+  if (buf->b_ml.ml_mmap != NULL)
+    return ml_mmap_find_line_or_offset(buf, lnum, offp);
+
   if (buf->b_ml.ml_usedchunks == -1
       || buf->b_ml.ml_chunksize == NULL
       || lnum < 0)
@@ -3970,6 +4298,456 @@ long ml_find_line_or_offset(buf_T *buf, linenr_T lnum, long *offp)
   return size;
 }
 
+/*
+ * Add "mm" to the list of mappings, installing the SIGBUS handler when
+ * needed.  Returns FAIL when there is no handler, the file must not be
+ * mapped then.
+ */
+static int ml_mmap_guard(mlmmap_T *mm)
+{
+  struct sigaction sa;
+
+  if (!mm_sigbus_installed) {
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = ml_mmap_sigbus;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGBUS, &sa, &mm_sigbus_prev) != 0)
+      return FAIL;
+    mm_page_size = (size_t)sysconf(_SC_PAGESIZE);
+    mm_sigbus_installed = TRUE;
+  }
+  mm->mm_next = mm_first;
+  mm_first = mm;
+  return OK;
+}
+
+/*
+ * Handler for SIGBUS: reading a mapped file failed, because it was
+ * truncated.  The rest of the mapping is replaced with zeros, so that
+ * reading it can continue, and a message is given by ml_mmap_report().
+ * For an address that is not in a mapping the previous handler is restored,
+ * the fault happens again when returning and gets the usual treatment.
+ */
+static void ml_mmap_sigbus(int sig, siginfo_t *info, void *context)
+{
+  char_u      *addr = (char_u *)info->si_addr;
+  mlmmap_T    *mm;
+  size_t off;
+
+  for (mm = mm_first; mm != NULL; mm = mm->mm_next) {
+    if (addr >= mm->mm_base && addr < mm->mm_base + mm->mm_size) {
+      off = (size_t)(addr - mm->mm_base) & ~(mm_page_size - 1);
+      if (mmap(mm->mm_base + off, mm->mm_size - off, PROT_READ,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, (off_t)0)
+          == MAP_FAILED)
+        break;
+      if (off < mm->mm_valid)
+        mm->mm_valid = off;
+      mm->mm_truncated = TRUE;
+      mm_got_sigbus = TRUE;
+      return;
+    }
+  }
+  sigaction(SIGBUS, &mm_sigbus_prev, NULL);
+  mm_sigbus_installed = FALSE;
+}
+
+/*
+ * Give a message for the mapped files that were truncated.
+ */
+static void ml_mmap_report(void)
+{
+  mlmmap_T    *mm;
+
+  mm_got_sigbus = FALSE;
+  for (mm = mm_first; mm != NULL; mm = mm->mm_next)
+    if (mm->mm_truncated && !mm->mm_reported) {
+      mm->mm_reported = TRUE;
+      EMSG2(_("E211: File \"%s\" no longer available"), mm->mm_fname);
+    }
+}
+
+/*
+ * Return the offset of the start of the line that comes "count" lines
+ * after the one at offset "off" in the mapped file.  Stops at the end of the
+ * text that can be used.
+ */
+static size_t ml_mmap_skip(mlmmap_T *mm, size_t off, linenr_T count)
+{
+  size_t valid = mm->mm_valid;
+  char_u      *p = mm->mm_base + off;
+  char_u      *nl;
+
+  if (off >= valid)
+    return valid;
+  for (; count > 0; count--) {
+    nl = memchr(p, NL, (size_t)(mm->mm_base + valid - p));
+    if (nl == NULL)
+      return valid;
+    p = nl + 1;
+  }
+  return (size_t)(p - mm->mm_base);
+}
+
+/*
+ * Return the offset in the mapped file of the start of line "lnum", which
+ * must have been counted.  For a line after the last one the size of the
+ * text is returned, counting a missing NL at the end of the file.  While
+ * counting that is where counting stopped.
+ */
+static size_t ml_mmap_line_start(mlmmap_T *mm, linenr_T lnum)
+{
+  size_t idx;
+
+  if (lnum > mm->mm_line_count)
+    return mm->mm_counting ? mm->mm_counted
+                           : mm->mm_size + (mm->mm_no_eol ? 1 : 0);
+
+  idx = (size_t)(lnum - 1) / MM_INDEX_STEP;
+  return ml_mmap_skip(mm, mm->mm_index[idx], (lnum - 1) % MM_INDEX_STEP);
+}
+
+/*
+ * Return the length of the line that starts at offset "start" in the mapped
+ * file, excluding the NL.
+ */
+static size_t ml_mmap_line_len(mlmmap_T *mm, size_t start)
+{
+  size_t valid = mm->mm_valid;
+  char_u      *p = mm->mm_base + start;
+  char_u      *nl;
+
+  if (start >= valid)
+    return 0;
+  nl = memchr(p, NL, valid - start);
+  return (size_t)((nl == NULL ? mm->mm_base + valid : nl) - p);
+}
+
+/*
+ * Copy "len" bytes of the mapped file at "p" to "to" and add a NUL.  NULs in
+ * the text are replaced with NLs, like when reading a file.
+ */
+static void ml_mmap_copy(char_u *to, char_u *p, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+    to[i] = p[i] == NUL ? NL : p[i];
+  to[len] = NUL;
+}
+
+/*
+ * Return a NUL terminated copy of line "lnum" of the mapped file.  The copy is
+ * only valid until the next call.
+ */
+static char_u *ml_mmap_get(mlmmap_T *mm, linenr_T lnum)
+{
+  size_t start;
+  size_t len;
+
+  if (mm->mm_line_lnum == lnum)
+    return mm->mm_line;
+
+  start = ml_mmap_line_start(mm, lnum);
+  len = ml_mmap_line_len(mm, start);
+
+  if (len + 1 > mm->mm_line_size) {
+    mm->mm_line_size = len + 1 < 256 ? 256 : len + 1;
+    free(mm->mm_line);
+    mm->mm_line = xmalloc(mm->mm_line_size);
+  }
+  ml_mmap_copy(mm->mm_line, mm->mm_base + start, len);
+  mm->mm_line_lnum = lnum;
+
+  return mm->mm_line;
+}
+
+/*
+ * Turn the mapped file of "buf" into data blocks that are filled from the
+ * mapping when they are needed, see ml_mmap_fill().  Called before the first
+ * change to the buffer.  The lines are not copied, only the pointer blocks
+ * are made and the sizes for line2byte() computed.
+ */
+static void ml_mmap_materialize(buf_T *buf)
+{
+  mlmmap_T    *mm = buf->b_ml.ml_mmap;
+  memfile_T   *mfp = buf->b_ml.ml_mfp;
+  unsigned page_size = mfp->mf_page_size;
+  PTR_EN      *pe = NULL;
+  PTR_EN old_pe;
+  PTR_BL      *pp;
+  bhdr_T      *hp;
+  chunksize_T *cs;
+  size_t blocks_size = 0;
+  long count = 0;
+  long n;
+  long i;
+  int pb_count_max;
+  size_t start = 0;
+  size_t len;
+  size_t used;
+  linenr_T lnum = 1;
+  blocknr_T first;
+
+  /* All lines are needed.  Normally a change waited for them already and an
+   * illegal byte made the file read the usual way, otherwise the bytes are
+   * used as-is. */
+  (void)ml_mmap_count(buf, 0);
+  mm->mm_counting = FALSE;
+
+  buf->b_ml.ml_mmap = NULL;
+  buf->b_ml.ml_mmap_fill = mm;
+  free(buf->b_ml.ml_chunksize);
+  buf->b_ml.ml_numchunks = (int)(mm->mm_line_count / MLCS_MINL) + 2;
+  buf->b_ml.ml_chunksize = xcalloc((size_t)buf->b_ml.ml_numchunks,
+      sizeof(chunksize_T));
+  buf->b_ml.ml_usedchunks = 1;
+  cs = buf->b_ml.ml_chunksize;
+
+  /*
+   * Divide the lines over data blocks, as many as fit in a page, and
+   * compute the size of every chunk of MLCS_MINL lines.
+   */
+  while (lnum <= mm->mm_line_count) {
+    if ((size_t)count == blocks_size) {
+      blocks_size = blocks_size == 0 ? 1024 : blocks_size * 2;
+      mm->mm_blocks = xrealloc(mm->mm_blocks,
+          blocks_size * sizeof(mlmmblock_T));
+      pe = xrealloc(pe, blocks_size * sizeof(PTR_EN));
+    }
+    mm->mm_blocks[count].mb_start = start;
+    used = HEADER_SIZE;
+    for (n = 0; lnum <= mm->mm_line_count; n++, lnum++) {
+      len = ml_mmap_line_len(mm, start) + 1;
+      if (n > 0 && used + INDEX_SIZE + len > page_size)
+        break;
+      used += INDEX_SIZE + len;
+      start += len;                     /* past the NL */
+      if (start > mm->mm_valid)
+        start = mm->mm_valid;
+      if (cs->mlcs_numlines == MLCS_MINL) {
+        ++cs;
+        buf->b_ml.ml_usedchunks++;
+      }
+      cs->mlcs_numlines++;
+      cs->mlcs_totalsize += (long)len;
+    }
+    mm->mm_blocks[count].mb_line_count = (linenr_T)n;
+    pe[count].pe_bnum = 0;
+    pe[count].pe_line_count = (linenr_T)n;
+    pe[count].pe_old_lnum = lnum - (linenr_T)n;
+    pe[count].pe_page_count = (int)((used + page_size - 1) / page_size);
+    count++;
+  }
+
+  first = mf_new_fill(mfp, count, ml_mmap_fill, mm);
+  for (i = 0; i < count; i++)
+    pe[i].pe_bnum = first - i;
+
+  /*
+   * Add levels of pointer blocks until the root can hold the entries.
+   */
+  pb_count_max = (int)((page_size - sizeof(PTR_BL)) / sizeof(PTR_EN) + 1);
+  while (count > pb_count_max) {
+    n = 0;
+    for (i = 0; i < count; i += pb_count_max) {
+      hp = ml_new_ptr(mfp);
+      pp = (PTR_BL *)(hp->bh_data);
+      pp->pb_count = (uint16_t)(count - i < pb_count_max ? count - i
+                                                          : pb_count_max);
+      memmove(pp->pb_pointer, pe + i, pp->pb_count * sizeof(PTR_EN));
+      pe[n].pe_bnum = hp->bh_bnum;
+      pe[n].pe_page_count = 1;
+      pe[n].pe_old_lnum = pp->pb_pointer[0].pe_old_lnum;
+      pe[n].pe_line_count = 0;
+      for (int j = 0; j < pp->pb_count; j++)
+        pe[n].pe_line_count += pp->pb_pointer[j].pe_line_count;
+      mf_put(mfp, hp, TRUE, FALSE);
+      n++;
+    }
+    count = n;
+  }
+
+  /* Replace the data block with the empty line in the root. */
+  hp = mf_get(mfp, (blocknr_T)1, 1);
+  pp = (PTR_BL *)(hp->bh_data);
+  old_pe = pp->pb_pointer[0];
+  pp->pb_count = (uint16_t)count;
+  memmove(pp->pb_pointer, pe, (size_t)count * sizeof(PTR_EN));
+  mf_put(mfp, hp, TRUE, FALSE);
+  if ((hp = mf_get(mfp, old_pe.pe_bnum, old_pe.pe_page_count)) != NULL)
+    mf_free(mfp, hp);
+  free(pe);
+
+  buf->b_ml.ml_stack_top = 0;
+  buf->b_ml.ml_leaf_count = 0;
+  buf->b_ml.ml_line_lnum = 0;
+  lowest_marked = 0;
+}
+
+/*
+ * Get the data blocks of "buf" that are filled from a mapped file into
+ * memory and mark them changed, so that they are kept or written to the
+ * swap file.  Afterwards the mapping isn't used.
+ */
+static void ml_mmap_fill_all(buf_T *buf)
+{
+  bhdr_T      *hp;
+  linenr_T lnum;
+
+  for (lnum = 1; lnum <= buf->b_ml.ml_line_count;
+       lnum = buf->b_ml.ml_locked_high + 1) {
+    if ((hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+      break;
+    if (hp->bh_bnum < 0)
+      buf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+  }
+  (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+}
+
+/*
+ * Called before file "fname" is truncated for writing it: a buffer that uses
+ * a mapping of it gets all lines into its memfile, otherwise they would be
+ * lost.
+ */
+void ml_mmap_unmap_file(char_u *fname)
+{
+  FileID file_id;
+  buf_T       *buf;
+  mlmmap_T    *mm;
+
+  if (mm_first == NULL || !os_get_file_id((char *)fname, &file_id))
+    return;
+  for (buf = firstbuf; buf != NULL; buf = buf->b_next) {
+    mm = buf->b_ml.ml_mmap != NULL ? buf->b_ml.ml_mmap
+                                   : buf->b_ml.ml_mmap_fill;
+    if (mm == NULL || !os_file_id_equal(&file_id, &mm->mm_file_id))
+      continue;
+    if (buf->b_ml.ml_mmap != NULL)
+      ml_mmap_materialize(buf);
+    ml_flush_line(buf);
+    ml_mmap_fill_all(buf);
+    buf->b_ml.ml_mfp->mf_fill = NULL;
+    ml_mmap_free(buf->b_ml.ml_mmap_fill);
+    buf->b_ml.ml_mmap_fill = NULL;
+  }
+}
+
+/*
+ * Fill a data block with the lines of block "idx" of the mapped file "arg".
+ * Called by mf_get().  When the file was changed the lines are truncated to
+ * what fits in the block.
+ */
+static void ml_mmap_fill(void *arg, long idx, char_u *data, unsigned size)
+{
+  mlmmap_T    *mm = arg;
+  mlmmblock_T *mb = &mm->mm_blocks[idx];
+  DATA_BL     *dp = (DATA_BL *)data;
+  size_t start = mb->mb_start;
+  unsigned txt_start = size;
+  unsigned index_end = HEADER_SIZE + (unsigned)mb->mb_line_count * INDEX_SIZE;
+  size_t len;
+  size_t room;
+
+  memset(data, 0, size);
+  for (linenr_T i = 0; i < mb->mb_line_count; i++) {
+    len = ml_mmap_line_len(mm, start);
+    /* Keep room for the NUL of the other lines. */
+    room = txt_start - index_end - (size_t)(mb->mb_line_count - i - 1);
+    if (len + 1 > room)
+      len = room - 1;
+    txt_start -= (unsigned)len + 1;
+    ml_mmap_copy(data + txt_start, mm->mm_base + start, len);
+    dp->db_index[i] = txt_start;
+    start = ml_mmap_skip(mm, start, 1);
+  }
+  dp->db_id = DATA_ID;
+  dp->db_txt_start = txt_start;
+  dp->db_txt_end = size;
+  dp->db_free = txt_start - index_end;
+  dp->db_line_count = mb->mb_line_count;
+}
+
+/*
+ * Unmap the file of "mm" and free its memory.
+ */
+static void ml_mmap_free(mlmmap_T *mm)
+{
+  mlmmap_T    **mmp;
+
+  if (mm == NULL)
+    return;
+  for (mmp = &mm_first; *mmp != NULL; mmp = &(*mmp)->mm_next)
+    if (*mmp == mm) {
+      *mmp = mm->mm_next;
+      break;
+    }
+  munmap(mm->mm_base, mm->mm_size);
+  free(mm->mm_index);
+  free(mm->mm_line);
+  free(mm->mm_blocks);
+  free(mm->mm_fname);
+  free(mm);
+}
+
+/*
+ * ml_find_line_or_offset() for a buffer that uses a mapped file, which is
+ * always in Unix format.
+ */
+static long ml_mmap_find_line_or_offset(buf_T *buf, linenr_T lnum, long *offp)
+{
+  mlmmap_T    *mm = buf->b_ml.ml_mmap;
+  long offset = offp == NULL ? 0 : *offp;
+  long size;
+  long len;
+  size_t lo, hi;
+
+  if (lnum < 0)
+    return -1;
+  if (lnum == 0 && offset <= 0)
+    return 1;
+
+  if (lnum != 0) {
+    if (lnum > mm->mm_line_count)
+      (void)ml_mmap_count(buf, 0);
+    size = (long)ml_mmap_line_start(mm, lnum);
+    /* Don't count the last line break if 'bin' and 'noeol'. */
+    if (lnum > mm->mm_line_count && buf->b_p_bin && !buf->b_p_eol)
+      size--;
+    return size;
+  }
+
+  /* Count the lines up to "offset" and find the last index entry that
+   * starts before it. */
+  while (mm->mm_counting && mm->mm_counted <= (size_t)offset)
+    if (ml_mmap_count(buf, MM_COUNT_SIZE) == FAIL)
+      break;
+  if ((size_t)offset > ml_mmap_line_start(mm, mm->mm_line_count + 1))
+    return -1;                  /* beyond the end */
+
+  lo = 0;
+  hi = mm->mm_indexed - 1;
+  while (lo < hi) {
+    size_t mid = (lo + hi + 1) / 2;
+    if (mm->mm_index[mid] < (size_t)offset)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  for (lnum = (linenr_T)(lo * MM_INDEX_STEP) + 1;; lnum++) {
+    size = (long)ml_mmap_line_start(mm, lnum);
+    len = (long)ml_mmap_line_len(mm, (size_t)size) + 1;
+    if (size + len >= offset || lnum == mm->mm_line_count)
+      break;
+  }
+
+  if (size + len == offset)
+    *offp = 0;
+  else
+    *offp = offset - size;
+  return lnum;
+}
+
 /*
  * Goto byte in buffer with offset 'cnt'.
  */
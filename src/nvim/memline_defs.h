@@ -2,6 +2,7 @@
 #define NVIM_MEMLINE_DEFS_H
 
 #include "nvim/memfile_defs.h"
+#include "nvim/os/fs_defs.h"
 
 /*
  * When searching for a specific line, we remember what blocks in the tree
@@ -15,6 +16,23 @@ typedef struct info_pointer {
   int ip_index;                 /* index for block with current lnum */
 } infoptr_T;    /* block/index pair */
 
+/*
+ * ml_find_line() remembers the path to recently used data blocks, so that
+ * lines in them are found again without going down the tree.  This makes
+ * jumping between a few distant places in a big buffer cheap.
+ */
+#define ML_LEAF_COUNT   8       /* nr of data blocks remembered */
+#define ML_LEAF_DEPTH   6       /* max nr of pointer blocks on the path */
+
+typedef struct ml_leaf {
+  blocknr_T lf_bnum;            /* block number of the data block */
+  int lf_page_count;            /* number of pages in the data block */
+  linenr_T lf_low;              /* first line in the data block */
+  linenr_T lf_high;             /* last line in the data block */
+  int lf_depth;                 /* number of entries in lf_stack */
+  infoptr_T lf_stack[ML_LEAF_DEPTH];   /* ml_stack leading to the block */
+} mlleaf_T;
+
 typedef struct ml_chunksize {
   int mlcs_numlines;
   long mlcs_totalsize;
@@ -26,6 +44,48 @@ typedef struct ml_chunksize {
 #define ML_CHNK_DELLINE 2
 #define ML_CHNK_UPDLINE 3
 
+/*
+ * Lines of a mapped file that a data block is filled with, see
+ * ml_mmap_materialize().
+ */
+typedef struct {
+  size_t mb_start;              /* offset of the first line */
+  linenr_T mb_line_count;       /* number of lines */
+} mlmmblock_T;
+
+/*
+ * Read-only mapping of the file a buffer was loaded from.  While a memline
+ * has one in ml_mmap, lines are taken from the mapping instead of the
+ * memfile (see ml_open_mmap()).  After the first change it is in
+ * ml_mmap_fill and data blocks are filled from it when needed.
+ */
+typedef struct ml_mmap mlmmap_T;
+struct ml_mmap {
+  char_u      *mm_base;         /* start of the mapped file */
+  size_t mm_size;               /* number of mapped bytes */
+  volatile size_t mm_valid;     /* number of bytes that can be used, less
+                                   than mm_size when the file was truncated */
+  volatile int mm_truncated;    /* TRUE when the file was truncated */
+  int mm_reported;              /* TRUE when truncating was reported */
+  int mm_no_eol;                /* TRUE when the last line has no NL */
+  size_t      *mm_index;        /* offset of every MM_INDEX_STEP'th line */
+  size_t mm_index_size;         /* number of allocated mm_index entries */
+  size_t mm_indexed;            /* number of valid mm_index entries */
+  linenr_T mm_line_count;       /* number of lines counted */
+  size_t mm_counted;            /* number of bytes counted */
+  int mm_counting;              /* TRUE while not all lines were counted */
+  int mm_check_utf8;            /* TRUE when counted lines are checked for
+                                   illegal UTF-8 */
+  int mm_illegal;               /* TRUE when an illegal byte was found */
+  linenr_T mm_line_lnum;        /* line number of mm_line, 0 if not valid */
+  char_u      *mm_line;         /* NUL terminated copy of a line */
+  size_t mm_line_size;          /* allocated size of mm_line */
+  mlmmblock_T *mm_blocks;       /* lines of the data blocks to fill */
+  char_u      *mm_fname;        /* file name for messages */
+  FileID mm_file_id;            /* identifies the file */
+  mlmmap_T    *mm_next;         /* next one in the list of mappings */
+};
+
 /*
  * the memline structure holds all the information about a memline
  */
@@ -51,9 +111,18 @@ typedef struct memline {
   linenr_T ml_locked_low;       /* first line in ml_locked */
   linenr_T ml_locked_high;      /* last line in ml_locked */
   int ml_locked_lineadd;            /* number of lines inserted in ml_locked */
+
+  mlleaf_T ml_leaves[ML_LEAF_COUNT];  /* recently used data blocks */
+  int ml_leaf_count;            /* number of valid entries in ml_leaves */
+  int ml_leaf_next;             /* entry to replace when ml_leaves is full */
+
   chunksize_T *ml_chunksize;
   int ml_numchunks;
   int ml_usedchunks;
+
+  mlmmap_T    *ml_mmap;         /* mapped file, NULL when not used */
+  mlmmap_T    *ml_mmap_fill;    /* mapped file that data blocks are filled
+                                   from, NULL when not used */
 } memline_T;
 
 #endif // NVIM_MEMLINE_DEFS_H
@@ -1777,7 +1777,7 @@ static void msg_scroll_up(void)
 
     /* Also clear the last char of the last but one line if it was not
      * cleared before to avoid a scroll-up. */
-    if (ScreenAttrs[LineOffset[Rows - 2] + Columns - 1] == (sattr_T)-1)
+    if (ScreenCells[LineOffset[Rows - 2] + Columns - 1].sc_attr == (sattr_T)-1)
       screen_fill((int)Rows - 2, (int)Rows - 1,
           (int)Columns - 1, (int)Columns, ' ', ' ', 0);
   }
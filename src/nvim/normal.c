@@ -6885,6 +6885,10 @@ static void nv_goto(cmdarg_T *cap)
 {
   linenr_T lnum;
 
+  /* The last line or a line beyond the lines read so far needs all of
+   * them. */
+  if (cap->arg || cap->count0 > curbuf->b_ml.ml_line_count)
+    readfile_bg_wait(curbuf);
   if (cap->arg)
     lnum = curbuf->b_ml.ml_line_count;
   else
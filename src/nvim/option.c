@@ -453,6 +453,9 @@ static struct vimoption
   {"beautify",    "bf",   P_BOOL|P_VI_DEF,
    (char_u *)NULL, PV_NONE,
    {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
+  {"bgreadsize",  "brs",  P_NUM|P_VI_DEF,
+   (char_u *)&p_brs, PV_NONE,
+   {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
   {"binary",      "bin",  P_BOOL|P_VI_DEF|P_RSTAT,
    (char_u *)&p_bin, PV_BIN,
    {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
@@ -1107,6 +1110,9 @@ static struct vimoption
    (char_u *)&p_msm, PV_NONE,
    {(char_u *)"460000,2000,500", (char_u *)0L}
    SCRIPTID_INIT},
+  {"mmapsize",    "mms",  P_NUM|P_VI_DEF,
+   (char_u *)&p_mms, PV_NONE,
+   {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
   {"modeline",    "ml",   P_BOOL|P_VIM,
    (char_u *)&p_ml, PV_ML,
    {(char_u *)FALSE, (char_u *)TRUE} SCRIPTID_INIT},
@@ -1543,6 +1549,9 @@ static struct vimoption
    (char_u *)&p_tenc, PV_NONE,
    {(char_u *)"", (char_u *)0L}
    SCRIPTID_INIT},
+  {"termsync",    NULL,   P_BOOL|P_VI_DEF,
+   (char_u *)&p_tsy, PV_NONE,
+   {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
   {"terse",       NULL,   P_BOOL|P_VI_DEF,
    (char_u *)&p_terse, PV_NONE,
    {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
@@ -5655,6 +5664,14 @@ set_num_option (
     errmsg = e_positive;
     p_ss = 0;
   }
+  if (p_mms < 0) {
+    errmsg = e_positive;
+    p_mms = 0;
+  }
+  if (p_brs < 0) {
+    errmsg = e_positive;
+    p_brs = 0;
+  }
 
   /* May set global value for local option. */
   if ((opt_flags & (OPT_LOCAL | OPT_GLOBAL)) == 0)
@@ -5683,8 +5700,10 @@ static void check_redraw(long_u flags)
   if ((flags & P_RSTAT) || all)         /* mark all status lines dirty */
     status_redraw_all();
 
-  if ((flags & P_RBUF) || (flags & P_RWIN) || all)
+  if ((flags & P_RBUF) || (flags & P_RWIN) || all) {
     changed_window_setting();
+    render_cache_invalidate();
+  }
   if (flags & P_RBUF)
     redraw_curbuf_later(NOT_VALID);
   if (doclear)
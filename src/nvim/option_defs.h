@@ -302,6 +302,7 @@ static char *(p_bkc_values[]) =
 EXTERN char_u   *p_bdir;        /* 'backupdir' */
 EXTERN char_u   *p_bex;         /* 'backupext' */
 EXTERN char_u   *p_bsk;         /* 'backupskip' */
+EXTERN long p_brs;              /* 'bgreadsize' */
 EXTERN char_u   *p_breakat;     /* 'breakat' */
 EXTERN char_u   *p_cmp;         /* 'casemap' */
 EXTERN unsigned cmp_flags;
@@ -448,6 +449,7 @@ EXTERN long p_mmp;              /* 'maxmempattern' */
 EXTERN long p_mmt;              /* 'maxmemtot' */
 EXTERN long p_mis;              /* 'menuitems' */
 EXTERN char_u   *p_msm;         /* 'mkspellmem' */
+EXTERN long p_mms;              /* 'mmapsize' */
 EXTERN long p_mls;              /* 'modelines' */
 EXTERN char_u   *p_mouse;       /* 'mouse' */
 EXTERN char_u   *p_mousem;      /* 'mousemodel' */
@@ -551,6 +553,7 @@ EXTERN char_u   *p_tags;        /* 'tags' */
 EXTERN int p_tgst;              /* 'tagstack' */
 EXTERN int p_tbidi;             /* 'termbidi' */
 EXTERN char_u   *p_tenc;        /* 'termencoding' */
+EXTERN int p_tsy;               /* 'termsync' */
 EXTERN int p_terse;             /* 'terse' */
 EXTERN int p_to;                /* 'tildeop' */
 EXTERN int p_timeout;           /* 'timeout' */
@@ -20,6 +20,17 @@
 #include "nvim/map.h"
 #include "nvim/lib/kvec.h"
 
+// Minimum free space reserved in the unpacker buffer before each read
+#define CHANNEL_READ_SIZE 0xffff
+// Reading stops while the unpacker holds more unparsed bytes than this, until
+// `parse_msgpack` catches up
+#define CHANNEL_UNPARSED_MAX (16 * CHANNEL_READ_SIZE)
+// Responses queued by `parse_msgpack` are sent before the next request is
+// dispatched when there are this many of them, or when the first one was
+// queued this long ago(in nanoseconds)
+#define CHANNEL_PENDING_MAX 32
+#define CHANNEL_PENDING_NS 1000000
+
 typedef struct {
   uint64_t request_id;
   bool errored;
@@ -30,6 +41,8 @@ typedef struct {
   uint64_t id;
   PMap(cstr_t) *subscribed_events;
   bool is_job, enabled;
+  // Set while reading is stopped because of `CHANNEL_UNPARSED_MAX`
+  bool read_stopped;
   msgpack_unpacker *unpacker;
   union {
     Job *job;
@@ -41,12 +54,23 @@ typedef struct {
   } data;
   uint64_t next_request_id;
   kvec_t(ChannelCallFrame *) call_stack;
+  // Responses to requests parsed in the current `parse_msgpack` invocation,
+  // sent together by `channel_flush`
+  kvec_t(WBuffer *) pending_writes;
+  // `uv_hrtime` when the first of `pending_writes` was queued
+  uint64_t pending_since;
   size_t rpc_call_level;
+  // Time spent in `msgpack_rpc_call` for the requests of this channel
+  LatencyStats rpc_stats;
 } Channel;
 
 static uint64_t next_id = 1;
 static PMap(uint64_t) *channels = NULL;
 static PMap(cstr_t) *event_strings = NULL;
+// Incremented when a channel subscribes or unsubscribes
+static uint64_t subscription_tick = 0;
+// Number of channels that have `pending_writes`
+static size_t pending_channels = 0;
 static msgpack_sbuffer out_buffer;
 
 #ifdef INCLUDE_GENERATED_DECLARATIONS
@@ -99,6 +123,7 @@ bool channel_from_job(char **argv)
     return false;
   }
 
+  job_set_direct_stdout(channel->data.job, job_out_alloc, job_out_commit);
   return true;
 }
 
@@ -112,7 +137,10 @@ void channel_from_stream(uv_stream_t *stream)
   stream->data = NULL;
   channel->is_job = false;
   // read stream
-  channel->data.streams.read = rstream_new(parse_msgpack, 1024, channel, true);
+  channel->data.streams.read = rstream_new(parse_msgpack, 0, channel, true);
+  rstream_set_direct(channel->data.streams.read,
+                     unpacker_alloc,
+                     unpacker_commit);
   rstream_set_stream(channel->data.streams.read, stream);
   rstream_start(channel->data.streams.read);
   // write stream
@@ -139,7 +167,7 @@ bool channel_send_event(uint64_t id, char *name, Object arg)
     }
     send_event(channel, name, arg);
   } else {
-    broadcast_event(name, arg);
+    broadcast_event(name, name, arg);
   }
 
   return true;
@@ -217,6 +245,49 @@ bool channel_send_call(uint64_t id,
   return true;
 }
 
+/// Sends an event to the channels that subscribed to another event. Used to
+/// send related events to the same channels.
+///
+/// @param subscription The event type the channels subscribed to
+/// @param name The event name, an arbitrary string
+/// @param arg The event arg
+/// @return True if there was a subscribed channel and the data was sent to
+///         all subscribed channels, false otherwise.
+bool channel_send_grouped_event(char *subscription, char *name, Object arg)
+{
+  return broadcast_event(subscription, name, arg);
+}
+
+/// Gets a number that changes when a channel subscribes or unsubscribes to
+/// an event, including when a subscribed channel is closed
+uint64_t channel_subscription_tick(void)
+{
+  return subscription_tick;
+}
+
+/// Counts the channels that subscribed to an event
+///
+/// @param event The event type string
+/// @return The number of channels that receive `event` broadcasts
+size_t channel_subscriber_count(char *event)
+{
+  size_t count = 0;
+  Channel *channel;
+
+  if (!channels) {
+    // Not initialized yet
+    return 0;
+  }
+
+  map_foreach_value(channels, channel, {
+    if (pmap_has(cstr_t)(channel->subscribed_events, event)) {
+      count++;
+    }
+  });
+
+  return count;
+}
+
 /// Subscribes to event broadcasts
 ///
 /// @param id The channel id
@@ -237,6 +308,7 @@ void channel_subscribe(uint64_t id, char *event)
   }
 
   pmap_put(cstr_t)(channel->subscribed_events, event_string, event_string);
+  subscription_tick++;
 }
 
 /// Unsubscribes to event broadcasts
@@ -254,12 +326,56 @@ void channel_unsubscribe(uint64_t id, char *event)
   unsubscribe(channel, event);
 }
 
+/// Gets the request timing statistics of all channels
+///
+/// @param reset Reset the statistics after reading them
+/// @return An Array with a Dictionary for each channel, containing the
+///         channel "id" and the statistics of its "requests"
+Array channel_get_stats(bool reset)
+{
+  Array rv = ARRAY_DICT_INIT;
+  Channel *channel;
+
+  map_foreach_value(channels, channel, {
+    ADD(rv, DICTIONARY_OBJ(channel_stats(channel, reset)));
+  });
+
+  return rv;
+}
+
+static Dictionary channel_stats(Channel *channel, bool reset)
+{
+  Dictionary rv = ARRAY_DICT_INIT;
+
+  PUT(rv, "id", INTEGER_OBJ((Integer)channel->id));
+  PUT(rv, "requests",
+      DICTIONARY_OBJ(latency_stats_to_dict(&channel->rpc_stats)));
+
+  if (reset) {
+    memset(&channel->rpc_stats, 0, sizeof(channel->rpc_stats));
+  }
+
+  return rv;
+}
+
 static void job_out(RStream *rstream, void *data, bool eof)
 {
   Job *job = data;
   parse_msgpack(rstream, job_data(job), eof);
 }
 
+static char *job_out_alloc(RStream *rstream, void *data, size_t *size)
+{
+  Job *job = data;
+  return unpacker_alloc(rstream, job_data(job), size);
+}
+
+static void job_out_commit(RStream *rstream, void *data, size_t count)
+{
+  Job *job = data;
+  unpacker_commit(rstream, job_data(job), count);
+}
+
 static void job_err(RStream *rstream, void *data, bool eof)
 {
   // TODO(tarruda): plugin error messages should be sent to the error buffer
@@ -270,6 +386,33 @@ static void job_exit(Job *job, void *data)
   // TODO(tarruda): what should be done here?
 }
 
+// Reads from the channel streams are stored directly in the unpacker buffer,
+// which avoids copying every byte received through an intermediate buffer.
+static char *unpacker_alloc(RStream *rstream, void *data, size_t *size)
+{
+  Channel *channel = data;
+  msgpack_unpacker_reserve_buffer(channel->unpacker, CHANNEL_READ_SIZE);
+  *size = msgpack_unpacker_buffer_capacity(channel->unpacker);
+  return msgpack_unpacker_buffer(channel->unpacker);
+}
+
+// Called right after a read completes, before the next `unpacker_alloc`
+// call. Parsing is left to `parse_msgpack`, which may be deferred. Until it
+// runs the stream must not keep reading, or the unpacker would grow without
+// limit.
+static void unpacker_commit(RStream *rstream, void *data, size_t count)
+{
+  Channel *channel = data;
+  msgpack_unpacker_buffer_consumed(channel->unpacker, count);
+
+  if (!channel->read_stopped
+      && msgpack_unpacker_nonparsed_size(channel->unpacker)
+         > CHANNEL_UNPARSED_MAX) {
+    rstream_stop(rstream);
+    channel->read_stopped = true;
+  }
+}
+
 static void parse_msgpack(RStream *rstream, void *data, bool eof)
 {
   Channel *channel = data;
@@ -286,13 +429,7 @@ static void parse_msgpack(RStream *rstream, void *data, bool eof)
   }
 
   channel->rpc_call_level++;
-  uint32_t count = rstream_available(rstream);
-
-  // Feed the unpacker with data
-  msgpack_unpacker_reserve_buffer(channel->unpacker, count);
-  rstream_read(rstream, msgpack_unpacker_buffer(channel->unpacker), count);
-  msgpack_unpacker_buffer_consumed(channel->unpacker, count);
-
+  // The unpacker was already fed by `unpacker_commit`
   msgpack_unpacked unpacked;
   msgpack_unpacked_init(&unpacked);
   UnpackResult result;
@@ -315,15 +452,23 @@ static void parse_msgpack(RStream *rstream, void *data, bool eof)
       }
       msgpack_unpacked_destroy(&unpacked);
       // Bail out from this event loop iteration
-      goto end;
+      goto flush;
     }
 
-    // Perform the call
-    WBuffer *resp = msgpack_rpc_call(channel->id, &unpacked.data, &out_buffer);
-    // write the response
-    if (!channel_write(channel, resp)) {
-      goto end;
+    // Perform the call. The response is only queued, so pipelined requests
+    // are answered with a single write after all of them are processed.
+    // Responses that were queued for a while, or that would wait for a
+    // request that may run for long, are sent first.
+    uint64_t start = uv_hrtime();
+    if (kv_size(channel->pending_writes)
+        && (kv_size(channel->pending_writes) >= CHANNEL_PENDING_MAX
+            || start - channel->pending_since >= CHANNEL_PENDING_NS
+            || msgpack_rpc_may_block(&unpacked.data))) {
+      channel_flush(channel);
     }
+    WBuffer *resp = msgpack_rpc_call(channel->id, &unpacked.data, &out_buffer);
+    latency_stats_add(&channel->rpc_stats, uv_hrtime() - start);
+    channel_queue(channel, resp);
   }
 
   if (result == kUnpackResultFail) {
@@ -338,7 +483,16 @@ static void parse_msgpack(RStream *rstream, void *data, bool eof)
                            "an object with high level of nesting");
   }
 
-end:
+flush:
+  channel_flush(channel);
+
+  if (channel->read_stopped && channel->enabled) {
+    // All complete messages were parsed, what is left is the start of the
+    // next one, which needs more data
+    channel->read_stopped = false;
+    rstream_start(rstream);
+  }
+
   channel->rpc_call_level--;
   if (!channel->enabled && !kv_size(channel->call_stack)) {
     // Now it's safe to destroy the channel
@@ -348,12 +502,59 @@ end:
 
 static bool channel_write(Channel *channel, WBuffer *buffer)
 {
+  // Queued responses must reach the client before anything sent after them
+  channel_queue(channel, buffer);
+  return channel_flush(channel);
+}
+
+// Queues `buffer` to be sent by the next `channel_flush`
+static void channel_queue(Channel *channel, WBuffer *buffer)
+{
+  if (!kv_size(channel->pending_writes)) {
+    channel->pending_since = uv_hrtime();
+    pending_channels++;
+  }
+
+  kv_push(WBuffer *, channel->pending_writes, buffer);
+}
+
+/// Sends the queued responses of all channels. Called when the event loop is
+/// entered while requests are being handled: a request that waits for input
+/// or for another channel must not delay the responses to earlier requests.
+void channel_flush_pending(void)
+{
+  if (!pending_channels) {
+    return;
+  }
+
+  Channel *channel;
+
+  map_foreach_value(channels, channel, {
+    if (channel->enabled) {
+      channel_flush(channel);
+    }
+  });
+}
+
+// Sends all queued buffers with a single write request
+static bool channel_flush(Channel *channel)
+{
+  size_t count = kv_size(channel->pending_writes);
+
+  if (!count) {
+    return true;
+  }
+
+  WBuffer **buffers = channel->pending_writes.items;
   bool success;
+  // The buffers are owned by the stream from now on
+  kv_size(channel->pending_writes) = 0;
+  pending_channels--;
 
   if (channel->is_job) {
-    success = job_write(channel->data.job, buffer);
+    success = job_writev(channel->data.job, buffers, count);
   } else {
-    success = wstream_write(channel->data.streams.write, buffer);
+    success = wstream_writev(channel->data.streams.write, buffers, count);
   }
 
   if (!success) {
@@ -392,14 +593,17 @@ static void send_event(Channel *channel,
   channel_write(channel, serialize_request(0, method, arg, &out_buffer));
 }
 
-static void broadcast_event(char *name, Object arg)
+// Sends event `name` to the channels subscribed to `subscription`. Returns
+// false if there was no such channel or a write failed.
+static bool broadcast_event(char *subscription, char *name, Object arg)
 {
   kvec_t(Channel *) subscribed;
   kv_init(subscribed);
   Channel *channel;
+  bool success = false;
 
   map_foreach_value(channels, channel, {
-    if (pmap_has(cstr_t)(channel->subscribed_events, name)) {
+    if (pmap_has(cstr_t)(channel->subscribed_events, subscription)) {
       kv_push(Channel *, subscribed, channel);
     }
   });
@@ -412,18 +616,23 @@ static void broadcast_event(char *name, Object arg)
   String method = {.size = strlen(name), .data = name};
   WBuffer *buffer = serialize_request(0, method, arg, &out_buffer);
 
+  success = true;
   for (size_t i = 0; i < kv_size(subscribed); i++) {
-    channel_write(kv_A(subscribed, i), buffer);
+    if (!channel_write(kv_A(subscribed, i), buffer)) {
+      success = false;
+    }
   }
 
 end:
   kv_destroy(subscribed);
+  return success;
 }
 
 static void unsubscribe(Channel *channel, char *event)
 {
   char *event_string = pmap_get(cstr_t)(event_strings, event);
   pmap_del(cstr_t)(channel->subscribed_events, event_string);
+  subscription_tick++;
 
   map_foreach_value(channels, channel, {
     if (pmap_has(cstr_t)(channel->subscribed_events, event_string)) {
@@ -459,6 +668,17 @@ static void close_channel(Channel *channel)
 
   pmap_free(cstr_t)(channel->subscribed_events);
   kv_destroy(channel->call_stack);
+
+  // Release responses that were never flushed
+  if (kv_size(channel->pending_writes)) {
+    pending_channels--;
+  }
+
+  for (size_t i = 0; i < kv_size(channel->pending_writes); i++) {
+    wstream_free_buffer(kv_A(channel->pending_writes, i));
+  }
+
+  kv_destroy(channel->pending_writes);
   free(channel);
 }
 
@@ -472,12 +692,15 @@ static Channel *register_channel()
 {
   Channel *rv = xmalloc(sizeof(Channel));
   rv->enabled = true;
+  rv->read_stopped = false;
   rv->rpc_call_level = 0;
   rv->unpacker = msgpack_unpacker_new(MSGPACK_UNPACKER_INIT_BUFFER_SIZE);
   rv->id = next_id++;
   rv->subscribed_events = pmap_new(cstr_t)();
   rv->next_request_id = 1;
   kv_init(rv->call_stack);
+  kv_init(rv->pending_writes);
+  memset(&rv->rpc_stats, 0, sizeof(rv->rpc_stats));
   pmap_put(uint64_t)(channels, rv->id, rv);
   return rv;
 }
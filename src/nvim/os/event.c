@@ -1,6 +1,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sched.h>
 
 #include <uv.h>
 
@@ -12,8 +14,11 @@
 #include "nvim/os/rstream.h"
 #include "nvim/os/job.h"
 #include "nvim/vim.h"
+#include "nvim/memfile.h"
 #include "nvim/memory.h"
 #include "nvim/misc2.h"
+#include "nvim/quickfix.h"
+#include "nvim/api/private/helpers.h"
 
 #include "nvim/lib/klist.h"
 
@@ -21,6 +26,18 @@
 #define _destroy_event(x)  // do nothing
 KLIST_INIT(Event, Event, _destroy_event)
 
+// Number of slots in the queue used by other threads, must be a power of two
+#define ASYNC_QUEUE_SIZE 1024
+
+// Slot of the queue filled by other threads. `seq` tells the state of the
+// slot: it is equal to the position of a producer when the slot is free, and
+// one more than that when it contains an event for the loop thread.
+typedef struct {
+  size_t seq;
+  Event event;
+  bool deferred;
+} AsyncSlot;
+
 typedef struct {
   bool timed_out;
   int32_t ms;
@@ -32,11 +49,39 @@ typedef struct {
 #endif
 static klist_t(Event) *deferred_events, *immediate_events;
 
+// Bounded multi-producer single-consumer queue. Worker threads reserve a
+// position by incrementing `async_head`, only the loop thread reads from
+// `async_tail`. Pushing doesn't take a lock and doesn't allocate memory.
+static AsyncSlot async_queue[ASYNC_QUEUE_SIZE];
+static size_t async_head, async_tail;
+// Wakes the event loop after events were pushed by another thread
+static uv_async_t async_handle;
+
+// Time spent handling each event type and each `event_process` call that
+// handled events, and the largest size the queues had
+static LatencyStats event_stats[kEventTypeCount], process_stats;
+static size_t deferred_high_water, immediate_high_water;
+static const char *event_type_names[kEventTypeCount] = {
+  [kEventSignal] = "signal",
+  [kEventRStreamData] = "rstream_data",
+  [kEventJobExit] = "job_exit",
+  [kEventSwapWrite] = "swap_write",
+  [kEventVimgrepRead] = "vimgrep_read"
+};
+
 void event_init()
 {
   // Initialize the event queues
   deferred_events = kl_init(Event);
   immediate_events = kl_init(Event);
+  // Initialize the queue used by other threads
+  for (size_t i = 0; i < ASYNC_QUEUE_SIZE; i++) {
+    async_queue[i].seq = i;
+  }
+  async_head = async_tail = 0;
+  uv_async_init(uv_default_loop(), &async_handle, async_cb);
+  // Pending work keeps the loop alive, the handle itself shouldn't
+  uv_unref((uv_handle_t *)&async_handle);
   // Initialize input events
   input_init();
   // Timer to wake the event loop if a timeout argument is passed to
@@ -56,6 +101,7 @@ void event_teardown()
   channel_teardown();
   job_teardown();
   server_teardown();
+  uv_close((uv_handle_t *)&async_handle, NULL);
 }
 
 // Wait for some event
@@ -70,6 +116,10 @@ bool event_poll(int32_t ms)
     input_start();
   }
 
+  // A RPC request that waits or runs for long must not hold back the
+  // responses to the requests before it
+  channel_flush_pending();
+
   uv_timer_t timer;
   uv_prepare_t timer_prepare;
   TimerData timer_data = {.ms = ms, .timed_out = false, .timer = &timer};
@@ -129,7 +179,69 @@ bool event_has_deferred()
 // Push an event to the queue
 void event_push(Event event, bool deferred)
 {
-  *kl_pushp(Event, get_queue(deferred)) = event;
+  klist_t(Event) *queue = get_queue(deferred);
+  size_t *high_water = deferred ? &deferred_high_water : &immediate_high_water;
+
+  *kl_pushp(Event, queue) = event;
+  if (queue->size > *high_water) {
+    *high_water = queue->size;
+  }
+}
+
+// Push an event to the queue from a thread other than the loop thread, for
+// example from a `uv_work_t` callback. The event is moved to the normal
+// queues by the loop thread, in the order it was pushed. Waits while the
+// queue is full, so it must not be called from the loop thread.
+void event_push_async(Event event, bool deferred)
+{
+  size_t pos = __atomic_load_n(&async_head, __ATOMIC_RELAXED);
+  AsyncSlot *slot;
+
+  for (;;) {
+    slot = &async_queue[pos & (ASYNC_QUEUE_SIZE - 1)];
+    size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0) {
+      // The slot is free, try to reserve it
+      if (__atomic_compare_exchange_n(&async_head, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The queue is full, let the loop thread drain it
+      uv_async_send(&async_handle);
+      sched_yield();
+      pos = __atomic_load_n(&async_head, __ATOMIC_RELAXED);
+    } else {
+      // Another producer took the slot
+      pos = __atomic_load_n(&async_head, __ATOMIC_RELAXED);
+    }
+  }
+
+  slot->event = event;
+  slot->deferred = deferred;
+  // Publish the event
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  uv_async_send(&async_handle);
+}
+
+// Clears references to `rstream` from events that are still queued, so they
+// are ignored after the instance is freed
+void event_discard_rstream(RStream *rstream)
+{
+  for (int i = 0; i < 2; i++) {
+    klist_t(Event) *queue = get_queue(i == 0);
+
+    for (kliter_t(Event) *it = kl_begin(queue);
+         it != kl_end(queue);
+         it = kl_next(it)) {
+      if (kl_val(it).type == kEventRStreamData
+          && kl_val(it).data.rstream.ptr == rstream) {
+        kl_val(it).data.rstream.ptr = NULL;
+      }
+    }
+  }
 }
 
 // Runs the appropriate action for each queued event
@@ -137,9 +249,13 @@ bool event_process(bool deferred)
 {
   bool processed_events = false;
   Event event;
+  uint64_t start = uv_hrtime();
+
+  async_drain();
 
   while (kl_shift(Event, get_queue(deferred), &event) == 0) {
     processed_events = true;
+    uint64_t event_start = uv_hrtime();
     switch (event.type) {
       case kEventSignal:
         signal_handle(event);
@@ -150,14 +266,117 @@ bool event_process(bool deferred)
       case kEventJobExit:
         job_exit_event(event);
         break;
+      case kEventSwapWrite:
+        mf_write_event(event);
+        break;
+      case kEventVimgrepRead:
+        vgr_read_event(event);
+        break;
       default:
         abort();
     }
+    latency_stats_add(&event_stats[event.type], uv_hrtime() - event_start);
+  }
+
+  if (processed_events) {
+    latency_stats_add(&process_stats, uv_hrtime() - start);
   }
 
   return processed_events;
 }
 
+/// Records a duration in `stats`
+///
+/// @param stats The statistics to update
+/// @param ns The duration in nanoseconds
+void latency_stats_add(LatencyStats *stats, uint64_t ns)
+{
+  uint64_t us = ns / 1000;
+  size_t bucket = 0;
+
+  while (bucket < LATENCY_BUCKETS - 1 && us >= ((uint64_t)1 << bucket)) {
+    bucket++;
+  }
+
+  stats->count++;
+  stats->total += ns;
+  if (ns > stats->max) {
+    stats->max = ns;
+  }
+  stats->buckets[bucket]++;
+}
+
+/// Converts `stats` to a Dictionary with the count and the total, maximum,
+/// median and 99th percentile durations in microseconds. The percentiles are
+/// the upper bounds of the buckets that contain them.
+///
+/// @param stats The statistics to convert
+/// @return The dictionary
+Dictionary latency_stats_to_dict(LatencyStats *stats)
+{
+  Dictionary rv = ARRAY_DICT_INIT;
+
+  PUT(rv, "count", INTEGER_OBJ((Integer)stats->count));
+  PUT(rv, "total_us", INTEGER_OBJ((Integer)(stats->total / 1000)));
+  PUT(rv, "max_us", INTEGER_OBJ((Integer)(stats->max / 1000)));
+  PUT(rv, "p50_us", INTEGER_OBJ(latency_stats_percentile(stats, 50)));
+  PUT(rv, "p99_us", INTEGER_OBJ(latency_stats_percentile(stats, 99)));
+  return rv;
+}
+
+/// Gets the event loop statistics
+///
+/// @param reset Reset the statistics after reading them
+/// @return A Dictionary with the statistics of each event type in "events",
+///         of the `event_process` calls in "process" and the queue sizes
+Dictionary event_get_stats(bool reset)
+{
+  Dictionary rv = ARRAY_DICT_INIT;
+  Dictionary events = ARRAY_DICT_INIT;
+
+  for (int i = 0; i < kEventTypeCount; i++) {
+    PUT(events,
+        event_type_names[i],
+        DICTIONARY_OBJ(latency_stats_to_dict(&event_stats[i])));
+  }
+
+  PUT(rv, "events", DICTIONARY_OBJ(events));
+  PUT(rv, "process", DICTIONARY_OBJ(latency_stats_to_dict(&process_stats)));
+  PUT(rv, "deferred_queued", INTEGER_OBJ((Integer)deferred_events->size));
+  PUT(rv, "immediate_queued", INTEGER_OBJ((Integer)immediate_events->size));
+  PUT(rv, "deferred_high_water", INTEGER_OBJ((Integer)deferred_high_water));
+  PUT(rv, "immediate_high_water", INTEGER_OBJ((Integer)immediate_high_water));
+
+  if (reset) {
+    memset(event_stats, 0, sizeof(event_stats));
+    memset(&process_stats, 0, sizeof(process_stats));
+    deferred_high_water = deferred_events->size;
+    immediate_high_water = immediate_events->size;
+  }
+
+  return rv;
+}
+
+static Integer latency_stats_percentile(LatencyStats *stats, int percent)
+{
+  uint64_t seen = 0;
+  // Number of recorded durations that are not above the percentile
+  uint64_t rank = (stats->count * (uint64_t)percent + 99) / 100;
+
+  if (!stats->count) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < LATENCY_BUCKETS - 1; i++) {
+    seen += stats->buckets[i];
+    if (seen >= rank) {
+      return (Integer)1 << i;
+    }
+  }
+
+  return (Integer)(stats->max / 1000);
+}
+
 // Set a flag in the `event_poll` loop for signaling of a timeout
 static void timer_cb(uv_timer_t *handle)
 {
@@ -173,6 +392,33 @@ static void timer_prepare_cb(uv_prepare_t *handle)
   uv_prepare_stop(handle);
 }
 
+// Moves the events pushed by other threads to the normal queues. Runs on the
+// loop thread only.
+static void async_drain(void)
+{
+  for (;;) {
+    AsyncSlot *slot = &async_queue[async_tail & (ASYNC_QUEUE_SIZE - 1)];
+    size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if (seq != async_tail + 1) {
+      // Empty, or the producer didn't finish writing the slot yet. In the
+      // latter case it will send another wakeup.
+      break;
+    }
+
+    event_push(slot->event, slot->deferred);
+    // Free the slot for the producer that wraps around to it
+    __atomic_store_n(&slot->seq, async_tail + ASYNC_QUEUE_SIZE,
+                     __ATOMIC_RELEASE);
+    async_tail++;
+  }
+}
+
+static void async_cb(uv_async_t *handle)
+{
+  async_drain();
+}
+
 static klist_t(Event) *get_queue(bool deferred)
 {
   return deferred ? deferred_events : immediate_events;
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "nvim/api/private/defs.h"
 #include "nvim/os/event_defs.h"
 #include "nvim/os/job_defs.h"
 
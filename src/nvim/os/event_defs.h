@@ -1,13 +1,32 @@
 #ifndef NVIM_OS_EVENT_DEFS_H
 #define NVIM_OS_EVENT_DEFS_H
 
+#include <stdint.h>
+
 #include "nvim/os/job_defs.h"
 #include "nvim/os/rstream_defs.h"
 
+struct mf_write;
+struct vgr_read;
+
+// Number of latency buckets, bucket `i` counts durations below 2^i
+// microseconds, the last one everything that is longer
+#define LATENCY_BUCKETS 24
+
+typedef struct {
+  uint64_t count;
+  uint64_t total;  // nanoseconds
+  uint64_t max;  // nanoseconds
+  uint64_t buckets[LATENCY_BUCKETS];
+} LatencyStats;
+
 typedef enum {
   kEventSignal,
   kEventRStreamData,
-  kEventJobExit
+  kEventJobExit,
+  kEventSwapWrite,
+  kEventVimgrepRead,
+  kEventTypeCount
 } EventType;
 
 typedef struct {
@@ -19,6 +38,8 @@ typedef struct {
       bool eof;
     } rstream;
     Job *job;
+    struct mf_write *swap_write;
+    struct vgr_read *vgr_read;
   } data;
 } Event;
 
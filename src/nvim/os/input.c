@@ -12,9 +12,12 @@
 #include "nvim/ui.h"
 #include "nvim/fileio.h"
 #include "nvim/getchar.h"
+#include "nvim/syntax.h"
 #include "nvim/term.h"
 
 #define READ_BUFFER_SIZE 256
+// Milliseconds of background work between checks for typed keys
+#define IDLE_SLICE_MS 10
 
 typedef enum {
   kInputNone,
@@ -71,7 +74,27 @@ int os_inchar(uint8_t *buf, int maxlen, int32_t ms, int tb_change_cnt)
       return 0;
     }
   } else {
-    if ((result = inbuf_poll(p_ut)) == kInputNone) {
+    // Until a key is typed, count the lines of mapped files and save syntax
+    // states ahead of time. The time it takes counts for 'updatetime'.
+    uint64_t idle_start = uv_hrtime();
+    int old_redraw = must_redraw;
+
+    while ((result = inbuf_poll(0)) == kInputNone
+           && (readfile_bg_idle(IDLE_SLICE_MS)
+               || syntax_idle(IDLE_SLICE_MS))) {
+    }
+
+    // Show lines that were counted meanwhile.
+    if (result == kInputNone && must_redraw > old_redraw && maxlen >= 3) {
+      return push_event_key(buf, maxlen);
+    }
+
+    if (result == kInputNone) {
+      int64_t idle_ms = (int64_t)((uv_hrtime() - idle_start) / 1000000);
+      result = inbuf_poll(idle_ms < p_ut ? (int32_t)(p_ut - idle_ms) : 0);
+    }
+
+    if (result == kInputNone) {
       if (trigger_cursorhold() && maxlen >= 3
           && !typebuf_changed(tb_change_cnt)) {
         buf[0] = K_SPECIAL;
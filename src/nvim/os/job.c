@@ -269,6 +269,18 @@ bool job_write(Job *job, WBuffer *buffer)
   return wstream_write(job->in, buffer);
 }
 
+/// Writes multiple buffers to the job's stdin with a single write request.
+///
+/// @param job The Job instance
+/// @param buffers Array of buffers which contain the data to be written
+/// @param count Number of items in `buffers`
+/// @return true if the write request was successfully sent, false if writing
+///         to the job stream failed (possibly because the OS buffer is full)
+bool job_writev(Job *job, WBuffer **buffers, size_t count)
+{
+  return wstream_writev(job->in, buffers, count);
+}
+
 /// Sets the `defer` flag for a Job instance
 ///
 /// @param rstream The Job id
@@ -280,6 +292,20 @@ void job_set_defer(Job *job, bool defer)
   rstream_set_defer(job->err, defer);
 }
 
+/// Makes the job stdout stream read directly into caller-owned memory.
+/// See `rstream_set_direct` for details. The callbacks receive the `Job`
+/// instance as data.
+///
+/// @param job The Job instance
+/// @param alloc_cb Function that returns the memory for the next read
+/// @param commit_cb Function called with the number of bytes read
+void job_set_direct_stdout(Job *job,
+                           rstream_alloc_cb alloc_cb,
+                           rstream_commit_cb commit_cb)
+{
+  rstream_set_direct(job->out, alloc_cb, commit_cb);
+}
+
 
 /// Runs the read callback associated with the job exit event
 ///
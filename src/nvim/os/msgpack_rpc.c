@@ -57,6 +57,20 @@ WBuffer *msgpack_rpc_call(uint64_t channel_id,
   return serialize_response(response_id, NULL, rv, sbuffer);
 }
 
+/// Tests if a request calls an API function that may wait for input or
+/// re-enter the event loop, for instance by running Vim script.
+///
+/// @param req The parsed request object, which may be invalid
+/// @return true if the request may block
+bool msgpack_rpc_may_block(msgpack_object *req)
+  FUNC_ATTR_NONNULL_ALL
+{
+  return req->type == MSGPACK_OBJECT_ARRAY
+      && req->via.array.size == 4
+      && req->via.array.ptr[2].type == MSGPACK_OBJECT_POSITIVE_INTEGER
+      && msgpack_rpc_method_may_block(req->via.array.ptr[2].via.u64);
+}
+
 /// Try to unpack a msgpack document from the data in the unpacker buffer. This
 /// function is a replacement to msgpack.h `msgpack_unpack_next` that lets
 /// the called know if the unpacking failed due to bad input or due to missing
@@ -33,6 +33,13 @@ Object msgpack_rpc_dispatch(uint64_t channel_id,
                             Error *err)
   FUNC_ATTR_NONNULL_ARG(2) FUNC_ATTR_NONNULL_ARG(3);
 
+/// Tests if calling an API function may wait for input or re-enter the
+/// event loop. The implementation is generated with `msgpack_rpc_dispatch`.
+///
+/// @param method_id The method id
+/// @return true if the function may block
+bool msgpack_rpc_method_may_block(uint64_t method_id);
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "os/msgpack_rpc.h.generated.h"
 #endif
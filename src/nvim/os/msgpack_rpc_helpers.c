@@ -4,7 +4,9 @@
 #include <msgpack.h>
 
 #include "nvim/os/msgpack_rpc_helpers.h"
+#include "nvim/api/private/handle.h"
 #include "nvim/vim.h"
+#include "nvim/memline.h"
 #include "nvim/memory.h"
 
 #define REMOTE_FUNCS_IMPL(t, lt)                                            \
@@ -266,6 +268,10 @@ void msgpack_rpc_from_object(Object result, msgpack_packer *res)
     case kObjectTypeDictionary:
       msgpack_rpc_from_dictionary(result.data.dictionary, res);
       break;
+
+    case kObjectTypeBufferLines:
+      msgpack_rpc_from_bufferlines(result.data.bufferlines, res);
+      break;
   }
 }
 
@@ -295,6 +301,27 @@ void msgpack_rpc_from_dictionary(Dictionary result, msgpack_packer *res)
   }
 }
 
+void msgpack_rpc_from_bufferlines(BufferLines result, msgpack_packer *res)
+{
+  buf_T *buf = handle_get_buffer(result.buffer);
+
+  if (!buf || result.start >= result.end) {
+    msgpack_pack_array(res, 0);
+    return;
+  }
+
+  msgpack_pack_array(res, (size_t)(result.end - result.start));
+
+  // Lines are packed straight from the memline data blocks. Reading them in
+  // order keeps `ml_get_buf` within the locked block most of the time.
+  for (Integer lnum = result.start; lnum < result.end; lnum++) {
+    const char *line = (char *)ml_get_buf(buf, (linenr_T)lnum, false);
+    size_t len = strlen(line);
+    msgpack_pack_raw(res, len);
+    msgpack_pack_raw_body(res, line, len);
+  }
+}
+
 void msgpack_rpc_free_string(String value)
 {
   if (!value.data) {
@@ -315,6 +342,7 @@ void msgpack_rpc_free_object(Object value)
     case kObjectTypeBuffer:
     case kObjectTypeWindow:
     case kObjectTypeTabpage:
+    case kObjectTypeBufferLines:
       break;
 
     case kObjectTypeString:
@@ -83,6 +83,8 @@ void msgpack_rpc_from_array(Array result, msgpack_packer *res)
   FUNC_ATTR_NONNULL_ARG(2);
 void msgpack_rpc_from_dictionary(Dictionary result, msgpack_packer *res)
   FUNC_ATTR_NONNULL_ARG(2);
+void msgpack_rpc_from_bufferlines(BufferLines result, msgpack_packer *res)
+  FUNC_ATTR_NONNULL_ARG(2);
 
 /// Helpers for initializing types that may be freed later
 #define msgpack_rpc_init_boolean
@@ -119,6 +121,7 @@ void msgpack_rpc_free_windowarray(WindowArray value);
 void msgpack_rpc_free_tabpagearray(TabpageArray value);
 void msgpack_rpc_free_array(Array value);
 void msgpack_rpc_free_dictionary(Dictionary value);
+#define msgpack_rpc_free_bufferlines(value)
 
 #endif  // NVIM_OS_MSGPACK_RPC_HELPERS_H
 
@@ -23,6 +23,10 @@ struct rstream {
   uv_handle_type file_type;
   uv_file fd;
   rstream_cb cb;
+  // Set when reading directly into caller-owned memory(see
+  // `rstream_set_direct`)
+  rstream_alloc_cb direct_alloc_cb;
+  rstream_commit_cb direct_commit_cb;
   size_t buffer_size, rpos, wpos, fpos;
   bool reading, free_handle, defer;
 };
@@ -52,6 +56,8 @@ RStream * rstream_new(rstream_cb cb,
   rv->data = data;
   rv->defer = defer;
   rv->cb = cb;
+  rv->direct_alloc_cb = NULL;
+  rv->direct_commit_cb = NULL;
   rv->rpos = rv->wpos = rv->fpos = 0;
   rv->stream = NULL;
   rv->fread_idle = NULL;
@@ -74,6 +80,8 @@ void rstream_free(RStream *rstream)
     }
   }
 
+  // Events that were not processed yet must not reach the freed instance
+  event_discard_rstream(rstream);
   free(rstream->buffer);
   free(rstream);
 }
@@ -130,6 +138,44 @@ void rstream_set_file(RStream *rstream, uv_file file)
   rstream->free_handle = true;
 }
 
+/// Sets the position of the next read from a regular file, which is the start
+/// of the file unless this is called before `rstream_start`.
+///
+/// @param rstream The `RStream` instance
+/// @param offset Offset of the next read, in bytes from the start of the file
+void rstream_set_file_offset(RStream *rstream, size_t offset)
+{
+  assert(rstream->file_type == UV_FILE);
+  rstream->fpos = offset;
+}
+
+/// Switches a `RStream` instance to direct mode: Instead of being stored in
+/// the internal buffer(which is released), data is read straight into the
+/// memory returned by `alloc_cb`, and `commit_cb` is called as soon as the
+/// read completes, so the owner of the memory can account for it before the
+/// next read is started. `rstream_read`/`rstream_available` are meaningless
+/// for streams in this mode, the `rstream_cb` only signals that new data was
+/// committed(or that EOF was reached). The owner limits the memory used by
+/// stopping the stream from `commit_cb` and starting it again later.
+///
+/// This must be called before any data is read from the stream.
+///
+/// @param rstream The `RStream` instance
+/// @param alloc_cb Function that returns the memory for the next read
+/// @param commit_cb Function called with the number of bytes read
+void rstream_set_direct(RStream *rstream,
+                        rstream_alloc_cb alloc_cb,
+                        rstream_commit_cb commit_cb)
+{
+  assert(rstream->wpos == rstream->rpos);
+  free(rstream->buffer);
+  rstream->buffer = NULL;
+  rstream->buffer_size = 0;
+  rstream->rpos = rstream->wpos = 0;
+  rstream->direct_alloc_cb = alloc_cb;
+  rstream->direct_commit_cb = commit_cb;
+}
+
 /// Tests if the stream is backed by a regular file
 ///
 /// @param rstream The `RStream` instance
@@ -227,6 +273,11 @@ void rstream_read_event(Event event)
 {
   RStream *rstream = event.data.rstream.ptr;
 
+  if (rstream == NULL) {
+    // The instance was freed after the event was queued
+    return;
+  }
+
   rstream->cb(rstream, rstream->data, event.data.rstream.eof);
 }
 
@@ -242,8 +293,9 @@ static void alloc_cb(uv_handle_t *handle, size_t suggested, uv_buf_t *buf)
     return;
   }
 
-  buf->len = rstream->buffer_size - rstream->wpos;
-  buf->base = rstream->buffer + rstream->wpos;
+  size_t len;
+  buf->base = read_buffer(rstream, &len);
+  buf->len = len;
 
   // Avoid `alloc_cb`, `alloc_cb` sequences on windows
   rstream->reading = true;
@@ -271,13 +323,7 @@ static void read_cb(uv_stream_t *stream, ssize_t cnt, const uv_buf_t *buf)
 
   // Data was already written, so all we need is to update 'wpos' to reflect
   // the space actually used in the buffer.
-  rstream->wpos += nread;
-
-  if (rstream->wpos == rstream->buffer_size) {
-    // The last read filled the buffer, stop reading for now
-    rstream_stop(rstream);
-  }
-
+  commit_read(rstream, nread);
   rstream->reading = false;
   emit_read_event(rstream, false);
 }
@@ -288,8 +334,9 @@ static void fread_idle_cb(uv_idle_t *handle)
   uv_fs_t req;
   RStream *rstream = handle_get_rstream((uv_handle_t *)handle);
 
-  rstream->uvbuf.base = rstream->buffer + rstream->wpos;
-  rstream->uvbuf.len = rstream->buffer_size - rstream->wpos;
+  size_t len;
+  rstream->uvbuf.base = read_buffer(rstream, &len);
+  rstream->uvbuf.len = len;
 
   // the offset argument to uv_fs_read is int64_t, could someone really try
   // to read more than 9 quintillion (9e18) bytes?
@@ -321,15 +368,40 @@ static void fread_idle_cb(uv_idle_t *handle)
   // no errors (req.result (ssize_t) is positive), it's safe to cast.
   size_t nread = (size_t) req.result;
 
-  rstream->wpos += nread;
   rstream->fpos += nread;
+  commit_read(rstream, nread);
+  emit_read_event(rstream, false);
+}
+
+// Returns the memory that will receive the next read
+static char *read_buffer(RStream *rstream, size_t *len)
+{
+  if (rstream->direct_alloc_cb) {
+    return rstream->direct_alloc_cb(rstream, rstream->data, len);
+  }
+
+  *len = rstream->buffer_size - rstream->wpos;
+  return rstream->buffer + rstream->wpos;
+}
+
+// Accounts for `nread` bytes stored in the memory returned by `read_buffer`
+static void commit_read(RStream *rstream, size_t nread)
+{
+  if (rstream->direct_commit_cb) {
+    // The data is already where it should be, the owner only needs to know
+    // how much of it was filled. There's no internal buffer to fill up, so
+    // the stream keeps reading unless the owner calls `rstream_stop` until
+    // it has consumed the data.
+    rstream->direct_commit_cb(rstream, rstream->data, nread);
+    return;
+  }
+
+  rstream->wpos += nread;
 
   if (rstream->wpos == rstream->buffer_size) {
     // The last read filled the buffer, stop reading for now
     rstream_stop(rstream);
   }
-
-  emit_read_event(rstream, false);
 }
 
 static void close_cb(uv_handle_t *handle)
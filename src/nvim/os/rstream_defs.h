@@ -2,6 +2,7 @@
 #define NVIM_OS_RSTREAM_DEFS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct rstream RStream;
 
@@ -12,5 +13,22 @@ typedef struct rstream RStream;
 /// @param eof If the stream reached EOF.
 typedef void (*rstream_cb)(RStream *rstream, void *data, bool eof);
 
+/// Type of function called by a RStream in direct mode to obtain the memory
+/// that will receive the next read.
+///
+/// @param rstream The RStream instance
+/// @param data State associated with the RStream instance
+/// @param[out] size The number of bytes available in the returned buffer
+/// @return Pointer to the memory where the data will be stored
+typedef char *(*rstream_alloc_cb)(RStream *rstream, void *data, size_t *size);
+
+/// Type of function called by a RStream in direct mode after data was stored
+/// in the memory returned by the `rstream_alloc_cb`.
+///
+/// @param rstream The RStream instance
+/// @param data State associated with the RStream instance
+/// @param count Number of bytes that were stored
+typedef void (*rstream_commit_cb)(RStream *rstream, void *data, size_t count);
+
 #endif  // NVIM_OS_RSTREAM_DEFS_H
 
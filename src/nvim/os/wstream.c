@@ -30,7 +30,8 @@ struct wbuffer {
 
 typedef struct {
   WStream *wstream;
-  WBuffer *buffer;
+  size_t count;
+  WBuffer *buffers[];
 } WriteData;
 
 
@@ -89,38 +90,77 @@ void wstream_set_stream(WStream *wstream, uv_stream_t *stream)
 /// @param buffer The buffer which contains data to be written
 /// @return false if the write failed
 bool wstream_write(WStream *wstream, WBuffer *buffer)
+{
+  return wstream_writev(wstream, &buffer, 1);
+}
+
+/// Queues multiple buffers for writing with a single scatter/gather write
+/// request. The buffers are written in order. Like `wstream_write`, this will
+/// fail if the write would cause the WStream use more memory than specified
+/// by `maxmem`, in which case none of the buffers is written.
+///
+/// @param wstream The `WStream` instance
+/// @param buffers Array of buffers which contain data to be written
+/// @param count Number of items in `buffers`
+/// @return false if the write failed
+bool wstream_writev(WStream *wstream, WBuffer **buffers, size_t count)
 {
   WriteData *data;
-  uv_buf_t uvbuf;
+  uv_buf_t *uvbufs;
   uv_write_t *req;
+  size_t size = 0;
 
   // This should not be called after a wstream was freed
   assert(!wstream->freed);
+  assert(count > 0);
 
-  buffer->refcount++;
+  for (size_t i = 0; i < count; i++) {
+    buffers[i]->refcount++;
+    size += buffers[i]->size;
+  }
 
   if (wstream->curmem > wstream->maxmem) {
     goto err;
   }
 
-  wstream->curmem += buffer->size;
-  data = xmalloc(sizeof(WriteData));
+  wstream->curmem += size;
+  data = xmalloc(sizeof(WriteData) + count * sizeof(WBuffer *));
   data->wstream = wstream;
-  data->buffer = buffer;
+  data->count = count;
+  uvbufs = xmalloc(count * sizeof(uv_buf_t));
+
+  for (size_t i = 0; i < count; i++) {
+    data->buffers[i] = buffers[i];
+    uvbufs[i].base = buffers[i]->data;
+    uvbufs[i].len = buffers[i]->size;
+  }
+
   req = xmalloc(sizeof(uv_write_t));
   req->data = data;
-  uvbuf.base = buffer->data;
-  uvbuf.len = buffer->size;
   wstream->pending_reqs++;
 
-  if (uv_write(req, wstream->stream, &uvbuf, 1, write_cb)) {
+  // libuv keeps its own copy of the `uv_buf_t` array
+  int rv = uv_write(req,
+                    wstream->stream,
+                    uvbufs,
+                    (unsigned int)count,
+                    write_cb);
+  free(uvbufs);
+
+  if (rv) {
+    wstream->curmem -= size;
+    wstream->pending_reqs--;
+    free(req);
+    free(data);
     goto err;
   }
 
   return true;
 
 err:
-  release_wbuffer(buffer);
+  for (size_t i = 0; i < count; i++) {
+    release_wbuffer(buffers[i]);
+  }
   return false;
 }
 
@@ -145,14 +185,26 @@ WBuffer *wstream_new_buffer(char *data, size_t size, wbuffer_data_finalizer cb)
   return rv;
 }
 
+/// Frees a WBuffer that was never passed to `wstream_write`
+///
+/// @param buffer The WBuffer instance
+void wstream_free_buffer(WBuffer *buffer)
+{
+  assert(!buffer->refcount);
+  buffer->cb(buffer->data);
+  free(buffer);
+}
+
 static void write_cb(uv_write_t *req, int status)
 {
   WriteData *data = req->data;
 
   free(req);
-  data->wstream->curmem -= data->buffer->size;
 
-  release_wbuffer(data->buffer);
+  for (size_t i = 0; i < data->count; i++) {
+    data->wstream->curmem -= data->buffers[i]->size;
+    release_wbuffer(data->buffers[i]);
+  }
 
   data->wstream->pending_reqs--;
   if (data->wstream->freed && data->wstream->pending_reqs == 0) {
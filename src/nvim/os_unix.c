@@ -96,6 +96,36 @@ void mch_write(char_u *s, int len)
     os_microdelay(p_wd, false);
 }
 
+/*
+ * Write the "cnt" pieces in "iov" to the screen, with as few system calls as
+ * possible.  The contents of "iov" is changed.
+ */
+void mch_writev(struct iovec *iov, int cnt)
+{
+  while (cnt > 0) {
+    ssize_t n = writev(1, iov, cnt);
+
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    /* Skip what was written, a large buffer may take more than one call. */
+    while (cnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= (ssize_t)iov->iov_len;
+      ++iov;
+      --cnt;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= (size_t)n;
+    }
+  }
+  if (p_wd)             /* Unix is too fast, slow down a bit more */
+    os_microdelay(p_wd, false);
+}
+
 /*
  * If the machine has job control, use it to suspend the program,
  * otherwise fake it by starting a new shell.
@@ -1,6 +1,8 @@
 #ifndef NVIM_OS_UNIX_H
 #define NVIM_OS_UNIX_H
 
+#include <sys/uio.h>
+
 #include "nvim/os/shell.h"
 
 #ifdef INCLUDE_GENERATED_DECLARATIONS
@@ -12,6 +12,8 @@
 
 #include <string.h>
 
+#include <uv.h>
+
 #include "nvim/vim.h"
 #include "nvim/quickfix.h"
 #include "nvim/buffer.h"
@@ -46,6 +48,7 @@
 #include "nvim/ui.h"
 #include "nvim/window.h"
 #include "nvim/os/os.h"
+#include "nvim/os/event.h"
 
 
 struct dir_stack_T {
@@ -134,6 +137,51 @@ struct efm_S {
   int conthere;                 /* %> used */
 };
 
+/* Number of files ":vimgrep" reads ahead in libuv threads.  Less than the
+ * size of the queue for events of other threads, so that pushing the events
+ * never waits, see event_push_async(). */
+#define VGR_READ_AHEAD  512
+/* Number of bytes of text that may be kept for files read ahead. */
+#define VGR_READ_KEEP   (64L * 1024L * 1024L)
+/* Larger files are loaded into a buffer. */
+#define VGR_READ_MAX    (16L * 1024L * 1024L)
+
+/* Values for vgr_read_T.status */
+#define VGR_READ_OK     1       /* the lines can be searched */
+#define VGR_READ_SKIP   2       /* the file can't contain a match */
+#define VGR_READ_LOAD   3       /* the file must be loaded into a buffer */
+#define VGR_READ_AGAIN  4       /* the file may match, but too much text was
+                                   kept already: read it again when needed */
+
+/*
+ * A file that ":vimgrep" reads in a libuv thread, so that it doesn't need to
+ * be loaded into a dummy buffer.  The thread only uses the members up to
+ * "status", matching is done in the main thread.  When done the thread
+ * pushes a kEventVimgrepRead event, vgr_read_event() then sets "done".  The
+ * request is freed by vgr_read_done() when the loop runs it, or by
+ * vgr_read_free() when that is called later.
+ */
+typedef struct vgr_read {
+  uv_work_t req;
+  char_u      *fname;           /* full name of the file */
+  char_u      *must;            /* text a match must contain or NULL */
+  int mustlen;                  /* length of "must" */
+  int must_ic;                  /* compare "must" ignoring case */
+  int now;                      /* TRUE when read by the main thread */
+  size_t kept;                  /* number of bytes counted in vgr_read_kept */
+  char_u      *data;            /* the text, lines are NUL terminated */
+  char_u      **lines;          /* start of each line in "data" */
+  linenr_T lcount;              /* number of lines */
+  int status;                   /* VGR_READ_ value */
+  int done;                     /* TRUE when vgr_read_work() is done */
+  int released;                 /* TRUE when vgr_read_free() was called */
+  int finished;                 /* TRUE when vgr_read_done() was called */
+} vgr_read_T;
+
+
+/* Number of bytes of text kept for files read ahead, updated by the threads
+ * that read them. */
+static size_t vgr_read_kept = 0;
 
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "quickfix.c.generated.h"
@@ -2703,7 +2751,6 @@ void ex_vimgrep(exarg_T *eap)
   qf_info_T   *qi = &ql_info;
   qfline_T    *cur_qf_start;
   qfline_T    *prevp = NULL;
-  long lnum;
   buf_T       *buf;
   int duplicate_name = FALSE;
   int using_dummy;
@@ -2715,12 +2762,17 @@ void ex_vimgrep(exarg_T *eap)
   char_u      *save_ei = NULL;
   aco_save_T aco;
   int flags = 0;
-  colnr_T col;
   long tomatch;
   char_u      *dirname_start = NULL;
   char_u      *dirname_now = NULL;
   char_u      *target_dir = NULL;
   char_u      *au_name =  NULL;
+  vgr_read_T  **reads = NULL;
+  vgr_read_T  *rd;
+  int next_read = 0;
+  char_u      *must = NULL;
+  int mustlen = 0;
+  int must_ic = FALSE;
 
   switch (eap->cmdidx) {
   case CMD_vimgrep:     au_name = (char_u *)"vimgrep"; break;
@@ -2811,6 +2863,13 @@ void ex_vimgrep(exarg_T *eap)
    * changing the current quickfix list. */
   cur_qf_start = qi->qf_lists[qi->qf_curlist].qf_start;
 
+  /* When possible files are read ahead in other threads, so that the time
+   * spent on reading overlaps with searching. */
+  if (vgr_can_read(s != NULL && *s != NUL ? s : last_search_pat())) {
+    reads = xcalloc((size_t)fcount, sizeof(vgr_read_T *));
+    must = vim_regmust(regmatch.regprog, regmatch.rmm_ic, &mustlen, &must_ic);
+  }
+
   seconds = (time_t)0;
   for (fi = 0; fi < fcount && !got_int && tomatch > 0; ++fi) {
     fname = path_shorten_fname_if_possible(fnames[fi]);
@@ -2833,6 +2892,33 @@ void ex_vimgrep(exarg_T *eap)
       out_flush();
     }
 
+    if (reads != NULL) {
+      for (; next_read < fcount && next_read < fi + VGR_READ_AHEAD;
+           ++next_read)
+        reads[next_read] = vgr_read_start(fnames[next_read],
+            must, mustlen, must_ic);
+      rd = reads[fi];
+      reads[fi] = NULL;
+      if (rd != NULL) {
+        vgr_read_wait(rd);
+        if (rd->status == VGR_READ_AGAIN) {
+          rd->now = TRUE;
+          vgr_read_file(rd);
+        }
+        /* Autocommands of a file loaded before may have changed things,
+         * check again. */
+        if (rd->status != VGR_READ_LOAD && vgr_can_read_file(fnames[fi])) {
+          if (rd->status == VGR_READ_OK)
+            vgr_match_lines(qi, &prevp, &regmatch, fname, curbuf,
+                rd->lines, rd->lcount, flags, &tomatch);
+          cur_qf_start = qi->qf_lists[qi->qf_curlist].qf_start;
+          vgr_read_free(rd);
+          continue;
+        }
+        vgr_read_free(rd);
+      }
+    }
+
     buf = buflist_findname_exp(fnames[fi]);
     if (buf == NULL || buf->b_ml.ml_mfp == NULL) {
       /* Remember that a buffer with this name already exists. */
@@ -2878,47 +2964,9 @@ void ex_vimgrep(exarg_T *eap)
       if (!got_int)
         smsg((char_u *)_("Cannot open file \"%s\""), fname);
     } else {
-      /* Try for a match in all lines of the buffer.
-       * For ":1vimgrep" look for first match only. */
-      found_match = FALSE;
-      for (lnum = 1; lnum <= buf->b_ml.ml_line_count && tomatch > 0;
-           ++lnum) {
-        col = 0;
-        while (vim_regexec_multi(&regmatch, curwin, buf, lnum,
-                   col, NULL) > 0) {
-          ;
-          if (qf_add_entry(qi, &prevp,
-                  NULL,                     /* dir */
-                  fname,
-                  0,
-                  ml_get_buf(buf,
-                      regmatch.startpos[0].lnum + lnum, FALSE),
-                  regmatch.startpos[0].lnum + lnum,
-                  regmatch.startpos[0].col + 1,
-                  FALSE,                    /* vis_col */
-                  NULL,                     /* search pattern */
-                  0,                        /* nr */
-                  0,                        /* type */
-                  TRUE                      /* valid */
-                  ) == FAIL) {
-            got_int = TRUE;
-            break;
-          }
-          found_match = TRUE;
-          if (--tomatch == 0)
-            break;
-          if ((flags & VGR_GLOBAL) == 0
-              || regmatch.endpos[0].lnum > 0)
-            break;
-          col = regmatch.endpos[0].col
-                + (col == regmatch.endpos[0].col);
-          if (col > (colnr_T)STRLEN(ml_get_buf(buf, lnum, FALSE)))
-            break;
-        }
-        line_breakcheck();
-        if (got_int)
-          break;
-      }
+      /* Try for a match in all lines of the buffer. */
+      found_match = vgr_match_lines(qi, &prevp, &regmatch, fname, buf,
+          NULL, buf->b_ml.ml_line_count, flags, &tomatch);
       cur_qf_start = qi->qf_lists[qi->qf_curlist].qf_start;
 
       if (using_dummy) {
@@ -2970,6 +3018,14 @@ void ex_vimgrep(exarg_T *eap)
     }
   }
 
+  if (reads != NULL) {
+    /* Files read ahead when searching was interrupted. */
+    for (; fi < next_read; ++fi)
+      if (reads[fi] != NULL)
+        vgr_read_free(reads[fi]);
+    free(reads);
+  }
+
   FreeWild(fcount, fnames);
 
   qi->qf_lists[qi->qf_curlist].qf_nonevalid = FALSE;
@@ -3017,6 +3073,382 @@ theend:
   vim_regfree(regmatch.regprog);
 }
 
+/*
+ * Search for matches of "regmatch" in the "lcount" lines of "buf", or in
+ * "lines" when it is not NULL, and add them to quickfix list "qi" for file
+ * "fname".  For ":1vimgrep" look for the first "*tomatch" matches only.
+ * Returns TRUE if a match was found.
+ */
+static int vgr_match_lines(qf_info_T *qi, qfline_T **prevp,
+                           regmmatch_T *regmatch, char_u *fname, buf_T *buf,
+                           char_u **lines, linenr_T lcount, int flags,
+                           long *tomatch)
+{
+  int found_match = FALSE;
+  linenr_T lnum;
+  colnr_T col;
+
+  for (lnum = 1; lnum <= lcount && *tomatch > 0; ++lnum) {
+    col = 0;
+    while ((lines != NULL
+            ? vim_regexec_lines(regmatch, curwin, buf, lines, lcount,
+                lnum, col)
+            : vim_regexec_multi(regmatch, curwin, buf, lnum, col,
+                NULL)) > 0) {
+      if (qf_add_entry(qi, prevp,
+              NULL,                     /* dir */
+              fname,
+              0,
+              vgr_get_line(buf, lines,
+                  regmatch->startpos[0].lnum + lnum),
+              regmatch->startpos[0].lnum + lnum,
+              regmatch->startpos[0].col + 1,
+              FALSE,                    /* vis_col */
+              NULL,                     /* search pattern */
+              0,                        /* nr */
+              0,                        /* type */
+              TRUE                      /* valid */
+              ) == FAIL) {
+        got_int = TRUE;
+        break;
+      }
+      found_match = TRUE;
+      if (--*tomatch == 0)
+        break;
+      if ((flags & VGR_GLOBAL) == 0
+          || regmatch->endpos[0].lnum > 0)
+        break;
+      col = regmatch->endpos[0].col
+            + (col == regmatch->endpos[0].col);
+      if (col > (colnr_T)STRLEN(vgr_get_line(buf, lines, lnum)))
+        break;
+    }
+    line_breakcheck();
+    if (got_int)
+      break;
+  }
+  return found_match;
+}
+
+/*
+ * Get line "lnum" from "lines", or from "buf" when "lines" is NULL.
+ */
+static char_u *vgr_get_line(buf_T *buf, char_u **lines, linenr_T lnum)
+{
+  if (lines != NULL)
+    return lines[lnum - 1];
+  return ml_get_buf(buf, lnum, FALSE);
+}
+
+/*
+ * Return TRUE when ":vimgrep" can read files itself instead of loading them
+ * into a dummy buffer: reading a file that is valid UTF-8 without a CR must
+ * give the lines of the file and pattern "pat" must not depend on the buffer,
+ * the current buffer is used for 'iskeyword'.
+ */
+static int vgr_can_read(char_u *pat)
+{
+  char_u      *p = p_fencs;
+  char_u      *isk = NULL;
+  long n;
+  int same_isk;
+
+  if (!enc_utf8 || p_acd)
+    return FALSE;
+  /* A dummy buffer gets the global value of 'iskeyword'. */
+  get_option_value((char_u *)"isk", &n, &isk, OPT_GLOBAL);
+  same_isk = isk != NULL && STRCMP(curbuf->b_p_isk, isk) == 0;
+  free(isk);
+  if (!same_isk)
+    return FALSE;
+  /* "\%V" and "\%'m" would use the current buffer. */
+  if (pat == NULL || strstr((char *)pat, "%V") != NULL
+      || strstr((char *)pat, "%'") != NULL)
+    return FALSE;
+  if (*p_ffs == NUL || STRNCMP(p_ffs, "mac", 3) == 0)
+    return FALSE;
+  if (STRNCMP(p, "ucs-bom,", 8) == 0)
+    p += 8;
+  return STRNCMP(p, "utf-8", 5) == 0 && (p[5] == ',' || p[5] == NUL);
+}
+
+/*
+ * Return TRUE when file "fname" doesn't have a buffer and loading it into a
+ * dummy buffer would not trigger autocommands, so that it can be read by
+ * vgr_read_start().
+ */
+static int vgr_can_read_file(char_u *fname)
+{
+  static event_T events[] = {
+    EVENT_BUFREADPRE, EVENT_BUFREADPOST, EVENT_BUFREADCMD, EVENT_SWAPEXISTS,
+    EVENT_BUFUNLOAD, EVENT_BUFDELETE, EVENT_BUFWIPEOUT
+  };
+
+  if (buflist_findname_exp(fname) != NULL)
+    return FALSE;
+  for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); i++)
+    if (has_autocmd(events[i], fname, NULL))
+      return FALSE;
+  return TRUE;
+}
+
+/*
+ * Start reading file "fname" in a libuv thread.  When "must" is not NULL a
+ * file that doesn't contain it is skipped.
+ * Returns NULL when the file must be loaded into a buffer.
+ */
+static vgr_read_T *vgr_read_start(char_u *fname, char_u *must, int mustlen,
+                                  int must_ic)
+{
+  vgr_read_T  *rd;
+  char_u      *full_name;
+
+  if (!vgr_can_read_file(fname))
+    return NULL;
+  /* Autocommands of other files may change the directory. */
+  full_name = FullName_save(fname, FALSE);
+  if (full_name == NULL)
+    return NULL;
+
+  rd = xcalloc(1, sizeof(vgr_read_T));
+  rd->fname = full_name;
+  rd->must = must;
+  rd->mustlen = mustlen;
+  rd->must_ic = must_ic;
+  rd->req.data = rd;
+  uv_queue_work(uv_default_loop(), &rd->req, vgr_read_work, vgr_read_done);
+  return rd;
+}
+
+/*
+ * Read a file for ":vimgrep" in a libuv thread.
+ */
+static void vgr_read_work(uv_work_t *req)
+{
+  vgr_read_T  *rd = req->data;
+
+  vgr_read_file(rd);
+  vgr_read_signal(rd);
+}
+
+/*
+ * Read the file of "rd", split it into lines and check that it contains the
+ * text a match must contain.  Runs in a libuv thread, or in the main thread
+ * when "rd->now" is set.  Must not use global variables other than
+ * "vgr_read_kept" and can't use xmalloc().
+ */
+static void vgr_read_file(vgr_read_T *rd)
+{
+  struct stat st;
+  size_t size;
+  size_t len = 0;
+  ssize_t n = 0;
+  int fd;
+
+  rd->status = VGR_READ_LOAD;
+  fd = open((char *)rd->fname, O_RDONLY);
+  if (fd < 0)
+    return;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+      || st.st_size > VGR_READ_MAX
+      || (rd->data = malloc((size_t)st.st_size + 1)) == NULL) {
+    close(fd);
+    return;
+  }
+  size = (size_t)st.st_size;
+  while (len < size) {
+    n = read(fd, rd->data + len, size - len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    len += (size_t)n;
+  }
+  close(fd);
+  if (n >= 0)
+    rd->status = vgr_read_split(rd, len);
+  /* Only keep the text of files read ahead up to a limit, so that a pattern
+   * matching in many files doesn't use too much memory. */
+  if (rd->status == VGR_READ_OK && !rd->now) {
+    if (__atomic_add_fetch(&vgr_read_kept, len, __ATOMIC_RELAXED)
+        > VGR_READ_KEEP) {
+      __atomic_sub_fetch(&vgr_read_kept, len, __ATOMIC_RELAXED);
+      rd->status = VGR_READ_AGAIN;
+    } else
+      rd->kept = len;
+  }
+  if (rd->status != VGR_READ_OK) {
+    free(rd->data);
+    rd->data = NULL;
+    free(rd->lines);
+    rd->lines = NULL;
+  }
+}
+
+/*
+ * Tell the main thread that reading the file of "rd" is done.
+ */
+static void vgr_read_signal(vgr_read_T *rd)
+{
+  Event event;
+
+  event.type = kEventVimgrepRead;
+  event.data.vgr_read = rd;
+  event_push_async(event, false);
+}
+
+/*
+ * Called in the main thread for the kEventVimgrepRead event pushed by
+ * vgr_read_signal().
+ */
+void vgr_read_event(Event event)
+{
+  event.data.vgr_read->done = TRUE;
+}
+
+/*
+ * Check the "len" bytes read into "rd->data" and split them into lines.
+ * Returns VGR_READ_LOAD when readfile() would do something else than
+ * splitting the text at NL characters: for a NUL, CR, BOM or illegal UTF-8.
+ */
+static int vgr_read_split(vgr_read_T *rd, size_t len)
+{
+  char_u      *data = rd->data;
+  size_t nl = 0;
+  int ascii = TRUE;
+  int l;
+
+  if (len >= 3 && data[0] == 0xef && data[1] == 0xbb && data[2] == 0xbf)
+    return VGR_READ_LOAD;
+  for (size_t i = 0; i < len; ++i) {
+    if (data[i] == NL)
+      ++nl;
+    else if (data[i] == NUL || data[i] == CAR)
+      return VGR_READ_LOAD;
+    else if (data[i] >= 0x80) {
+      /* A length of 1 means it's an illegal byte. */
+      l = utf_ptr2len_len(data + i, (int)(len - i));
+      if (l == 1 || (size_t)l > len - i)
+        return VGR_READ_LOAD;
+      i += (size_t)l - 1;
+      ascii = FALSE;
+    }
+  }
+
+  if (rd->must != NULL && !vgr_contains(data, len, rd->must, rd->mustlen,
+                                        rd->must_ic, ascii))
+    return VGR_READ_SKIP;
+
+  /* An empty file has one empty line, like a buffer. */
+  rd->lcount = (linenr_T)nl + (len == 0 || data[len - 1] != NL);
+  rd->lines = malloc((size_t)rd->lcount * sizeof(char_u *));
+  if (rd->lines == NULL)
+    return VGR_READ_LOAD;
+  data[len] = NUL;
+  rd->lines[0] = data;
+  for (linenr_T lnum = 1; lnum < rd->lcount; ++lnum) {
+    data = (char_u *)memchr(data, NL, (size_t)(rd->data + len - data));
+    *data++ = NUL;
+    rd->lines[lnum] = data;
+  }
+  if (len > 0 && rd->data[len - 1] == NL)
+    rd->data[len - 1] = NUL;
+  return VGR_READ_OK;
+}
+
+/*
+ * Return TRUE if the "len" bytes of "data" may contain the "mustlen" bytes
+ * of "must".  Ignoring case is only done for ASCII, other characters may
+ * have an ASCII character as their folded case.  "ascii" is TRUE when "data"
+ * is all ASCII.
+ */
+static int vgr_contains(char_u *data, size_t len, char_u *must, int mustlen,
+                        int ic, int ascii)
+{
+  char_u      *end;
+  char_u      *p;
+  int i;
+
+  if ((size_t)mustlen > len)
+    return FALSE;
+  end = data + len - (size_t)mustlen + 1;
+
+  if (!ic) {
+    for (p = data; p < end; ++p) {
+      p = memchr(p, *must, (size_t)(end - p));
+      if (p == NULL)
+        return FALSE;
+      if (memcmp(p + 1, must + 1, (size_t)(mustlen - 1)) == 0)
+        return TRUE;
+    }
+    return FALSE;
+  }
+
+  if (!ascii)
+    return TRUE;
+  for (i = 0; i < mustlen; ++i)
+    if (must[i] >= 0x80)
+      return TRUE;
+  for (p = data; p < end; ++p) {
+    for (i = 0; i < mustlen; ++i)
+      if (TOLOWER_ASC(p[i]) != TOLOWER_ASC(must[i]))
+        break;
+    if (i == mustlen)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/*
+ * Called in the main thread when vgr_read_work() is done.  The request may
+ * only be freed after this, when vgr_read_free() was called already it is
+ * freed here.
+ */
+static void vgr_read_done(uv_work_t *req, int status)
+{
+  vgr_read_T  *rd = req->data;
+
+  rd->finished = TRUE;
+  if (rd->released)
+    vgr_read_destroy(rd);
+}
+
+/*
+ * Wait for reading the file of "rd" to be done.  Runs the event loop until
+ * its event was handled, like when waiting for a RPC response.
+ */
+static void vgr_read_wait(vgr_read_T *rd)
+{
+  while (!rd->done)
+    event_poll(-1);
+}
+
+/*
+ * Free the text read for "rd".  The request itself is freed by
+ * vgr_read_done() when the loop didn't run it yet.
+ */
+static void vgr_read_free(vgr_read_T *rd)
+{
+  vgr_read_wait(rd);
+  if (rd->kept > 0) {
+    __atomic_sub_fetch(&vgr_read_kept, rd->kept, __ATOMIC_RELAXED);
+    rd->kept = 0;
+  }
+  free(rd->data);
+  rd->data = NULL;
+  free(rd->lines);
+  rd->lines = NULL;
+  rd->released = TRUE;
+  if (rd->finished)
+    vgr_read_destroy(rd);
+}
+
+static void vgr_read_destroy(vgr_read_T *rd)
+{
+  free(rd->fname);
+  free(rd);
+}
+
 /*
  * Skip over the pattern argument of ":vimgrep /pat/[g][j]".
  * Put the start of the pattern in "*s", unless "s" is NULL.
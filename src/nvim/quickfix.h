@@ -1,6 +1,8 @@
 #ifndef NVIM_QUICKFIX_H
 #define NVIM_QUICKFIX_H
 
+#include "nvim/os/event_defs.h"
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "quickfix.h.generated.h"
 #endif
@@ -43,6 +43,9 @@
 /* #undef REGEXP_DEBUG */
 /* #define REGEXP_DEBUG */
 
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "nvim/vim.h"
@@ -57,6 +60,7 @@
 #include "nvim/misc1.h"
 #include "nvim/misc2.h"
 #include "nvim/garray.h"
+#include "nvim/hashtab.h"
 #include "nvim/strings.h"
 
 #ifdef REGEXP_DEBUG
@@ -516,6 +520,7 @@ static int re_multi_type(int c)
 #define JUST_CALC_SIZE  ((char_u *) -1)
 
 static char_u           *reg_prev_sub = NULL;
+static int reg_used_prev_sub;   /* pattern being compiled uses "~" */
 
 /*
  * REGEXP_INRANGE contains all characters which are always special in a []
@@ -1904,6 +1909,7 @@ static char_u *regatom(int *flagp)
   /* NOTREACHED */
 
   case Magic('~'):              /* previous substitute pattern */
+    reg_used_prev_sub = TRUE;
     if (reg_prev_sub != NULL) {
       char_u      *lp;
 
@@ -3173,6 +3179,11 @@ static linenr_T reg_firstlnum;
 static linenr_T reg_maxline;
 static int reg_line_lbr;                    /* "\n" in string is line break */
 
+/* When not NULL: the lines vim_regexec_lines() matches against, used instead
+ * of the lines of "reg_buf".  "reg_lines_count" is the number of lines. */
+static char_u           **reg_lines = NULL;
+static linenr_T reg_lines_count;
+
 /*
  * "regstack" and "backpos" are used by regmatch().  They are kept over calls
  * to avoid invoking malloc() and free() often.
@@ -3204,6 +3215,7 @@ void free_regexp_stuff(void)
   ga_clear(&backpos);
   free(reg_tofree);
   free(reg_prev_sub);
+  regcache_clear();
 }
 
 #endif
@@ -3220,9 +3232,21 @@ static char_u *reg_getline(linenr_T lnum)
   if (lnum > reg_maxline)
     /* Must have matched the "\n" in the last line. */
     return (char_u *)"";
+  if (reg_lines != NULL)
+    return reg_lines[reg_firstlnum + lnum - 1];
   return ml_get_buf(reg_buf, reg_firstlnum + lnum, FALSE);
 }
 
+/*
+ * Return the number of lines that a multi-line match can use.
+ */
+static linenr_T reg_line_count(void)
+{
+  if (reg_lines != NULL)
+    return reg_lines_count;
+  return reg_buf->b_ml.ml_line_count;
+}
+
 static regsave_T behind_pos;
 
 static char_u   *reg_startzp[NSUBEXP];  /* Workspace to mark beginning */
@@ -3286,7 +3310,7 @@ proftime_T  *tm;                /* timeout limit or NULL */
   reg_buf = buf;
   reg_win = win;
   reg_firstlnum = lnum;
-  reg_maxline = reg_buf->b_ml.ml_line_count - lnum;
+  reg_maxline = reg_line_count() - lnum;
   reg_line_lbr = FALSE;
   ireg_ic = rmp->rmm_ic;
   ireg_icombine = FALSE;
@@ -3363,43 +3387,11 @@ static long bt_regexec_both(char_u *line,
   if (prog->regflags & RF_ICOMBINE)
     ireg_icombine = TRUE;
 
-  /* If there is a "must appear" string, look for it. */
-  if (prog->regmust != NULL) {
-    int c;
-
-    if (has_mbyte)
-      c = (*mb_ptr2char)(prog->regmust);
-    else
-      c = *prog->regmust;
-    s = line + col;
-
-    /*
-     * This is used very often, esp. for ":global".  Use three versions of
-     * the loop to avoid overhead of conditions.
-     */
-    if (!ireg_ic
-        && !has_mbyte
-        )
-      while ((s = vim_strbyte(s, c)) != NULL) {
-        if (cstrncmp(s, prog->regmust, &prog->regmlen) == 0)
-          break;                        /* Found it. */
-        ++s;
-      }
-    else if (!ireg_ic || (!enc_utf8 && mb_char2len(c) > 1))
-      while ((s = vim_strchr(s, c)) != NULL) {
-        if (cstrncmp(s, prog->regmust, &prog->regmlen) == 0)
-          break;                        /* Found it. */
-        mb_ptr_adv(s);
-      }
-    else
-      while ((s = cstrchr(s, c)) != NULL) {
-        if (cstrncmp(s, prog->regmust, &prog->regmlen) == 0)
-          break;                        /* Found it. */
-        mb_ptr_adv(s);
-      }
-    if (s == NULL)              /* Not present. */
-      goto theend;
-  }
+  /* If there is a "must appear" string, look for it.  This is used very
+   * often, esp. for ":global". */
+  if (prog->regmust != NULL
+      && find_regmust(line + col, prog->regmust, prog->regmlen) == NULL)
+    goto theend;                /* Not present. */
 
   regline = line;
   reglnum = 0;
@@ -6254,6 +6246,48 @@ static char_u *cstrchr(char_u *s, int c)
   return NULL;
 }
 
+/*
+ * Find the first occurrence of the "len" bytes of "must" in "s".
+ * Returns NULL when it is not present.
+ * Used to reject a line before trying to match, keep it fast!  When case
+ * matters memchr() finds the candidates and memcmp() checks them, for UTF-8
+ * that works because a character can't match halfway another one.
+ */
+static char_u *find_regmust(char_u *s, char_u *must, int len)
+{
+  char_u      *end;
+  int c;
+  int n;
+
+  if (!ireg_ic && !ireg_icombine && (!has_mbyte || enc_utf8)) {
+    n = (int)STRLEN(s);
+    if (n < len)
+      return NULL;
+    end = s + n - len + 1;
+    while (s < end) {
+      s = memchr(s, *must, (size_t)(end - s));
+      if (s == NULL)
+        return NULL;
+      if (memcmp(s + 1, must + 1, (size_t)(len - 1)) == 0)
+        return s;
+      ++s;
+    }
+    return NULL;
+  }
+
+  if (has_mbyte)
+    c = (*mb_ptr2char)(must);
+  else
+    c = *must;
+  while ((s = cstrchr(s, c)) != NULL) {
+    n = len;
+    if (cstrncmp(s, must, &n) == 0)
+      return s;
+    mb_ptr_adv(s);
+  }
+  return NULL;
+}
+
 /***************************************************************
 *		      regsub stuff			       *
 ***************************************************************/
@@ -6896,6 +6930,16 @@ static regengine_T nfa_regengine =
 #endif
 };
 
+/* ":regtime on": collect statistics of executed patterns in "regstat_ht",
+ * indexed by the pattern. */
+static bool reg_time_on = false;
+static hashtab_T regstat_ht;
+
+/*
+ * HI2RS() converts a hashitem pointer to a regstat pointer.
+ */
+#define HI2RS(hi) ((regstat_T *)((hi)->hi_key - offsetof(regstat_T, rs_pattern)))
+
 /* Which regexp engine to use? Needed for vim_regcomp().
  * Must match with 'regexpengine'. */
 static int regexp_engine = 0;
@@ -6910,6 +6954,88 @@ static char_u regname[][30] = {
 };
 #endif
 
+/*
+ * Programs freed with vim_regfree() are kept in "regcache", vim_regcomp()
+ * reuses them when compiling the same pattern with the same flags and
+ * options.  Scripts calling match() or substitute() in a loop then don't
+ * compile the pattern every time.
+ * A program is taken out of the cache while it is used, thus it is never used
+ * by two callers at the same time, also not when matching recursively.
+ * The most recently freed program is first, when the cache is full the
+ * oldest one is freed.
+ */
+#define REGCACHE_SIZE   32
+static regprog_T *regcache[REGCACHE_SIZE];
+static int regcache_len = 0;
+
+/*
+ * Return the key for a program compiled with "re_flags": the flags, the
+ * options and the state that change how a pattern is compiled, including
+ * whether syntax items allow "\z(" and "\z1".  Ignoring case doesn't matter,
+ * it's only used when matching.
+ * A pattern with "~" also depends on the previous substitute string, such a
+ * program is not cached at all.
+ */
+static int regcache_key(int re_flags)
+{
+  int key = re_flags;
+
+  key = key * 4 + (int)p_re;
+  key = key * 2 + (vim_strchr(p_cpo, CPO_LITERAL) != NULL);
+  key = key * 2 + (vim_strchr(p_cpo, CPO_BACKSL) != NULL);
+  key = key * 2 + (has_mbyte != 0);
+  key = key * 2 + (enc_utf8 != 0);
+  key = key * 2 + (enc_dbcs != 0);
+  key = key * 4 + (reg_do_extmatch & (REX_SET | REX_USE));
+  return key;
+}
+
+/*
+ * Take the program compiled from "pattern" with key "key" out of the cache.
+ * Returns NULL if there is none.
+ */
+static regprog_T *regcache_take(char_u *pattern, int key)
+{
+  int i;
+  regprog_T *prog;
+
+  for (i = 0; i < regcache_len; ++i) {
+    prog = regcache[i];
+    if (prog->regkey == key && STRCMP(prog->regpat, pattern) == 0) {
+      --regcache_len;
+      memmove(regcache + i, regcache + i + 1,
+          (regcache_len - i) * sizeof(regprog_T *));
+      return prog;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Put "prog" in the cache, freeing the oldest program when it is full.
+ * Returns FALSE when "prog" can't be cached.
+ */
+static int regcache_put(regprog_T *prog)
+{
+  if (prog->regkey < 0)
+    return FALSE;
+  if (regcache_len == REGCACHE_SIZE)
+    regprog_free(regcache[--regcache_len]);
+  memmove(regcache + 1, regcache, regcache_len * sizeof(regprog_T *));
+  regcache[0] = prog;
+  ++regcache_len;
+  return TRUE;
+}
+
+/*
+ * Free all the programs in the cache.
+ */
+void regcache_clear(void)
+{
+  while (regcache_len > 0)
+    regprog_free(regcache[--regcache_len]);
+}
+
 /*
  * Compile a regular expression into internal code.
  * Returns the program in allocated memory.
@@ -6920,8 +7046,16 @@ regprog_T *vim_regcomp(char_u *expr_arg, int re_flags)
 {
   regprog_T   *prog = NULL;
   char_u      *expr = expr_arg;
+  int key = regcache_key(re_flags);
+  int save_called_emsg = called_emsg;
+
+  prog = regcache_take(expr_arg, key);
+  if (prog != NULL)
+    return prog;
 
   regexp_engine = p_re;
+  called_emsg = FALSE;
+  reg_used_prev_sub = FALSE;
 
   /* Check for prefix "\%#=", that sets the regexp engine */
   if (STRNCMP(expr, "\\%#=", 4) == 0) {
@@ -6955,6 +7089,16 @@ regprog_T *vim_regcomp(char_u *expr_arg, int re_flags)
   else
     prog = bt_regengine.regcomp(expr, re_flags);
 
+  if (prog != NULL) {
+    /* Remember the pattern, statistics are looked up when executing. */
+    prog->regpat = vim_strsave(expr_arg);
+    prog->regstat = NULL;
+    /* Don't reuse a program when compiling gave a message or when it
+     * includes the previous substitute string, which may change. */
+    prog->regkey = called_emsg || reg_used_prev_sub ? -1 : key;
+  }
+  called_emsg |= save_called_emsg;
+
   if (prog == NULL) {       /* error compiling regexp with initial engine */
 #ifdef BT_REGEXP_DEBUG_LOG
     if (regexp_engine != BACKTRACKING_ENGINE) {     /* debugging log for NFA */
@@ -6981,11 +7125,18 @@ regprog_T *vim_regcomp(char_u *expr_arg, int re_flags)
 
 /*
  * Free a compiled regexp program, returned by vim_regcomp().
+ * It is kept in the cache, it may be used again.
  */
 void vim_regfree(regprog_T *prog)
 {
-  if (prog != NULL)
-    prog->engine->regfree(prog);
+  if (prog != NULL && !regcache_put(prog))
+    regprog_free(prog);
+}
+
+static void regprog_free(regprog_T *prog)
+{
+  free(prog->regpat);
+  prog->engine->regfree(prog);
 }
 
 /*
@@ -7002,7 +7153,7 @@ vim_regexec (
     colnr_T col            /* column to start looking for match */
 )
 {
-  return rmp->regprog->engine->regexec_nl(rmp, line, col, false);
+  return regexec_nl_timed(rmp, line, col, false);
 }
 
 /*
@@ -7010,7 +7161,7 @@ vim_regexec (
  */
 int vim_regexec_nl(regmatch_T *rmp, char_u *line, colnr_T col)
 {
-  return rmp->regprog->engine->regexec_nl(rmp, line, col, true);
+  return regexec_nl_timed(rmp, line, col, true);
 }
 
 /*
@@ -7030,5 +7181,293 @@ long vim_regexec_multi(
   proftime_T  *tm                 /* timeout limit or NULL */
 )
 {
-  return rmp->regprog->engine->regexec_multi(rmp, win, buf, lnum, col, tm);
+  regprog_T *prog = rmp->regprog;
+  proftime_T pt;
+  long r;
+
+  if (!reg_time_on)
+    return prog->engine->regexec_multi(rmp, win, buf, lnum, col, tm);
+
+  profile_start(&pt);
+  r = prog->engine->regexec_multi(rmp, win, buf, lnum, col, tm);
+  profile_end(&pt);
+  regstat_add(prog, &pt, r > 0);
+  return r;
+}
+
+/*
+ * Like vim_regexec_multi(), but match against the "count" lines in "lines"
+ * instead of the text of "buf".  "buf" is still used for 'iskeyword' and
+ * marks.  Used for text that was not loaded into a buffer, the lines must
+ * stay valid until this returns.
+ */
+long vim_regexec_lines(regmmatch_T *rmp, win_T *win, buf_T *buf,
+                       char_u **lines, linenr_T count, linenr_T lnum,
+                       colnr_T col)
+{
+  long r;
+
+  reg_lines = lines;
+  reg_lines_count = count;
+  r = vim_regexec_multi(rmp, win, buf, lnum, col, NULL);
+  reg_lines = NULL;
+  return r;
+}
+
+/*
+ * Return the text that every match of "prog" contains, NULL if it isn't
+ * known.  "*lenp" is set to its length in bytes and "*icp" to TRUE when it
+ * must be compared ignoring case, "ic" is the value of 'ignorecase'.
+ * The text is part of "prog", it may be used by another thread as long as
+ * "prog" is not freed.
+ */
+char_u *vim_regmust(regprog_T *prog, int ic, int *lenp, int *icp)
+{
+  char_u      *must;
+
+  if (prog->regflags & RF_ICOMBINE)
+    return NULL;
+  if (prog->engine == &nfa_regengine) {
+    must = ((nfa_regprog_T *)prog)->regmust;
+    *lenp = ((nfa_regprog_T *)prog)->regmlen;
+  } else {
+    must = ((bt_regprog_T *)prog)->regmust;
+    *lenp = ((bt_regprog_T *)prog)->regmlen;
+  }
+  if (must == NULL || *lenp == 0)
+    return NULL;
+
+  if (prog->regflags & RF_ICASE)
+    *icp = TRUE;
+  else if (prog->regflags & RF_NOICASE)
+    *icp = FALSE;
+  else
+    *icp = ic;
+  return must;
+}
+
+/*
+ * Call the regexec_nl() function of the engine, for ":regtime" also measure
+ * how long it takes.
+ */
+static int regexec_nl_timed(regmatch_T *rmp, char_u *line, colnr_T col,
+                            bool line_lbr)
+{
+  regprog_T *prog = rmp->regprog;
+  proftime_T pt;
+  int r;
+
+  if (!reg_time_on)
+    return prog->engine->regexec_nl(rmp, line, col, line_lbr);
+
+  profile_start(&pt);
+  r = prog->engine->regexec_nl(rmp, line, col, line_lbr);
+  profile_end(&pt);
+  regstat_add(prog, &pt, r != 0);
+  return r;
+}
+
+/*
+ * Add one execution of "prog" that took "pt" to the statistics of its
+ * pattern.
+ */
+static void regstat_add(regprog_T *prog, proftime_T *pt, int matched)
+{
+  regstat_T *rs = prog->regstat;
+
+  if (rs == NULL) {
+    hash_T hash = hash_hash(prog->regpat);
+    hashitem_T *hi = hash_lookup(&regstat_ht, prog->regpat, hash);
+
+    if (HASHITEM_EMPTY(hi)) {
+      rs = xcalloc(1, sizeof(regstat_T) + STRLEN(prog->regpat));
+      STRCPY(rs->rs_pattern, prog->regpat);
+      hash_add_item(&regstat_ht, hi, rs->rs_pattern, hash);
+    } else
+      rs = HI2RS(hi);
+    prog->regstat = rs;
+  }
+
+  profile_add(&rs->rs_total, pt);
+  if (profile_cmp(pt, &rs->rs_slowest) < 0)
+    rs->rs_slowest = *pt;
+  ++rs->rs_count;
+  if (matched)
+    ++rs->rs_match;
+  rs->rs_nfa = prog->engine == &nfa_regengine;
+  rs->rs_nstate = rs->rs_nfa ? ((nfa_regprog_T *)prog)->nstate : 0;
+}
+
+/*
+ * ":regtime".
+ */
+void ex_regtime(exarg_T *eap)
+{
+  if (STRCMP(eap->arg, "on") == 0)
+    regtime_enable(true);
+  else if (STRCMP(eap->arg, "off") == 0)
+    regtime_enable(false);
+  else if (STRCMP(eap->arg, "clear") == 0)
+    regtime_clear();
+  else if (STRCMP(eap->arg, "report") == 0)
+    regtime_report();
+  else
+    EMSG2(_(e_invarg2), eap->arg);
+}
+
+/*
+ * Start or stop collecting statistics of executed patterns.
+ */
+void regtime_enable(bool on)
+{
+  if (regstat_ht.ht_mask == 0)
+    hash_init(&regstat_ht);
+  reg_time_on = on;
+}
+
+/*
+ * Return the statistics collected for "pattern", NULL if it wasn't executed
+ * while ":regtime on".
+ */
+regstat_T *regtime_lookup(char_u *pattern)
+{
+  hashitem_T *hi;
+
+  if (regstat_ht.ht_mask == 0)
+    return NULL;
+  hi = hash_find(&regstat_ht, pattern);
+  return HASHITEM_EMPTY(hi) ? NULL : HI2RS(hi);
+}
+
+/*
+ * Clear the statistics of all patterns.  They are kept, compiled programs
+ * may point to them.
+ */
+static void regtime_clear(void)
+{
+  hashitem_T *hi;
+  size_t todo = regstat_ht.ht_used;
+
+  for (hi = regstat_ht.ht_array; todo > 0; ++hi) {
+    if (!HASHITEM_EMPTY(hi)) {
+      regstat_T *rs = HI2RS(hi);
+
+      profile_zero(&rs->rs_total);
+      profile_zero(&rs->rs_slowest);
+      rs->rs_count = 0;
+      rs->rs_match = 0;
+      --todo;
+    }
+  }
+}
+
+/*
+ * Function given to ExpandGeneric() to obtain the possible arguments of the
+ * ":regtime {on,off,clear,report}" command.
+ */
+char_u *get_regtime_arg(expand_T *xp, int idx)
+{
+  switch (idx) {
+  case 0: return (char_u *)"on";
+  case 1: return (char_u *)"off";
+  case 2: return (char_u *)"clear";
+  case 3: return (char_u *)"report";
+  }
+  return NULL;
+}
+
+static int reg_compare_regtime(const void *v1, const void *v2)
+{
+  const regstat_T *s1 = *(const regstat_T **)v1;
+  const regstat_T *s2 = *(const regstat_T **)v2;
+
+  return profile_cmp(&s1->rs_total, &s2->rs_total);
+}
+
+/*
+ * List the statistics of the executed patterns, slowest first.
+ */
+static void regtime_report(void)
+{
+  hashitem_T *hi;
+  size_t todo = regstat_ht.ht_used;
+  proftime_T tm;
+  proftime_T total_total;
+  long total_count = 0;
+  int len;
+  garray_T ga;
+
+  ga_init(&ga, (int)sizeof(regstat_T *), 50);
+  profile_zero(&total_total);
+  for (hi = regstat_ht.ht_array; todo > 0; ++hi) {
+    if (!HASHITEM_EMPTY(hi)) {
+      regstat_T *rs = HI2RS(hi);
+
+      if (rs->rs_count > 0) {
+        GA_APPEND(regstat_T *, &ga, rs);
+        profile_add(&total_total, &rs->rs_total);
+        total_count += rs->rs_count;
+      }
+      --todo;
+    }
+  }
+
+  if (ga.ga_len == 0) {
+    MSG(_("No patterns executed, use \":regtime on\" first"));
+    return;
+  }
+
+  /* sort on total time */
+  qsort(ga.ga_data, (size_t)ga.ga_len, sizeof(regstat_T *),
+      reg_compare_regtime);
+
+  MSG_PUTS_TITLE(_(
+          "  TOTAL      COUNT  MATCH   SLOWEST     AVERAGE   ENGINE STATES  PATTERN"));
+  MSG_PUTS("\n");
+  for (int idx = 0; idx < ga.ga_len && !got_int; ++idx) {
+    regstat_T *rs = ((regstat_T **)ga.ga_data)[idx];
+
+    MSG_PUTS(profile_msg(&rs->rs_total));
+    MSG_PUTS(" ");     /* make sure there is always a separating space */
+    msg_advance(13);
+    msg_outnum(rs->rs_count);
+    MSG_PUTS(" ");
+    msg_advance(20);
+    msg_outnum(rs->rs_match);
+    MSG_PUTS(" ");
+    msg_advance(26);
+    MSG_PUTS(profile_msg(&rs->rs_slowest));
+    MSG_PUTS(" ");
+    msg_advance(38);
+    profile_divide(&rs->rs_total, (int)rs->rs_count, &tm);
+    MSG_PUTS(profile_msg(&tm));
+    MSG_PUTS(" ");
+    msg_advance(50);
+    MSG_PUTS(rs->rs_nfa ? "NFA" : "BT");
+    MSG_PUTS(" ");
+    msg_advance(57);
+    if (rs->rs_nfa)
+      msg_outnum(rs->rs_nstate);
+    else
+      MSG_PUTS("-");
+    MSG_PUTS(" ");
+
+    msg_advance(65);
+    if (Columns < 80)
+      len = 20;       /* will wrap anyway */
+    else
+      len = Columns - 66;
+    if (len > (int)STRLEN(rs->rs_pattern))
+      len = (int)STRLEN(rs->rs_pattern);
+    msg_outtrans_len(rs->rs_pattern, len);
+    MSG_PUTS("\n");
+  }
+  ga_clear(&ga);
+  if (!got_int) {
+    MSG_PUTS("\n");
+    MSG_PUTS(profile_msg(&total_total));
+    msg_advance(13);
+    msg_outnum(total_count);
+    MSG_PUTS("\n");
+  }
 }
@@ -30,6 +30,20 @@
 
 typedef struct regengine regengine_T;
 
+/*
+ * Used for :regtime: statistics of executing a pattern, collected for all the
+ * programs compiled from the same pattern.
+ */
+typedef struct {
+  proftime_T rs_total;          /* total time used */
+  proftime_T rs_slowest;        /* time of slowest call */
+  long rs_count;                /* nr of times executed */
+  long rs_match;                /* nr of times matched */
+  int rs_nfa;                   /* TRUE when last executed with the NFA engine */
+  int rs_nstate;                /* nr of NFA states, zero for backtracking */
+  char_u rs_pattern[1];         /* the pattern, actually longer */
+} regstat_T;
+
 /*
  * Structure returned by vim_regcomp() to pass on to vim_regexec().
  * This is the general structure. For the actual matcher, two specific
@@ -38,6 +52,11 @@ typedef struct regengine regengine_T;
 typedef struct regprog {
   regengine_T         *engine;
   unsigned regflags;
+  char_u              *regpat;          /* pattern, for :regtime and the
+                                         * cache of programs */
+  int regkey;                           /* flags and options it was
+                                         * compiled with, -1: don't cache */
+  regstat_T           *regstat;         /* :regtime statistics or NULL */
 } regprog_T;
 
 /*
@@ -46,9 +65,12 @@ typedef struct regprog {
  * See regexp.c for an explanation.
  */
 typedef struct {
-  /* These two members implement regprog_T */
+  /* These five members implement regprog_T */
   regengine_T         *engine;
   unsigned regflags;
+  char_u              *regpat;
+  int regkey;
+  regstat_T           *regstat;
 
   int regstart;
   char_u reganch;
@@ -76,15 +98,23 @@ struct nfa_state {
  * Structure used by the NFA matcher.
  */
 typedef struct {
-  /* These two members implement regprog_T */
+  /* These five members implement regprog_T */
   regengine_T         *engine;
   unsigned regflags;
+  char_u              *regpat;
+  int regkey;
+  regstat_T           *regstat;
 
   nfa_state_T         *start;           /* points into state[] */
 
   int reganch;                          /* pattern starts with ^ */
   int regstart;                         /* char at start of pattern */
   char_u              *match_text;      /* plain text to match with */
+  char_u              *regmust;         /* text a match must contain */
+  int regmlen;                          /* length of regmust */
+  int regmprefix;                       /* regmust is at start of match */
+  int use_dfa;                          /* nfa_dfa_no_match() can be used */
+  struct nfa_dfa      *dfa;             /* lazily built DFA or NULL */
 
   int has_zend;                         /* pattern contains \ze */
   int has_backref;                      /* pattern contains \1 .. \9 */
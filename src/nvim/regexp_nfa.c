@@ -33,6 +33,13 @@
 /* Added to NFA_ANY - NFA_NUPPER_IC to include a NL. */
 #define NFA_ADD_NL              31
 
+/* Number of hash table entries for the states of the DFA. */
+#define NFA_DFA_HASH_SIZE       64
+/* Maximum memory used for the states of the DFA of one pattern. */
+#define NFA_DFA_MAX_MEM         (100 * 1024)
+/* Stop using the DFA when the states were flushed this often. */
+#define NFA_DFA_MAX_FLUSH       10
+
 enum {
   NFA_SPLIT = -1024,
   NFA_MATCH,
@@ -307,6 +314,40 @@ typedef struct {
   int has_pim;                  /* TRUE when any state has a PIM */
 } nfa_list_T;
 
+/*
+ * A state of the lazily built DFA: the set of NFA states that consume a
+ * character or are NFA_MATCH, after the zero-width states were followed.
+ */
+typedef struct nfa_dfa_state_S nfa_dfa_state_T;
+struct nfa_dfa_state_S {
+  nfa_dfa_state_T *hash_next;   /* next state with the same hash */
+  unsigned hash;
+  int accept;                   /* contains NFA_MATCH */
+  int n;                        /* nr of NFA states in "states" */
+  int             *states;      /* indexes in prog->state[], sorted */
+  nfa_dfa_state_T **next;       /* state for each class of characters,
+                                 * NULL when not known yet */
+};
+
+/*
+ * The DFA of a NFA program, "prog->dfa".  States are added when they are
+ * reached, they are all thrown away when NFA_DFA_MAX_MEM is exceeded.
+ */
+struct nfa_dfa {
+  int ic;                       /* value of ireg_ic it was built for */
+  int nclass;                   /* nr of classes of characters */
+  char_u charclass[256];        /* class of characters below 256, that
+                                 * all NFA states treat the same way */
+  nfa_dfa_state_T *start;       /* NULL after flushing */
+  nfa_dfa_state_T *table[NFA_DFA_HASH_SIZE];
+  size_t mem;                   /* memory used by the states */
+  int flushes;                  /* nr of times the states were flushed */
+  int             *work;        /* set of NFA states being built */
+  int             *stack;       /* used by nfa_dfa_closure() */
+  int             *mark;        /* "markid" when in "work" */
+  int markid;
+};
+
 /* NFA regexp \ze operator encountered. */
 static int nfa_has_zend;
 
@@ -558,6 +599,301 @@ static char_u *nfa_get_match_text(nfa_state_T *start)
   return ret;
 }
 
+/*
+ * Return TRUE if state "c" is zero-width and doesn't stop text before and
+ * after it from being found as one string.
+ */
+static int nfa_must_transparent(int c)
+{
+  switch (c) {
+  case NFA_NOPEN:
+  case NFA_NCLOSE:
+  case NFA_ZSTART:
+  case NFA_ZEND:
+  case NFA_BOW:
+  case NFA_EOW:
+  case NFA_EMPTY:
+    return TRUE;
+  }
+  /* NFA_MOPEN .. NFA_ZCLOSE9 */
+  return c >= NFA_MOPEN && c <= NFA_ZCLOSE9;
+}
+
+/*
+ * Put the states that follow state "p" in "next", skipping over what isn't
+ * matched against the text as a sequence: the characters of a collection and
+ * the pattern of "\@=" and friends.
+ * Returns the number of states put in "next".
+ */
+static int nfa_must_next(nfa_state_T *p, nfa_state_T **next)
+{
+  switch (p->c) {
+  case NFA_MATCH:
+    return 0;
+
+  case NFA_SPLIT:
+    next[0] = p->out;
+    next[1] = p->out1;
+    return 2;
+
+  case NFA_START_COLL:
+  case NFA_START_NEG_COLL:
+  case NFA_START_INVISIBLE:
+  case NFA_START_INVISIBLE_FIRST:
+  case NFA_START_INVISIBLE_NEG:
+  case NFA_START_INVISIBLE_NEG_FIRST:
+  case NFA_START_INVISIBLE_BEFORE:
+  case NFA_START_INVISIBLE_BEFORE_FIRST:
+  case NFA_START_INVISIBLE_BEFORE_NEG:
+  case NFA_START_INVISIBLE_BEFORE_NEG_FIRST:
+  case NFA_START_PATTERN:
+  case NFA_COMPOSING:
+    /* out1 points to the END state */
+    next[0] = p->out1->out;
+    return 1;
+
+  default:
+    next[0] = p->out;
+    return p->out != NULL ? 1 : 0;
+  }
+}
+
+/*
+ * Find the nearest common dominator of states "a" and "b".
+ */
+static int nfa_must_intersect(int *idom, int *po, int a, int b)
+{
+  while (a != b) {
+    while (po[a] < po[b])
+      a = idom[a];
+    while (po[b] < po[a])
+      b = idom[b];
+  }
+  return a;
+}
+
+/*
+ * Figure out the longest literal text that every match must contain, so that
+ * a line without it can be skipped without running the NFA.  This also finds
+ * text after something expensive, e.g. the "(" in "\h\w*\s*(".
+ * The states that every path from the start to NFA_MATCH goes through are
+ * the dominators of NFA_MATCH.  Characters among them that directly follow
+ * each other are text that must appear.
+ * Sets "prog->regmust", "prog->regmlen" and "prog->regmprefix".
+ */
+static void nfa_get_regmust(nfa_regprog_T *prog)
+{
+  int n = prog->nstate;
+  int         *po;              /* postorder number, -1 when not reached */
+  int         *order;           /* states in postorder */
+  int         *idom;            /* immediate dominator */
+  int         *stack;
+  int         *tried;
+  int         *npred;
+  int         *pred;
+  nfa_state_T *next[2];
+  nfa_state_T *p;
+  int i, j, k, sp, cnt, count;
+  int changed;
+  int match = -1;
+  int can_nl = FALSE;
+  int first = -1, last = -1;
+  int len = 0, bestlen = 0, runstart = 0;
+  char_u      *s;
+
+  prog->regmust = NULL;
+  prog->regmlen = 0;
+  prog->regmprefix = FALSE;
+
+  /* When the pattern is just literal text find_match_text() does better.
+   * The text is still given to vim_regmust() users: "regstart" followed by
+   * "match_text". */
+  if (prog->match_text != NULL) {
+    if (prog->regstart != NUL) {
+      len = MB_CHAR2LEN(prog->regstart);
+      prog->regmlen = len + (int)STRLEN(prog->match_text);
+      prog->regmust = xmalloc(prog->regmlen + 1);
+      if (has_mbyte)
+        (*mb_char2bytes)(prog->regstart, prog->regmust);
+      else
+        prog->regmust[0] = prog->regstart;
+      STRCPY(prog->regmust + len, prog->match_text);
+      prog->regmprefix = TRUE;
+    }
+    return;
+  }
+
+  po = xmalloc(n * sizeof(int));
+  order = xmalloc(n * sizeof(int));
+  idom = xmalloc(n * sizeof(int));
+  stack = xmalloc(n * sizeof(int));
+  tried = xmalloc(n * sizeof(int));
+  npred = xmalloc((n + 1) * sizeof(int));
+  pred = xmalloc(2 * n * sizeof(int));
+
+  for (i = 0; i < n; ++i) {
+    int c = prog->state[i].c;
+
+    po[i] = -1;
+    idom[i] = -1;
+    npred[i] = 0;
+    /* Text that must appear can't be looked for in one line when the
+     * match may continue in the next one. */
+    if (c == NFA_NEWL || (c >= NFA_FIRST_NL && c <= NFA_LAST_NL)
+        || (c >= NFA_ZREF1 && c <= NFA_ZREF9))
+      can_nl = TRUE;
+  }
+  npred[n] = 0;
+
+  /* Number the reachable states in postorder. */
+  count = 0;
+  sp = 0;
+  stack[0] = (int)(prog->start - prog->state);
+  tried[0] = 0;
+  po[stack[0]] = -2;
+  while (sp >= 0) {
+    p = &prog->state[stack[sp]];
+    cnt = nfa_must_next(p, next);
+    if (tried[sp] < cnt) {
+      j = (int)(next[tried[sp]++] - prog->state);
+      ++npred[j];
+      if (po[j] == -1) {
+        po[j] = -2;             /* on the stack */
+        stack[++sp] = j;
+        tried[sp] = 0;
+      }
+    } else {
+      if (p->c == NFA_MATCH)
+        match = stack[sp];
+      po[stack[sp]] = count;
+      order[count++] = stack[sp--];
+    }
+  }
+  if (match < 0)
+    goto theend;
+
+  /* Make "npred[j]" the start of the predecessors of state "j" in "pred",
+   * they end where those of "j + 1" start. */
+  for (i = 0, k = 0; i <= n; ++i) {
+    cnt = npred[i];
+    npred[i] = k;
+    k += cnt;
+  }
+  /* "tried" is used to count the predecessors already stored */
+  for (i = 0; i < n; ++i)
+    tried[i] = 0;
+  for (i = 0; i < count; ++i) {
+    cnt = nfa_must_next(&prog->state[order[i]], next);
+    for (k = 0; k < cnt; ++k) {
+      j = (int)(next[k] - prog->state);
+      pred[npred[j] + tried[j]++] = order[i];
+    }
+  }
+
+  /* Find the immediate dominators, as in "A Simple, Fast Dominance
+   * Algorithm" by Cooper, Harvey and Kennedy.  The start state is last in
+   * postorder. */
+  idom[order[count - 1]] = order[count - 1];
+  do {
+    changed = FALSE;
+    for (i = count - 2; i >= 0; --i) {
+      int b = order[i];
+      int new_idom = -1;
+
+      for (k = npred[b]; k < npred[b + 1]; ++k) {
+        j = pred[k];
+        if (idom[j] == -1)
+          continue;
+        if (new_idom == -1)
+          new_idom = j;
+        else
+          new_idom = nfa_must_intersect(idom, po, j, new_idom);
+      }
+      if (idom[b] != new_idom) {
+        idom[b] = new_idom;
+        changed = TRUE;
+      }
+    }
+  } while (changed);
+
+  /* Put the dominators of NFA_MATCH in "stack", from the start state to
+   * NFA_MATCH. */
+  sp = 0;
+  for (j = match; ; j = idom[j]) {
+    stack[sp++] = j;
+    if (j == idom[j])
+      break;
+  }
+  for (i = 0; i < sp / 2; ++i) {
+    j = stack[i];
+    stack[i] = stack[sp - 1 - i];
+    stack[sp - 1 - i] = j;
+  }
+
+  /* Find the longest sequence of characters, only zero-width states may be
+   * in between.  Prefer the first one, it may be at the start. */
+  for (i = 0; i < sp; ++i) {
+    p = &prog->state[stack[i]];
+    if (p->c > 0) {
+      if (len == 0)
+        runstart = i;
+      len += MB_CHAR2LEN(p->c);
+      if (len > bestlen) {
+        bestlen = len;
+        first = runstart;
+        last = i;
+      }
+    } else if (!nfa_must_transparent(p->c)) {
+      len = 0;
+      continue;
+    }
+    /* The text continues only when the next state directly follows. */
+    if (i + 1 == sp || p->out != &prog->state[stack[i + 1]])
+      len = 0;
+  }
+  if (first < 0)
+    goto theend;
+
+  /* The text is at the start when only zero-width states come before it,
+   * then it is where a match has to be tried. */
+  for (p = prog->start; p != &prog->state[stack[first]]; p = p->out)
+    if ((!nfa_must_transparent(p->c) && p->c != NFA_BOL && p->c != NFA_BOF)
+        || p->out == NULL)
+      break;
+  prog->regmprefix = (p == &prog->state[stack[first]]);
+
+  /* Not useful when it's just "regstart", and when it may be found in
+   * another line. */
+  if ((prog->regmprefix && bestlen == MB_CHAR2LEN(prog->regstart))
+      || (can_nl && !prog->regmprefix)) {
+    prog->regmprefix = FALSE;
+    goto theend;
+  }
+
+  prog->regmust = xmalloc(bestlen + 1);
+  prog->regmlen = bestlen;
+  s = prog->regmust;
+  for (i = first; i <= last; ++i) {
+    p = &prog->state[stack[i]];
+    if (p->c <= 0)
+      continue;
+    if (has_mbyte)
+      s += (*mb_char2bytes)(p->c, s);
+    else
+      *s++ = p->c;
+  }
+  *s = NUL;
+
+theend:
+  free(po);
+  free(order);
+  free(idom);
+  free(stack);
+  free(tried);
+  free(npred);
+  free(pred);
+}
+
 /*
  * Allocate more space for post_start.  Called when
  * running above the estimated number of states.
@@ -1223,6 +1559,7 @@ static int nfa_regatom(void)
 
     /* Previous substitute pattern.
      * Generated as "\%(pattern\)". */
+    reg_used_prev_sub = TRUE;
     if (reg_prev_sub == NULL) {
       EMSG(_(e_nopresub));
       return FAIL;
@@ -2446,6 +2783,9 @@ static void nfa_dump(nfa_regprog_T *prog)
           prog->regstart, prog->regstart);
     if (prog->match_text != NULL)
       fprintf(debugf, "match_text: \"%s\"\n", prog->match_text);
+    if (prog->regmust != NULL)
+      fprintf(debugf, "regmust: \"%s\"%s\n", prog->regmust,
+          prog->regmprefix ? " (at start)" : "");
 
     fclose(debugf);
   }
@@ -4764,6 +5104,370 @@ static long find_match_text(colnr_T startcol, int regstart, char_u *match_text)
   return 0L;
 }
 
+/*
+ * Return TRUE if the DFA can be used for "prog": nothing depends on what was
+ * matched before, what is around the match or the text in other lines.
+ */
+static int nfa_dfa_possible(nfa_regprog_T *prog)
+{
+  int i;
+  int c;
+
+  for (i = 0; i < prog->nstate; ++i) {
+    c = prog->state[i].c;
+    if (c == NFA_NEWL || c == NFA_SKIP
+        || (c >= NFA_FIRST_NL && c <= NFA_LAST_NL)
+        || (c >= NFA_START_INVISIBLE && c <= NFA_END_COMPOSING)
+        || (c >= NFA_BACKREF1 && c <= NFA_ZREF9))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/*
+ * Return TRUE if NFA state "c" consumes a character.
+ */
+static int nfa_dfa_consumes(int c)
+{
+  return c > 0 || (c >= NFA_ANY && c <= NFA_NUPPER_IC)
+         || c == NFA_START_COLL || c == NFA_START_NEG_COLL;
+}
+
+/*
+ * Return TRUE if NFA state "state", which consumes a character, may match
+ * "curc".  What depends on options or the buffer is assumed to match, the
+ * DFA is kept when they change.
+ */
+static int nfa_dfa_charmatch(nfa_state_T *state, int curc)
+{
+  nfa_state_T *p;
+  int c1, c2;
+  int low;
+
+  switch (state->c) {
+  case NFA_START_COLL:
+  case NFA_START_NEG_COLL:
+    for (p = state->out; p->c != NFA_END_COLL; p = p->out) {
+      if (p->c == NFA_RANGE_MIN) {
+        c1 = p->val;
+        p = p->out;             /* advance to NFA_RANGE_MAX */
+        c2 = p->val;
+        if (curc >= c1 && curc <= c2)
+          break;
+        if (ireg_ic) {
+          low = vim_tolower(curc);
+          while (c1 <= c2 && vim_tolower(c1) != low)
+            ++c1;
+          if (c1 <= c2)
+            break;
+        }
+      } else if (p->c < 0 ? (p->c == NFA_CLASS_PRINT
+                             || check_char_class(p->c, curc))
+                 : (curc == p->c
+                    || (ireg_ic && vim_tolower(curc)
+                        == vim_tolower(p->c))))
+        break;
+    }
+    return (p->c == NFA_END_COLL) == (state->c == NFA_START_NEG_COLL);
+
+  case NFA_ANY:
+  case NFA_IDENT:
+  case NFA_SIDENT:
+  case NFA_KWORD:
+  case NFA_SKWORD:
+  case NFA_FNAME:
+  case NFA_SFNAME:
+  case NFA_PRINT:
+  case NFA_SPRINT:
+    return TRUE;
+
+  case NFA_WHITE:     return vim_iswhite(curc);
+  case NFA_NWHITE:    return !vim_iswhite(curc);
+  case NFA_DIGIT:     return ri_digit(curc);
+  case NFA_NDIGIT:    return !ri_digit(curc);
+  case NFA_HEX:       return ri_hex(curc);
+  case NFA_NHEX:      return !ri_hex(curc);
+  case NFA_OCTAL:     return ri_octal(curc);
+  case NFA_NOCTAL:    return !ri_octal(curc);
+  case NFA_WORD:      return ri_word(curc);
+  case NFA_NWORD:     return !ri_word(curc);
+  case NFA_HEAD:      return ri_head(curc);
+  case NFA_NHEAD:     return !ri_head(curc);
+  case NFA_ALPHA:     return ri_alpha(curc);
+  case NFA_NALPHA:    return !ri_alpha(curc);
+  case NFA_LOWER:     return ri_lower(curc);
+  case NFA_NLOWER:    return !ri_lower(curc);
+  case NFA_UPPER:     return ri_upper(curc);
+  case NFA_NUPPER:    return !ri_upper(curc);
+  case NFA_LOWER_IC:  return ri_lower(curc) || (ireg_ic && ri_upper(curc));
+  case NFA_NLOWER_IC: return !(ri_lower(curc) || (ireg_ic && ri_upper(curc)));
+  case NFA_UPPER_IC:  return ri_upper(curc) || (ireg_ic && ri_lower(curc));
+  case NFA_NUPPER_IC: return !(ri_upper(curc) || (ireg_ic && ri_lower(curc)));
+
+  default:            /* regular character */
+    return state->c == curc
+           || (ireg_ic && vim_tolower(state->c) == vim_tolower(curc));
+  }
+}
+
+/*
+ * Allocate the DFA for "prog", for the current value of ireg_ic.
+ */
+static struct nfa_dfa *nfa_dfa_alloc(nfa_regprog_T *prog)
+{
+  struct nfa_dfa *dfa = xcalloc(1, sizeof(struct nfa_dfa));
+  char_u newclass[256];
+  int map[512];
+  nfa_state_T *p;
+  int i, c, key;
+
+  dfa->ic = ireg_ic;
+  dfa->work = xmalloc(prog->nstate * sizeof(int));
+  dfa->stack = xmalloc(prog->nstate * sizeof(int));
+  dfa->mark = xcalloc(prog->nstate, sizeof(int));
+
+  /* Put characters that all states treat the same way in one class, so
+   * that a DFA state needs a transition only for each class. */
+  dfa->nclass = 1;
+  for (i = 0; i < prog->nstate; ++i) {
+    p = &prog->state[i];
+    if (!nfa_dfa_consumes(p->c))
+      continue;
+    for (key = 0; key < dfa->nclass * 2; ++key)
+      map[key] = -1;
+    dfa->nclass = 0;
+    for (c = 1; c < 256; ++c) {
+      key = dfa->charclass[c] * 2 + (nfa_dfa_charmatch(p, c) ? 1 : 0);
+      if (map[key] < 0)
+        map[key] = dfa->nclass++;
+      newclass[c] = map[key];
+    }
+    memmove(dfa->charclass + 1, newclass + 1, 255);
+  }
+  return dfa;
+}
+
+/*
+ * Throw away the states of "dfa".
+ */
+static void nfa_dfa_flush(struct nfa_dfa *dfa)
+{
+  nfa_dfa_state_T *ds;
+  int i;
+
+  for (i = 0; i < NFA_DFA_HASH_SIZE; ++i)
+    while (dfa->table[i] != NULL) {
+      ds = dfa->table[i];
+      dfa->table[i] = ds->hash_next;
+      free(ds);
+    }
+  dfa->start = NULL;
+  dfa->mem = 0;
+  ++dfa->flushes;
+}
+
+static void nfa_dfa_free(struct nfa_dfa *dfa)
+{
+  if (dfa != NULL) {
+    nfa_dfa_flush(dfa);
+    free(dfa->work);
+    free(dfa->stack);
+    free(dfa->mark);
+    free(dfa);
+  }
+}
+
+/*
+ * Add the states that can be reached from "state" without consuming a
+ * character to the set being built, "dfa->work[*np]".  Zero-width items are
+ * assumed to match.
+ */
+static void nfa_dfa_closure(nfa_regprog_T *prog, nfa_state_T *state, int *np)
+{
+  struct nfa_dfa *dfa = prog->dfa;
+  nfa_state_T *p;
+  int sp = 0;
+
+#define DFA_PUSH(s) \
+  if ((s) != NULL && dfa->mark[(s) - prog->state] != dfa->markid) { \
+    dfa->mark[(s) - prog->state] = dfa->markid; \
+    dfa->stack[sp++] = (int)((s) - prog->state); \
+  }
+
+  DFA_PUSH(state);
+  while (sp > 0) {
+    p = &prog->state[dfa->stack[--sp]];
+    if (p->c == NFA_SPLIT) {
+      DFA_PUSH(p->out1);
+      DFA_PUSH(p->out);
+    } else if (p->c == NFA_MATCH || nfa_dfa_consumes(p->c))
+      dfa->work[(*np)++] = (int)(p - prog->state);
+    else
+      DFA_PUSH(p->out);
+  }
+
+#undef DFA_PUSH
+}
+
+/*
+ * Start building a set of NFA states in "dfa->work".
+ */
+static void nfa_dfa_clear_set(struct nfa_dfa *dfa, int nstates)
+{
+  if (++dfa->markid == INT_MAX) {
+    memset(dfa->mark, 0, nstates * sizeof(int));
+    dfa->markid = 1;
+  }
+}
+
+static int nfa_dfa_cmp(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Find the DFA state for the "n" NFA states in "dfa->work", add it when it
+ * doesn't exist yet.  When this uses too much memory all states are thrown
+ * away first.
+ * Returns NULL when that happened too often.
+ */
+static nfa_dfa_state_T *nfa_dfa_state(nfa_regprog_T *prog, int n)
+{
+  struct nfa_dfa *dfa = prog->dfa;
+  nfa_dfa_state_T *ds;
+  unsigned hash = (unsigned)n;
+  size_t size;
+  int i;
+
+  qsort(dfa->work, (size_t)n, sizeof(int), nfa_dfa_cmp);
+  for (i = 0; i < n; ++i)
+    hash = hash * 31 + (unsigned)dfa->work[i];
+
+  for (ds = dfa->table[hash % NFA_DFA_HASH_SIZE]; ds != NULL;
+       ds = ds->hash_next)
+    if (ds->hash == hash && ds->n == n
+        && memcmp(ds->states, dfa->work, n * sizeof(int)) == 0)
+      return ds;
+
+  size = sizeof(nfa_dfa_state_T) + dfa->nclass * sizeof(nfa_dfa_state_T *)
+         + n * sizeof(int);
+  if (dfa->mem + size > NFA_DFA_MAX_MEM) {
+    nfa_dfa_flush(dfa);
+    if (dfa->flushes > NFA_DFA_MAX_FLUSH)
+      return NULL;
+  }
+
+  ds = xcalloc(1, size);
+  ds->next = (nfa_dfa_state_T **)(ds + 1);
+  ds->states = (int *)(ds->next + dfa->nclass);
+  ds->n = n;
+  ds->hash = hash;
+  for (i = 0; i < n; ++i) {
+    ds->states[i] = dfa->work[i];
+    if (prog->state[ds->states[i]].c == NFA_MATCH)
+      ds->accept = TRUE;
+  }
+  ds->hash_next = dfa->table[hash % NFA_DFA_HASH_SIZE];
+  dfa->table[hash % NFA_DFA_HASH_SIZE] = ds;
+  dfa->mem += size;
+  return ds;
+}
+
+/*
+ * Compute the DFA state that follows "from" for character "curc".  A match
+ * can start at every position, unless the pattern starts with "^".
+ * Returns NULL when the DFA was flushed too often.
+ */
+static nfa_dfa_state_T *nfa_dfa_step(nfa_regprog_T *prog,
+                                     nfa_dfa_state_T *from, int curc)
+{
+  struct nfa_dfa *dfa = prog->dfa;
+  nfa_state_T *p;
+  int n = 0;
+  int i;
+
+  nfa_dfa_clear_set(dfa, prog->nstate);
+  for (i = 0; i < from->n; ++i) {
+    p = &prog->state[from->states[i]];
+    if (p->c == NFA_MATCH || !nfa_dfa_charmatch(p, curc))
+      continue;
+    if (p->c == NFA_START_COLL || p->c == NFA_START_NEG_COLL)
+      /* out1 of START points to the END state */
+      nfa_dfa_closure(prog, p->out1->out, &n);
+    else
+      nfa_dfa_closure(prog, p->out, &n);
+  }
+  if (!prog->reganch)
+    nfa_dfa_closure(prog, prog->start, &n);
+  return nfa_dfa_state(prog, n);
+}
+
+/*
+ * Run the DFA of "prog" over "regline" from column "col", building it where
+ * needed.  Zero-width items like "^" and "\<" are assumed to match, the DFA
+ * can only tell that there is no match, the NFA finds out where a match is.
+ * Returns TRUE when there can't be a match.
+ */
+static int nfa_dfa_no_match(nfa_regprog_T *prog, colnr_T col)
+{
+  struct nfa_dfa *dfa = prog->dfa;
+  nfa_dfa_state_T *ds;
+  nfa_dfa_state_T *next;
+  char_u          *s;
+  int curc;
+  int clen;
+  int flushes;
+  int n = 0;
+
+  /* The classes of characters depend on ignoring case. */
+  if (dfa != NULL && dfa->ic != ireg_ic) {
+    nfa_dfa_free(dfa);
+    dfa = NULL;
+  }
+  if (dfa == NULL)
+    dfa = prog->dfa = nfa_dfa_alloc(prog);
+
+  if (dfa->start == NULL) {
+    nfa_dfa_clear_set(dfa, prog->nstate);
+    nfa_dfa_closure(prog, prog->start, &n);
+    dfa->start = nfa_dfa_state(prog, n);
+  }
+
+  ds = dfa->start;
+  for (s = regline + col;; s += clen) {
+    if (ds == NULL) {
+      /* Too many states for this pattern, don't try again. */
+      nfa_dfa_free(dfa);
+      prog->dfa = NULL;
+      prog->use_dfa = FALSE;
+      return FALSE;
+    }
+    if (ds->accept)
+      return FALSE;
+    if (*s == NUL || ds->n == 0)
+      return TRUE;
+
+    if (has_mbyte) {
+      curc = (*mb_ptr2char)(s);
+      clen = (*mb_ptr2len)(s);
+    } else {
+      curc = *s;
+      clen = 1;
+    }
+
+    if (curc < 256 && (next = ds->next[dfa->charclass[curc]]) != NULL) {
+      ds = next;
+      continue;
+    }
+    flushes = dfa->flushes;
+    next = nfa_dfa_step(prog, ds, curc);
+    /* Remember the transition, unless "ds" was thrown away. */
+    if (next != NULL && curc < 256 && dfa->flushes == flushes)
+      ds->next[dfa->charclass[curc]] = next;
+    ds = next;
+  }
+}
+
 /*
  * Main matching routine.
  *
@@ -6159,10 +6863,26 @@ nfa_regexec_both (
       return find_match_text(col, prog->regstart, prog->match_text);
   }
 
+  /* If there is text that must appear, look for it.  Without it there can't
+   * be a match.  When it's at the start of the match, that is the first
+   * position where the NFA needs to be tried. */
+  if (prog->regmust != NULL && !ireg_icombine) {
+    char_u *s = find_regmust(regline + col, prog->regmust, prog->regmlen);
+
+    if (s == NULL)
+      return 0L;
+    if (prog->regmprefix)
+      col = (colnr_T)(s - regline);
+  }
+
   /* If the start column is past the maximum column: no need to try. */
   if (ireg_maxcol > 0 && col >= ireg_maxcol)
     goto theend;
 
+  /* The DFA finds out quickly when there can't be a match. */
+  if (prog->use_dfa && nfa_dfa_no_match(prog, col))
+    goto theend;
+
   nstate = prog->nstate;
   for (i = 0; i < nstate; ++i) {
     prog->state[i].id = i;
@@ -6262,6 +6982,9 @@ static regprog_T *nfa_regcomp(char_u *expr, int re_flags)
   prog->reganch = nfa_get_reganch(prog->start, 0);
   prog->regstart = nfa_get_regstart(prog->start, 0);
   prog->match_text = nfa_get_match_text(prog->start);
+  nfa_get_regmust(prog);
+  prog->use_dfa = nfa_dfa_possible(prog);
+  prog->dfa = NULL;
 
 #ifdef REGEXP_DEBUG
   nfa_postfix_dump(expr, OK);
@@ -6299,6 +7022,8 @@ static void nfa_regfree(regprog_T *prog)
 {
   if (prog != NULL) {
     free(((nfa_regprog_T *)prog)->match_text);
+    free(((nfa_regprog_T *)prog)->regmust);
+    nfa_dfa_free(((nfa_regprog_T *)prog)->dfa);
 #ifdef REGEXP_DEBUG
     free(((nfa_regprog_T *)prog)->pattern);
 #endif
@@ -6372,7 +7097,7 @@ proftime_T  *tm;         /* timeout limit or NULL */
   reg_buf = buf;
   reg_win = win;
   reg_firstlnum = lnum;
-  reg_maxline = reg_buf->b_ml.ml_line_count - lnum;
+  reg_maxline = reg_line_count() - lnum;
   reg_line_lbr = FALSE;
   ireg_ic = rmp->rmm_ic;
   ireg_icombine = FALSE;
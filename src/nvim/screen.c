@@ -13,27 +13,25 @@
  * by remembering what is already on the screen, and only updating the parts
  * that changed.
  *
- * ScreenLines[off]  Contains a copy of the whole screen, as it is currently
+ * ScreenCells[off]  Contains a copy of the whole screen, as it is currently
  *		     displayed (excluding text written by external commands).
- * ScreenAttrs[off]  Contains the associated attributes.
- * LineOffset[row]   Contains the offset into ScreenLines*[] and ScreenAttrs[]
- *		     for each line.
+ *		     Each cell has the character and the attributes.
+ * LineOffset[row]   Contains the offset into ScreenCells[] for each line.
  * LineWraps[row]    Flag for each line whether it wraps to the next line.
  *
- * For double-byte characters, two consecutive bytes in ScreenLines[] can form
+ * For double-byte characters, the sc_char of two consecutive cells can form
  * one character which occupies two display cells.
  * For UTF-8 a multi-byte character is converted to Unicode and stored in
- * ScreenLinesUC[].  ScreenLines[] contains the first byte only.  For an ASCII
- * character without composing chars ScreenLinesUC[] will be 0 and
- * ScreenLinesC[][] is not used.  When the character occupies two display
- * cells the next byte in ScreenLines[] is 0.
- * ScreenLinesC[][] contain up to 'maxcombine' composing characters
- * (drawn on top of the first character).  There is 0 after the last one used.
- * ScreenLines2[] is only used for euc-jp to store the second byte if the
- * first byte is 0x8e (single-width character).
+ * sc_uc.  sc_char contains the first byte only.  For an ASCII character
+ * without composing chars sc_uc will be 0 and sc_cc[] is not used.  When the
+ * character occupies two display cells sc_char of the next cell is 0.
+ * sc_cc[] contains up to 'maxcombine' composing characters (drawn on top of
+ * the first character).  There is 0 after the last one used.
+ * sc_char2 is only used for euc-jp to store the second byte if the first byte
+ * is 0x8e (single-width character).
  *
  * The screen_*() functions write to the screen and handle updating
- * ScreenLines[].
+ * ScreenCells[].
  *
  * update_screen() is the function that updates all windows and status lines.
  * It is called form the main loop when must_redraw is non-zero.  It may be
@@ -86,7 +84,15 @@
  *   update_screen() called to redraw.
  */
 
+#include <stddef.h>
 #include <string.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#include <uv.h>
 
 #include "nvim/vim.h"
 #include "nvim/arabic.h"
@@ -103,6 +109,7 @@
 #include "nvim/fileio.h"
 #include "nvim/fold.h"
 #include "nvim/getchar.h"
+#include "nvim/grid.h"
 #include "nvim/main.h"
 #include "nvim/mbyte.h"
 #include "nvim/memline.h"
@@ -133,6 +140,10 @@
                              * doesn't fit. */
 #define W_ENDCOL(wp)   (wp->w_wincol + wp->w_width)
 
+/* Number of screen cells compared at once by screen_cells_first_diff() and
+ * screen_cells_last_diff(). */
+#define CELL_BLOCK 16
+
 /*
  * The attributes that are actually active for writing to the screen.
  */
@@ -151,7 +162,37 @@ static foldinfo_T win_foldinfo; /* info for 'foldcolumn' */
 /*
  * Buffer for one screen line (characters and attributes).
  */
-static schar_T  *current_ScreenLine;
+static screencell_T *current_ScreenLine;
+
+/*
+ * Cache of lines drawn by win_line(), to be copied to the screen when the
+ * same line is displayed again, e.g. when scrolling back.  Each window has
+ * RENDER_CACHE_SIZE entries, indexed by the line number.  An entry is used
+ * when the buffer wasn't changed and "render_tick" is the same, it is
+ * incremented for anything else that changes how lines are displayed, such as
+ * setting an option or highlighting.  Stored syntax states that changed, e.g.
+ * parsed while waiting for a key, change "b_syn_tick".  Lines that depend on
+ * the cursor position or on matches are not cached.
+ */
+#define RENDER_CACHE_SIZE 256
+
+typedef struct renderline {
+  linenr_T rl_lnum;             /* buffer line, zero when entry not used */
+  int rl_fnum;                  /* number of the buffer */
+  int rl_changedtick;           /* b_changedtick when drawn */
+  int rl_tick;                  /* render_tick when drawn */
+  int rl_syn_tick;              /* b_syn_tick when drawn */
+  int rl_width;                 /* window width when drawn */
+  colnr_T rl_leftcol;           /* w_leftcol when drawn */
+  int rl_rows;                  /* number of screen rows */
+  screencell_T *rl_cells;       /* rl_rows * rl_width cells */
+} renderline_T;
+
+static int render_tick = 0;
+
+/* Encoding ScreenCells[] was allocated for, it is reallocated when it changes. */
+static int screen_enc_utf8 = FALSE;
+static int screen_enc_dbcs = 0;
 
 # define SCREEN_LINE(r, o, e, c, rl)    screen_line((r), (o), (e), (c), (rl))
 #ifdef INCLUDE_GENERATED_DECLARATIONS
@@ -203,6 +244,8 @@ void redraw_all_later(int type)
 {
   win_T       *wp;
 
+  if (type >= SOME_VALID)
+    render_cache_invalidate();
   FOR_ALL_WINDOWS(wp)
   {
     redraw_win_later(wp, type);
@@ -221,6 +264,8 @@ void redraw_buf_later(buf_T *buf, int type)
 {
   win_T       *wp;
 
+  if (type >= SOME_VALID)
+    render_cache_invalidate();
   FOR_ALL_WINDOWS(wp)
   {
     if (wp->w_buffer == buf)
@@ -238,12 +283,7 @@ int redraw_asap(int type)
   int rows;
   int r;
   int ret = 0;
-  schar_T     *screenline;      /* copy from ScreenLines[] */
-  sattr_T     *screenattr;      /* copy from ScreenAttrs[] */
-  int i;
-  u8char_T    *screenlineUC = NULL;     /* copy from ScreenLinesUC[] */
-  u8char_T    *screenlineC[MAX_MCO];    /* copy from ScreenLinesC[][] */
-  schar_T     *screenline2 = NULL;      /* copy from ScreenLines2[] */
+  screencell_T *screenline;     /* copy from ScreenCells[] */
 
   redraw_later(type);
   if (msg_scrolled || (State != NORMAL && State != NORMAL_BUSY))
@@ -251,84 +291,29 @@ int redraw_asap(int type)
 
   /* Allocate space to save the text displayed in the command line area. */
   rows = Rows - cmdline_row;
-  screenline = xmalloc((size_t)(rows * Columns * sizeof(schar_T)));
-  screenattr = xmalloc((size_t)(rows * Columns * sizeof(sattr_T)));
-
-  if (enc_utf8) {
-    screenlineUC = xmalloc((size_t)(rows * Columns * sizeof(u8char_T)));
-
-    for (i = 0; i < p_mco; ++i) {
-      screenlineC[i] = xmalloc((size_t)(rows * Columns * sizeof(u8char_T)));
-    }
-  }
-  if (enc_dbcs == DBCS_JPNU) {
-    screenline2 = xmalloc((size_t)(rows * Columns * sizeof(schar_T)));
-  }
+  screenline = xmalloc((size_t)(rows * Columns * sizeof(screencell_T)));
 
   /* Save the text displayed in the command line area. */
-  for (r = 0; r < rows; ++r) {
+  for (r = 0; r < rows; ++r)
     memmove(screenline + r * Columns,
-        ScreenLines + LineOffset[cmdline_row + r],
-        (size_t)Columns * sizeof(schar_T));
-    memmove(screenattr + r * Columns,
-        ScreenAttrs + LineOffset[cmdline_row + r],
-        (size_t)Columns * sizeof(sattr_T));
-    if (enc_utf8) {
-      memmove(screenlineUC + r * Columns,
-          ScreenLinesUC + LineOffset[cmdline_row + r],
-          (size_t)Columns * sizeof(u8char_T));
-      for (i = 0; i < p_mco; ++i)
-        memmove(screenlineC[i] + r * Columns,
-            ScreenLinesC[r] + LineOffset[cmdline_row + r],
-            (size_t)Columns * sizeof(u8char_T));
-    }
-    if (enc_dbcs == DBCS_JPNU)
-      memmove(screenline2 + r * Columns,
-          ScreenLines2 + LineOffset[cmdline_row + r],
-          (size_t)Columns * sizeof(schar_T));
-  }
+        ScreenCells + LineOffset[cmdline_row + r],
+        (size_t)Columns * sizeof(screencell_T));
 
   update_screen(0);
   ret = 3;
 
   if (must_redraw == 0) {
-    int off = (int)(current_ScreenLine - ScreenLines);
-
     /* Restore the text displayed in the command line area. */
     for (r = 0; r < rows; ++r) {
       memmove(current_ScreenLine,
           screenline + r * Columns,
-          (size_t)Columns * sizeof(schar_T));
-      memmove(ScreenAttrs + off,
-          screenattr + r * Columns,
-          (size_t)Columns * sizeof(sattr_T));
-      if (enc_utf8) {
-        memmove(ScreenLinesUC + off,
-            screenlineUC + r * Columns,
-            (size_t)Columns * sizeof(u8char_T));
-        for (i = 0; i < p_mco; ++i)
-          memmove(ScreenLinesC[i] + off,
-              screenlineC[i] + r * Columns,
-              (size_t)Columns * sizeof(u8char_T));
-      }
-      if (enc_dbcs == DBCS_JPNU)
-        memmove(ScreenLines2 + off,
-            screenline2 + r * Columns,
-            (size_t)Columns * sizeof(schar_T));
+          (size_t)Columns * sizeof(screencell_T));
       SCREEN_LINE(cmdline_row + r, 0, Columns, Columns, FALSE);
     }
     ret = 4;
   }
 
   free(screenline);
-  free(screenattr);
-  if (enc_utf8) {
-    free(screenlineUC);
-    for (i = 0; i < p_mco; ++i)
-      free(screenlineC[i]);
-  }
-  if (enc_dbcs == DBCS_JPNU)
-    free(screenline2);
 
   /* Show the intro message when appropriate. */
   maybe_intro_message();
@@ -381,7 +366,7 @@ void update_curbuf(int type)
  * update_screen()
  *
  * Based on the current value of curwin->w_topline, transfer a screenfull
- * of stuff from Filemem to ScreenLines[], and update curwin->w_botline.
+ * of stuff from Filemem to ScreenCells[], and update curwin->w_botline.
  */
 void update_screen(int type)
 {
@@ -419,6 +404,8 @@ void update_screen(int type)
   }
 
   updating_screen = TRUE;
+  /* Write the whole screen update at once. */
+  out_frame_start();
   ++display_tick;           /* let syntax code know we're in a next round of
                              * display updating */
 
@@ -568,6 +555,8 @@ void update_screen(int type)
     maybe_intro_message();
   did_intro = TRUE;
 
+  out_frame_end();
+
 }
 
 /*
@@ -620,7 +609,7 @@ void update_single_line(win_T *wp, linenr_T lnum)
         init_search_hl(wp);
         start_search_hl();
         prepare_search_hl(wp, lnum);
-        win_line(wp, lnum, row, row + wp->w_lines[j].wl_size, FALSE);
+        win_line_prof(wp, lnum, row, row + wp->w_lines[j].wl_size, FALSE);
         end_search_hl();
         break;
       }
@@ -1539,14 +1528,18 @@ static void win_update(win_T *wp)
           syntax_end_parsing(syntax_last_parsed + 1);
 
         /*
-         * Display one line.
+         * Display one line, from the cache when it was drawn before.
          */
-        row = win_line(wp, lnum, srow, wp->w_height, mod_top == 0);
+        row = render_cache_draw(wp, lnum, srow);
+        if (row < 0) {
+          row = win_line_prof(wp, lnum, srow, wp->w_height, mod_top == 0);
+          render_cache_store(wp, lnum, srow, row);
+          syntax_last_parsed = lnum;
+        }
 
         wp->w_lines[idx].wl_folded = FALSE;
         wp->w_lines[idx].wl_lastlnum = lnum;
         did_update = DID_LINE;
-        syntax_last_parsed = lnum;
       }
 
       wp->w_lines[idx].wl_lnum = lnum;
@@ -1796,7 +1789,7 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
   int fdc;
   int col;
   int txtcol;
-  int off = (int)(current_ScreenLine - ScreenLines);
+  int off = (int)(current_ScreenLine - ScreenCells);
   int ri;
 
   /* Build the fold line:
@@ -1814,10 +1807,9 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
    * Ignores 'rightleft', this window is never right-left.
    */
   if (cmdwin_type != 0 && wp == curwin) {
-    ScreenLines[off] = cmdwin_type;
-    ScreenAttrs[off] = hl_attr(HLF_AT);
-    if (enc_utf8)
-      ScreenLinesUC[off] = 0;
+    ScreenCells[off].sc_char = cmdwin_type;
+    ScreenCells[off].sc_attr = hl_attr(HLF_AT);
+    ScreenCells[off].sc_uc = 0;
     ++col;
   }
 
@@ -1836,7 +1828,7 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
           hl_attr(HLF_FC));
       /* reverse the fold column */
       for (i = 0; i < fdc; ++i)
-        ScreenLines[off + wp->w_width - i - 1 - col] = buf[i];
+        ScreenCells[off + wp->w_width - i - 1 - col].sc_char = buf[i];
     } else
       copy_text_attr(off + col, buf, fdc, hl_attr(HLF_FC));
     col += fdc;
@@ -1844,10 +1836,10 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
 
 # define RL_MEMSET(p, v, l)  if (wp->w_p_rl) \
     for (ri = 0; ri < l; ++ri) \
-      ScreenAttrs[off + (wp->w_width - (p) - (l)) + ri] = v; \
+      ScreenCells[off + (wp->w_width - (p) - (l)) + ri].sc_attr = v; \
   else \
     for (ri = 0; ri < l; ++ri) \
-      ScreenAttrs[off + (p) + ri] = v
+      ScreenCells[off + (p) + ri].sc_attr = v
 
   /* Set all attributes of the 'number' or 'relativenumber' column and the
    * text */
@@ -1930,7 +1922,7 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
     else
       idx = off + col;
 
-    /* Store multibyte characters in ScreenLines[] et al. correctly. */
+    /* Store multibyte characters in ScreenCells[] correctly. */
     for (p = text; *p != NUL; ) {
       cells = (*mb_ptr2cells)(p);
       c_len = (*mb_ptr2len)(p);
@@ -1938,11 +1930,11 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
           - (wp->w_p_rl ? col : 0)
           )
         break;
-      ScreenLines[idx] = *p;
+      ScreenCells[idx].sc_char = *p;
       if (enc_utf8) {
         u8c = utfc_ptr2char(p, u8cc);
         if (*p < 0x80 && u8cc[0] == 0) {
-          ScreenLinesUC[idx] = 0;
+          ScreenCells[idx].sc_uc = 0;
           prev_c = u8c;
         } else {
           if (p_arshape && !p_tbidi && arabic_char(u8c)) {
@@ -1967,30 +1959,30 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
 
             u8c = arabic_shape(u8c, &firstbyte, &u8cc[0],
                 pc, pc1, nc);
-            ScreenLines[idx] = firstbyte;
+            ScreenCells[idx].sc_char = firstbyte;
           } else
             prev_c = u8c;
           /* Non-BMP character: display as ? or fullwidth ?. */
 #ifdef UNICODE16
           if (u8c >= 0x10000)
-            ScreenLinesUC[idx] = (cells == 2) ? 0xff1f : (int)'?';
+            ScreenCells[idx].sc_uc = (cells == 2) ? 0xff1f : (int)'?';
           else
 #endif
-          ScreenLinesUC[idx] = u8c;
+          ScreenCells[idx].sc_uc = u8c;
           for (i = 0; i < Screen_mco; ++i) {
-            ScreenLinesC[i][idx] = u8cc[i];
+            ScreenCells[idx].sc_cc[i] = u8cc[i];
             if (u8cc[i] == 0)
               break;
           }
         }
         if (cells > 1)
-          ScreenLines[idx + 1] = 0;
+          ScreenCells[idx + 1].sc_char = 0;
       } else if (enc_dbcs == DBCS_JPNU && *p == 0x8e)
         /* double-byte single width character */
-        ScreenLines2[idx] = p[1];
+        ScreenCells[idx].sc_char2 = p[1];
       else if (cells > 1)
         /* double-width character */
-        ScreenLines[idx + 1] = p[1];
+        ScreenCells[idx + 1].sc_char = p[1];
       col += cells;
       idx += cells;
       p += c_len;
@@ -2000,10 +1992,7 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
     if (len > wp->w_width - col)
       len = wp->w_width - col;
     if (len > 0) {
-      if (wp->w_p_rl)
-        STRNCPY(current_ScreenLine, text, len);
-      else
-        STRNCPY(current_ScreenLine + col, text, len);
+      copy_text(wp->w_p_rl ? off : off + col, text, len);
       col += len;
     }
   }
@@ -2014,14 +2003,12 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
   while (col < wp->w_width
          - (wp->w_p_rl ? txtcol : 0)
          ) {
-    if (enc_utf8) {
-      if (fill_fold >= 0x80) {
-        ScreenLinesUC[off + col] = fill_fold;
-        ScreenLinesC[0][off + col] = 0;
-      } else
-        ScreenLinesUC[off + col] = 0;
-    }
-    ScreenLines[off + col++] = fill_fold;
+    if (enc_utf8 && fill_fold >= 0x80) {
+      ScreenCells[off + col].sc_uc = fill_fold;
+      ScreenCells[off + col].sc_cc[0] = 0;
+    } else
+      ScreenCells[off + col].sc_uc = 0;
+    ScreenCells[off + col++].sc_char = fill_fold;
   }
 
   if (text != buf)
@@ -2079,8 +2066,8 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
     else
       txtcol -= wp->w_leftcol;
     if (txtcol >= 0 && txtcol < wp->w_width)
-      ScreenAttrs[off + txtcol] = hl_combine_attr(
-          ScreenAttrs[off + txtcol], hl_attr(HLF_CUC));
+      ScreenCells[off + txtcol].sc_attr = hl_combine_attr(
+          ScreenCells[off + txtcol].sc_attr, hl_attr(HLF_CUC));
   }
 
   SCREEN_LINE(row + wp->w_winrow, wp->w_wincol, wp->w_width,
@@ -2101,17 +2088,28 @@ static void fold_line(win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T
 }
 
 /*
- * Copy "buf[len]" to ScreenLines["off"] and set attributes to "attr".
+ * Copy the single byte characters "buf[len]" to ScreenCells["off"].
+ */
+static void copy_text(int off, char_u *buf, int len)
+{
+  int i;
+
+  for (i = 0; i < len; ++i) {
+    ScreenCells[off + i].sc_char = buf[i];
+    ScreenCells[off + i].sc_uc = 0;
+  }
+}
+
+/*
+ * Copy "buf[len]" to ScreenCells["off"] and set attributes to "attr".
  */
 static void copy_text_attr(int off, char_u *buf, int len, int attr)
 {
   int i;
 
-  memmove(ScreenLines + off, buf, (size_t)len);
-  if (enc_utf8)
-    memset(ScreenLinesUC + off, 0, sizeof(u8char_T) * (size_t)len);
+  copy_text(off, buf, len);
   for (i = 0; i < len; ++i)
-    ScreenAttrs[off + i] = attr;
+    ScreenCells[off + i].sc_attr = attr;
 }
 
 /*
@@ -2163,6 +2161,19 @@ fill_foldcolumn (
     p[i >= wp->w_p_fdc ? i - 1 : i] = '+';
 }
 
+/*
+ * Call win_line() and add the time it took to the highlighting profile.
+ */
+static int win_line_prof(win_T *wp, linenr_T lnum, int startrow, int endrow,
+                         int nochange)
+{
+  uint64_t start = uv_hrtime();
+  int row = win_line(wp, lnum, startrow, endrow, nochange);
+
+  syntax_prof_line(wp, lnum, uv_hrtime() - start);
+  return row;
+}
+
 /*
  * Display line "lnum" of window 'wp' on the screen.
  * Start at row "startrow", stop when "endrow" is reached.
@@ -2180,7 +2191,7 @@ win_line (
 )
 {
   int col;                              /* visual column on screen */
-  unsigned off;                         /* offset in ScreenLines/ScreenAttrs */
+  unsigned off;                         /* offset in ScreenCells */
   int c = 0;                            /* init for GCC */
   long vcol = 0;                        /* virtual column (for tabs) */
   long vcol_prev = -1;                  /* "vcol" of previous character */
@@ -2230,6 +2241,8 @@ win_line (
   int vcol_save_attr = 0;               /* saved attr for 'cursorcolumn' */
   int syntax_attr = 0;                  /* attributes desired by syntax */
   int has_syntax = FALSE;               /* this buffer has syntax highl. */
+  synline_T   *syn_line = NULL;         /* syntax attributes of the line */
+  synrun_T    *syn_run;                 /* syntax attributes of a column */
   int save_did_emsg;
   int eol_hl_off = 0;                   /* 1 if highlighted char after EOL */
   int draw_color_col = FALSE;           /* highlight colorcolumn */
@@ -2285,6 +2298,7 @@ win_line (
 
   int syntax_flags    = 0;
   int syntax_seqnr    = 0;
+  int syntax_cchar    = NUL;
   int prev_syntax_id  = 0;
   int conceal_attr    = hl_attr(HLF_CONCEAL);
   int is_concealing   = FALSE;
@@ -2318,7 +2332,7 @@ win_line (
      * error, stop syntax highlighting. */
     save_did_emsg = did_emsg;
     did_emsg = FALSE;
-    syntax_start(wp, lnum);
+    syn_line = syntax_line(wp, lnum);
     if (did_emsg)
       wp->w_s->b_syn_error = TRUE;
     else {
@@ -2610,10 +2624,6 @@ win_line (
           spell_attr = highlight_attr[spell_hlf];
       }
       wp->w_cursor = pos;
-
-      /* Need to restart syntax highlighting for this line. */
-      if (has_syntax)
-        syntax_start(wp, lnum);
     }
   }
 
@@ -2697,7 +2707,7 @@ win_line (
     area_highlighting = TRUE;
   }
 
-  off = (unsigned)(current_ScreenLine - ScreenLines);
+  off = (unsigned)(current_ScreenLine - ScreenCells);
   col = 0;
   if (wp->w_p_rl) {
     /* Rightleft window: process the text in the normal direction, but put
@@ -3264,25 +3274,12 @@ win_line (
          * (double-wide char that doesn't fit). */
         v = (long)(ptr - line);
         if (has_syntax && v > 0) {
-          /* Get the syntax attribute for the character.  If there
-           * is an error, disable syntax highlighting. */
-          save_did_emsg = did_emsg;
-          did_emsg = FALSE;
-
-          syntax_attr = get_syntax_attr((colnr_T)v - 1,
-              has_spell ? &can_spell :
-              NULL, FALSE);
-
-          if (did_emsg) {
-            wp->w_s->b_syn_error = TRUE;
-            has_syntax = FALSE;
-          } else
-            did_emsg = save_did_emsg;
-
-          /* Need to get the line again, a multi-line regexp may
-           * have made it invalid. */
-          line = ml_get_buf(wp->w_buffer, lnum, FALSE);
-          ptr = line + v;
+          /* Get the syntax attribute for the character, computed by
+           * syntax_line(). */
+          syntax_attr = syntax_line_attr(syn_line, (colnr_T)v - 1, &syn_run);
+          if (has_spell)
+            can_spell = syn_run->sr_can_spell;
+          syntax_cchar = syn_run->sr_cchar;
 
           if (!attr_pri)
             char_attr = syntax_attr;
@@ -3292,8 +3289,10 @@ win_line (
            * with line highlighting */
           if (c == NUL)
             syntax_flags = 0;
-          else
-            syntax_flags = get_syntax_info(&syntax_seqnr);
+          else {
+            syntax_flags = syn_run->sr_flags;
+            syntax_seqnr = syn_run->sr_seqnr;
+          }
         }
 
         /* Check spelling (unless at the end of the line).
@@ -3412,7 +3411,7 @@ win_line (
         /*
          * when getting a character from the file, we may have to
          * turn it into something else on the way to putting it
-         * into "ScreenLines".
+         * into "ScreenCells".
          */
         if (c == TAB && (!wp->w_p_list || lcs_tab1)) {
           /* tab amount depends on current column */
@@ -3545,12 +3544,12 @@ win_line (
                   && vim_strchr(wp->w_p_cocu, 'v') == NULL)) {
         char_attr = conceal_attr;
         if (prev_syntax_id != syntax_seqnr
-            && (syn_get_sub_char() != NUL || wp->w_p_cole == 1)
+            && (syntax_cchar != NUL || wp->w_p_cole == 1)
             && wp->w_p_cole != 3) {
           /* First time at this concealed item: display one
            * character. */
-          if (syn_get_sub_char() != NUL)
-            c = syn_get_sub_char();
+          if (syntax_cchar != NUL)
+            c = syntax_cchar;
           else if (lcs_conceal != NUL)
             c = lcs_conceal;
           else
@@ -3692,9 +3691,8 @@ win_line (
           col += n;
         } else {
           /* Add a blank character to highlight. */
-          ScreenLines[off] = ' ';
-          if (enc_utf8)
-            ScreenLinesUC[off] = 0;
+          ScreenCells[off].sc_char = ' ';
+          ScreenCells[off].sc_uc = 0;
         }
         if (area_attr == 0) {
           /* Use attributes from match with highest priority among
@@ -3717,7 +3715,7 @@ win_line (
               cur = cur->next;
           }
         }
-        ScreenAttrs[off] = char_attr;
+        ScreenCells[off].sc_attr = char_attr;
         if (wp->w_p_rl) {
           --col;
           --off;
@@ -3779,20 +3777,19 @@ win_line (
               rightmost_vcol = color_cols[i];
 
         while (col < wp->w_width) {
-          ScreenLines[off] = ' ';
-          if (enc_utf8)
-            ScreenLinesUC[off] = 0;
+          ScreenCells[off].sc_char = ' ';
+          ScreenCells[off].sc_uc = 0;
           ++col;
           if (draw_color_col)
             draw_color_col = advance_color_col(VCOL_HLC,
                 &color_cols);
 
           if (wp->w_p_cuc && VCOL_HLC == (long)wp->w_virtcol)
-            ScreenAttrs[off++] = hl_attr(HLF_CUC);
+            ScreenCells[off++].sc_attr = hl_attr(HLF_CUC);
           else if (draw_color_col && VCOL_HLC == *color_cols)
-            ScreenAttrs[off++] = hl_attr(HLF_MC);
+            ScreenCells[off++].sc_attr = hl_attr(HLF_MC);
           else
-            ScreenAttrs[off++] = 0;
+            ScreenCells[off++].sc_attr = 0;
 
           if (VCOL_HLC >= rightmost_vcol)
             break;
@@ -3873,31 +3870,31 @@ win_line (
         --off;
         --col;
       }
-      ScreenLines[off] = c;
+      ScreenCells[off].sc_char = c;
       if (enc_dbcs == DBCS_JPNU) {
         if ((mb_c & 0xff00) == 0x8e00)
-          ScreenLines[off] = 0x8e;
-        ScreenLines2[off] = mb_c & 0xff;
+          ScreenCells[off].sc_char = 0x8e;
+        ScreenCells[off].sc_char2 = mb_c & 0xff;
       } else if (enc_utf8) {
         if (mb_utf8) {
           int i;
 
-          ScreenLinesUC[off] = mb_c;
+          ScreenCells[off].sc_uc = mb_c;
           if ((c & 0xff) == 0)
-            ScreenLines[off] = 0x80;               /* avoid storing zero */
+            ScreenCells[off].sc_char = 0x80;               /* avoid storing zero */
           for (i = 0; i < Screen_mco; ++i) {
-            ScreenLinesC[i][off] = u8cc[i];
+            ScreenCells[off].sc_cc[i] = u8cc[i];
             if (u8cc[i] == 0)
               break;
           }
         } else
-          ScreenLinesUC[off] = 0;
+          ScreenCells[off].sc_uc = 0;
       }
       if (multi_attr) {
-        ScreenAttrs[off] = multi_attr;
+        ScreenCells[off].sc_attr = multi_attr;
         multi_attr = 0;
       } else
-        ScreenAttrs[off] = char_attr;
+        ScreenCells[off].sc_attr = char_attr;
 
       if (has_mbyte && (*mb_char2cells)(mb_c) > 1) {
         /* Need to fill two screen columns. */
@@ -3905,10 +3902,10 @@ win_line (
         ++col;
         if (enc_utf8)
           /* UTF-8: Put a 0 in the second screen char. */
-          ScreenLines[off] = 0;
+          ScreenCells[off].sc_char = 0;
         else
           /* DBCS: Put second byte in the second screen char. */
-          ScreenLines[off] = mb_c & 0xff;
+          ScreenCells[off].sc_char = mb_c & 0xff;
         ++vcol;
         /* When "tocol" is halfway a character, set it to the end of
          * the character, otherwise highlighting won't stop. */
@@ -4086,21 +4083,21 @@ win_line (
 
           /* When there is a multi-byte character, just output a
            * space to keep it simple. */
-          if (has_mbyte && MB_BYTE2LEN(ScreenLines[LineOffset[
+          if (has_mbyte && MB_BYTE2LEN(ScreenCells[LineOffset[
                                                      screen_row -
-                                                     1] + (Columns - 1)]) > 1)
+                                                     1] + (Columns - 1)].sc_char) > 1)
             out_char(' ');
           else
-            out_char(ScreenLines[LineOffset[screen_row - 1]
-                                 + (Columns - 1)]);
+            out_char(ScreenCells[LineOffset[screen_row - 1]
+                                 + (Columns - 1)].sc_char);
           /* force a redraw of the first char on the next line */
-          ScreenAttrs[LineOffset[screen_row]] = (sattr_T)-1;
+          ScreenCells[LineOffset[screen_row]].sc_attr = (sattr_T)-1;
           screen_start();               /* don't know where cursor is now */
         }
       }
 
       col = 0;
-      off = (unsigned)(current_ScreenLine - ScreenLines);
+      off = (unsigned)(current_ScreenLine - ScreenCells);
       if (wp->w_p_rl) {
         col = wp->w_width - 1;          /* col is not used if breaking! */
         off += col;
@@ -4135,18 +4132,119 @@ win_line (
 }
 
 
+/*
+ * Return TRUE if screen cell "off_from" differs from "off_to".  The character,
+ * attribute and decoded character are compared with one memcmp(), composing
+ * characters also when sc_uc is zero, that only gives a false "differs".
+ */
+static int screen_cell_differs(unsigned off_from, unsigned off_to)
+{
+  const screencell_T *from = ScreenCells + off_from;
+  const screencell_T *to = ScreenCells + off_to;
+
+  if (memcmp(from, to, offsetof(screencell_T, sc_cc)) != 0)
+    return TRUE;
+  return Screen_mco > 0
+         && memcmp(from->sc_cc, to->sc_cc,
+      sizeof(u8char_T) * (size_t)Screen_mco) != 0;
+}
+
+/*
+ * Return a mask with bit "i" set when screen cell "off_from + i" differs
+ * from "off_to + i", for CELL_BLOCK cells.
+ * With SSE2 the first 8 bytes of two cells are compared at once.  They hold
+ * the character, attribute and decoded character, with a 16 bit u8char_T
+ * also the first composing character, that only gives a false "differs".
+ * The other composing characters are only compared for cells that are
+ * otherwise equal.
+ */
+static unsigned screen_cells_diff_mask(unsigned off_from, unsigned off_to)
+{
+  unsigned mask = 0;
+  int i;
+
+#ifdef __SSE2__
+  const screencell_T *from = ScreenCells + off_from;
+  const screencell_T *to = ScreenCells + off_to;
+  unsigned eq;
+
+  for (i = 0; i < CELL_BLOCK; i += 2) {
+    eq = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)&from[i]),
+          _mm_loadl_epi64((const __m128i *)&from[i + 1])),
+        _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)&to[i]),
+          _mm_loadl_epi64((const __m128i *)&to[i + 1]))));
+    mask |= (unsigned)((eq & 0xff) != 0xff) << i;
+    mask |= (unsigned)((eq >> 8) != 0xff) << (i + 1);
+  }
+  if (Screen_mco > 0)
+    for (i = 0; i < CELL_BLOCK; ++i)
+      if (!(mask & (1u << i)) && from[i].sc_uc != 0
+          && memcmp(from[i].sc_cc, to[i].sc_cc,
+              sizeof(u8char_T) * (size_t)Screen_mco) != 0)
+        mask |= 1u << i;
+#else
+  for (i = 0; i < CELL_BLOCK; ++i)
+    mask |= (unsigned)screen_cell_differs(off_from + i, off_to + i) << i;
+#endif
+  return mask;
+}
+
+/*
+ * Return the index of the first of "count" cells at "off_from" that differs
+ * from the cells at "off_to", "count" when they are all equal.
+ */
+static int screen_cells_first_diff(unsigned off_from, unsigned off_to,
+                                   int count)
+{
+  unsigned mask;
+  int i;
+
+  for (i = 0; i + CELL_BLOCK <= count; i += CELL_BLOCK) {
+    mask = screen_cells_diff_mask(off_from + i, off_to + i);
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+  for (; i < count; ++i)
+    if (screen_cell_differs(off_from + i, off_to + i))
+      return i;
+  return count;
+}
+
+/*
+ * Return the index of the last of "count" cells at "off_from" that differs
+ * from the cells at "off_to", -1 when they are all equal.
+ */
+static int screen_cells_last_diff(unsigned off_from, unsigned off_to,
+                                  int count)
+{
+  unsigned mask;
+  int i;
+
+  for (i = count; i >= CELL_BLOCK; i -= CELL_BLOCK) {
+    mask = screen_cells_diff_mask(off_from + i - CELL_BLOCK,
+        off_to + i - CELL_BLOCK);
+    if (mask != 0)
+      return i - CELL_BLOCK + 31 - __builtin_clz(mask);
+  }
+  while (--i >= 0)
+    if (screen_cell_differs(off_from + i, off_to + i))
+      return i;
+  return -1;
+}
+
 /*
  * Return if the composing characters at "off_from" and "off_to" differ.
- * Only to be used when ScreenLinesUC[off_from] != 0.
+ * Only to be used when ScreenCells[off_from].sc_uc != 0.
  */
 static int comp_char_differs(int off_from, int off_to)
 {
   int i;
 
   for (i = 0; i < Screen_mco; ++i) {
-    if (ScreenLinesC[i][off_from] != ScreenLinesC[i][off_to])
+    if (ScreenCells[off_from].sc_cc[i] != ScreenCells[off_to].sc_cc[i])
       return TRUE;
-    if (ScreenLinesC[i][off_from] == 0)
+    if (ScreenCells[off_from].sc_cc[i] == 0)
       break;
   }
   return FALSE;
@@ -4162,22 +4260,22 @@ static int comp_char_differs(int off_from, int off_to)
 static int char_needs_redraw(int off_from, int off_to, int cols)
 {
   if (cols > 0
-      && ((ScreenLines[off_from] != ScreenLines[off_to]
-           || ScreenAttrs[off_from] != ScreenAttrs[off_to])
+      && ((ScreenCells[off_from].sc_char != ScreenCells[off_to].sc_char
+           || ScreenCells[off_from].sc_attr != ScreenCells[off_to].sc_attr)
 
           || (enc_dbcs != 0
-              && MB_BYTE2LEN(ScreenLines[off_from]) > 1
-              && (enc_dbcs == DBCS_JPNU && ScreenLines[off_from] == 0x8e
-                  ? ScreenLines2[off_from] != ScreenLines2[off_to]
-                  : (cols > 1 && ScreenLines[off_from + 1]
-                     != ScreenLines[off_to + 1])))
+              && MB_BYTE2LEN(ScreenCells[off_from].sc_char) > 1
+              && (enc_dbcs == DBCS_JPNU && ScreenCells[off_from].sc_char == 0x8e
+                  ? ScreenCells[off_from].sc_char2 != ScreenCells[off_to].sc_char2
+                  : (cols > 1 && ScreenCells[off_from + 1].sc_char
+                     != ScreenCells[off_to + 1].sc_char)))
           || (enc_utf8
-              && (ScreenLinesUC[off_from] != ScreenLinesUC[off_to]
-                  || (ScreenLinesUC[off_from] != 0
+              && (ScreenCells[off_from].sc_uc != ScreenCells[off_to].sc_uc
+                  || (ScreenCells[off_from].sc_uc != 0
                       && comp_char_differs(off_from, off_to))
                   || ((*mb_off2cells)(off_from, off_from + cols) > 1
-                      && ScreenLines[off_from + 1]
-                      != ScreenLines[off_to + 1])))
+                      && ScreenCells[off_from + 1].sc_char
+                      != ScreenCells[off_to + 1].sc_char)))
           ))
     return TRUE;
   return FALSE;
@@ -4207,6 +4305,8 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
   ;
   int redraw_next;                      /* redraw_this for next character */
   int clear_next = FALSE;
+  int first_diff;                       /* first cell that changed */
+  int last_diff;                        /* last cell that changed */
   int char_cells;                       /* 1: normal char */
                                         /* 2: occupies two display cells */
 # define CHAR_CELLS char_cells
@@ -4218,7 +4318,7 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
     endcol = Columns;
 
 
-  off_from = (unsigned)(current_ScreenLine - ScreenLines);
+  off_from = (unsigned)(current_ScreenLine - ScreenCells);
   off_to = LineOffset[row] + coloff;
   max_off_from = off_from + screen_Columns;
   max_off_to = LineOffset[row] + screen_Columns;
@@ -4226,9 +4326,9 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
   if (rlflag) {
     /* Clear rest first, because it's left of the text. */
     if (clear_width > 0) {
-      while (col <= endcol && ScreenLines[off_to] == ' '
-             && ScreenAttrs[off_to] == 0
-             && (!enc_utf8 || ScreenLinesUC[off_to] == 0)
+      while (col <= endcol && ScreenCells[off_to].sc_char == ' '
+             && ScreenCells[off_to].sc_attr == 0
+             && (!enc_utf8 || ScreenCells[off_to].sc_uc == 0)
              ) {
         ++off_to;
         ++col;
@@ -4243,9 +4343,38 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
     endcol = (clear_width > 0 ? clear_width : -clear_width);
   }
 
+  /*
+   * Skip the cells that didn't change at the start of the line and find the
+   * last one that changed, comparing a block of cells at once.  Not with
+   * 'wiv', it also outputs something for cells that are not redrawn, and not
+   * for DBCS, sc_char2 isn't compared.
+   */
+  last_diff = endcol - 1;
+  if (!p_wiv && enc_dbcs == 0 && col < endcol) {
+    first_diff = col + screen_cells_first_diff(off_from, off_to, endcol - col);
+    /* Don't start in the right halve of a double-wide character. */
+    if (first_diff > col && first_diff < endcol && has_mbyte
+        && (*mb_off2cells)(off_from + first_diff - col - 1, max_off_from) > 1)
+      --first_diff;
+    off_from += first_diff - col;
+    off_to += first_diff - col;
+    col = first_diff;
+    if (col < endcol)
+      last_diff = col + screen_cells_last_diff(off_from, off_to,
+          endcol - col);
+  }
+
   redraw_next = char_needs_redraw(off_from, off_to, endcol - col);
 
   while (col < endcol) {
+    /* The rest of the line didn't change. */
+    if (col > last_diff && !redraw_next && !force) {
+      off_from += endcol - col;
+      off_to += endcol - col;
+      col = endcol;
+      break;
+    }
+
     if (has_mbyte && (col + 1 < endcol))
       char_cells = (*mb_off2cells)(off_from, max_off_from);
     else
@@ -4271,8 +4400,8 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
        */
       if (       p_wiv
                  && !force
-                 && ScreenAttrs[off_to] != 0
-                 && ScreenAttrs[off_from] != ScreenAttrs[off_to]) {
+                 && ScreenCells[off_to].sc_attr != 0
+                 && ScreenCells[off_from].sc_attr != ScreenCells[off_to].sc_attr) {
         /*
          * Need to remove highlighting attributes here.
          */
@@ -4286,8 +4415,8 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
          * If the previous character was highlighted, need to stop
          * highlighting at this character.
          */
-        if (col + coloff > 0 && ScreenAttrs[off_to - 1] != 0) {
-          screen_attr = ScreenAttrs[off_to - 1];
+        if (col + coloff > 0 && ScreenCells[off_to - 1].sc_attr != 0) {
+          screen_attr = ScreenCells[off_to - 1].sc_attr;
           term_windgoto(row, col + coloff);
           screen_stop_highlight();
         } else
@@ -4297,13 +4426,13 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
         /* Check if overwriting a double-byte with a single-byte or
          * the other way around requires another character to be
          * redrawn.  For UTF-8 this isn't needed, because comparing
-         * ScreenLinesUC[] is sufficient. */
+         * sc_uc is sufficient. */
         if (char_cells == 1
             && col + 1 < endcol
             && (*mb_off2cells)(off_to, max_off_to) > 1) {
           /* Writing a single-cell character over a double-cell
            * character: need to redraw the next cell. */
-          ScreenLines[off_to + 1] = 0;
+          ScreenCells[off_to + 1].sc_char = 0;
           redraw_next = TRUE;
         } else if (char_cells == 2
                    && col + 2 < endcol
@@ -4312,12 +4441,9 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
           /* Writing the second half of a double-cell character over
            * a double-cell character: need to redraw the second
            * cell. */
-          ScreenLines[off_to + 2] = 0;
+          ScreenCells[off_to + 2].sc_char = 0;
           redraw_next = TRUE;
         }
-
-        if (enc_dbcs == DBCS_JPNU)
-          ScreenLines2[off_to] = ScreenLines2[off_from];
       }
       /* When writing a single-width character over a double-width
        * character and at the end of the redrawn text, need to clear out
@@ -4332,18 +4458,8 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
                   && (*mb_off2cells)(off_to + 1, max_off_to) > 1)))
         clear_next = TRUE;
 
-      ScreenLines[off_to] = ScreenLines[off_from];
-      if (enc_utf8) {
-        ScreenLinesUC[off_to] = ScreenLinesUC[off_from];
-        if (ScreenLinesUC[off_from] != 0) {
-          int i;
-
-          for (i = 0; i < Screen_mco; ++i)
-            ScreenLinesC[i][off_to] = ScreenLinesC[i][off_from];
-        }
-      }
       if (char_cells == 2)
-        ScreenLines[off_to + 1] = ScreenLines[off_from + 1];
+        ScreenCells[off_to + 1].sc_char = ScreenCells[off_from + 1].sc_char;
 
 #if defined(FEAT_GUI) || defined(UNIX)
       /* The bold trick makes a single column of pixels appear in the
@@ -4355,18 +4471,19 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
         term_is_xterm
 # endif
         ) {
-        hl = ScreenAttrs[off_to];
+        hl = ScreenCells[off_to].sc_attr;
         if (hl > HL_ALL)
           hl = syn_attr2attr(hl);
         if (hl & HL_BOLD)
           redraw_next = TRUE;
       }
 #endif
-      ScreenAttrs[off_to] = ScreenAttrs[off_from];
+      /* Character, attributes and composing characters in one go. */
+      ScreenCells[off_to] = ScreenCells[off_from];
       /* For simplicity set the attributes of second half of a
        * double-wide character equal to the first half. */
       if (char_cells == 2)
-        ScreenAttrs[off_to + 1] = ScreenAttrs[off_from];
+        ScreenCells[off_to + 1].sc_attr = ScreenCells[off_from].sc_attr;
 
       if (enc_dbcs != 0 && char_cells == 2)
         screen_char_2(off_to, row, col + coloff);
@@ -4374,7 +4491,7 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
         screen_char(off_to, row, col + coloff);
     } else if (  p_wiv
                  && col + coloff > 0) {
-      if (ScreenAttrs[off_to] == ScreenAttrs[off_to - 1]) {
+      if (ScreenCells[off_to].sc_attr == ScreenCells[off_to - 1].sc_attr) {
         /*
          * Don't output stop-highlight when moving the cursor, it will
          * stop the highlighting when it should continue.
@@ -4392,9 +4509,8 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
   if (clear_next) {
     /* Clear the second half of a double-wide character of which the left
      * half was overwritten with a single-wide character. */
-    ScreenLines[off_to] = ' ';
-    if (enc_utf8)
-      ScreenLinesUC[off_to] = 0;
+    ScreenCells[off_to].sc_char = ' ';
+    ScreenCells[off_to].sc_uc = 0;
     screen_char(off_to, row, col + coloff);
   }
 
@@ -4403,9 +4519,9 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
       ) {
 
     /* blank out the rest of the line */
-    while (col < clear_width && ScreenLines[off_to] == ' '
-           && ScreenAttrs[off_to] == 0
-           && (!enc_utf8 || ScreenLinesUC[off_to] == 0)
+    while (col < clear_width && ScreenCells[off_to].sc_char == ' '
+           && ScreenCells[off_to].sc_attr == 0
+           && (!enc_utf8 || ScreenCells[off_to].sc_uc == 0)
            ) {
       ++off_to;
       ++col;
@@ -4424,19 +4540,17 @@ static void screen_line(int row, int coloff, int endcol, int clear_width, int rl
       int c;
 
       c = fillchar_vsep(&hl);
-      if (ScreenLines[off_to] != c
-          || (enc_utf8 && (int)ScreenLinesUC[off_to]
+      if (ScreenCells[off_to].sc_char != c
+          || (enc_utf8 && (int)ScreenCells[off_to].sc_uc
               != (c >= 0x80 ? c : 0))
-          || ScreenAttrs[off_to] != hl) {
-        ScreenLines[off_to] = c;
-        ScreenAttrs[off_to] = hl;
-        if (enc_utf8) {
-          if (c >= 0x80) {
-            ScreenLinesUC[off_to] = c;
-            ScreenLinesC[0][off_to] = 0;
-          } else
-            ScreenLinesUC[off_to] = 0;
-        }
+          || ScreenCells[off_to].sc_attr != hl) {
+        ScreenCells[off_to].sc_char = c;
+        ScreenCells[off_to].sc_attr = hl;
+        if (enc_utf8 && c >= 0x80) {
+          ScreenCells[off_to].sc_uc = c;
+          ScreenCells[off_to].sc_cc[0] = 0;
+        } else
+          ScreenCells[off_to].sc_uc = 0;
         screen_char(off_to, row, col + coloff);
       }
     } else
@@ -5139,7 +5253,7 @@ theend:
 
 
 /*
- * Output a single character directly to the screen and update ScreenLines.
+ * Output a single character directly to the screen and update ScreenCells.
  */
 void screen_putchar(int c, int row, int col, int attr)
 {
@@ -5155,7 +5269,7 @@ void screen_putchar(int c, int row, int col, int attr)
 }
 
 /*
- * Get a single character directly from ScreenLines into "bytes[]".
+ * Get a single character directly from ScreenCells into "bytes[]".
  * Also return its attribute in *attrp;
  */
 void screen_getbytes(int row, int col, char_u *bytes, int *attrp)
@@ -5163,20 +5277,20 @@ void screen_getbytes(int row, int col, char_u *bytes, int *attrp)
   unsigned off;
 
   /* safety check */
-  if (ScreenLines != NULL && row < screen_Rows && col < screen_Columns) {
+  if (ScreenCells != NULL && row < screen_Rows && col < screen_Columns) {
     off = LineOffset[row] + col;
-    *attrp = ScreenAttrs[off];
-    bytes[0] = ScreenLines[off];
+    *attrp = ScreenCells[off].sc_attr;
+    bytes[0] = ScreenCells[off].sc_char;
     bytes[1] = NUL;
 
-    if (enc_utf8 && ScreenLinesUC[off] != 0)
+    if (enc_utf8 && ScreenCells[off].sc_uc != 0)
       bytes[utfc_char2bytes(off, bytes)] = NUL;
-    else if (enc_dbcs == DBCS_JPNU && ScreenLines[off] == 0x8e) {
-      bytes[0] = ScreenLines[off];
-      bytes[1] = ScreenLines2[off];
+    else if (enc_dbcs == DBCS_JPNU && ScreenCells[off].sc_char == 0x8e) {
+      bytes[0] = ScreenCells[off].sc_char;
+      bytes[1] = ScreenCells[off].sc_char2;
       bytes[2] = NUL;
     } else if (enc_dbcs && MB_BYTE2LEN(bytes[0]) > 1) {
-      bytes[1] = ScreenLines[off + 1];
+      bytes[1] = ScreenCells[off + 1].sc_char;
       bytes[2] = NUL;
     }
   }
@@ -5186,14 +5300,14 @@ void screen_getbytes(int row, int col, char_u *bytes, int *attrp)
 /*
  * Return TRUE if composing characters for screen posn "off" differs from
  * composing characters in "u8cc".
- * Only to be used when ScreenLinesUC[off] != 0.
+ * Only to be used when ScreenCells[off].sc_uc != 0.
  */
 static int screen_comp_differs(int off, int *u8cc)
 {
   int i;
 
   for (i = 0; i < Screen_mco; ++i) {
-    if (ScreenLinesC[i][off] != (u8char_T)u8cc[i])
+    if (ScreenCells[off].sc_cc[i] != (u8char_T)u8cc[i])
       return TRUE;
     if (u8cc[i] == 0)
       break;
@@ -5203,9 +5317,9 @@ static int screen_comp_differs(int off, int *u8cc)
 
 /*
  * Put string '*text' on the screen at position 'row' and 'col', with
- * attributes 'attr', and update ScreenLines[] and ScreenAttrs[].
+ * attributes 'attr', and update ScreenCells[].
  * Note: only outputs within one row, message is truncated at screen boundary!
- * Note: if ScreenLines[], row and/or col is invalid, nothing is done.
+ * Note: if ScreenCells[], row and/or col is invalid, nothing is done.
  */
 void screen_puts(char_u *text, int row, int col, int attr)
 {
@@ -5235,7 +5349,7 @@ void screen_puts_len(char_u *text, int textlen, int row, int col, int attr)
   int force_redraw_next = FALSE;
   int need_redraw;
 
-  if (ScreenLines == NULL || row >= screen_Rows)        /* safety check */
+  if (ScreenCells == NULL || row >= screen_Rows)        /* safety check */
     return;
   off = LineOffset[row] + col;
 
@@ -5243,11 +5357,11 @@ void screen_puts_len(char_u *text, int textlen, int row, int col, int attr)
    * left halve.  Only needed in a terminal. */
   if (has_mbyte && col > 0 && col < screen_Columns
       && mb_fix_col(col, row) != col) {
-    ScreenLines[off - 1] = ' ';
-    ScreenAttrs[off - 1] = 0;
+    ScreenCells[off - 1].sc_char = ' ';
+    ScreenCells[off - 1].sc_attr = 0;
     if (enc_utf8) {
-      ScreenLinesUC[off - 1] = 0;
-      ScreenLinesC[0][off - 1] = 0;
+      ScreenCells[off - 1].sc_uc = 0;
+      ScreenCells[off - 1].sc_cc[0] = 0;
     }
     /* redraw the previous cell, make it empty */
     screen_char(off - 1, row, col - 1);
@@ -5313,18 +5427,18 @@ void screen_puts_len(char_u *text, int textlen, int row, int col, int attr)
     force_redraw_this = force_redraw_next;
     force_redraw_next = FALSE;
 
-    need_redraw = ScreenLines[off] != c
+    need_redraw = ScreenCells[off].sc_char != c
                   || (mbyte_cells == 2
-                      && ScreenLines[off + 1] != (enc_dbcs ? ptr[1] : 0))
+                      && ScreenCells[off + 1].sc_char != (enc_dbcs ? ptr[1] : 0))
                   || (enc_dbcs == DBCS_JPNU
                       && c == 0x8e
-                      && ScreenLines2[off] != ptr[1])
+                      && ScreenCells[off].sc_char2 != ptr[1])
                   || (enc_utf8
-                      && (ScreenLinesUC[off] !=
+                      && (ScreenCells[off].sc_uc !=
                           (u8char_T)(c < 0x80 && u8cc[0] == 0 ? 0 : u8c)
-                          || (ScreenLinesUC[off] != 0
+                          || (ScreenCells[off].sc_uc != 0
                               && screen_comp_differs(off, u8cc))))
-                  || ScreenAttrs[off] != attr
+                  || ScreenCells[off].sc_attr != attr
                   || exmode_active;
 
     if (need_redraw
@@ -5335,12 +5449,12 @@ void screen_puts_len(char_u *text, int textlen, int row, int col, int attr)
        * character.  When a bold character is removed, the next
        * character should be redrawn too.  This happens for our own GUI
        * and for some xterms. */
-      if (need_redraw && ScreenLines[off] != ' ' && (
+      if (need_redraw && ScreenCells[off].sc_char != ' ' && (
 # ifdef UNIX
             term_is_xterm
 # endif
             )) {
-        int n = ScreenAttrs[off];
+        int n = ScreenCells[off].sc_attr;
 
         if (n > HL_ALL)
           n = syn_attr2attr(n);
@@ -5371,33 +5485,33 @@ void screen_puts_len(char_u *text, int textlen, int row, int col, int attr)
               || (mbyte_cells == 2
                   && (*mb_off2cells)(off, max_off) == 1
                   && (*mb_off2cells)(off + 1, max_off) > 1)))
-        ScreenLines[off + mbyte_blen] = 0;
-      ScreenLines[off] = c;
-      ScreenAttrs[off] = attr;
+        ScreenCells[off + mbyte_blen].sc_char = 0;
+      ScreenCells[off].sc_char = c;
+      ScreenCells[off].sc_attr = attr;
       if (enc_utf8) {
         if (c < 0x80 && u8cc[0] == 0)
-          ScreenLinesUC[off] = 0;
+          ScreenCells[off].sc_uc = 0;
         else {
           int i;
 
-          ScreenLinesUC[off] = u8c;
+          ScreenCells[off].sc_uc = u8c;
           for (i = 0; i < Screen_mco; ++i) {
-            ScreenLinesC[i][off] = u8cc[i];
+            ScreenCells[off].sc_cc[i] = u8cc[i];
             if (u8cc[i] == 0)
               break;
           }
         }
         if (mbyte_cells == 2) {
-          ScreenLines[off + 1] = 0;
-          ScreenAttrs[off + 1] = attr;
+          ScreenCells[off + 1].sc_char = 0;
+          ScreenCells[off + 1].sc_attr = attr;
         }
         screen_char(off, row, col);
       } else if (mbyte_cells == 2) {
-        ScreenLines[off + 1] = ptr[1];
-        ScreenAttrs[off + 1] = attr;
+        ScreenCells[off + 1].sc_char = ptr[1];
+        ScreenCells[off + 1].sc_attr = attr;
         screen_char_2(off, row, col);
       } else if (enc_dbcs == DBCS_JPNU && c == 0x8e) {
-        ScreenLines2[off] = ptr[1];
+        ScreenCells[off].sc_char2 = ptr[1];
         screen_char(off, row, col);
       } else
         screen_char(off, row, col);
@@ -5781,8 +5895,8 @@ void reset_cterm_colors(void)
 }
 
 /*
- * Put character ScreenLines["off"] on the screen at position "row" and "col",
- * using the attributes from ScreenAttrs["off"].
+ * Put character ScreenCells["off"] on the screen at position "row" and "col",
+ * using its attributes.
  */
 static void screen_char(unsigned off, int row, int col)
 {
@@ -5799,7 +5913,7 @@ static void screen_char(unsigned off, int row, int col)
       /* account for first command-line character in rightleft mode */
       && !cmdmsg_rl
       ) {
-    ScreenAttrs[off] = (sattr_T)-1;
+    ScreenCells[off].sc_attr = (sattr_T)-1;
     return;
   }
 
@@ -5809,7 +5923,7 @@ static void screen_char(unsigned off, int row, int col)
   if (screen_char_attr != 0)
     attr = screen_char_attr;
   else
-    attr = ScreenAttrs[off];
+    attr = ScreenCells[off].sc_attr;
   if (screen_attr != attr)
     screen_stop_highlight();
 
@@ -5818,7 +5932,7 @@ static void screen_char(unsigned off, int row, int col)
   if (screen_attr != attr)
     screen_start_highlight(attr);
 
-  if (enc_utf8 && ScreenLinesUC[off] != 0) {
+  if (enc_utf8 && ScreenCells[off].sc_uc != 0) {
     char_u buf[MB_MAXBYTES + 1];
 
     /* Convert UTF-8 character to bytes and write it. */
@@ -5826,14 +5940,14 @@ static void screen_char(unsigned off, int row, int col)
     buf[utfc_char2bytes(off, buf)] = NUL;
 
     out_str(buf);
-    if (utf_char2cells(ScreenLinesUC[off]) > 1)
+    if (utf_char2cells(ScreenCells[off].sc_uc) > 1)
       ++screen_cur_col;
   } else {
     out_flush_check();
-    out_char(ScreenLines[off]);
+    out_char(ScreenCells[off].sc_char);
     /* double-byte character in single-width cell */
-    if (enc_dbcs == DBCS_JPNU && ScreenLines[off] == 0x8e)
-      out_char(ScreenLines2[off]);
+    if (enc_dbcs == DBCS_JPNU && ScreenCells[off].sc_char == 0x8e)
+      out_char(ScreenCells[off].sc_char2);
   }
 
   screen_cur_col++;
@@ -5841,7 +5955,7 @@ static void screen_char(unsigned off, int row, int col)
 
 
 /*
- * Used for enc_dbcs only: Put one double-wide character at ScreenLines["off"]
+ * Used for enc_dbcs only: Put one double-wide character at ScreenCells["off"]
  * on the screen at position 'row' and 'col'.
  * The attributes of the first byte is used for all.  This is required to
  * output the two bytes of a double-byte character with nothing in between.
@@ -5855,20 +5969,20 @@ static void screen_char_2(unsigned off, int row, int col)
   /* Outputting the last character on the screen may scrollup the screen.
    * Don't to it!  Mark the character invalid (update it when scrolled up) */
   if (row == screen_Rows - 1 && col >= screen_Columns - 2) {
-    ScreenAttrs[off] = (sattr_T)-1;
+    ScreenCells[off].sc_attr = (sattr_T)-1;
     return;
   }
 
   /* Output the first byte normally (positions the cursor), then write the
    * second byte directly. */
   screen_char(off, row, col);
-  out_char(ScreenLines[off + 1]);
+  out_char(ScreenCells[off + 1].sc_char);
   ++screen_cur_col;
 }
 
 /*
  * Draw a rectangle of the screen, inverted when "invert" is TRUE.
- * This uses the contents of ScreenLines[] and doesn't change it.
+ * This uses the contents of ScreenCells[] and doesn't change it.
  */
 void screen_draw_rectangle(int row, int col, int height, int width, int invert)
 {
@@ -5876,8 +5990,8 @@ void screen_draw_rectangle(int row, int col, int height, int width, int invert)
   int off;
   int max_off;
 
-  /* Can't use ScreenLines unless initialized */
-  if (ScreenLines == NULL)
+  /* Can't use ScreenCells unless initialized */
+  if (ScreenCells == NULL)
     return;
 
   if (invert)
@@ -5940,7 +6054,7 @@ void screen_fill(int start_row, int end_row, int start_col, int end_col, int c1,
     end_row = screen_Rows;
   if (end_col > screen_Columns)         /* safety check */
     end_col = screen_Columns;
-  if (ScreenLines == NULL
+  if (ScreenCells == NULL
       || start_row >= end_row
       || start_col >= end_col)          /* nothing to do */
     return;
@@ -5984,14 +6098,9 @@ void screen_fill(int start_row, int end_row, int start_col, int end_col, int c1,
       end_off = LineOffset[row] + end_col;
 
       /* skip blanks (used often, keep it fast!) */
-      if (enc_utf8)
-        while (off < end_off && ScreenLines[off] == ' '
-               && ScreenAttrs[off] == 0 && ScreenLinesUC[off] == 0)
-          ++off;
-      else
-        while (off < end_off && ScreenLines[off] == ' '
-               && ScreenAttrs[off] == 0)
-          ++off;
+      while (off < end_off && ScreenCells[off].sc_char == ' '
+             && ScreenCells[off].sc_attr == 0 && ScreenCells[off].sc_uc == 0)
+        ++off;
       if (off < end_off) {              /* something to be cleared */
         col = off - LineOffset[row];
         screen_stop_highlight();
@@ -5999,11 +6108,10 @@ void screen_fill(int start_row, int end_row, int start_col, int end_col, int c1,
         out_str(T_CE);
         screen_start();                 /* don't know where cursor is now */
         col = end_col - col;
-        while (col--) {                 /* clear chars in ScreenLines */
-          ScreenLines[off] = ' ';
-          if (enc_utf8)
-            ScreenLinesUC[off] = 0;
-          ScreenAttrs[off] = 0;
+        while (col--) {                 /* clear chars in ScreenCells */
+          ScreenCells[off].sc_char = ' ';
+          ScreenCells[off].sc_uc = 0;
+          ScreenCells[off].sc_attr = 0;
           ++off;
         }
       }
@@ -6013,10 +6121,10 @@ void screen_fill(int start_row, int end_row, int start_col, int end_col, int c1,
     off = LineOffset[row] + start_col;
     c = c1;
     for (col = start_col; col < end_col; ++col) {
-      if (ScreenLines[off] != c
-          || (enc_utf8 && (int)ScreenLinesUC[off]
+      if (ScreenCells[off].sc_char != c
+          || (enc_utf8 && (int)ScreenCells[off].sc_uc
               != (c >= 0x80 ? c : 0))
-          || ScreenAttrs[off] != attr
+          || ScreenCells[off].sc_attr != attr
 #if defined(FEAT_GUI) || defined(UNIX)
           || force_next
 #endif
@@ -6031,23 +6139,21 @@ void screen_fill(int start_row, int end_row, int start_col, int end_col, int c1,
           term_is_xterm
 # endif
           ) {
-          if (ScreenLines[off] != ' '
-              && (ScreenAttrs[off] > HL_ALL
-                  || ScreenAttrs[off] & HL_BOLD))
+          if (ScreenCells[off].sc_char != ' '
+              && (ScreenCells[off].sc_attr > HL_ALL
+                  || ScreenCells[off].sc_attr & HL_BOLD))
             force_next = TRUE;
           else
             force_next = FALSE;
         }
 #endif
-        ScreenLines[off] = c;
-        if (enc_utf8) {
-          if (c >= 0x80) {
-            ScreenLinesUC[off] = c;
-            ScreenLinesC[0][off] = 0;
-          } else
-            ScreenLinesUC[off] = 0;
-        }
-        ScreenAttrs[off] = attr;
+        ScreenCells[off].sc_char = c;
+        if (enc_utf8 && c >= 0x80) {
+          ScreenCells[off].sc_uc = c;
+          ScreenCells[off].sc_cc[0] = 0;
+        } else
+          ScreenCells[off].sc_uc = 0;
+        ScreenCells[off].sc_attr = attr;
         if (!did_delete || c != ' ')
           screen_char(off, row, col);
       }
@@ -6070,6 +6176,114 @@ void screen_fill(int start_row, int end_row, int start_col, int end_col, int c1,
   }
 }
 
+/*
+ * Return TRUE if line "lnum" of window "wp" may be stored in or drawn from
+ * the render cache.  Not when how it is displayed depends on more than the
+ * text, options and highlighting.
+ */
+static int render_cache_usable(win_T *wp, linenr_T lnum)
+{
+  return lnum != wp->w_cursor.lnum
+         && !(lnum == wp->w_topline && wp->w_skipcol > 0)
+         && !(VIsual_active && wp->w_buffer == curwin->w_buffer)
+         && !wp->w_p_cuc
+         && !wp->w_p_rnu
+         && !wp->w_p_diff
+         && !wp->w_p_spell
+         && wp->w_p_fdc == 0
+         && !draw_signcolumn(wp)
+         && wp->w_match_head == NULL
+         && search_hl.rm.regprog == NULL
+         && !highlight_match
+         && dollar_vcol < 0;
+}
+
+/*
+ * Draw line "lnum" of window "wp" at window row "srow" from the render cache.
+ * Returns the row below the line, -1 when it isn't cached.
+ */
+static int render_cache_draw(win_T *wp, linenr_T lnum, int srow)
+{
+  renderline_T *rl;
+  int r;
+
+  if (wp->w_render_cache == NULL || !render_cache_usable(wp, lnum))
+    return -1;
+  rl = &wp->w_render_cache[lnum % RENDER_CACHE_SIZE];
+  if (rl->rl_lnum != lnum
+      || rl->rl_fnum != wp->w_buffer->b_fnum
+      || rl->rl_changedtick != wp->w_buffer->b_changedtick
+      || rl->rl_tick != render_tick
+      || rl->rl_syn_tick != wp->w_s->b_syn_tick
+      || rl->rl_width != wp->w_width
+      || rl->rl_leftcol != wp->w_leftcol
+      || srow + rl->rl_rows >= wp->w_height)
+    return -1;
+
+  for (r = 0; r < rl->rl_rows; ++r) {
+    memmove(current_ScreenLine, rl->rl_cells + r * rl->rl_width,
+        (size_t)rl->rl_width * sizeof(screencell_T));
+    SCREEN_LINE(srow + r + wp->w_winrow, wp->w_wincol, wp->w_width,
+        wp->w_width, FALSE);
+  }
+  return srow + rl->rl_rows;
+}
+
+/*
+ * Store line "lnum" of window "wp", just drawn by win_line() from window row
+ * "srow" to "row", in the render cache.
+ */
+static void render_cache_store(win_T *wp, linenr_T lnum, int srow, int row)
+{
+  renderline_T *rl;
+  int r;
+
+  /* Only when the whole line is visible. */
+  if (row <= srow || row >= wp->w_height || !render_cache_usable(wp, lnum))
+    return;
+  if (wp->w_render_cache == NULL)
+    wp->w_render_cache = xcalloc(RENDER_CACHE_SIZE, sizeof(renderline_T));
+
+  rl = &wp->w_render_cache[lnum % RENDER_CACHE_SIZE];
+  rl->rl_lnum = lnum;
+  rl->rl_fnum = wp->w_buffer->b_fnum;
+  rl->rl_changedtick = wp->w_buffer->b_changedtick;
+  rl->rl_tick = render_tick;
+  rl->rl_syn_tick = wp->w_s->b_syn_tick;
+  rl->rl_width = wp->w_width;
+  rl->rl_leftcol = wp->w_leftcol;
+  rl->rl_rows = row - srow;
+  rl->rl_cells = xrealloc(rl->rl_cells, (size_t)(rl->rl_rows * rl->rl_width)
+      * sizeof(screencell_T));
+  for (r = 0; r < rl->rl_rows; ++r)
+    memmove(rl->rl_cells + r * rl->rl_width,
+        ScreenCells + LineOffset[srow + r + wp->w_winrow] + wp->w_wincol,
+        (size_t)rl->rl_width * sizeof(screencell_T));
+}
+
+/*
+ * Forget all lines in the render cache of all windows.
+ */
+void render_cache_invalidate(void)
+{
+  ++render_tick;
+}
+
+/*
+ * Free the render cache of window "wp".
+ */
+void render_cache_free(win_T *wp)
+{
+  int i;
+
+  if (wp->w_render_cache == NULL)
+    return;
+  for (i = 0; i < RENDER_CACHE_SIZE; ++i)
+    free(wp->w_render_cache[i].rl_cells);
+  free(wp->w_render_cache);
+  wp->w_render_cache = NULL;
+}
+
 /*
  * Check if there should be a delay.  Used before clearing or redrawing the
  * screen or the command line.
@@ -6096,17 +6310,17 @@ void check_for_delay(int check_msg_scroll)
 int screen_valid(int doclear)
 {
   screenalloc(doclear);            /* allocate screen buffers if size changed */
-  return ScreenLines != NULL;
+  return ScreenCells != NULL;
 }
 
 /*
  * Resize the shell to Rows and Columns.
- * Allocate ScreenLines[] and associated items.
+ * Allocate ScreenCells[] and associated items.
  *
  * There may be some time between setting Rows and Columns and (re)allocating
- * ScreenLines[].  This happens when starting up and when (manually) changing
+ * ScreenCells[].  This happens when starting up and when (manually) changing
  * the shell size.  Always use screen_Rows and screen_Columns to access items
- * in ScreenLines[].  Use Rows and Columns for positioning text etc. where the
+ * in ScreenCells[].  Use Rows and Columns for positioning text etc. where the
  * final size of the shell is needed.
  */
 void screenalloc(int doclear)
@@ -6115,12 +6329,8 @@ void screenalloc(int doclear)
   win_T           *wp;
   int outofmem = FALSE;
   int len;
-  schar_T         *new_ScreenLines;
-  u8char_T        *new_ScreenLinesUC = NULL;
-  u8char_T        *new_ScreenLinesC[MAX_MCO];
-  schar_T         *new_ScreenLines2 = NULL;
+  screencell_T    *new_ScreenCells;
   int i;
-  sattr_T         *new_ScreenAttrs;
   unsigned        *new_LineOffset;
   char_u          *new_LineWraps;
   short           *new_TabPageIdxs;
@@ -6135,16 +6345,16 @@ retry:
    * when Rows and Columns have been set and we have started doing full
    * screen stuff.
    */
-  if ((ScreenLines != NULL
+  if ((ScreenCells != NULL
        && Rows == screen_Rows
        && Columns == screen_Columns
-       && enc_utf8 == (ScreenLinesUC != NULL)
-       && (enc_dbcs == DBCS_JPNU) == (ScreenLines2 != NULL)
+       && enc_utf8 == screen_enc_utf8
+       && enc_dbcs == screen_enc_dbcs
        && p_mco == Screen_mco
        )
       || Rows == 0
       || Columns == 0
-      || (!full_screen && ScreenLines == NULL))
+      || (!full_screen && ScreenCells == NULL))
     return;
 
   /*
@@ -6168,13 +6378,13 @@ retry:
 
   /*
    * We're changing the size of the screen.
-   * - Allocate new arrays for ScreenLines and ScreenAttrs.
+   * - Allocate a new array for ScreenCells.
    * - Move lines from the old arrays into the new arrays, clear extra
    *	 lines (unless the screen is going to be cleared).
    * - Free the old arrays.
    *
-   * If anything fails, make ScreenLines NULL, so we don't do anything!
-   * Continuing with the old ScreenLines may result in a crash, because the
+   * If anything fails, make ScreenCells NULL, so we don't do anything!
+   * Continuing with the old ScreenCells may result in a crash, because the
    * size is wrong.
    */
   FOR_ALL_TAB_WINDOWS(tp, wp)
@@ -6182,18 +6392,8 @@ retry:
   if (aucmd_win != NULL)
     win_free_lsize(aucmd_win);
 
-  new_ScreenLines = xmalloc((size_t)((Rows + 1) * Columns * sizeof(schar_T)));
-  memset(new_ScreenLinesC, 0, sizeof(u8char_T *) * MAX_MCO);
-  if (enc_utf8) {
-    new_ScreenLinesUC = xmalloc(
-        (size_t)((Rows + 1) * Columns * sizeof(u8char_T)));
-    for (i = 0; i < p_mco; ++i)
-      new_ScreenLinesC[i] = xcalloc((Rows + 1) * Columns, sizeof(u8char_T));
-  }
-  if (enc_dbcs == DBCS_JPNU)
-    new_ScreenLines2 = xmalloc(
-        (size_t)((Rows + 1) * Columns * sizeof(schar_T)));
-  new_ScreenAttrs = xmalloc((size_t)((Rows + 1) * Columns * sizeof(sattr_T)));
+  new_ScreenCells = xcalloc((size_t)((Rows + 1) * Columns),
+      sizeof(screencell_T));
   new_LineOffset = xmalloc((size_t)(Rows * sizeof(unsigned)));
   new_LineWraps = xmalloc((size_t)(Rows * sizeof(char_u)));
   new_TabPageIdxs = xmalloc((size_t)(Columns * sizeof(short)));
@@ -6206,18 +6406,12 @@ retry:
     win_alloc_lines(aucmd_win);
   }
 
-  for (i = 0; i < p_mco; ++i)
-    if (new_ScreenLinesC[i] == NULL)
-      break;
-  if (new_ScreenLines == NULL
-      || (enc_utf8 && (new_ScreenLinesUC == NULL || i != p_mco))
-      || (enc_dbcs == DBCS_JPNU && new_ScreenLines2 == NULL)
-      || new_ScreenAttrs == NULL
+  if (new_ScreenCells == NULL
       || new_LineOffset == NULL
       || new_LineWraps == NULL
       || new_TabPageIdxs == NULL
       || outofmem) {
-    if (ScreenLines != NULL || !done_outofmem_msg) {
+    if (ScreenCells != NULL || !done_outofmem_msg) {
       /* guess the size */
       do_outofmem_msg((Rows + 1) * Columns);
 
@@ -6225,18 +6419,8 @@ retry:
        * and over again. */
       done_outofmem_msg = TRUE;
     }
-    free(new_ScreenLines);
-    new_ScreenLines = NULL;
-    free(new_ScreenLinesUC);
-    new_ScreenLinesUC = NULL;
-    for (i = 0; i < p_mco; ++i) {
-      free(new_ScreenLinesC[i]);
-      new_ScreenLinesC[i] = NULL;
-    }
-    free(new_ScreenLines2);
-    new_ScreenLines2 = NULL;
-    free(new_ScreenAttrs);
-    new_ScreenAttrs = NULL;
+    free(new_ScreenCells);
+    new_ScreenCells = NULL;
     free(new_LineOffset);
     new_LineOffset = NULL;
     free(new_LineWraps);
@@ -6257,74 +6441,41 @@ retry:
        * executing an external command, for the GUI).
        */
       if (!doclear) {
-        (void)memset(new_ScreenLines + new_row * Columns,
-            ' ', (size_t)Columns * sizeof(schar_T));
-        if (enc_utf8) {
-          (void)memset(new_ScreenLinesUC + new_row * Columns,
-              0, (size_t)Columns * sizeof(u8char_T));
-          for (i = 0; i < p_mco; ++i)
-            (void)memset(new_ScreenLinesC[i]
-                + new_row * Columns,
-                0, (size_t)Columns * sizeof(u8char_T));
-        }
-        if (enc_dbcs == DBCS_JPNU)
-          (void)memset(new_ScreenLines2 + new_row * Columns,
-              0, (size_t)Columns * sizeof(schar_T));
-        (void)memset(new_ScreenAttrs + new_row * Columns,
-            0, (size_t)Columns * sizeof(sattr_T));
+        for (i = 0; i < Columns; ++i)
+          new_ScreenCells[new_row * Columns + i].sc_char = ' ';
         old_row = new_row + (screen_Rows - Rows);
-        if (old_row >= 0 && ScreenLines != NULL) {
+        /* When switching encoding don't copy characters, they may be
+         * invalid now.  Also when p_mco changes. */
+        if (old_row >= 0 && ScreenCells != NULL
+            && enc_utf8 == screen_enc_utf8
+            && enc_dbcs == screen_enc_dbcs
+            && p_mco == Screen_mco) {
           if (screen_Columns < Columns)
             len = screen_Columns;
           else
             len = Columns;
-          /* When switching to utf-8 don't copy characters, they
-           * may be invalid now.  Also when p_mco changes. */
-          if (!(enc_utf8 && ScreenLinesUC == NULL)
-              && p_mco == Screen_mco)
-            memmove(new_ScreenLines + new_LineOffset[new_row],
-                ScreenLines + LineOffset[old_row],
-                (size_t)len * sizeof(schar_T));
-          if (enc_utf8 && ScreenLinesUC != NULL
-              && p_mco == Screen_mco) {
-            memmove(new_ScreenLinesUC + new_LineOffset[new_row],
-                ScreenLinesUC + LineOffset[old_row],
-                (size_t)len * sizeof(u8char_T));
-            for (i = 0; i < p_mco; ++i)
-              memmove(new_ScreenLinesC[i]
-                  + new_LineOffset[new_row],
-                  ScreenLinesC[i] + LineOffset[old_row],
-                  (size_t)len * sizeof(u8char_T));
-          }
-          if (enc_dbcs == DBCS_JPNU && ScreenLines2 != NULL)
-            memmove(new_ScreenLines2 + new_LineOffset[new_row],
-                ScreenLines2 + LineOffset[old_row],
-                (size_t)len * sizeof(schar_T));
-          memmove(new_ScreenAttrs + new_LineOffset[new_row],
-              ScreenAttrs + LineOffset[old_row],
-              (size_t)len * sizeof(sattr_T));
+          memmove(new_ScreenCells + new_LineOffset[new_row],
+              ScreenCells + LineOffset[old_row],
+              (size_t)len * sizeof(screencell_T));
         }
       }
     }
     /* Use the last line of the screen for the current line. */
-    current_ScreenLine = new_ScreenLines + Rows * Columns;
+    current_ScreenLine = new_ScreenCells + Rows * Columns;
   }
 
   free_screenlines();
 
-  ScreenLines = new_ScreenLines;
-  ScreenLinesUC = new_ScreenLinesUC;
-  for (i = 0; i < p_mco; ++i)
-    ScreenLinesC[i] = new_ScreenLinesC[i];
+  ScreenCells = new_ScreenCells;
   Screen_mco = p_mco;
-  ScreenLines2 = new_ScreenLines2;
-  ScreenAttrs = new_ScreenAttrs;
+  screen_enc_utf8 = enc_utf8;
+  screen_enc_dbcs = enc_dbcs;
   LineOffset = new_LineOffset;
   LineWraps = new_LineWraps;
   TabPageIdxs = new_TabPageIdxs;
 
   /* It's important that screen_Rows and screen_Columns reflect the actual
-   * size of ScreenLines[].  Set them before calling anything. */
+   * size of ScreenCells[].  Set them before calling anything. */
   screen_Rows = Rows;
   screen_Columns = Columns;
 
@@ -6350,14 +6501,7 @@ retry:
 
 void free_screenlines(void)
 {
-  int i;
-
-  free(ScreenLinesUC);
-  for (i = 0; i < Screen_mco; ++i)
-    free(ScreenLinesC[i]);
-  free(ScreenLines2);
-  free(ScreenLines);
-  free(ScreenAttrs);
+  free(ScreenCells);
   free(LineOffset);
   free(LineWraps);
   free(TabPageIdxs);
@@ -6374,15 +6518,16 @@ static void screenclear2(void)
 {
   int i;
 
-  if (starting == NO_SCREEN || ScreenLines == NULL
+  if (starting == NO_SCREEN || ScreenCells == NULL
       )
     return;
 
   screen_attr = -1;             /* force setting the Normal colors */
   screen_stop_highlight();      /* don't want highlighting here */
+  render_cache_invalidate();
 
 
-  /* blank out ScreenLines */
+  /* blank out ScreenCells */
   for (i = 0; i < Rows; ++i) {
     lineclear(LineOffset[i], (int)Columns);
     LineWraps[i] = FALSE;
@@ -6399,7 +6544,8 @@ static void screenclear2(void)
     clear_cmdline = TRUE;
   }
 
-  screen_cleared = TRUE;        /* can use contents of ScreenLines now */
+  screen_cleared = TRUE;        /* can use contents of ScreenCells now */
+  grid_invalidate();            /* highlighting may have changed */
 
   win_rest_invalid(firstwin);
   redraw_cmdline = TRUE;
@@ -6416,24 +6562,30 @@ static void screenclear2(void)
 }
 
 /*
- * Clear one line in ScreenLines.
+ * Clear one line in ScreenCells.
  */
 static void lineclear(unsigned off, int width)
 {
-  (void)memset(ScreenLines + off, ' ', (size_t)width * sizeof(schar_T));
-  if (enc_utf8)
-    (void)memset(ScreenLinesUC + off, 0,
-        (size_t)width * sizeof(u8char_T));
-  (void)memset(ScreenAttrs + off, 0, (size_t)width * sizeof(sattr_T));
+  screencell_T *cell = ScreenCells + off;
+
+  while (width-- > 0) {
+    cell->sc_char = ' ';
+    cell->sc_attr = 0;
+    cell->sc_uc = 0;
+    ++cell;
+  }
 }
 
 /*
- * Mark one line in ScreenLines invalid by setting the attributes to an
+ * Mark one line in ScreenCells invalid by setting the attributes to an
  * invalid value.
  */
 static void lineinvalid(unsigned off, int width)
 {
-  (void)memset(ScreenAttrs + off, -1, (size_t)width * sizeof(sattr_T));
+  screencell_T *cell = ScreenCells + off;
+
+  while (width-- > 0)
+    (cell++)->sc_attr = (sattr_T)-1;
 }
 
 /*
@@ -6444,22 +6596,8 @@ static void linecopy(int to, int from, win_T *wp)
   unsigned off_to = LineOffset[to] + wp->w_wincol;
   unsigned off_from = LineOffset[from] + wp->w_wincol;
 
-  memmove(ScreenLines + off_to, ScreenLines + off_from,
-      wp->w_width * sizeof(schar_T));
-  if (enc_utf8) {
-    int i;
-
-    memmove(ScreenLinesUC + off_to, ScreenLinesUC + off_from,
-        wp->w_width * sizeof(u8char_T));
-    for (i = 0; i < p_mco; ++i)
-      memmove(ScreenLinesC[i] + off_to, ScreenLinesC[i] + off_from,
-          wp->w_width * sizeof(u8char_T));
-  }
-  if (enc_dbcs == DBCS_JPNU)
-    memmove(ScreenLines2 + off_to, ScreenLines2 + off_from,
-        wp->w_width * sizeof(schar_T));
-  memmove(ScreenAttrs + off_to, ScreenAttrs + off_from,
-      wp->w_width * sizeof(sattr_T));
+  memmove(ScreenCells + off_to, ScreenCells + off_from,
+      wp->w_width * sizeof(screencell_T));
 }
 
 /*
@@ -6489,7 +6627,7 @@ void screen_start(void)
  */
 void windgoto(int row, int col)
 {
-  sattr_T         *p;
+  screencell_T    *p;
   int i;
   int plan;
   int cost;
@@ -6506,8 +6644,8 @@ void windgoto(int row, int col)
 #define PLAN_CR     2
 #define PLAN_NL     3
 #define PLAN_WRITE  4
-  /* Can't use ScreenLines unless initialized */
-  if (ScreenLines == NULL)
+  /* Can't use ScreenCells unless initialized */
+  if (ScreenCells == NULL)
     return;
 
   if (col != screen_cur_col || row != screen_cur_row) {
@@ -6602,16 +6740,16 @@ void windgoto(int row, int col)
          * Check if the attributes are correct without additionally
          * stopping highlighting.
          */
-        p = ScreenAttrs + LineOffset[row] + wouldbe_col;
-        while (i && *p++ == attr)
+        p = ScreenCells + LineOffset[row] + wouldbe_col;
+        while (i && (p++)->sc_attr == attr)
           --i;
         if (i != 0) {
           /*
            * Try if it works when highlighting is stopped here.
            */
-          if (*--p == 0) {
+          if ((--p)->sc_attr == 0) {
             cost += noinvcurs;
-            while (i && *p++ == 0)
+            while (i && (p++)->sc_attr == 0)
               --i;
           }
           if (i != 0)
@@ -6620,7 +6758,7 @@ void windgoto(int row, int col)
         if (enc_utf8) {
           /* Don't use an UTF-8 char for positioning, it's slow. */
           for (i = wouldbe_col; i < col; ++i)
-            if (ScreenLinesUC[LineOffset[row] + i] != 0) {
+            if (ScreenCells[LineOffset[row] + i].sc_uc != 0) {
               cost = 999;
               break;
             }
@@ -6668,13 +6806,13 @@ void windgoto(int row, int col)
 
             off = LineOffset[row] + screen_cur_col;
             while (i-- > 0) {
-              if (ScreenAttrs[off] != screen_attr)
+              if (ScreenCells[off].sc_attr != screen_attr)
                 screen_stop_highlight();
               out_flush_check();
-              out_char(ScreenLines[off]);
+              out_char(ScreenCells[off].sc_char);
               if (enc_dbcs == DBCS_JPNU
-                  && ScreenLines[off] == 0x8e)
-                out_char(ScreenLines2[off]);
+                  && ScreenCells[off].sc_char == 0x8e)
+                out_char(ScreenCells[off].sc_char2);
               ++off;
             }
           }
@@ -6870,7 +7008,7 @@ static int win_do_lines(win_T *wp, int row, int line_count, int mayclear, int de
   /*
    * If the terminal can set a scroll region, use that.
    * Always do this in a vertically split window.  This will redraw from
-   * ScreenLines[] when t_CV isn't defined.  That's faster than using
+   * ScreenCells[] when t_CV isn't defined.  That's faster than using
    * win_line().
    * Don't use a scroll region when we are going to redraw the text, writing
    * a character in the lower right corner of the scroll region causes a
@@ -6935,7 +7073,7 @@ static void win_rest_invalid(win_T *wp)
 #define USE_REDRAW  9
 
 /*
- * insert lines on the screen and update ScreenLines[]
+ * insert lines on the screen and update ScreenCells[]
  * 'end' is the line after the scrolled part. Normally it is Rows.
  * When scrolling region used 'off' is the offset from the top for the region.
  * 'row' and 'end' are relative to the start of the region.
@@ -6972,7 +7110,7 @@ screen_ins_lines (
   /*
    * There are seven ways to insert lines:
    * 0. When in a vertically split window and t_CV isn't set, redraw the
-   *    characters from ScreenLines[].
+   *    characters from ScreenCells[].
    * 1. Use T_CD (clear to end of display) if it exists and the result of
    *	  the insert is just empty lines
    * 2. Use T_CAL (insert multiple lines) if it exists and T_AL is not
@@ -6988,7 +7126,7 @@ screen_ins_lines (
    *	  just empty lines.
    * 7. Use T_SR (scroll reverse) if it exists and inserting at row 0 and
    *	  the 'da' flag is not set or we have clear line capability.
-   * 8. redraw the characters from ScreenLines[].
+   * 8. redraw the characters from ScreenCells[].
    *
    * Careful: In a hpterm scroll reverse doesn't work as expected, it moves
    * the scrollbar for the window. It does have insert line, use that if it
@@ -7039,7 +7177,7 @@ screen_ins_lines (
 
   /*
    * Shift LineOffset[] line_count down to reflect the inserted lines.
-   * Clear the inserted lines in ScreenLines[].
+   * Clear the inserted lines in ScreenCells[].
    */
   row += off;
   end += off;
@@ -7108,7 +7246,7 @@ screen_ins_lines (
 }
 
 /*
- * delete lines on the screen and update ScreenLines[]
+ * delete lines on the screen and update ScreenCells[]
  * 'end' is the line after the scrolled part. Normally it is Rows.
  * When scrolling region used 'off' is the offset from the top for the region.
  * 'row' and 'end' are relative to the start of the region.
@@ -7159,14 +7297,14 @@ screen_del_lines (
   /*
    * There are six ways to delete lines:
    * 0. When in a vertically split window and t_CV isn't set, redraw the
-   *    characters from ScreenLines[].
+   *    characters from ScreenCells[].
    * 1. Use T_CD if it exists and the result is empty.
    * 2. Use newlines if row == 0 and count == 1 or T_CDL does not exist.
    * 3. Use T_CDL (delete multiple lines) if it exists and line_count > 1 or
    *	  none of the other ways work.
    * 4. Use T_CE (erase line) if the result is empty.
    * 5. Use T_DL (delete line) if it exists.
-   * 6. redraw the characters from ScreenLines[].
+   * 6. redraw the characters from ScreenCells[].
    */
   if (wp != NULL && wp->w_width != Columns && *T_CSV == NUL)
     type = USE_REDRAW;
@@ -7203,7 +7341,7 @@ screen_del_lines (
 
   /*
    * Now shift LineOffset[] line_count up to reflect the deleted lines.
-   * Clear the inserted lines in ScreenLines[].
+   * Clear the inserted lines in ScreenCells[].
    */
   row += off;
   end += off;
@@ -772,6 +772,17 @@ int searchit(
       }
       at_first_line = FALSE;
 
+      /* At the end of the lines read so far, search the lines that are
+       * still being read in the background before wrapping around. */
+      if (dir == FORWARD && !found && readfile_bg_reading(buf)
+          && lnum > buf->b_ml.ml_line_count
+          && (stop_lnum == 0 || lnum <= stop_lnum)
+          && !got_int && !called_emsg && !break_loop) {
+        readfile_bg_wait(buf);
+        --loop;
+        continue;
+      }
+
       /*
        * Stop the search if wrapscan isn't set, "stop_lnum" is
        * specified, after an interrupt, after a match and after looping
@@ -789,9 +800,10 @@ int searchit(
        * is redrawn. The keep_msg is cleared whenever another message is
        * written.
        */
-      if (dir == BACKWARD)          /* start second loop at the other end */
+      if (dir == BACKWARD) {        /* start second loop at the other end */
+        readfile_bg_wait(buf);
         lnum = buf->b_ml.ml_line_count;
-      else
+      } else
         lnum = 1;
       if (!shortmess(SHM_SEARCH) && (options & SEARCH_MSG))
         give_warning((char_u *)_(dir == BACKWARD
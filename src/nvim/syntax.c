@@ -13,6 +13,8 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include <uv.h>
+
 #include "nvim/vim.h"
 #include "nvim/syntax.h"
 #include "nvim/charset.h"
@@ -40,6 +42,8 @@
 #include "nvim/term.h"
 #include "nvim/ui.h"
 #include "nvim/os/os.h"
+#include "nvim/os/event.h"
+#include "nvim/api/private/helpers.h"
 
 /*
  * Structure that stores information about a highlight group.
@@ -200,6 +204,36 @@ typedef struct {
   char_u      *pattern;
 } time_entry_T;
 
+/*
+ * Highlighting profile of a syntax group, see syntax_get_stats().
+ */
+typedef struct {
+  uint64_t calls;               /* nr of times a pattern was tried */
+  uint64_t samples;             /* nr of calls that were timed */
+  uint64_t time;                /* estimated total time in nanoseconds */
+  uint64_t slowest;             /* slowest timed call in nanoseconds */
+} synprof_T;
+
+/*
+ * A line that took long to draw, see syntax_prof_line().
+ */
+typedef struct {
+  uint64_t buffer;              /* handle of the buffer */
+  linenr_T lnum;
+  uint64_t time;                /* nanoseconds spent in win_line() */
+} synprof_line_T;
+
+/*
+ * A pattern in the profile, copied from its syn_time_T.
+ */
+typedef struct {
+  uint64_t buffer;              /* handle of the buffer */
+  int id;                       /* group ID, zero for "linecont" */
+  char_u      *pattern;
+  uint64_t samples;
+  uint64_t time;
+} synprof_pat_T;
+
 struct name_list {
   int flag;
   char        *name;
@@ -371,6 +405,27 @@ static int current_line_id = 0;         /* unique number for current line */
 static int syn_time_on = FALSE;
 # define IF_SYN_TIME(p) (p)
 
+#define SYN_LINE_CACHE_SIZE 256 /* nr of entries in b_syn_lines[] */
+
+/*
+ * The highlighting profile is always collected, it must be cheap.  Every
+ * line drawn is timed, but only about one in SYN_PROF_RATE calls of
+ * syn_regexec().  The time of a sample is multiplied by the number of calls
+ * since the previous one.  The interval is random, otherwise it could keep
+ * hitting the same pattern when patterns are tried in a fixed order.
+ */
+#define SYN_PROF_RATE       64
+#define SYN_PROF_LINES      10  /* nr of slowest lines kept */
+#define SYN_PROF_PATTERNS   20  /* nr of slowest patterns reported */
+
+static garray_T syn_prof_groups         /* synprof_T for each group ID */
+  = {0, 0, sizeof(synprof_T), 50, NULL};
+static LatencyStats syn_prof_draw;      /* all win_line() calls */
+static synprof_line_T syn_prof_slow[SYN_PROF_LINES];
+static uint64_t syn_prof_calls = 0;     /* calls since the previous sample */
+static uint64_t syn_prof_next = SYN_PROF_RATE;  /* sample at this count */
+static uint32_t syn_prof_seed = 1;
+
 
 
 /*
@@ -475,10 +530,7 @@ void syntax_start(win_T *wp, linenr_T lnum)
    * Advance from the sync point or saved state until the current line.
    * Save some entries for syncing with later on.
    */
-  if (syn_block->b_sst_len <= Rows)
-    dist = 999999;
-  else
-    dist = syn_buf->b_ml.ml_line_count / (syn_block->b_sst_len - Rows) + 1;
+  dist = syn_stack_dist();
   while (current_lnum < lnum) {
     syn_start_line();
     (void)syn_finish_line(FALSE);
@@ -536,6 +588,142 @@ void syntax_start(win_T *wp, linenr_T lnum)
   syn_start_line();
 }
 
+/*
+ * Parse the syntax of displayed windows while waiting for the user to type,
+ * for about "ms" milliseconds.  A state is saved in b_sst_array[] every so
+ * many lines, from the first line to the last, so that after a jump to any
+ * line the state can be loaded from close by instead of syncing.
+ * Returns TRUE when there is more to do.
+ */
+int syntax_idle(long ms)
+{
+  proftime_T tm;
+  win_T       *wp;
+  int more = FALSE;
+
+  /* Not when the screen is being updated, it uses the current state.  Also
+   * not at a prompt, e.g. wait_return() may be called halfway a command
+   * that uses the current state. */
+  if (updating_screen || starting || State == HITRETURN || State == ASKMORE
+      || State == CONFIRM || State == EXTERNCMD)
+    return FALSE;
+
+  profile_setlimit(ms, &tm);
+  FOR_ALL_WINDOWS(wp)
+  {
+    if (!syn_idle_needed(wp))
+      continue;
+    if (more || profile_passed_limit(&tm))
+      return TRUE;
+    syn_idle_parse(wp, &tm);
+    more = syn_idle_needed(wp);
+  }
+  return more;
+}
+
+/*
+ * Return TRUE when syntax_idle() has work to do for window "wp".
+ */
+static int syn_idle_needed(win_T *wp)
+{
+  return syntax_present(wp)
+         && wp->w_s->b_sst_idle_lnum <= wp->w_buffer->b_ml.ml_line_count;
+}
+
+/*
+ * Parse lines of window "wp" from where syntax_idle() stopped before, until
+ * "tm" has passed.
+ */
+static void syn_idle_parse(win_T *wp, proftime_T *tm)
+{
+  synstate_T  *prev;
+  synstate_T  *sp;
+  int dist;
+  int count = 0;
+  int time_up = FALSE;
+  int stored = FALSE;
+
+  syntax_start(wp, wp->w_s->b_sst_idle_lnum < 1
+                   ? 1 : wp->w_s->b_sst_idle_lnum);
+  if (syn_block->b_sst_array == NULL)
+    return;
+  dist = syn_stack_dist();
+  prev = syn_stack_find_entry(current_lnum);
+
+  for (;; ) {
+    (void)syn_finish_line(FALSE);
+    ++current_lnum;
+    if (current_lnum > syn_buf->b_ml.ml_line_count)
+      break;
+
+    sp = prev == NULL ? syn_block->b_sst_first : prev->sst_next;
+
+    /* After a change: when the state is the same as the one stored before
+     * the change, the states stored after it that only depended on this
+     * change are valid again, like in syntax_start().  Continue after them,
+     * where parsing stopped before the change if there is no later change. */
+    if (sp != NULL && sp->sst_lnum == current_lnum
+        && sp->sst_change_lnum != 0
+        && current_lnum < syn_block->b_sst_idle_end
+        && syn_stack_equal(sp)) {
+      while (sp != NULL && sp->sst_change_lnum <= current_lnum) {
+        sp->sst_change_lnum = 0;
+        prev = sp;
+        sp = sp->sst_next;
+      }
+      if (sp == NULL || sp->sst_lnum >= syn_block->b_sst_idle_end)
+        current_lnum = syn_block->b_sst_idle_end;
+      else
+        current_lnum = prev->sst_lnum;
+      break;
+    }
+
+    /* Store the state every "dist" lines, replace the states saved for
+     * displayed lines, they may depend on a sync point.  Stop at a line
+     * where the state was stored, to continue there the next time. */
+    if ((++count & 31) == 0 && profile_passed_limit(tm))
+      time_up = TRUE;
+    if (prev == NULL
+        || current_lnum >= prev->sst_lnum + dist
+        || (sp != NULL && sp->sst_lnum == current_lnum)
+        || time_up) {
+      sp = store_current_state();
+      if (sp != NULL) {
+        prev = sp;
+        stored = TRUE;
+        if (time_up)
+          break;
+      }
+    }
+
+    syn_start_line();
+    line_breakcheck();
+    if (got_int)
+      break;
+  }
+
+  syn_block->b_sst_idle_lnum = current_lnum;
+  if (syn_block->b_sst_idle_end < current_lnum)
+    syn_block->b_sst_idle_end = current_lnum;
+  /* Lines drawn before may have used a sync point instead of the states
+   * stored now. */
+  if (stored)
+    ++syn_block->b_syn_tick;
+  /* The screen update must not continue from here. */
+  invalidate_current_state();
+}
+
+/*
+ * Return the normal distance between entries in b_sst_array[] for lines that
+ * are not displayed.
+ */
+static int syn_stack_dist(void)
+{
+  if (syn_block->b_sst_len <= Rows)
+    return 999999;
+  return syn_buf->b_ml.ml_line_count / (syn_block->b_sst_len - Rows) + 1;
+}
+
 /*
  * We cannot simply discard growarrays full of state_items or buf_states; we
  * have to manually release their extmatch pointers first.
@@ -836,7 +1024,7 @@ static int syn_match_linecont(linenr_T lnum)
     regmatch.rmm_ic = syn_block->b_syn_linecont_ic;
     regmatch.regprog = syn_block->b_syn_linecont_prog;
     return syn_regexec(&regmatch, lnum, (colnr_T)0,
-        IF_SYN_TIME(&syn_block->b_syn_linecont_time));
+        IF_SYN_TIME(&syn_block->b_syn_linecont_time), 0);
   }
   return FALSE;
 }
@@ -971,6 +1159,16 @@ static void syn_stack_free_block(synblock_T *block)
     block->b_sst_array = NULL;
     block->b_sst_len = 0;
   }
+  block->b_sst_idle_lnum = 0;
+  block->b_sst_idle_end = 0;
+  ++block->b_syn_tick;
+
+  if (block->b_syn_lines != NULL) {
+    for (int i = 0; i < SYN_LINE_CACHE_SIZE; ++i)
+      free(block->b_syn_lines[i].sl_runs);
+    free(block->b_syn_lines);
+    block->b_syn_lines = NULL;
+  }
 }
 /*
  * Free b_sst_array[] for buffer "buf".
@@ -1078,6 +1276,110 @@ void syn_stack_apply_changes(buf_T *buf)
     if ((wp->w_buffer == buf) && (wp->w_s != &buf->b_s))
       syn_stack_apply_changes_block(wp->w_s, buf);
   }
+
+  /* Parse the changed lines again, once for each state stack. */
+  FOR_ALL_WINDOWS(wp)
+  {
+    win_T       *wwp;
+
+    if (wp->w_buffer != buf || !syntax_present(wp))
+      continue;
+    for (wwp = firstwin; wwp != wp; wwp = wwp->w_next)
+      if (wwp->w_s == wp->w_s)
+        break;
+    if (wwp == wp)
+      syn_stack_reparse(wp, buf);
+  }
+}
+
+/*
+ * Parse the lines from the change in "buf" onwards, for the state stack of
+ * window "wp", until the state at the start of a line is equal to the state
+ * saved for it before the change.  The lines above it are highlighted
+ * differently now, b_mod_bot is moved down to have them redrawn.
+ * Parsing stops at the end of the windows in which the change starts, the
+ * states further down are checked when they are used.
+ */
+static void syn_stack_reparse(win_T *wp, buf_T *buf)
+{
+  linenr_T top = buf->b_mod_top - wp->w_s->b_syn_sync_linebreaks;
+  linenr_T stop = 0;
+  linenr_T parsed_lnum;
+  synstate_T  *prev;
+  synstate_T  *sp;
+  win_T       *wwp;
+  int dist;
+  int converged = FALSE;
+
+  if (top < 1)
+    top = 1;
+  /* Only for windows in which the change starts.  A line takes at least one
+   * screen line, unless it is folded. */
+  FOR_ALL_WINDOWS(wwp)
+  {
+    if (wwp->w_s == wp->w_s && top >= wwp->w_topline
+        && top < wwp->w_topline + wwp->w_height
+        && wwp->w_topline + wwp->w_height > stop)
+      stop = wwp->w_topline + wwp->w_height;
+  }
+  if (stop > buf->b_ml.ml_line_count)
+    stop = buf->b_ml.ml_line_count;
+  if (top >= stop || buf->b_mod_bot > stop)
+    return;             /* the change continues below the windows */
+
+  syntax_start(wp, top);
+  if (syn_block->b_sst_array == NULL)
+    return;
+  dist = syn_stack_dist();
+  prev = syn_stack_find_entry(current_lnum);
+
+  while (current_lnum < stop) {
+    (void)syn_finish_line(FALSE);
+    ++current_lnum;
+
+    sp = prev == NULL ? syn_block->b_sst_first : prev->sst_next;
+    while (sp != NULL && sp->sst_lnum < current_lnum)
+      sp = sp->sst_next;
+    if (sp != NULL && sp->sst_lnum == current_lnum) {
+      if (current_lnum >= buf->b_mod_bot && syn_stack_equal(sp)) {
+        /* The change doesn't matter below this line: the saved states
+         * that waited for it to be parsed are valid again. */
+        parsed_lnum = current_lnum;
+        while (sp != NULL && sp->sst_change_lnum != 0
+               && sp->sst_change_lnum <= parsed_lnum) {
+          sp->sst_change_lnum = 0;
+          sp = sp->sst_next;
+        }
+        converged = TRUE;
+        break;
+      }
+      sp = store_current_state();
+    } else if (prev == NULL || current_lnum >= prev->sst_lnum + dist)
+      sp = store_current_state();
+    else
+      sp = NULL;
+    if (sp != NULL)
+      prev = sp;
+
+    syn_start_line();
+    line_breakcheck();
+    if (got_int)
+      break;
+  }
+
+  /* Lines up to "current_lnum" need to be redrawn, including that one
+   * when the states didn't become equal. */
+  if (!converged)
+    ++current_lnum;
+  if (current_lnum > buf->b_mod_bot) {
+    buf->b_mod_bot = current_lnum;
+    FOR_ALL_WINDOWS(wwp)
+    {
+      if (wwp->w_s == wp->w_s)
+        redraw_win_later(wwp, VALID);
+    }
+  }
+  invalidate_current_state();
 }
 
 static void syn_stack_apply_changes_block(synblock_T *block, buf_T *buf)
@@ -1088,6 +1390,15 @@ static void syn_stack_apply_changes_block(synblock_T *block, buf_T *buf)
   if (block->b_sst_array == NULL)       /* nothing to do */
     return;
 
+  /* States from the change onwards must be computed again.  Where the
+   * parsing got to moves with the text, unless it was in the changed area. */
+  if (block->b_sst_idle_end > buf->b_mod_top) {
+    n = block->b_sst_idle_end + buf->b_mod_xlines;
+    block->b_sst_idle_end = n <= buf->b_mod_bot ? buf->b_mod_top : n;
+  }
+  if (block->b_sst_idle_lnum > buf->b_mod_top)
+    block->b_sst_idle_lnum = buf->b_mod_top;
+
   prev = NULL;
   for (p = block->b_sst_first; p != NULL; ) {
     if (p->sst_lnum + block->b_syn_sync_linebreaks > buf->b_mod_top) {
@@ -1139,10 +1450,7 @@ static int syn_stack_cleanup(void)
     return retval;
 
   /* Compute normal distance between non-displayed entries. */
-  if (syn_block->b_sst_len <= Rows)
-    dist = 999999;
-  else
-    dist = syn_buf->b_ml.ml_line_count / (syn_block->b_sst_len - Rows) + 1;
+  dist = syn_stack_dist();
 
   /*
    * Go through the list to find the "tick" for the oldest entry that can
@@ -1221,6 +1529,7 @@ static synstate_T *store_current_state(void)
   bufstate_T  *bp;
   stateitem_T *cur_si;
   synstate_T  *sp = syn_stack_find_entry(current_lnum);
+  int is_new = FALSE;
 
   /*
    * If the current state contains a start or end pattern that continues
@@ -1283,9 +1592,13 @@ static synstate_T *store_current_state(void)
       sp = p;
       sp->sst_stacksize = 0;
       sp->sst_lnum = current_lnum;
+      is_new = TRUE;
     }
   }
   if (sp != NULL) {
+    /* A different state for a line changes the highlighting after it. */
+    if (!is_new && !syn_stack_equal(sp))
+      ++syn_block->b_syn_tick;
     /* When overwriting an existing state stack, clear it first */
     clear_syn_state(sp);
     sp->sst_stacksize = current_state.ga_len;
@@ -1599,6 +1912,169 @@ get_syntax_attr (
   return attr;
 }
 
+/*
+ * Get the syntax attributes of the columns of line "lnum" that window "wp"
+ * can display, for win_line().  They are cached, other windows that show the
+ * same lines of the buffer use them without parsing again.
+ * This runs in the main thread: the syntax and regexp engines keep their
+ * state in global variables and get lines through the memline cache.
+ * The result is valid until the next call.  When there is an error "did_emsg"
+ * is set.
+ */
+synline_T *syntax_line(win_T *wp, linenr_T lnum)
+{
+  synblock_T  *block = wp->w_s;
+  synline_T   *slp;
+  colnr_T len;
+  colnr_T endcol;
+  int can_spell;
+
+  if (block->b_syn_lines == NULL)
+    block->b_syn_lines = xcalloc(SYN_LINE_CACHE_SIZE, sizeof(synline_T));
+  slp = &block->b_syn_lines[lnum % SYN_LINE_CACHE_SIZE];
+  endcol = syn_line_endcol(wp, lnum);
+
+  if (slp->sl_lnum == lnum
+      && slp->sl_changedtick == wp->w_buffer->b_changedtick
+      && slp->sl_syn_tick == block->b_syn_tick
+      && slp->sl_smc == wp->w_buffer->b_p_smc
+      && (slp->sl_endcol == MAXCOL
+          || (endcol != MAXCOL && endcol <= slp->sl_endcol))
+      && !block->b_syn_nocache) {
+    /* Continue with this buffer, like syntax_start() does, the state of
+     * another buffer must not be stored here. */
+    if (syn_block != block) {
+      invalidate_current_state();
+      syn_buf = wp->w_buffer;
+      syn_block = block;
+    }
+    syn_win = wp;
+    block->b_sst_lasttick = display_tick;
+    return slp;
+  }
+
+  slp->sl_lnum = 0;
+  slp->sl_count = 0;
+  syntax_start(wp, lnum);
+
+  /* Also get the attributes for the NUL, after 'synmaxcol' they are zero. */
+  len = (colnr_T)STRLEN(ml_get_buf(wp->w_buffer, lnum, FALSE));
+  if (wp->w_buffer->b_p_smc > 0 && len > (colnr_T)wp->w_buffer->b_p_smc)
+    len = (colnr_T)wp->w_buffer->b_p_smc;
+  if (endcol < len)
+    len = endcol;
+  else
+    endcol = MAXCOL;
+  for (colnr_T col = 0; col <= len; ++col) {
+    (void)get_syntax_attr(col, &can_spell, FALSE);
+    if (did_emsg)
+      return slp;
+    syn_line_add(slp, col, can_spell);
+  }
+
+  slp->sl_lnum = lnum;
+  slp->sl_changedtick = wp->w_buffer->b_changedtick;
+  slp->sl_syn_tick = block->b_syn_tick;
+  slp->sl_smc = wp->w_buffer->b_p_smc;
+  slp->sl_endcol = endcol;
+  return slp;
+}
+
+/*
+ * Return the last column of line "lnum" that window "wp" may display, MAXCOL
+ * when that may be the end of the line.  With 'nowrap' that is at the right
+ * edge of the window, otherwise when the window is full.  Avoids parsing all
+ * of a very long line when only the start of it is visible.
+ */
+static colnr_T syn_line_endcol(win_T *wp, linenr_T lnum)
+{
+  char_u      *line = ml_get_buf(wp->w_buffer, lnum, FALSE);
+  char_u      *p = line;
+  colnr_T vcol = 0;
+  colnr_T maxvcol;
+
+  /* Concealed text takes no space, more of the line may be displayed. */
+  if (wp->w_p_cole > 0)
+    return MAXCOL;
+
+  if (wp->w_p_wrap)
+    maxvcol = (lnum == wp->w_topline ? wp->w_skipcol : 0)
+              + wp->w_width * wp->w_height;
+  else
+    maxvcol = wp->w_leftcol + wp->w_width;
+
+  while (*p != NUL && vcol <= maxvcol) {
+    vcol += win_lbr_chartabsize(wp, p, vcol, NULL);
+    mb_ptr_adv(p);
+  }
+  return *p == NUL ? MAXCOL : (colnr_T)(p - line);
+}
+
+/*
+ * Add the current attributes for column "col" to "slp".
+ */
+static void syn_line_add(synline_T *slp, colnr_T col, int can_spell)
+{
+  synrun_T    *srp;
+
+  if (slp->sl_count > 0) {
+    srp = &slp->sl_runs[slp->sl_count - 1];
+    if (srp->sr_trans_id == current_trans_id
+        && srp->sr_flags == current_flags
+        && srp->sr_seqnr == current_seqnr
+        && srp->sr_cchar == current_sub_char
+        && srp->sr_can_spell == can_spell)
+      return;
+  }
+
+  if (slp->sl_count == slp->sl_size) {
+    slp->sl_size = slp->sl_size == 0 ? 8 : slp->sl_size * 2;
+    slp->sl_runs = xrealloc(slp->sl_runs,
+        sizeof(synrun_T) * (size_t)slp->sl_size);
+  }
+  srp = &slp->sl_runs[slp->sl_count++];
+  srp->sr_col = col;
+  srp->sr_trans_id = current_trans_id;
+  srp->sr_flags = current_flags;
+  srp->sr_seqnr = current_seqnr;
+  srp->sr_cchar = current_sub_char;
+  srp->sr_can_spell = can_spell;
+}
+
+/*
+ * Get the highlight attributes of column "col" from "slp", returned by
+ * syntax_line().  "*srpp" is set to the run with the other attributes.
+ */
+int syntax_line_attr(synline_T *slp, colnr_T col, synrun_T **srpp)
+{
+  int lo = 0;
+  int hi = slp->sl_count - 1;
+
+  /* Find the last run that starts at or before "col". */
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+
+    if (slp->sl_runs[mid].sr_col <= col)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  *srpp = &slp->sl_runs[lo];
+  return (*srpp)->sr_trans_id == 0 ? 0 : syn_id2attr((*srpp)->sr_trans_id);
+}
+
+/*
+ * Return TRUE if pattern "pat" may depend on the cursor position, the Visual
+ * area or a mark, then the result can't be cached.
+ */
+static int syn_pat_uses_cursor(char_u *pat)
+{
+  return vim_strchr(pat, '%') != NULL
+         && (strstr((char *)pat, "%#") != NULL
+             || strstr((char *)pat, "%V") != NULL
+             || strstr((char *)pat, "%'") != NULL);
+}
+
 /*
  * Get syntax attributes for current_lnum, current_col.
  */
@@ -1812,7 +2288,8 @@ syn_current_attr (
               if (!syn_regexec(&regmatch,
                       current_lnum,
                       (colnr_T)lc_col,
-                      IF_SYN_TIME(&spp->sp_time))) {
+                      IF_SYN_TIME(&spp->sp_time),
+                      spp->sp_syn.id)) {
                 /* no match in this line, try another one */
                 spp->sp_startcol = MAXCOL;
                 continue;
@@ -2597,7 +3074,7 @@ find_endpos (
       regmatch.rmm_ic = spp->sp_ic;
       regmatch.regprog = spp->sp_prog;
       if (syn_regexec(&regmatch, startpos->lnum, lc_col,
-              IF_SYN_TIME(&spp->sp_time))) {
+              IF_SYN_TIME(&spp->sp_time), spp->sp_syn.id)) {
         if (best_idx == -1 || regmatch.startpos[0].col
             < best_regmatch.startpos[0].col) {
           best_idx = idx;
@@ -2626,7 +3103,7 @@ find_endpos (
       regmatch.rmm_ic = spp_skip->sp_ic;
       regmatch.regprog = spp_skip->sp_prog;
       if (syn_regexec(&regmatch, startpos->lnum, lc_col,
-              IF_SYN_TIME(&spp_skip->sp_time))
+              IF_SYN_TIME(&spp_skip->sp_time), spp_skip->sp_syn.id)
           && regmatch.startpos[0].col
           <= best_regmatch.startpos[0].col) {
         /* Add offset to skip pattern match */
@@ -2844,12 +3321,19 @@ static char_u *syn_getcurline(void)
 
 /*
  * Call vim_regexec() to find a match with "rmp" in "syn_buf".
+ * The time is added to the profile of group "id".
  * Returns TRUE when there is a match.
  */
-static int syn_regexec(regmmatch_T *rmp, linenr_T lnum, colnr_T col, syn_time_T *st)
+static int syn_regexec(regmmatch_T *rmp, linenr_T lnum, colnr_T col, syn_time_T *st, int id)
 {
   int r;
   proftime_T pt;
+  uint64_t start = 0;
+  synprof_T   *gp = syn_prof_group(id);
+
+  ++gp->calls;
+  if (++syn_prof_calls >= syn_prof_next)
+    start = uv_hrtime();
 
   if (syn_time_on)
     profile_start(&pt);
@@ -2857,6 +3341,9 @@ static int syn_regexec(regmmatch_T *rmp, linenr_T lnum, colnr_T col, syn_time_T
   rmp->rmm_maxcol = syn_buf->b_p_smc;
   r = vim_regexec_multi(rmp, syn_win, syn_buf, lnum, col, NULL);
 
+  if (start != 0)
+    syn_prof_sample(gp, st, uv_hrtime() - start);
+
   if (syn_time_on) {
     profile_end(&pt);
     profile_add(&st->total, &pt);
@@ -3036,6 +3523,7 @@ void syntax_clear(synblock_T *block)
   block->b_syn_ic = FALSE;          /* Use case, by default */
   block->b_syn_spell = SYNSPL_DEFAULT;   /* default spell checking */
   block->b_syn_containedin = FALSE;
+  block->b_syn_nocache = FALSE;
 
   /* free the keywords */
   clear_keywtab(&block->b_keywtab);
@@ -4875,6 +5363,8 @@ static char_u *get_syn_pattern(char_u *arg, synpat_T *ci)
     return NULL;
   ci->sp_ic = curwin->w_s->b_syn_ic;
   syn_clear_time(&ci->sp_time);
+  if (syn_pat_uses_cursor(ci->sp_pattern))
+    curwin->w_s->b_syn_nocache = TRUE;
 
   /*
    * Check for a match, highlight or region offset.
@@ -5016,6 +5506,8 @@ static void syn_cmd_sync(exarg_T *eap, int syncing)
           vim_regcomp(curwin->w_s->b_syn_linecont_pat, RE_MAGIC);
         p_cpo = cpo_save;
         syn_clear_time(&curwin->w_s->b_syn_linecont_time);
+        if (syn_pat_uses_cursor(curwin->w_s->b_syn_linecont_pat))
+          curwin->w_s->b_syn_nocache = TRUE;
 
         if (curwin->w_s->b_syn_linecont_prog == NULL) {
           free(curwin->w_s->b_syn_linecont_pat);
@@ -5757,6 +6249,223 @@ static void syntime_report(void)
   }
 }
 
+/*
+ * Get the profile of group "id", zero for the "linecont" pattern.
+ */
+static synprof_T *syn_prof_group(int id)
+{
+  if (id >= syn_prof_groups.ga_len) {
+    int len = highlight_ga.ga_len + 1 > id ? highlight_ga.ga_len + 1 : id + 1;
+
+    ga_grow(&syn_prof_groups, len - syn_prof_groups.ga_len);
+    memset((synprof_T *)syn_prof_groups.ga_data + syn_prof_groups.ga_len, 0,
+        sizeof(synprof_T) * (size_t)(len - syn_prof_groups.ga_len));
+    syn_prof_groups.ga_len = len;
+  }
+  return (synprof_T *)syn_prof_groups.ga_data + id;
+}
+
+/*
+ * Add a call of syn_regexec() that took "ns" nanoseconds to the profile of
+ * group "gp", pattern "st" and "syn_buf".  It stands for all the calls since
+ * the previous sample.  Then pick the interval to the next sample.
+ */
+static void syn_prof_sample(synprof_T *gp, syn_time_T *st, uint64_t ns)
+{
+  uint64_t estimate = ns * syn_prof_calls;
+
+  ++gp->samples;
+  gp->time += estimate;
+  if (ns > gp->slowest)
+    gp->slowest = ns;
+  ++st->samples;
+  st->prof_time += estimate;
+  syn_buf->b_syn_prof_time += estimate;
+
+  /* xorshift, the interval is 1 to 2 * SYN_PROF_RATE - 1 calls */
+  syn_prof_seed ^= syn_prof_seed << 13;
+  syn_prof_seed ^= syn_prof_seed >> 17;
+  syn_prof_seed ^= syn_prof_seed << 5;
+  syn_prof_calls = 0;
+  syn_prof_next = 1 + syn_prof_seed % (2 * SYN_PROF_RATE - 1);
+}
+
+/*
+ * Add line "lnum" of window "wp", drawn by win_line() in "ns" nanoseconds, to
+ * the highlighting profile.
+ */
+void syntax_prof_line(win_T *wp, linenr_T lnum, uint64_t ns)
+{
+  synprof_line_T *lp = &syn_prof_slow[0];
+
+  latency_stats_add(&syn_prof_draw, ns);
+  latency_stats_add(&wp->w_buffer->b_draw_stats, ns);
+
+  /* Replace the fastest of the slowest lines. */
+  for (int i = 1; i < SYN_PROF_LINES; ++i)
+    if (syn_prof_slow[i].time < lp->time)
+      lp = &syn_prof_slow[i];
+  if (ns > lp->time) {
+    lp->buffer = wp->w_buffer->handle;
+    lp->lnum = lnum;
+    lp->time = ns;
+  }
+}
+
+/*
+ * Get the highlighting profile, for vim_get_syntax_stats().  Times are in
+ * microseconds.  When "reset" is true start a new profile.
+ */
+Dictionary syntax_get_stats(bool reset)
+{
+  Dictionary rv = ARRAY_DICT_INIT;
+  Array lines = ARRAY_DICT_INIT;
+  Array groups = ARRAY_DICT_INIT;
+  Array patterns = ARRAY_DICT_INIT;
+  Array buffers = ARRAY_DICT_INIT;
+  garray_T ga;
+  buf_T       *buf;
+  win_T       *wp;
+  tabpage_T   *tp;
+
+  PUT(rv, "sample_rate", INTEGER_OBJ(SYN_PROF_RATE));
+  PUT(rv, "lines", DICTIONARY_OBJ(latency_stats_to_dict(&syn_prof_draw)));
+
+  qsort(syn_prof_slow, SYN_PROF_LINES, sizeof(synprof_line_T),
+      syn_prof_compare_lines);
+  for (int i = 0; i < SYN_PROF_LINES && syn_prof_slow[i].time > 0; ++i) {
+    Dictionary line = ARRAY_DICT_INIT;
+
+    PUT(line, "buffer", INTEGER_OBJ((Integer)syn_prof_slow[i].buffer));
+    PUT(line, "lnum", INTEGER_OBJ(syn_prof_slow[i].lnum));
+    PUT(line, "time_us", INTEGER_OBJ((Integer)(syn_prof_slow[i].time / 1000)));
+    ADD(lines, DICTIONARY_OBJ(line));
+  }
+  PUT(rv, "slowest_lines", ARRAY_OBJ(lines));
+
+  for (int id = 0; id < syn_prof_groups.ga_len; ++id) {
+    synprof_T *gp = (synprof_T *)syn_prof_groups.ga_data + id;
+    Dictionary group = ARRAY_DICT_INIT;
+
+    if (gp->calls == 0)
+      continue;
+    PUT(group, "name", STRING_OBJ(cstr_to_string(
+                id == 0 ? "linecont" : (char *)syn_id2name(id))));
+    PUT(group, "calls", INTEGER_OBJ((Integer)gp->calls));
+    PUT(group, "samples", INTEGER_OBJ((Integer)gp->samples));
+    PUT(group, "time_us", INTEGER_OBJ((Integer)(gp->time / 1000)));
+    PUT(group, "slowest_us", INTEGER_OBJ((Integer)(gp->slowest / 1000)));
+    ADD(groups, DICTIONARY_OBJ(group));
+  }
+  PUT(rv, "groups", ARRAY_OBJ(groups));
+
+  /* Patterns are kept with the syntax items, of each buffer and of windows
+   * that use ":ownsyntax". */
+  ga_init(&ga, sizeof(synprof_pat_T), 50);
+  for (buf = firstbuf; buf != NULL; buf = buf->b_next)
+    syn_prof_patterns(&buf->b_s, buf, &ga, reset);
+  FOR_ALL_TAB_WINDOWS(tp, wp)
+    if (wp->w_s != &wp->w_buffer->b_s)
+      syn_prof_patterns(wp->w_s, wp->w_buffer, &ga, reset);
+  qsort(ga.ga_data, (size_t)ga.ga_len, sizeof(synprof_pat_T),
+      syn_prof_compare_patterns);
+  for (int i = 0; i < ga.ga_len && i < SYN_PROF_PATTERNS; ++i) {
+    synprof_pat_T *pp = (synprof_pat_T *)ga.ga_data + i;
+    Dictionary pattern = ARRAY_DICT_INIT;
+
+    PUT(pattern, "buffer", INTEGER_OBJ((Integer)pp->buffer));
+    PUT(pattern, "group", STRING_OBJ(cstr_to_string(
+                pp->id == 0 ? "linecont" : (char *)syn_id2name(pp->id))));
+    PUT(pattern, "pattern", STRING_OBJ(cstr_to_string((char *)pp->pattern)));
+    PUT(pattern, "samples", INTEGER_OBJ((Integer)pp->samples));
+    PUT(pattern, "time_us", INTEGER_OBJ((Integer)(pp->time / 1000)));
+    ADD(patterns, DICTIONARY_OBJ(pattern));
+  }
+  ga_clear(&ga);
+  PUT(rv, "patterns", ARRAY_OBJ(patterns));
+
+  for (buf = firstbuf; buf != NULL; buf = buf->b_next) {
+    Dictionary b = ARRAY_DICT_INIT;
+
+    if (buf->b_draw_stats.count == 0 && buf->b_syn_prof_time == 0)
+      continue;
+    PUT(b, "buffer", INTEGER_OBJ((Integer)buf->handle));
+    PUT(b, "name", STRING_OBJ(cstr_to_string(
+                buf->b_ffname == NULL ? "" : (char *)buf->b_ffname)));
+    PUT(b, "lines", DICTIONARY_OBJ(latency_stats_to_dict(&buf->b_draw_stats)));
+    PUT(b, "syntax_us", INTEGER_OBJ((Integer)(buf->b_syn_prof_time / 1000)));
+    ADD(buffers, DICTIONARY_OBJ(b));
+    if (reset) {
+      memset(&buf->b_draw_stats, 0, sizeof(buf->b_draw_stats));
+      buf->b_syn_prof_time = 0;
+    }
+  }
+  PUT(rv, "buffers", ARRAY_OBJ(buffers));
+
+  if (reset) {
+    memset(&syn_prof_draw, 0, sizeof(syn_prof_draw));
+    memset(syn_prof_slow, 0, sizeof(syn_prof_slow));
+    ga_clear(&syn_prof_groups);
+  }
+
+  return rv;
+}
+
+/*
+ * Add the sampled patterns of "block", which is used for "buf", to "gap".
+ * When "reset" is true clear their profile.
+ */
+static void syn_prof_patterns(synblock_T *block, buf_T *buf, garray_T *gap,
+                              bool reset)
+{
+  syn_time_T  *st = &block->b_syn_linecont_time;
+
+  if (st->samples > 0) {
+    synprof_pat_T *pp = GA_APPEND_VIA_PTR(synprof_pat_T, gap);
+
+    pp->buffer = buf->handle;
+    pp->id = 0;
+    pp->pattern = block->b_syn_linecont_pat;
+    pp->samples = st->samples;
+    pp->time = st->prof_time;
+    if (reset)
+      st->samples = st->prof_time = 0;
+  }
+
+  for (int idx = 0; idx < block->b_syn_patterns.ga_len; ++idx) {
+    synpat_T *spp = &(SYN_ITEMS(block)[idx]);
+
+    if (spp->sp_time.samples > 0) {
+      synprof_pat_T *pp = GA_APPEND_VIA_PTR(synprof_pat_T, gap);
+
+      pp->buffer = buf->handle;
+      pp->id = spp->sp_syn.id;
+      pp->pattern = spp->sp_pattern;
+      pp->samples = spp->sp_time.samples;
+      pp->time = spp->sp_time.prof_time;
+      if (reset)
+        spp->sp_time.samples = spp->sp_time.prof_time = 0;
+    }
+  }
+}
+
+/* Sort the slowest first. */
+static int syn_prof_compare_lines(const void *v1, const void *v2)
+{
+  const synprof_line_T *l1 = v1;
+  const synprof_line_T *l2 = v2;
+
+  return l1->time == l2->time ? 0 : l1->time < l2->time ? 1 : -1;
+}
+
+static int syn_prof_compare_patterns(const void *v1, const void *v2)
+{
+  const synprof_pat_T *p1 = v1;
+  const synprof_pat_T *p2 = v2;
+
+  return p1->time == p2->time ? 0 : p1->time < p2->time ? 1 : -1;
+}
+
 /**************************************
 *  Highlighting stuff		      *
 **************************************/
@@ -1,7 +1,11 @@
 #ifndef NVIM_SYNTAX_H
 #define NVIM_SYNTAX_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "nvim/buffer_defs.h"
+#include "nvim/api/private/defs.h"
 
 typedef int guicolor_T;
 
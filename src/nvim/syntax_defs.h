@@ -4,7 +4,7 @@
 #include "nvim/regexp_defs.h"
 
 # define SST_MIN_ENTRIES 150    /* minimal size for state stack array */
-# define SST_MAX_ENTRIES 1000   /* maximal size for state stack array */
+# define SST_MAX_ENTRIES 10000  /* maximal size for state stack array */
 # define SST_FIX_STATES  7      /* size of sst_stack[]. */
 # define SST_DIST        16     /* normal distance between entries */
 # define SST_INVALID    (synstate_T *)-1        /* invalid syn_state pointer */
@@ -63,6 +63,31 @@ struct syn_state {
                                  * may have made the state invalid */
 };
 
+/*
+ * Syntax attributes of a line, computed by syntax_line() for win_line().
+ * Consecutive columns with the same attributes share an entry in sl_runs[].
+ */
+typedef struct {
+  colnr_T sr_col;               /* first column of the run */
+  int sr_trans_id;              /* group ID used for highlighting or zero */
+  int sr_flags;                 /* HL_ flags of the syntax item */
+  int sr_seqnr;                 /* sequence number of the syntax item */
+  int sr_cchar;                 /* conceal substitute character */
+  int sr_can_spell;             /* spell checking is done */
+} synrun_T;
+
+typedef struct {
+  linenr_T sl_lnum;             /* line number, zero when not valid */
+  int sl_changedtick;           /* b_changedtick when computed */
+  int sl_syn_tick;              /* b_syn_tick when computed */
+  long sl_smc;                  /* 'synmaxcol' when computed */
+  colnr_T sl_endcol;            /* last column computed, MAXCOL when the
+                                 * whole line was done */
+  int sl_count;                 /* number of used entries in sl_runs[] */
+  int sl_size;                  /* number of allocated entries */
+  synrun_T    *sl_runs;
+} synline_T;
+
 /*
  * Structure shared between syntax.c, screen.c and gui_x11.c.
  */
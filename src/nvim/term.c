@@ -23,6 +23,7 @@
 
 #define tgetstr tgetstr_defined_wrong
 #include <string.h>
+#include <sys/uio.h>
 
 #include "nvim/vim.h"
 #include "nvim/term.h"
@@ -33,6 +34,7 @@
 #include "nvim/ex_getln.h"
 #include "nvim/fileio.h"
 #include "nvim/getchar.h"
+#include "nvim/grid.h"
 #include "nvim/message.h"
 #include "nvim/misc2.h"
 #include "nvim/garray.h"
@@ -2000,25 +2002,104 @@ void termcapinit(char_u *name)
 }
 
 /*
- * the number of calls to ui_write is reduced by using the buffer "out_buf"
+ * The number of calls to ui_write is reduced by using the buffer "out_buf".
+ * Normally it is flushed when OUT_SIZE bytes were collected.  Between
+ * out_frame_start() and out_frame_end() it grows instead, so that all the
+ * output of a screen update is written at once, up to OUT_FRAME_MAX bytes.
  */
 #  define OUT_SIZE      2047
-/* Add one to allow mch_write() in os_win32.c to append a NUL */
-static char_u out_buf[OUT_SIZE + 1];
+#  define OUT_FRAME_MAX (1024 * 1024)
+
+/* Synchronized update: the terminal holds back drawing until the end. */
+#define SYNC_UPDATE_START "\033[?2026h"
+#define SYNC_UPDATE_END   "\033[?2026l"
+
+static char_u *out_buf = NULL;
+static int out_buf_size = 0;            /* allocated size of out_buf */
 static int out_pos = 0;                 /* number of chars in out_buf */
+static int out_frame_depth = 0;         /* nesting of out_frame_start() */
+
+/*
+ * Return the number of bytes after which "out_buf" is flushed.
+ */
+static int out_limit(void)
+{
+  return out_frame_depth > 0 && !p_wd ? OUT_FRAME_MAX : OUT_SIZE;
+}
+
+/*
+ * Put byte "c" in "out_buf", growing it when needed.
+ */
+static void out_add(unsigned c)
+{
+  if (out_pos >= out_buf_size) {
+    /* Add one to allow mch_write() in os_win32.c to append a NUL */
+    out_buf_size = out_buf_size == 0 ? OUT_SIZE : out_buf_size * 2;
+    out_buf = xrealloc(out_buf, (size_t)out_buf_size + 1);
+  }
+  out_buf[out_pos++] = c;
+}
+
+/*
+ * Write "out_buf".  When "sync" is TRUE and 'termsync' is set wrap it in the
+ * synchronized update codes, written together with one system call.
+ */
+static void out_write(int sync)
+{
+  struct iovec iov[3];
+  int cnt = 0;
+  int len;
+
+  if (out_pos == 0)
+    return;
+
+  /* set out_pos to 0 before ui_write, to avoid recursiveness */
+  len = out_pos;
+  out_pos = 0;
+
+  if (sync && p_tsy) {
+    iov[cnt].iov_base = SYNC_UPDATE_START;
+    iov[cnt++].iov_len = STRLEN(SYNC_UPDATE_START);
+  }
+  iov[cnt].iov_base = out_buf;
+  iov[cnt++].iov_len = (size_t)len;
+  if (sync && p_tsy) {
+    iov[cnt].iov_base = SYNC_UPDATE_END;
+    iov[cnt++].iov_len = STRLEN(SYNC_UPDATE_END);
+  }
+  ui_writev(iov, cnt);
+}
 
 /*
  * out_flush(): flush the output buffer
  */
 void out_flush(void)
 {
-  int len;
+  /* Send the same screen updates to remote UIs, unless in the middle of a
+   * frame: out_frame_end() does it when the frame is complete. */
+  if (out_frame_depth == 0)
+    grid_flush();
 
-  if (out_pos != 0) {
-    /* set out_pos to 0 before ui_write, to avoid recursiveness */
-    len = out_pos;
-    out_pos = 0;
-    ui_write(out_buf, len);
+  out_write(out_frame_depth > 0);
+}
+
+/*
+ * Start collecting the output of a screen update, it is written when the
+ * matching out_frame_end() is called.  Calls can be nested.
+ */
+void out_frame_start(void)
+{
+  ++out_frame_depth;
+}
+
+/*
+ * End collecting the output of a screen update and write it.
+ */
+void out_frame_end(void)
+{
+  if (out_frame_depth > 0 && --out_frame_depth == 0) {
+    grid_flush();
+    out_write(TRUE);
   }
 }
 
@@ -2028,7 +2109,7 @@ void out_flush(void)
  */
 void out_flush_check(void)
 {
-  if (enc_dbcs != 0 && out_pos >= OUT_SIZE - MB_MAXBYTES)
+  if (enc_dbcs != 0 && out_pos >= out_limit() - MB_MAXBYTES)
     out_flush();
 }
 
@@ -2045,10 +2126,10 @@ void out_char(unsigned c)
     out_char('\r');
 #endif
 
-  out_buf[out_pos++] = c;
+  out_add(c);
 
   /* For testing we flush each time. */
-  if (out_pos >= OUT_SIZE || p_wd)
+  if (out_pos >= out_limit() || p_wd)
     out_flush();
 }
 
@@ -2063,9 +2144,9 @@ static void out_char_nf(unsigned c)
     out_char_nf('\r');
 #endif
 
-  out_buf[out_pos++] = c;
+  out_add(c);
 
-  if (out_pos >= OUT_SIZE)
+  if (out_pos >= out_limit())
     out_flush();
 }
 
@@ -2080,7 +2161,7 @@ static void out_char_nf(unsigned c)
  */
 void out_str_nf(char_u *s)
 {
-  if (out_pos > OUT_SIZE - 20)    /* avoid terminal strings being split up */
+  if (out_pos > out_limit() - 20)  /* avoid terminal strings being split up */
     out_flush();
   while (*s)
     out_char_nf(*s++);
@@ -2100,7 +2181,7 @@ void out_str(char_u *s)
 {
   if (s != NULL && *s) {
     /* avoid terminal strings being split up */
-    if (out_pos > OUT_SIZE - 20)
+    if (out_pos > out_limit() - 20)
       out_flush();
 #ifdef HAVE_TGETENT
     tputs((char *)s, 1, TPUTSFUNCAST out_char_nf);
@@ -2512,7 +2593,7 @@ void set_shellsize(int width, int height, int mustset)
      * - in Ex mode, don't redraw anything.
      * - Otherwise, redraw right now, and position the cursor.
      * Always need to call update_screen() or screenalloc(), to make
-     * sure Rows/Columns and the size of ScreenLines[] is correct!
+     * sure Rows/Columns and the size of ScreenCells[] is correct!
      */
     if (State == ASKMORE || State == EXTERNCMD || State == CONFIRM
         || exmode_active) {
@@ -16,6 +16,7 @@
  */
 
 #include <string.h>
+#include <sys/uio.h>
 
 #include "nvim/vim.h"
 #include "nvim/ui.h"
@@ -62,6 +63,27 @@ void ui_write(char_u *s, int len)
 #endif
 }
 
+/*
+ * Like ui_write(), but for "cnt" pieces of output that are written with one
+ * system call.  The contents of "iov" is changed.
+ */
+void ui_writev(struct iovec *iov, int cnt)
+{
+#ifndef NO_CONSOLE
+  if (silent_mode && p_verbose == 0)
+    return;
+
+  if (output_conv.vc_type != CONV_NONE) {
+    /* Converting makes a copy anyway, write the pieces one by one. */
+    for (int i = 0; i < cnt; ++i)
+      ui_write(iov[i].iov_base, (int)iov[i].iov_len);
+    return;
+  }
+
+  mch_writev(iov, cnt);
+#endif
+}
+
 /*
  * ui_inchar(): low level input function.
  * Get characters from the keyboard.
@@ -603,8 +625,8 @@ retnomove:
   /* Remember the character under the mouse, it might be a '-' or '+' in the
    * fold column. */
   if (row >= 0 && row < Rows && col >= 0 && col <= Columns
-      && ScreenLines != NULL)
-    mouse_char = ScreenLines[LineOffset[row] + col];
+      && ScreenCells != NULL)
+    mouse_char = ScreenCells[LineOffset[row] + col].sc_char;
   else
     mouse_char = ' ';
 
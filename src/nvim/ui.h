@@ -1,6 +1,8 @@
 #ifndef NVIM_UI_H
 #define NVIM_UI_H
 
+#include <sys/uio.h>
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "ui.h.generated.h"
 #endif
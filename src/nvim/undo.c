@@ -349,6 +349,8 @@ int u_savecommon(linenr_T top, linenr_T bot, linenr_T newbot, int reload)
      * (e.g., obtained from a source control system).
      */
     change_warning(0);
+    /* The line count must not change after the text was saved. */
+    readfile_bg_wait(curbuf);
     if (bot > curbuf->b_ml.ml_line_count + 1) {
       /* This happens when the FileChangedRO autocommand changes the
        * file in a way it becomes shorter. */
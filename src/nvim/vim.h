@@ -237,6 +237,7 @@ enum {
   EXPAND_HISTORY,
   EXPAND_USER,
   EXPAND_SYNTIME,
+  EXPAND_REGTIME,
 };
 
 /* Values for exmode_active (0 is no exmode) */
@@ -329,6 +330,7 @@ enum {
 #define READ_BUFFER     0x08    /* read from curbuf (converting stdin) */
 #define READ_DUMMY      0x10    /* reading into a dummy buffer */
 #define READ_KEEP_UNDO  0x20    /* keep undo info*/
+#define READ_NOFAST     0x40    /* don't map or read in the background */
 
 /* Values for change_indent() */
 #define INDENT_SET      1       /* set indent */
@@ -401,6 +403,7 @@ enum {
 #define MFS_STOP        2       /* stop syncing when a character is available */
 #define MFS_FLUSH       4       /* flushed file to disk */
 #define MFS_ZERO        8       /* only write block 0 */
+#define MFS_ASYNC       16      /* write in the background */
 
 /* flags for buf_copy_options() */
 #define BCO_ENTER       1       /* going to enter the buffer */
@@ -965,6 +968,19 @@ typedef void        *vim_acl_T;         /* dummy to pass an ACL to a function */
  * plus six following composing characters of three bytes each. */
 # define MB_MAXBYTES    21
 
+/*
+ * One cell of the screen, see ScreenCells[].  All that is needed to draw and
+ * compare a cell is kept together.  The fields before sc_cc[] must fit in 8
+ * bytes without padding, screen_cells_diff_mask() compares them at once.
+ */
+typedef struct {
+  schar_T sc_char;              /* character or first byte */
+  schar_T sc_char2;             /* euc-jp: second byte when "sc_char" is 0x8e */
+  sattr_T sc_attr;              /* attributes */
+  u8char_T sc_uc;               /* decoded UTF-8 character or NUL */
+  u8char_T sc_cc[MAX_MCO];      /* composing characters */
+} screencell_T;
+
 typedef struct timeval proftime_T;
 
 /* Values for "do_profiling". */
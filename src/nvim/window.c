@@ -3595,6 +3595,7 @@ win_free (
   if (prevwin == wp)
     prevwin = NULL;
   win_free_lsize(wp);
+  render_cache_free(wp);
 
   for (i = 0; i < wp->w_tagstacklen; ++i)
     free(wp->w_tagstack[i].tagname);